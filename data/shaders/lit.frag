@@ -0,0 +1,86 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+/* Forward shading with the lights binned into the fragment's cluster
+ * by light_cluster.comp. The placeholder geometry has no normals or
+ * positions of its own, so both are rebuilt from the fragment depth.
+ * Without any lights the vertex color is shown unlit.                */
+
+struct Light
+{
+    vec4 position_radius;
+    vec4 color_intensity;
+};
+
+layout(set = 0, binding = 0) uniform FrameConstants
+{
+    vec2 resolution;
+    float time;
+    uint frame;
+    uint instance_buffer;
+    uint sprite_buffer;
+    uint light_buffer;
+    uint cluster_buffer;
+    mat4 inverse_projection;
+    uvec4 cluster_grid;
+    vec4 cluster_depth;
+    vec2 render_size;
+    float render_scale;
+    uint padding;
+} constants;
+
+layout(std430, set = 1, binding = 1) readonly buffer Lights
+{
+    Light lights[];
+} light_buffers[];
+
+layout(std430, set = 1, binding = 1) readonly buffer Clusters
+{
+    uint index_count;
+    uint overflow;
+    uvec2 padding;
+    uint data[];
+} cluster_buffers[];
+
+layout(location = 0) in vec3 fragColor;
+
+layout(location = 0) out vec4 outColor;
+
+const vec3 AMBIENT = vec3(0.05);
+
+void main()
+{
+    uvec3 grid = constants.cluster_grid.xyz;
+    vec2 uv = gl_FragCoord.xy / constants.render_size;
+    vec4 view = constants.inverse_projection * vec4(uv * 2.0 - 1.0, gl_FragCoord.z, 1.0);
+    vec3 position = view.xyz / view.w;
+    vec3 normal = normalize(cross(dFdx(position), dFdy(position)));
+    vec3 lighting = AMBIENT;
+
+    /* Same slice mapping the binning inverts */
+    uint slice = uint(clamp(log(abs(position.z)) * constants.cluster_depth.z + constants.cluster_depth.w, 0.0, float(grid.z - 1)));
+    uvec2 tile = min(uvec2(uv * vec2(grid.xy)), grid.xy - 1);
+    uint cluster = tile.x + grid.x * (tile.y + grid.y * slice);
+    uint first = grid.x * grid.y * grid.z * 2 + cluster_buffers[constants.cluster_buffer].data[cluster * 2];
+    uint count = cluster_buffers[constants.cluster_buffer].data[cluster * 2 + 1];
+
+    /* Face the camera whichever way the triangle winds */
+    normal = dot(normal, position) > 0.0 ? -normal : normal;
+
+    for(uint i = 0; i < count; i++)
+    {
+        Light light = light_buffers[constants.light_buffer].lights[cluster_buffers[constants.cluster_buffer].data[first + i]];
+        vec3 to_light = light.position_radius.xyz - position;
+        float distance_squared = dot(to_light, to_light);
+        float ratio = distance_squared / (light.position_radius.w * light.position_radius.w);
+
+        /* Inverse square, windowed to reach zero at the radius */
+        float window = clamp(1.0 - ratio * ratio, 0.0, 1.0);
+        float attenuation = window * window / (distance_squared + 1.0);
+        float diffuse = max(dot(normal, to_light * inversesqrt(max(distance_squared, 1e-8))), 0.0);
+
+        lighting += light.color_intensity.rgb * light.color_intensity.w * attenuation * diffuse;
+    }
+
+    outColor = vec4(constants.cluster_grid.w > 0 ? fragColor * lighting : fragColor, 1.0);
+}
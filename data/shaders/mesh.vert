@@ -0,0 +1,58 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+/* Cooked mesh vertices are pulled from the mesh buffer, the index
+ * buffer is the same buffer past the vertices. Each vertex is four
+ * words, see MeshVertex in mesh.h.                                  */
+
+layout(set = 0, binding = 0) uniform FrameConstants
+{
+    vec2 resolution;
+    float time;
+    uint frame;
+    uint instance_buffer;
+} constants;
+
+layout(std430, set = 1, binding = 1) readonly buffer Vertices
+{
+    uvec4 vertices[];
+} vertex_buffers[];
+
+layout(std430, set = 1, binding = 1) readonly buffer Instances
+{
+    mat4 world[];
+} instance_buffers[];
+
+layout(push_constant) uniform Mesh
+{
+    mat4 view_proj;
+    vec4 position_offset;
+    vec4 position_scale;
+    uint vertex_buffer;
+    uint transform;
+} mesh;
+
+layout(location = 0) out vec3 fragColor;
+
+vec3 octahedral_decode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+
+    return normalize(n);
+}
+
+void main()
+{
+    uvec4 vertex = vertex_buffers[mesh.vertex_buffer].vertices[gl_VertexIndex];
+    vec3 quantized = vec3(vertex.x & 0xFFFFu, vertex.x >> 16, vertex.y & 0xFFFFu);
+    vec3 position = mesh.position_offset.xyz + quantized * mesh.position_scale.xyz;
+    mat4 world = instance_buffers[constants.instance_buffer].world[mesh.transform];
+    vec3 normal = octahedral_decode(unpackSnorm4x8(vertex.w).xy);
+
+    gl_Position = mesh.view_proj * world * vec4(position, 1.0);
+    fragColor = normalize(mat3(world) * normal) * 0.5 + 0.5;
+}
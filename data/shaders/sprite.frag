@@ -0,0 +1,31 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+/* Quads of one draw sample different atlases, so the index is
+ * non-uniform. Coverage textures only scale the color's alpha. */
+
+const uint SPRITE_TEXTURE_NONE = 0xFFFFFFFFu;
+const uint SPRITE_TEXTURE_COVERAGE = 0x80000000u;
+const uint BINDLESS_SAMPLER_LINEAR = 0;
+
+layout(set = 1, binding = 0) uniform texture2D images[];
+layout(set = 1, binding = 2) uniform sampler samplers[2];
+
+layout(location = 0) in vec2 frag_uv;
+layout(location = 1) in vec4 frag_color;
+layout(location = 2) flat in uint frag_texture;
+
+layout(location = 0) out vec4 out_color;
+
+void main()
+{
+    out_color = frag_color;
+
+    if(frag_texture != SPRITE_TEXTURE_NONE)
+    {
+        uint index = frag_texture & ~SPRITE_TEXTURE_COVERAGE;
+        vec4 texel = texture(sampler2D(images[nonuniformEXT(index)], samplers[BINDLESS_SAMPLER_LINEAR]), frag_uv);
+
+        out_color = (frag_texture & SPRITE_TEXTURE_COVERAGE) != 0 ? vec4(frag_color.rgb, frag_color.a * texel.r) : frag_color * texel;
+    }
+}
@@ -0,0 +1,48 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+/* One instance per quad, pulled from this frame's partition of the
+ * sprite stream. Positions are in pixels from the top left corner.  */
+
+struct Sprite
+{
+    vec4 rect;
+    uvec2 uv;
+    uint color;
+    uint texture;
+};
+
+layout(set = 0, binding = 0) uniform FrameConstants
+{
+    vec2 resolution;
+    float time;
+    uint frame;
+    uint instance_buffer;
+    uint sprite_buffer;
+} constants;
+
+layout(std430, set = 1, binding = 1) readonly buffer Sprites
+{
+    Sprite sprites[];
+} sprite_buffers[];
+
+layout(location = 0) out vec2 frag_uv;
+layout(location = 1) out vec4 frag_color;
+layout(location = 2) flat out uint frag_texture;
+
+const vec2 corners[6] = vec2[](
+    vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0),
+    vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0)
+);
+
+void main()
+{
+    Sprite sprite = sprite_buffers[constants.sprite_buffer].sprites[gl_InstanceIndex];
+    vec2 corner = corners[gl_VertexIndex];
+    vec2 position = sprite.rect.xy + sprite.rect.zw * corner;
+
+    gl_Position = vec4(position / constants.resolution * 2.0 - 1.0, 0.0, 1.0);
+    frag_uv = mix(unpackUnorm2x16(sprite.uv.x), unpackUnorm2x16(sprite.uv.y), corner);
+    frag_color = unpackUnorm4x8(sprite.color);
+    frag_texture = sprite.texture;
+}
@@ -3,14 +3,547 @@
 #include <stdbool.h>
 #include "interface.h"
 
+#define MIN(x,y) ((x) < (y) ? (x) : (y))
+#define MAX(x,y) ((x) > (y) ? (x) : (y))
+#define CLAMP(x,y,z) (MIN((z), MAX((x), (y))))
+
 bool init_vulkan(Interface *func);
 bool init_surface(Interface *func);
 bool init_device(Interface *func);
+bool init_surface_format(Interface *func);
 bool init_swapchain(Interface *func);
 bool init_render(Interface *func);
+bool init_lifetime(Interface *func);
+bool init_compute(Interface *func);
+bool init_timing(Interface *func);
+bool init_uniforms(Interface *func);
+bool init_bindless(Interface *func);
+bool init_textures(Interface *func);
+bool init_sprites(Interface *func);
+bool init_lights(Interface *func);
+bool init_capture(Interface *func);
+bool init_scene(Interface *func);
 bool init_render_pass(Interface *func);
+bool init_gpu_cull(Interface *func);
 bool init_framebuffers(Interface *func);
+bool init_shader_files(Interface *func);
 bool init_shaders(Interface *func);
 bool init_pipeline(Interface *func);
 
+/* Timestamp pairs written each frame */
+enum
+{
+    TIMING_GRAPHICS,
+    TIMING_COMPUTE,
+    TIMING_COUNT
+};
+
+#define TIMESTAMPS_PER_FRAME (TIMING_COUNT * 2)
+#define TIMING_REPORT_FRAMES 300
+
+void timing_begin(Interface *func, VkCommandBuffer cmd, uint32_t frame, uint32_t timing);
+void timing_end(Interface *func, VkCommandBuffer cmd, uint32_t frame, uint32_t timing);
+void timing_collect(Interface *func, uint32_t frame);
+void overdraw_begin(Interface *func, VkCommandBuffer cmd, uint32_t frame);
+void overdraw_end(Interface *func, VkCommandBuffer cmd, uint32_t frame);
+
+bool renderer_add_compute_pass(Interface *func, PFN_record_compute record, void *data);
+bool record_compute(Interface *func, uint32_t frame);
+
+/* Resource lifetime tracking */
+typedef void (*PFN_release)(Interface *func, void *data);
+
+typedef enum
+{
+    RELEASE_CALLBACK,
+    RELEASE_BUFFER,
+    RELEASE_IMAGE,
+    RELEASE_IMAGE_VIEW,
+    RELEASE_MEMORY,
+} ReleaseType;
+
+typedef struct DeferredRelease
+{
+    uint64_t value;
+    ReleaseType type;
+    union
+    {
+        struct
+        {
+            PFN_release release;
+            void *data;
+        } callback;
+        VkBuffer buffer;
+        VkImage image;
+        VkImageView image_view;
+        VkDeviceMemory memory;
+    };
+} DeferredRelease;
+
+uint64_t lifetime_submit(Interface *func, const VkSubmitInfo *submit_info);
+uint64_t lifetime_completed_value(Interface *func);
+bool lifetime_wait(Interface *func, uint64_t value);
+void lifetime_defer(Interface *func, uint64_t value, PFN_release release, void *data);
+void lifetime_defer_buffer(Interface *func, uint64_t value, VkBuffer buffer);
+void lifetime_defer_image(Interface *func, uint64_t value, VkImage image);
+void lifetime_defer_image_view(Interface *func, uint64_t value, VkImageView image_view);
+void lifetime_defer_memory(Interface *func, uint64_t value, VkDeviceMemory memory);
+void lifetime_collect(Interface *func);
+
+/* Memory helpers */
+uint32_t find_memory_type(Interface *func, uint32_t type_bits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred);
+bool create_buffer(Interface *func, VkDeviceSize size, VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+    VkBuffer *buffer, VkDeviceMemory *memory, uint32_t *memory_type);
+
+/* Uniform ring, each frame slot owns one partition */
+#define UNIFORM_FRAME_SIZE (2 * 1024 * 1024)
+#define UNIFORM_MAX_RANGE (64 * 1024)
+#define STORAGE_RANGE (1024 * 1024)
+
+/* Matches the std140 block at set 0, binding 0 of the shaders */
+typedef struct
+{
+    float resolution[2];
+    float time;
+    uint32_t frame;
+    /* Bindless buffer holding this frame's world matrices */
+    uint32_t instance_buffer;
+    /* Bindless buffer holding this frame's 2D quads */
+    uint32_t sprite_buffer;
+    /* Bindless buffers holding this frame's lights and their clusters */
+    uint32_t light_buffer;
+    uint32_t cluster_buffer;
+    float inverse_projection[16];
+    /* Clusters along x, y and z, then the number of lights */
+    uint32_t cluster_grid[4];
+    /* Near, far, then the scale and bias taking log depth to a slice */
+    float cluster_depth[4];
+    /* Size the scene is drawn at, resolution is the output size */
+    float render_size[2];
+    float render_scale;
+    uint32_t padding;
+} FrameConstants;
+
+void uniform_begin_frame(Interface *func, uint32_t frame);
+void *renderer_alloc_uniform(Interface *func, uint32_t size, uint32_t *offset);
+
+/* Instance buffer, one world matrix per transform node */
+#define INSTANCE_INITIAL_CAPACITY 1024
+#define INSTANCE_MAX_CAPACITY (1024 * 1024)
+
+void instance_begin_frame(Interface *func, uint32_t frame);
+void renderer_set_camera(Interface *func, const float view[16], const float projection[16], float near, float far);
+
+/* Push constants of mesh.vert, set per drawn object */
+typedef struct
+{
+    float view_proj[16];
+    float position_offset[4];
+    float position_scale[4];
+    /* Bindless buffer holding the mesh's vertices */
+    uint32_t vertex_buffer;
+    /* Node whose world matrix is read from the instance buffer */
+    uint32_t transform;
+} MeshDrawConstants;
+
+uint32_t renderer_mesh_lod(Interface *func, uint32_t mesh, const float center[3], float scale);
+void renderer_set_object_mesh(Interface *func, uint32_t object, uint32_t mesh, uint32_t transform);
+
+/* Bindless set, capped further by the device limits */
+#define BINDLESS_MAX_IMAGES 16384
+#define BINDLESS_MAX_BUFFERS 4096
+#define BINDLESS_SAMPLER_BINDING 2
+
+uint32_t renderer_bindless_add_image(Interface *func, VkImageView image_view, VkImageLayout layout);
+uint32_t renderer_bindless_add_buffer(Interface *func, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+void renderer_bindless_release(Interface *func, BindlessType type, uint32_t index);
+
+/* Texture streaming, see renderer_vk_texture.c */
+#define TEXTURE_DEFAULT_BUDGET_MB 256
+#define TEXTURE_STAGING_FRAME_SIZE (16 * 1024 * 1024)
+/* Levels this size and smaller are uploaded together as soon as a texture loads */
+#define TEXTURE_TAIL_SIZE 64
+
+void texture_begin_frame(Interface *func, VkCommandBuffer cmd, uint32_t frame);
+void texture_end_frame(Interface *func);
+
+/* 2D overlay, see renderer_vk_sprite.c */
+#define SPRITE_MAX_QUADS (256 * 1024)
+#define SPRITE_BENCHMARK_QUADS 200000
+#define SPRITE_BENCHMARK_LINES 400
+#define GLYPH_ATLAS_SIZE 512
+#define GLYPH_CELL_SIZE 32
+#define GLYPH_CELL_COUNT ((GLYPH_ATLAS_SIZE / GLYPH_CELL_SIZE) * (GLYPH_ATLAS_SIZE / GLYPH_CELL_SIZE))
+/* Open addressed, kept at most half full */
+#define GLYPH_TABLE_BITS 9
+#define GLYPH_TABLE_SIZE (1u << GLYPH_TABLE_BITS)
+/* Larger text scales the biggest rasterized glyph */
+#define GLYPH_MAX_PIXELS (GLYPH_CELL_SIZE - 2)
+#define GLYPH_MIN_PIXELS 4
+#define GLYPH_MAX_UPLOADS 64
+
+typedef struct
+{
+    /* Codepoint and pixel height, 0 for a cell never used */
+    uint32_t key;
+    uint16_t width;
+    uint16_t height;
+    uint64_t last_used;
+} GlyphCell;
+
+typedef struct GlyphCache
+{
+    GlyphCell cells[GLYPH_CELL_COUNT];
+    uint32_t cell_count;
+    /* Cell index plus one, 0 for an empty slot */
+    uint16_t table[GLYPH_TABLE_SIZE];
+    /* Cells rasterized into the current sprite partition */
+    uint16_t uploads[GLYPH_MAX_UPLOADS];
+    uint32_t upload_count;
+    uint32_t misses;
+    uint32_t evictions;
+} GlyphCache;
+
+void sprite_begin_frame(Interface *func, VkCommandBuffer cmd);
+void sprite_end_frame(Interface *func);
+void sprite_benchmark_frame(Interface *func);
+void record_sprites(Interface *func, VkCommandBuffer cmd);
+
+/* Clustered lighting, see renderer_vk_light.c */
+#define LIGHT_MAX_LIGHTS 16384
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+/* Average list length the index buffer is sized for, longer lists
+ * are truncated once it is full                                    */
+#define CLUSTER_AVERAGE_LIGHTS 64
+#define CLUSTER_MAX_INDICES (CLUSTER_COUNT * CLUSTER_AVERAGE_LIGHTS)
+/* Counter, overflow count and padding ahead of the ranges */
+#define CLUSTER_HEADER_SIZE 16
+#define CLUSTER_BUFFER_SIZE (CLUSTER_HEADER_SIZE + CLUSTER_COUNT * 8 + CLUSTER_MAX_INDICES * 4)
+#define LIGHT_GROUP_SIZE 64
+#define LIGHT_DEFAULT_NEAR 0.1f
+#define LIGHT_DEFAULT_FAR 1000.0f
+#define LIGHT_BENCHMARK_FRAMES 300
+
+/* World space, a radius of zero or less marks a free slot */
+typedef struct
+{
+    float position[3];
+    float radius;
+    float color[3];
+    float intensity;
+} Light;
+
+typedef struct LightSet
+{
+    Light lights[LIGHT_MAX_LIGHTS];
+    uint32_t count;
+    uint32_t live_count;
+    uint32_t free_list[LIGHT_MAX_LIGHTS];
+    uint32_t free_count;
+    
+    /* Benchmark state, the step indexes light_benchmark_counts */
+    uint32_t benchmark_step;
+    uint32_t benchmark_frames;
+    double benchmark_gpu_ms;
+    double benchmark_binning_ms;
+    uint64_t benchmark_cpu_ticks;
+} LightSet;
+
+bool light_supported(Interface *func);
+void renderer_set_light(Interface *func, uint32_t light, const float position[3], float radius, const float color[3], float intensity);
+void light_begin_frame(Interface *func, uint32_t frame);
+void light_benchmark_frame(Interface *func);
+void record_light_binning(Interface *func, VkCommandBuffer cmd, void *data);
+
+/* Frame capture, see renderer_vk_capture.c */
+/* Slots past the frames in flight give the encoder time to catch up */
+#define CAPTURE_ENCODE_SLOTS 3
+#define MAX_CAPTURE_SLOTS (MAX_FRAMES + CAPTURE_ENCODE_SLOTS)
+#define CAPTURE_INVALID UINT32_MAX
+
+typedef enum
+{
+    CAPTURE_SLOT_FREE,
+    /* Copy recorded, waiting for its submission to complete */
+    CAPTURE_SLOT_PENDING,
+    /* Queued for or owned by the encoder thread */
+    CAPTURE_SLOT_READY
+} CaptureSlotState;
+
+typedef struct
+{
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    uint8_t *mapped;
+    bool coherent;
+    uint64_t value;
+    uint32_t frame;
+    atomic_uint state;
+} CaptureSlot;
+
+typedef struct CaptureState
+{
+    CaptureSlot slots[MAX_CAPTURE_SLOTS];
+    uint32_t slot_count;
+    VkDeviceSize frame_size;
+    VkExtent2D extent;
+    bool bgra;
+    /* Numbered PNGs replace the extension of the path, raw frames
+     * are appended to the stream                                   */
+    bool png;
+    char *filename;
+    size_t stem_length;
+    FILE *stream;
+    
+    /* Render thread only, copies in submission order */
+    uint32_t pending[MAX_CAPTURE_SLOTS];
+    uint32_t pending_head;
+    uint32_t pending_count;
+    uint32_t current_slot;
+    uint32_t current_image;
+    uint32_t frames_seen;
+    uint32_t frames_captured;
+    
+    /* Single producer single consumer queue of ready slots, the
+     * render thread pushes and the encoder thread pops. It holds
+     * every slot, so it can't fill up.                            */
+    uint32_t queue[MAX_CAPTURE_SLOTS];
+    atomic_uint queue_head;
+    uint32_t queue_tail;
+    SDL_sem *ready;
+    SDL_Thread *thread;
+    /* Set by capture_shutdown, the encoder stops once the queue is empty */
+    atomic_bool stopping;
+    
+    atomic_uint frames_dropped;
+    atomic_uint frames_written;
+    atomic_uint write_failures;
+    atomic_ullong encode_ticks;
+} CaptureState;
+
+bool capture_supported(Interface *func);
+void capture_collect(Interface *func);
+void capture_begin_frame(Interface *func, uint32_t image_index);
+void record_capture(Interface *func, VkCommandBuffer cmd, void *data);
+void capture_shutdown(Interface *func);
+
+/* Dynamic resolution, see renderer_vk_resolution.c */
+#define RESOLUTION_DEFAULT_MIN_SCALE 0.5f
+#define RESOLUTION_DEFAULT_MAX_SCALE 1.0f
+#define RESOLUTION_DEFAULT_HYSTERESIS 0.1f
+/* Smallest scale accepted from the command line */
+#define RESOLUTION_SCALE_FLOOR 0.25f
+/* Largest change of scale in one step */
+#define RESOLUTION_MAX_STEP 0.1f
+/* Weight of the newest GPU time in the running average */
+#define RESOLUTION_SMOOTHING 0.1
+#define RESOLUTION_REPORT_FRAMES 600
+
+bool resolution_supported(Interface *func);
+void resolution_update(Interface *func);
+void record_upscale(Interface *func, VkCommandBuffer cmd, void *data);
+
+/* Render graph */
+#define MAX_GRAPH_RESOURCES 32
+#define MAX_GRAPH_PASSES 32
+#define MAX_PASS_ACCESSES 8
+#define MAX_GRAPH_IMAGE_BARRIERS 128
+#define GRAPH_INVALID UINT32_MAX
+
+typedef void (*PFN_record_pass)(Interface *func, VkCommandBuffer cmd, void *data);
+
+typedef enum
+{
+    GRAPH_PASS_GRAPHICS,
+    GRAPH_PASS_COMPUTE,
+    GRAPH_PASS_TRANSFER
+} GraphPassType;
+
+/* How a pass touches a resource, everything needed for barriers,
+ * layouts and resource usage flags is derived from this           */
+typedef enum
+{
+    GRAPH_COLOR_WRITE,
+    GRAPH_DEPTH_WRITE,
+    GRAPH_DEPTH_READ,
+    GRAPH_SAMPLED_READ,
+    GRAPH_STORAGE_READ,
+    GRAPH_STORAGE_WRITE,
+    GRAPH_INDIRECT_READ,
+    GRAPH_TRANSFER_READ,
+    GRAPH_TRANSFER_WRITE,
+    GRAPH_USAGE_COUNT
+} GraphUsage;
+
+typedef enum
+{
+    GRAPH_RESOURCE_IMAGE,
+    GRAPH_RESOURCE_BUFFER
+} GraphResourceType;
+
+typedef struct
+{
+    const char *name;
+    GraphResourceType type;
+    bool imported;
+    /* Imported images whose contents don't survive between frames */
+    bool discard;
+    bool per_image;
+    
+    VkFormat format;
+    VkImageAspectFlags aspect;
+    /* Zero means the swapchain extent */
+    VkExtent2D extent;
+    VkImageUsageFlags image_usage;
+    VkImageLayout final_layout;
+    VkPipelineStageFlags initial_stages;
+    VkImage images[MAX_SWAPCHAIN_IMAGES];
+    VkImageView views[MAX_SWAPCHAIN_IMAGES];
+    
+    VkDeviceSize size;
+    VkBufferUsageFlags buffer_usage;
+    VkBuffer buffer;
+    
+    /* Filled in by graph_compile and graph_create_resources */
+    bool used;
+    uint32_t first_pass;
+    uint32_t last_pass;
+    VkMemoryRequirements requirements;
+    VkDeviceSize offset;
+} GraphResource;
+
+typedef struct
+{
+    uint32_t resource;
+    GraphUsage usage;
+    bool clear;
+    VkClearValue clear_value;
+} GraphAccess;
+
+typedef struct
+{
+    uint32_t resource;
+    VkImageLayout old_layout;
+    VkImageLayout new_layout;
+    VkAccessFlags src_access;
+    VkAccessFlags dst_access;
+} GraphImageBarrier;
+
+/* Everything a pass needs before it runs, issued as one call */
+typedef struct
+{
+    VkPipelineStageFlags src_stages;
+    VkPipelineStageFlags dst_stages;
+    VkAccessFlags src_access;
+    VkAccessFlags dst_access;
+    uint32_t first_image_barrier;
+    uint32_t image_barrier_count;
+} GraphBarrierBatch;
+
+typedef struct
+{
+    const char *name;
+    GraphPassType type;
+    PFN_record_pass record;
+    void *data;
+    bool side_effects;
+    GraphAccess accesses[MAX_PASS_ACCESSES];
+    uint32_t access_count;
+    
+    bool culled;
+    GraphBarrierBatch barriers;
+    VkRenderPass render_pass;
+    VkFramebuffer framebuffers[MAX_SWAPCHAIN_IMAGES];
+    bool per_image;
+    VkExtent2D extent;
+    /* Drawn area when smaller than the attachments, 0 for all of them */
+    VkExtent2D render_area;
+    uint32_t clear_count;
+    VkClearValue clear_values[MAX_PASS_ACCESSES];
+} GraphPass;
+
+typedef struct RenderGraph
+{
+    GraphResource resources[MAX_GRAPH_RESOURCES];
+    uint32_t resource_count;
+    GraphPass passes[MAX_GRAPH_PASSES];
+    uint32_t pass_count;
+    GraphImageBarrier image_barriers[MAX_GRAPH_IMAGE_BARRIERS];
+    uint32_t image_barrier_count;
+    GraphBarrierBatch final_barriers;
+    
+    VkDeviceMemory transient_memory;
+    VkDeviceSize transient_size;
+    VkDeviceSize unaliased_size;
+    uint32_t barrier_batch_count;
+    bool compiled;
+    /* Swapchain image of the graph_execute being recorded */
+    uint32_t image_index;
+} RenderGraph;
+
+RenderGraph *graph_create(Interface *func);
+uint32_t graph_import_swapchain(RenderGraph *graph, Interface *func, const char *name);
+uint32_t graph_import_image(RenderGraph *graph, const char *name, VkImage image, VkImageView view,
+    VkFormat format, VkExtent2D extent, VkImageLayout layout);
+uint32_t graph_import_buffer(RenderGraph *graph, const char *name, VkBuffer buffer, VkDeviceSize size);
+void graph_set_image(RenderGraph *graph, uint32_t resource, VkImage image, VkImageView view);
+void graph_set_buffer(RenderGraph *graph, uint32_t resource, VkBuffer buffer);
+uint32_t graph_create_image(RenderGraph *graph, const char *name, VkFormat format, VkExtent2D extent);
+uint32_t graph_create_buffer(RenderGraph *graph, const char *name, VkDeviceSize size);
+uint32_t graph_add_pass(RenderGraph *graph, const char *name, GraphPassType type, PFN_record_pass record, void *data);
+void graph_use(RenderGraph *graph, uint32_t pass, uint32_t resource, GraphUsage usage);
+void graph_clear(RenderGraph *graph, uint32_t pass, uint32_t resource, VkClearValue clear_value);
+void graph_keep(RenderGraph *graph, uint32_t pass);
+void graph_set_render_area(RenderGraph *graph, uint32_t pass, VkExtent2D extent);
+bool graph_compile(Interface *func, RenderGraph *graph);
+bool graph_create_resources(Interface *func, RenderGraph *graph);
+void graph_execute(Interface *func, RenderGraph *graph, VkCommandBuffer cmd, uint32_t image_index);
+VkRenderPass graph_render_pass(RenderGraph *graph, uint32_t pass);
+VkImageView graph_image_view(RenderGraph *graph, uint32_t resource, uint32_t image_index);
+VkBuffer graph_buffer(RenderGraph *graph, uint32_t resource);
+VkImage graph_image(RenderGraph *graph, uint32_t resource);
+
+void record_depth_prepass(Interface *func, VkCommandBuffer cmd, void *data);
+void record_main_pass(Interface *func, VkCommandBuffer cmd, void *data);
+void record_overlay(Interface *func, VkCommandBuffer cmd, void *data);
+
+/* GPU culling, see renderer_vk_cull.c */
+#define GPU_CULL_MAX_OBJECTS 131072
+#define GPU_CULL_GROUP_SIZE 64
+#define HIZ_GROUP_SIZE 8
+#define CULL_FLAG_OCCLUSION 1
+#define CULL_FLAG_COMPACT 2
+
+/* Matches the std140 block at set 0, binding 0 of cull.comp */
+typedef struct
+{
+    float prev_view_proj[16];
+    float planes[6][4];
+    float hiz_size[2];
+    uint32_t object_count;
+    uint32_t flags;
+    /* Fraction of the pyramid the previous frame drew into */
+    float hiz_scale[2];
+} CullConstants;
+
+/* Push constants of hiz.comp */
+typedef struct
+{
+    int32_t src_size[2];
+    int32_t dst_size[2];
+    uint32_t level;
+} HizConstants;
+
+bool gpu_cull_supported(Interface *func);
+void gpu_cull_write_descriptors(Interface *func, VkImageView depth_view);
+bool gpu_cull_active(Interface *func);
+void gpu_cull_begin_frame(Interface *func, VkCommandBuffer cmd, uint32_t frame);
+void record_cull_reset(Interface *func, VkCommandBuffer cmd, void *data);
+void record_gpu_cull(Interface *func, VkCommandBuffer cmd, void *data);
+void record_hiz(Interface *func, VkCommandBuffer cmd, void *data);
+
 #endif
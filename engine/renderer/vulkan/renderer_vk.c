@@ -1,10 +1,15 @@
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+#include <ctype.h>
 #include "interface.h"
 #include "util.h"
+#include "job.h"
+#include "cull.h"
+#include "transform.h"
 #include "renderer_int.h"
 
-static const VkApplicationInfo app_info = 
+static VkApplicationInfo app_info = 
 {
     .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
     .pApplicationName = "Engine App",
@@ -44,62 +49,209 @@ static VkDebugReportCallbackCreateInfoEXT debug_callback_create_info = {
     .pfnCallback = prv_report_function,
 };
 
-int renderer_init(Interface *func)
+typedef struct
 {
-    bool error = false;
-    
-    if(!init_vulkan(func))
-    {
-        error = true;
-        func->printf("Failed to create instance\n");
-    }
-    else if(!init_surface(func))
+    const char *name;
+    bool (*init)(Interface *func);
+    const char *error;
+    uint32_t dependencies;
+} StartupStage;
+
+enum
+{
+    STAGE_INSTANCE,
+    STAGE_SURFACE,
+    STAGE_DEVICE,
+    STAGE_SURFACE_FORMAT,
+    STAGE_SWAPCHAIN,
+    STAGE_RENDER,
+    STAGE_LIFETIME,
+    STAGE_COMPUTE,
+    STAGE_TIMING,
+    STAGE_UNIFORMS,
+    STAGE_BINDLESS,
+    STAGE_TEXTURES,
+    STAGE_SCENE,
+    STAGE_RENDER_PASS,
+    STAGE_GPU_CULL,
+    STAGE_FRAMEBUFFERS,
+    STAGE_SHADER_FILES,
+    STAGE_SHADERS,
+    STAGE_PIPELINE,
+    STAGE_SPRITES,
+    STAGE_LIGHTS,
+    STAGE_CAPTURE,
+    STAGE_COUNT
+};
+
+#define STAGE_BIT(x) (1u << (x))
+
+/* Startup is expressed as a dependency graph so that work which
+ * does not need the swapchain (shader loading, module and pipeline
+ * creation) overlaps with instance, device and swapchain setup.
+ * Adding to the bindless set isn't thread safe, so the stages that do
+ * (sprites, then lights) are chained one after the other.           */
+static const StartupStage startup_stages[STAGE_COUNT] =
+{
+    [STAGE_INSTANCE] = {"instance", init_vulkan, "Failed to create instance\n", 0},
+    [STAGE_SURFACE] = {"surface", init_surface, "Failed to create surface\n", STAGE_BIT(STAGE_INSTANCE)},
+    [STAGE_DEVICE] = {"device", init_device, "Failed to create device\n", STAGE_BIT(STAGE_SURFACE)},
+    [STAGE_SURFACE_FORMAT] = {"surface format", init_surface_format, "Failed to find surface format\n", STAGE_BIT(STAGE_DEVICE)},
+    [STAGE_SWAPCHAIN] = {"swapchain", init_swapchain, "Failed to create swapchain\n", STAGE_BIT(STAGE_SURFACE_FORMAT)},
+    [STAGE_RENDER] = {"render", init_render, "Failed to create render construct\n", STAGE_BIT(STAGE_DEVICE)},
+    [STAGE_LIFETIME] = {"lifetime", init_lifetime, "Failed to create submission tracking\n", STAGE_BIT(STAGE_DEVICE)},
+    [STAGE_COMPUTE] = {"compute", init_compute, "Failed to create compute construct\n", STAGE_BIT(STAGE_DEVICE)},
+    [STAGE_TIMING] = {"timing", init_timing, "Failed to create timing queries\n", STAGE_BIT(STAGE_DEVICE)},
+    [STAGE_UNIFORMS] = {"uniforms", init_uniforms, "Failed to create uniform ring\n", STAGE_BIT(STAGE_DEVICE)},
+    [STAGE_BINDLESS] = {"bindless", init_bindless, "Failed to create bindless set\n", STAGE_BIT(STAGE_DEVICE)},
+    [STAGE_TEXTURES] = {"textures", init_textures, "Failed to create texture streaming\n", STAGE_BIT(STAGE_SWAPCHAIN) | STAGE_BIT(STAGE_BINDLESS)},
+    [STAGE_SCENE] = {"scene", init_scene, "Failed to create scene\n", 0},
+    [STAGE_RENDER_PASS] = {"render pass", init_render_pass, "Failed to create render pass\n", STAGE_BIT(STAGE_SURFACE_FORMAT) | STAGE_BIT(STAGE_SHADER_FILES)},
+    [STAGE_GPU_CULL] = {"gpu cull", init_gpu_cull, "Failed to create GPU culling\n", STAGE_BIT(STAGE_SWAPCHAIN) | STAGE_BIT(STAGE_UNIFORMS) | STAGE_BIT(STAGE_SHADERS) | STAGE_BIT(STAGE_RENDER_PASS)},
+    [STAGE_FRAMEBUFFERS] = {"framebuffers", init_framebuffers, "Failed to create framebuffers\n", STAGE_BIT(STAGE_SWAPCHAIN) | STAGE_BIT(STAGE_RENDER_PASS) | STAGE_BIT(STAGE_GPU_CULL)},
+    [STAGE_SHADER_FILES] = {"shader files", init_shader_files, "Failed to load shaders\n", 0},
+    [STAGE_SHADERS] = {"shaders", init_shaders, "Failed to create shaders\n", STAGE_BIT(STAGE_DEVICE) | STAGE_BIT(STAGE_SHADER_FILES)},
+    [STAGE_PIPELINE] = {"pipeline", init_pipeline, "Failed to create pipeline\n", STAGE_BIT(STAGE_RENDER_PASS) | STAGE_BIT(STAGE_SHADERS) | STAGE_BIT(STAGE_UNIFORMS) | STAGE_BIT(STAGE_BINDLESS)},
+    [STAGE_SPRITES] = {"sprites", init_sprites, "Failed to create sprite batching\n", STAGE_BIT(STAGE_SWAPCHAIN) | STAGE_BIT(STAGE_PIPELINE)},
+    [STAGE_LIGHTS] = {"lights", init_lights, "Failed to create clustered lighting\n", STAGE_BIT(STAGE_UNIFORMS) | STAGE_BIT(STAGE_BINDLESS) | STAGE_BIT(STAGE_RENDER_PASS) | STAGE_BIT(STAGE_SHADERS) | STAGE_BIT(STAGE_SPRITES)},
+    [STAGE_CAPTURE] = {"capture", init_capture, "Failed to create frame capture\n", STAGE_BIT(STAGE_SWAPCHAIN) | STAGE_BIT(STAGE_LIFETIME) | STAGE_BIT(STAGE_RENDER_PASS)},
+};
+
+static bool prv_run_startup_stage(Interface *func, void *data)
+{
+    const StartupStage *stage = data;
+    bool result = stage->init(func);
+
+    if(!result)
     {
-        error = true;
-        func->printf("Failed to create surface\n");
+        func->printf("%s", stage->error);
     }
-    else if(!init_device(func))
+
+    return result;
+}
+
+static void prv_report_startup(Interface *func, Job *jobs, uint64_t start_ticks, uint64_t end_ticks)
+{
+    double ms_per_tick = 1000.0 / (double)func->get_perf_frequency();
+    double serial_ms = 0.0;
+
+    func->printf("Startup timing (%u workers)\n", func->job_pool->worker_count);
+    func->printf("    %-16s %10s %10s %10s\n", "stage", "start ms", "end ms", "took ms");
+
+    for(uint32_t i = 0; i < STAGE_COUNT; i++)
     {
-        error = true;
-        func->printf("Failed to create device\n");
+        if(jobs[i].start_ticks)
+        {
+            double start_ms = (jobs[i].start_ticks - start_ticks) * ms_per_tick;
+            double stage_ms = (jobs[i].end_ticks - jobs[i].start_ticks) * ms_per_tick;
+
+            serial_ms += stage_ms;
+            func->printf("    %-16s %10.2f %10.2f %10.2f\n", jobs[i].name, start_ms, start_ms + stage_ms, stage_ms);
+        }
+        else
+        {
+            func->printf("    %-16s %10s\n", jobs[i].name, "skipped");
+        }
     }
-    else if(!init_swapchain(func))
+
+    func->printf("Startup took %.2f ms, %.2f ms if run serially\n",
+        (end_ticks - start_ticks) * ms_per_tick, serial_ms);
+}
+
+int renderer_init(Interface *func)
+{
+    bool error = false;
+    Job jobs[STAGE_COUNT];
+    JobGroup group = {0};
+    uint64_t start_ticks, end_ticks;
+
+    func->job_pool = job_pool_create(func);
+
+    if(!func->job_pool)
     {
         error = true;
-        func->printf("Failed to create swapchain\n");
+        func->printf("Failed to create job pool\n");
     }
-    else if(!init_render(func))
+    else
     {
-        error = true;
-        func->printf("Failed to create render construct\n");
+        for(uint32_t i = 0; i < STAGE_COUNT; i++)
+        {
+            job_init(&jobs[i], startup_stages[i].name, prv_run_startup_stage, (void*)&startup_stages[i]);
+        }
+
+        /* A dropped edge would let a stage race its dependency */
+        for(uint32_t i = 0; i < STAGE_COUNT && !error; i++)
+        {
+            for(uint32_t j = 0; j < STAGE_COUNT && !error; j++)
+            {
+                if((startup_stages[i].dependencies & STAGE_BIT(j)) && !job_depends_on(&jobs[i], &jobs[j]))
+                {
+                    error = true;
+                    func->printf("Startup stage %s has more than %u dependents\n", startup_stages[j].name, MAX_JOB_DEPENDENTS);
+                }
+            }
+        }
     }
-    else if(!init_render_pass(func))
+
+    if(!error)
     {
-        error = true;
-        func->printf("Failed to create render pass\n");
+        start_ticks = func->get_perf_counter();
+        job_submit(func->job_pool, &group, jobs, STAGE_COUNT);
+        job_wait(func->job_pool, &group);
+        end_ticks = func->get_perf_counter();
+
+        func->destroy_sem(group.done);
+
+        for(uint32_t i = 0; i < STAGE_COUNT; i++)
+        {
+            error |= !jobs[i].result;
+        }
+
+        prv_report_startup(func, jobs, start_ticks, end_ticks);
     }
-    else if(!init_framebuffers(func))
+    
+    if(!error && func->app_info.cull_benchmark)
     {
-        error = true;
-        func->printf("Failed to create framebuffers\n");
+        cull_benchmark(func, CULL_BENCHMARK_OBJECTS);
     }
-    else if(!init_shaders(func))
+    
+    if(!error && func->app_info.transform_benchmark)
     {
-        error = true;
-        func->printf("Failed to create shaders\n");
+        transform_benchmark(func, TRANSFORM_BENCHMARK_NODES);
     }
-    else if(!init_pipeline(func))
+
+    return !error;
+}
+
+/* Called once the render loop has stopped, whether or not startup
+ * succeeded                                                       */
+void renderer_shutdown(Interface *func)
+{
+    capture_shutdown(func);
+    
+    if(func->job_pool)
     {
-        error = true;
-        func->printf("Failed to create pipeline\n");
+        job_pool_destroy(func->job_pool);
+        func->job_pool = NULL;
     }
-    
-    return !error;
 }
 
 bool init_vulkan(Interface *func)
 {
     VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    PFN_vkEnumerateInstanceVersion enumerate_instance_version;
+    uint32_t instance_version = VK_API_VERSION_1_0;
+    
+    /* Only 1.1 loaders know about instance versions so
+     * the query itself has to be looked up dynamically */
+    enumerate_instance_version = (PFN_vkEnumerateInstanceVersion)func->vkGetInstanceProcAddr(NULL, "vkEnumerateInstanceVersion");
+    
+    if(enumerate_instance_version)
+    {
+        enumerate_instance_version(&instance_version);
+    }
+    
+    app_info.apiVersion = instance_version >= VK_API_VERSION_1_2 ? VK_API_VERSION_1_2 : instance_version;
     
     if(func->app_info.extension_count < MAX_EXTENSIONS)
     {
@@ -119,6 +271,14 @@ bool init_vulkan(Interface *func)
     
         if(result == VK_SUCCESS)
         {
+            func->instance_version = app_info.apiVersion;
+            
+            if(func->instance_version >= VK_API_VERSION_1_1)
+            {
+                func->vkGetPhysicalDeviceProperties2 = (PFN_vkGetPhysicalDeviceProperties2)func->vkGetInstanceProcAddr(func->instance, "vkGetPhysicalDeviceProperties2");
+                func->vkGetPhysicalDeviceFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2)func->vkGetInstanceProcAddr(func->instance, "vkGetPhysicalDeviceFeatures2");
+            }
+            
             if(func->app_info.debug)
             {
                 result = VK_ERROR_INITIALIZATION_FAILED;
@@ -155,62 +315,499 @@ bool init_surface(Interface *func)
     return func->create_surface(func);
 }
 
+/* Physical devices are ranked by type first, the score only orders
+ * devices of the same type. A software device reporting host memory
+ * as device local can't outrank a real GPU that way.                */
+enum
+{
+    RANK_CPU,
+    RANK_OTHER,
+    RANK_VIRTUAL_GPU,
+    RANK_INTEGRATED_GPU,
+    RANK_DISCRETE_GPU
+};
+
+#define SCORE_ASYNC_COMPUTE 2000
+#define SCORE_DEDICATED_TRANSFER 1000
+#define SCORE_PER_FEATURE 500
+
+typedef struct
+{
+    VkPhysicalDevice handle;
+    VkPhysicalDeviceProperties properties;
+    VkPhysicalDeviceFeatures features;
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    uint8_t uuid[VK_UUID_SIZE];
+    bool has_uuid;
+    VkDeviceSize vram;
+    uint32_t graphics_family;
+    uint32_t compute_family;
+    uint32_t transfer_family;
+    bool usable;
+    uint32_t rank;
+    /* One point per MiB of device local memory, then capabilities */
+    int64_t vram_score;
+    int64_t capability_score;
+    int64_t score;
+} DeviceCandidate;
+
+static const char *prv_device_type_name(VkPhysicalDeviceType type)
+{
+    switch(type)
+    {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            return "discrete";
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            return "integrated";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            return "virtual";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            return "cpu";
+        default:
+            return "other";
+    }
+}
+
+static void prv_format_uuid(const uint8_t *uuid, char *str)
+{
+    static const char hex[] = "0123456789abcdef";
+    
+    for(uint32_t i = 0; i < VK_UUID_SIZE; i++)
+    {
+        if(i == 4 || i == 6 || i == 8 || i == 10)
+        {
+            *str++ = '-';
+        }
+        *str++ = hex[uuid[i] >> 4];
+        *str++ = hex[uuid[i] & 0xf];
+    }
+    *str = '\0';
+}
+
+/* The override matches either a UUID, with or without dashes,
+ * or any case insensitive substring of the device name         */
+static bool prv_device_matches(const DeviceCandidate *candidate, const char *override)
+{
+    char uuid[VK_UUID_SIZE * 2 + 5];
+    const char *a, *b;
+    bool matches = false;
+    
+    if(candidate->has_uuid)
+    {
+        prv_format_uuid(candidate->uuid, uuid);
+        a = uuid;
+        b = override;
+        
+        while(*a && *b)
+        {
+            if(*a == '-')
+            {
+                a++;
+            }
+            else if(*b == '-')
+            {
+                b++;
+            }
+            else if(tolower((unsigned char)*a) == tolower((unsigned char)*b))
+            {
+                a++;
+                b++;
+            }
+            else
+            {
+                break;
+            }
+        }
+        
+        matches = *a == '\0' && *b == '\0';
+    }
+    
+    for(const char *name = candidate->properties.deviceName; *name && !matches; name++)
+    {
+        a = name;
+        b = override;
+        
+        while(*a && *b && tolower((unsigned char)*a) == tolower((unsigned char)*b))
+        {
+            a++;
+            b++;
+        }
+        
+        matches = *b == '\0';
+    }
+    
+    return matches;
+}
+
+static void prv_query_device(Interface *func, VkPhysicalDevice handle, DeviceCandidate *candidate)
+{
+    uint32_t queue_family_count = MAX_QUEUE_COUNT;
+    VkQueueFamilyProperties queue_family_properties[MAX_QUEUE_COUNT];
+    VkPhysicalDeviceIDProperties id_properties = {0};
+    VkPhysicalDeviceProperties2 properties2 = {0};
+    VkBool32 supports_present;
+    const VkPhysicalDeviceFeatures *features = &candidate->features;
+    const VkPhysicalDeviceLimits *limits = &candidate->properties.limits;
+    
+    *candidate = (DeviceCandidate) {0};
+    candidate->handle = handle;
+    candidate->graphics_family = UINT32_MAX;
+    candidate->compute_family = UINT32_MAX;
+    candidate->transfer_family = UINT32_MAX;
+    
+    func->vkGetPhysicalDeviceProperties(handle, &candidate->properties);
+    func->vkGetPhysicalDeviceFeatures(handle, &candidate->features);
+    func->vkGetPhysicalDeviceMemoryProperties(handle, &candidate->memory_properties);
+    
+    /* The device UUID is only reported through the 1.1 query */
+    if(func->vkGetPhysicalDeviceProperties2 && candidate->properties.apiVersion >= VK_API_VERSION_1_1)
+    {
+        id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &id_properties;
+        
+        func->vkGetPhysicalDeviceProperties2(handle, &properties2);
+        memcpy(candidate->uuid, id_properties.deviceUUID, VK_UUID_SIZE);
+        candidate->has_uuid = true;
+    }
+    
+    for(uint32_t i = 0; i < candidate->memory_properties.memoryHeapCount; i++)
+    {
+        if(candidate->memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+        {
+            candidate->vram += candidate->memory_properties.memoryHeaps[i].size;
+        }
+    }
+    
+    func->vkGetPhysicalDeviceQueueFamilyProperties(handle, &queue_family_count, queue_family_properties);
+    
+    for(uint32_t i = 0; i < queue_family_count; i++)
+    {
+        VkQueueFlags flags = queue_family_properties[i].queueFlags;
+        
+        if((flags & VK_QUEUE_GRAPHICS_BIT) && candidate->graphics_family == UINT32_MAX)
+        {
+            supports_present = VK_FALSE;
+            func->vkGetPhysicalDeviceSurfaceSupportKHR(handle, i, func->surface, &supports_present);
+            
+            if(supports_present)
+            {
+                candidate->graphics_family = i;
+            }
+        }
+        else if((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) &&
+                candidate->compute_family == UINT32_MAX)
+        {
+            candidate->compute_family = i;
+        }
+        else if((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+                candidate->transfer_family == UINT32_MAX)
+        {
+            candidate->transfer_family = i;
+        }
+    }
+    
+    candidate->usable = candidate->graphics_family != UINT32_MAX;
+    
+    switch(candidate->properties.deviceType)
+    {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            candidate->rank = RANK_DISCRETE_GPU;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            candidate->rank = RANK_INTEGRATED_GPU;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            candidate->rank = RANK_VIRTUAL_GPU;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            candidate->rank = RANK_CPU;
+            break;
+        default:
+            candidate->rank = RANK_OTHER;
+            break;
+    }
+    
+    candidate->vram_score = candidate->vram / (1024 * 1024);
+    
+    if(candidate->compute_family != UINT32_MAX)
+    {
+        candidate->capability_score += SCORE_ASYNC_COMPUTE;
+    }
+    
+    if(candidate->transfer_family != UINT32_MAX)
+    {
+        candidate->capability_score += SCORE_DEDICATED_TRANSFER;
+    }
+    
+    candidate->capability_score += SCORE_PER_FEATURE * (
+        features->textureCompressionBC +
+        features->samplerAnisotropy +
+        features->multiDrawIndirect +
+        features->drawIndirectFirstInstance +
+        features->pipelineStatisticsQuery);
+    
+    candidate->capability_score += limits->maxImageDimension2D / 16;
+    candidate->capability_score += limits->maxComputeSharedMemorySize / 1024;
+    candidate->score = candidate->vram_score + candidate->capability_score;
+}
+
+static bool prv_ranks_above(const DeviceCandidate *a, const DeviceCandidate *b)
+{
+    return a->rank > b->rank || (a->rank == b->rank && a->score > b->score);
+}
+
+/* Optional features are enabled whenever the device has them,
+ * the 1.2 ones are chained into device creation                */
+typedef struct
+{
+    VkPhysicalDeviceFeatures core;
+    VkPhysicalDeviceTimelineSemaphoreFeatures timeline;
+    VkPhysicalDeviceDescriptorIndexingFeatures indexing;
+    bool bindless;
+} OptionalFeatures;
+
+static void *prv_optional_features(Interface *func, const DeviceCandidate *candidate, uint32_t api_version,
+    OptionalFeatures *optional)
+{
+    VkPhysicalDeviceFeatures2 features2 = {0};
+    const VkPhysicalDeviceFeatures *supported = &candidate->features;
+    const VkPhysicalDeviceDescriptorIndexingFeatures *indexing = &optional->indexing;
+    void *chain = NULL;
+    
+    *optional = (OptionalFeatures) {0};
+    optional->timeline.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    optional->indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    
+    optional->core.samplerAnisotropy = supported->samplerAnisotropy;
+    optional->core.textureCompressionBC = supported->textureCompressionBC;
+    optional->core.multiDrawIndirect = supported->multiDrawIndirect;
+    optional->core.drawIndirectFirstInstance = supported->drawIndirectFirstInstance;
+    optional->core.pipelineStatisticsQuery = supported->pipelineStatisticsQuery;
+    optional->core.shaderSampledImageArrayDynamicIndexing = supported->shaderSampledImageArrayDynamicIndexing;
+    optional->core.shaderStorageBufferArrayDynamicIndexing = supported->shaderStorageBufferArrayDynamicIndexing;
+    
+    if(func->vkGetPhysicalDeviceFeatures2 && api_version >= VK_API_VERSION_1_2)
+    {
+        optional->timeline.pNext = &optional->indexing;
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &optional->timeline;
+        
+        func->vkGetPhysicalDeviceFeatures2(candidate->handle, &features2);
+        optional->timeline.pNext = NULL;
+    }
+    
+    if(optional->timeline.timelineSemaphore)
+    {
+        optional->timeline.pNext = chain;
+        chain = &optional->timeline;
+    }
+    
+    /* Bindless needs large partially bound arrays that can be
+     * written while a frame using other elements is in flight */
+    optional->bindless =
+        indexing->runtimeDescriptorArray &&
+        indexing->descriptorBindingPartiallyBound &&
+        indexing->descriptorBindingUpdateUnusedWhilePending &&
+        indexing->descriptorBindingSampledImageUpdateAfterBind &&
+        indexing->descriptorBindingStorageBufferUpdateAfterBind &&
+        indexing->shaderSampledImageArrayNonUniformIndexing &&
+        supported->shaderSampledImageArrayDynamicIndexing &&
+        supported->shaderStorageBufferArrayDynamicIndexing;
+    
+    if(optional->bindless)
+    {
+        optional->indexing.pNext = chain;
+        chain = &optional->indexing;
+    }
+    
+    return chain;
+}
+
+static bool prv_has_extension(Interface *func, VkPhysicalDevice handle, const char *name)
+{
+    uint32_t extension_count = 0;
+    VkExtensionProperties *extensions = NULL;
+    bool found = false;
+    
+    func->vkEnumerateDeviceExtensionProperties(handle, NULL, &extension_count, NULL);
+    extensions = func->malloc(sizeof(VkExtensionProperties) * MAX(extension_count, 1));
+    func->vkEnumerateDeviceExtensionProperties(handle, NULL, &extension_count, extensions);
+    
+    for(uint32_t i = 0; i < extension_count && !found; i++)
+    {
+        found = strcmp(extensions[i].extensionName, name) == 0;
+    }
+    
+    func->free(extensions);
+    
+    return found;
+}
+
+/* VK_EXT_calibrated_timestamps defines the device time domain as the
+ * one vkCmdWriteTimestamp writes in, whichever queue records it, so
+ * with it the graphics and compute timelines share one clock        */
+static bool prv_has_device_time_domain(Interface *func, VkPhysicalDevice handle)
+{
+    PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT get_time_domains;
+    uint32_t domain_count = MAX_TIME_DOMAINS;
+    VkTimeDomainEXT domains[MAX_TIME_DOMAINS];
+    bool found = false;
+    
+    if(prv_has_extension(func, handle, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME))
+    {
+        get_time_domains = (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)func->vkGetInstanceProcAddr(
+            func->instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+        
+        /* VK_INCOMPLETE still fills in the first domains */
+        if(get_time_domains && get_time_domains(handle, &domain_count, domains) >= VK_SUCCESS)
+        {
+            for(uint32_t i = 0; i < domain_count && !found; i++)
+            {
+                found = domains[i] == VK_TIME_DOMAIN_DEVICE_EXT;
+            }
+        }
+    }
+    
+    return found;
+}
+
 bool init_device(Interface *func)
 {
     VkResult result = VK_ERROR_INITIALIZATION_FAILED;
-    VkPhysicalDevice physical_device = VK_NULL_HANDLE;
-    uint32_t queue_family_index;
     uint32_t physical_device_count = MAX_DEVICE_COUNT;
     VkPhysicalDevice device_handles[MAX_DEVICE_COUNT];
-    uint32_t queue_family_count;
-    VkQueueFamilyProperties queue_family_properties[MAX_QUEUE_COUNT];
-    VkBool32 supports_present;
-    VkQueue queue;
+    DeviceCandidate candidates[MAX_DEVICE_COUNT];
+    uint32_t ranking[MAX_DEVICE_COUNT];
+    DeviceCandidate *selected = NULL;
+    const char *override = func->app_info.device_override;
+    char uuid[VK_UUID_SIZE * 2 + 5];
+    uint32_t compute_family = UINT32_MAX;
+    VkQueue queue, compute_queue;
     VkDevice device = VK_NULL_HANDLE;
     VkDeviceCreateInfo device_create_info = {0};
-    VkDeviceQueueCreateInfo queue_create_info = {0};
+    VkDeviceQueueCreateInfo queue_create_infos[2] = {0};
+    OptionalFeatures optional;
+    uint32_t api_version = VK_API_VERSION_1_0;
+    const char *extensions[3] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    uint32_t extension_count = 1;
+    bool draw_indirect_count = false;
+    bool device_time_domain = false;
     
     func->vkEnumeratePhysicalDevices(func->instance, &physical_device_count, device_handles);
     
     for(uint32_t i = 0; i < physical_device_count; i++)
     {
-        queue_family_count = MAX_QUEUE_COUNT;
-        func->vkGetPhysicalDeviceQueueFamilyProperties(
-            device_handles[i], &queue_family_count, queue_family_properties);
-        for(uint32_t j = 0; j < queue_family_count; j++)
+        prv_query_device(func, device_handles[i], &candidates[i]);
+        
+        /* Insertion sort, there are only ever a handful of devices */
+        uint32_t j = i;
+        while(j > 0 && prv_ranks_above(&candidates[i], &candidates[ranking[j - 1]]))
         {
-            supports_present = VK_FALSE;
-            func->vkGetPhysicalDeviceSurfaceSupportKHR(device_handles[i], j, func->surface, &supports_present);
-            
-            if(supports_present && (queue_family_properties[j].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+            ranking[j] = ranking[j - 1];
+            j--;
+        }
+        ranking[j] = i;
+    }
+    
+    if(override)
+    {
+        for(uint32_t i = 0; i < physical_device_count && !selected; i++)
+        {
+            if(candidates[ranking[i]].usable && prv_device_matches(&candidates[ranking[i]], override))
             {
-                queue_family_index = j;
-                physical_device = device_handles[i];
-                result = VK_SUCCESS;
-                break;
+                selected = &candidates[ranking[i]];
             }
         }
         
-        if(physical_device)
+        if(!selected)
         {
-            break;
+            func->printf("No usable device matches \"%s\", using the best ranked device\n", override);
         }
     }
     
-    if(result == VK_SUCCESS)
+    for(uint32_t i = 0; i < physical_device_count && !selected; i++)
+    {
+        if(candidates[ranking[i]].usable)
+        {
+            selected = &candidates[ranking[i]];
+        }
+    }
+    
+    func->printf("Physical device ranking\n");
+    for(uint32_t i = 0; i < physical_device_count; i++)
+    {
+        DeviceCandidate *candidate = &candidates[ranking[i]];
+        
+        if(candidate->has_uuid)
+        {
+            prv_format_uuid(candidate->uuid, uuid);
+        }
+        else
+        {
+            uuid[0] = '\0';
+        }
+        
+        func->printf("  %c %u. %s (%s, %llu MiB, %s%s) type rank %u, score %lld = %lld VRAM + %lld capabilities %s\n",
+            candidate == selected ? '*' : ' ',
+            i + 1,
+            candidate->properties.deviceName,
+            prv_device_type_name(candidate->properties.deviceType),
+            (unsigned long long)(candidate->vram / (1024 * 1024)),
+            candidate->compute_family != UINT32_MAX ? "async compute" : "no async compute",
+            candidate->transfer_family != UINT32_MAX ? ", dedicated transfer" : "",
+            candidate->rank,
+            (long long)candidate->score,
+            (long long)candidate->vram_score,
+            (long long)candidate->capability_score,
+            candidate->usable ? uuid : "cannot present");
+    }
+    
+    if(selected)
     {
+        /* Without a dedicated compute family, compute work goes
+         * through the graphics queue and simply doesn't overlap  */
+        compute_family = selected->compute_family != UINT32_MAX ? selected->compute_family : selected->graphics_family;
+        
+        api_version = MIN(func->instance_version, selected->properties.apiVersion);
+        
+        /* Lets GPU culling draw only what survived instead of
+         * issuing a zero instance draw for every culled object */
+        draw_indirect_count = prv_has_extension(func, selected->handle, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        
+        if(draw_indirect_count)
+        {
+            extensions[extension_count++] = VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME;
+        }
+        
+        /* Lets the timing report how much of the compute queue's
+         * work overlapped the graphics queue                      */
+        device_time_domain = prv_has_device_time_domain(func, selected->handle);
+        
+        if(device_time_domain)
+        {
+            extensions[extension_count++] = VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME;
+        }
+        
         device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-        device_create_info.queueCreateInfoCount = 1;
-        device_create_info.pQueueCreateInfos = &queue_create_info;
-        device_create_info.enabledExtensionCount = 1;
-        device_create_info.ppEnabledExtensionNames = (const char* const[]) {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+        device_create_info.pNext = prv_optional_features(func, selected, api_version, &optional);
+        device_create_info.pEnabledFeatures = &optional.core;
+        device_create_info.queueCreateInfoCount = compute_family != selected->graphics_family ? 2 : 1;
+        device_create_info.pQueueCreateInfos = queue_create_infos;
+        device_create_info.enabledExtensionCount = extension_count;
+        device_create_info.ppEnabledExtensionNames = extensions;
     
-        queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-        queue_create_info.queueFamilyIndex = queue_family_index;
-        queue_create_info.queueCount = 1;
-        queue_create_info.pQueuePriorities = (const float[]) {1.0f};
+        queue_create_infos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queue_create_infos[0].queueFamilyIndex = selected->graphics_family;
+        queue_create_infos[0].queueCount = 1;
+        queue_create_infos[0].pQueuePriorities = (const float[]) {1.0f};
+        
+        queue_create_infos[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queue_create_infos[1].queueFamilyIndex = compute_family;
+        queue_create_infos[1].queueCount = 1;
+        queue_create_infos[1].pQueuePriorities = (const float[]) {1.0f};
         
-        result = func->vkCreateDevice(physical_device, &device_create_info, NULL, &device);
+        result = func->vkCreateDevice(selected->handle, &device_create_info, NULL, &device);
         
         if(result != VK_SUCCESS)
         {
@@ -218,7 +815,19 @@ bool init_device(Interface *func)
         }
         else
         {
-            func->vkGetDeviceQueue(device, queue_family_index, 0, &queue);
+            func->vkGetDeviceQueue(device, selected->graphics_family, 0, &queue);
+            func->vkGetDeviceQueue(device, compute_family, 0, &compute_queue);
+            
+            if(optional.timeline.timelineSemaphore)
+            {
+                func->vkGetSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValue)func->vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValue");
+                func->vkWaitSemaphores = (PFN_vkWaitSemaphores)func->vkGetDeviceProcAddr(device, "vkWaitSemaphores");
+            }
+            
+            if(draw_indirect_count)
+            {
+                func->vkCmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCount)func->vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR");
+            }
         }
     }
     else
@@ -231,23 +840,53 @@ bool init_device(Interface *func)
         /* If we know everything completed successfully then
          * assign the create device to the interface         */
 
-        func->physical_device = physical_device;
+        func->physical_device = selected->handle;
+        func->physical_device_properties = selected->properties;
+        func->physical_device_features = optional.core;
+        func->memory_properties = selected->memory_properties;
+        func->api_version = api_version;
         func->device = device;
         func->queue = queue;
-        func->queue_family_index = queue_family_index;
+        func->queue_family_index = selected->graphics_family;
+        func->timeline_supported = func->vkGetSemaphoreCounterValue && func->vkWaitSemaphores;
+        func->bindless_supported = optional.bindless;
+        func->compute_queue = compute_queue;
+        func->compute_queue_family_index = compute_family;
+        func->device_time_domain = device_time_domain;
     }
     
     return result == VK_SUCCESS;
 }
 
-#define MIN(x,y) ((x) < (y) ? (x) : (y))
-#define MAX(x,y) ((x) > (y) ? (x) : (y))
-#define CLAMP(x,y,z) (MIN((z), MAX((x), (y))))
+bool init_surface_format(Interface *func)
+{
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    uint32_t format_count = 1;
+    VkSurfaceFormatKHR surface_format;
+    
+    result = func->vkGetPhysicalDeviceSurfaceFormatsKHR(
+        func->physical_device, func->surface, &format_count, &surface_format);
+    
+    /* Only asking for one format reports incomplete when there
+     * are more, the first one is still valid                   */
+    if(result == VK_INCOMPLETE)
+    {
+        result = VK_SUCCESS;
+    }
+    
+    if(surface_format.format == VK_FORMAT_UNDEFINED)
+    {
+        surface_format.format = VK_FORMAT_B8G8R8A8_UNORM;
+    }
+    
+    func->surface_format = surface_format;
+    
+    return result == VK_SUCCESS;
+}
 
 bool init_swapchain(Interface *func)
 {
     VkResult result = VK_ERROR_INITIALIZATION_FAILED;
-    uint32_t format_count = 1;
     uint32_t swapchain_image_count = 2;
     uint32_t present_mode_count = MAX_PRESENT_MODES_COUNT;
     VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
@@ -255,18 +894,9 @@ bool init_swapchain(Interface *func)
     VkSurfaceCapabilitiesKHR surface_capabilities;
     VkSwapchainKHR swapchain;
     VkExtent2D swapchain_extent;
-    VkSurfaceFormatKHR surface_format;
+    VkSurfaceFormatKHR surface_format = func->surface_format;
     VkSwapchainCreateInfoKHR swapchain_create_info = {0};
     
-    
-    func->vkGetPhysicalDeviceSurfaceFormatsKHR(
-        func->physical_device, func->surface, &format_count, &surface_format);
-        
-    if(surface_format.format == VK_FORMAT_UNDEFINED)
-    {
-        surface_format.format = VK_FORMAT_B8G8R8A8_UNORM;
-    }
-    
     func->vkGetPhysicalDeviceSurfacePresentModesKHR(
         func->physical_device, func->surface, &present_mode_count, present_modes);
         
@@ -306,6 +936,14 @@ bool init_swapchain(Interface *func)
     swapchain_create_info.imageExtent = swapchain_extent;
     swapchain_create_info.imageArrayLayers = 1;
     swapchain_create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    
+    /* Captured frames are copied straight out of the swapchain image,
+     * capture_supported makes the same check                          */
+    if(func->app_info.capture_path && (surface_capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
+    {
+        swapchain_create_info.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
+    
     swapchain_create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
     swapchain_create_info.preTransform = surface_capabilities.currentTransform;
     swapchain_create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
@@ -332,7 +970,6 @@ bool init_swapchain(Interface *func)
             func->vkGetSwapchainImagesKHR(func->device, swapchain, &swapchain_image_count, func->swapchain_images);
             func->swapchain_image_count = swapchain_image_count;
             func->swapchain = swapchain;
-            func->surface_format = surface_format;
             func->swapchain_extent = swapchain_extent;
         }
     }
@@ -345,7 +982,6 @@ bool init_render(Interface *func)
     VkCommandPoolCreateInfo cmd_pool_create_info = {0};
     VkCommandBufferAllocateInfo cmd_buffer_alloc_info = {0};
     VkSemaphoreCreateInfo sem_create_info = {0};
-    VkFenceCreateInfo fence_create_info = {0};
     
     cmd_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     cmd_pool_create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
@@ -362,14 +998,13 @@ bool init_render(Interface *func)
     
     sem_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
     
-    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-    
+    /* Frame slots are recycled by waiting on the submission value
+     * recorded in frame_values, see renderer_vk_lifetime.c        */
     for(size_t i = 0; i < MAX_FRAMES; i++)
     {
         func->vkCreateSemaphore(func->device, &sem_create_info, 0, &func->img_avaliable_sem[i]);
         func->vkCreateSemaphore(func->device, &sem_create_info, 0, &func->render_finished_sem[i]);
-        func->vkCreateFence(func->device, &fence_create_info, 0, &func->frame_fence[i]);
+        func->frame_values[i] = 0;
     }
     
     func->frame_index = 0;
@@ -377,57 +1012,162 @@ bool init_render(Interface *func)
     return true;
 }
 
+/* Depth only formats first since nothing uses stencil, every device
+ * has to support at least one of D24S8 and D32 as an attachment     */
+static VkFormat prv_pick_depth_format(Interface *func)
+{
+    const VkFormat candidates[] = {
+        VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D16_UNORM};
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkFormatProperties properties;
+    
+    for(uint32_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]) && format == VK_FORMAT_UNDEFINED; i++)
+    {
+        func->vkGetPhysicalDeviceFormatProperties(func->physical_device, candidates[i], &properties);
+        
+        if(properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+        {
+            format = candidates[i];
+        }
+    }
+    
+    return format;
+}
+
+/* Declares the frame as a render graph, the render passes pipelines
+ * are created against come from the compiled graph                  */
 bool init_render_pass(Interface *func)
 {
-    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
-    VkRenderPassCreateInfo render_pass_create_info = {0};
-    VkAttachmentDescription attachment_desc = {0};
-    VkSubpassDescription subpass_desc = {0};
-    VkSubpassDependency subpass_depend = {0};
-    VkAttachmentReference attachment_ref = {0};
-    
-    attachment_desc.format = func->surface_format.format;
-    attachment_desc.samples = VK_SAMPLE_COUNT_1_BIT;
-    attachment_desc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachment_desc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    attachment_desc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachment_desc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachment_desc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachment_desc.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-    
-    subpass_desc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass_desc.colorAttachmentCount = 1;
-    subpass_desc.pColorAttachments = &attachment_ref;
-    
-    attachment_ref.attachment = 0;
-    attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    
-    subpass_depend.srcSubpass = VK_SUBPASS_EXTERNAL;
-    subpass_depend.dstSubpass = 0;
-    subpass_depend.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    subpass_depend.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    subpass_depend.srcAccessMask = 0;
-    subpass_depend.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    subpass_depend.dependencyFlags = 0;
-    
-    render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-    render_pass_create_info.attachmentCount = 1,
-    render_pass_create_info.pAttachments = &attachment_desc;
-    render_pass_create_info.subpassCount = 1;
-    render_pass_create_info.pSubpasses = &subpass_desc;
-    render_pass_create_info.dependencyCount = 1;
-    render_pass_create_info.pDependencies = &subpass_depend;
-    
-    result = func->vkCreateRenderPass(func->device, &render_pass_create_info, 0, &func->render_pass);
+    bool result = false;
+    RenderGraph *graph = graph_create(func);
+    VkClearValue clear_value = {.color = {{ 0.0f, 0.1f, 0.2f, 1.0f }}};
+    VkClearValue depth_clear_value = {.depthStencil = {1.0f, 0}};
+    uint32_t reset_pass, cull_pass, hiz_pass;
     
-    return result == VK_SUCCESS;
+    func->depth_format = prv_pick_depth_format(func);
+    func->graph_prepass = GRAPH_INVALID;
+    
+    if(func->depth_format == VK_FORMAT_UNDEFINED)
+    {
+        func->printf("Failed to find a depth format\n");
+    }
+    else if(graph)
+    {
+        func->render_graph = graph;
+        func->graph_backbuffer = graph_import_swapchain(graph, func, "backbuffer");
+        func->graph_depth = graph_create_image(graph, "depth", func->depth_format, (VkExtent2D) {0, 0});
+        func->gpu_cull_enabled = func->gpu_cull_enabled && gpu_cull_supported(func);
+        func->lights_enabled = func->lights_enabled && light_supported(func);
+        func->capture_enabled = func->app_info.capture_path && capture_supported(func);
+        func->graph_capture_pass = GRAPH_INVALID;
+        func->resolution_enabled = func->app_info.resolution_target_ms > 0.0f && resolution_supported(func);
+        func->graph_scene_color = func->graph_backbuffer;
+        func->graph_upscale_pass = GRAPH_INVALID;
+        func->graph_overlay_pass = GRAPH_INVALID;
+        func->render_scale = 1.0f;
+        func->hiz_scale[0] = 1.0f;
+        func->hiz_scale[1] = 1.0f;
+        
+        /* Same format as the swapchain so the upscale is a plain blit */
+        if(func->resolution_enabled)
+        {
+            func->graph_scene_color = graph_create_image(graph, "scene color", func->surface_format.format, (VkExtent2D) {0, 0});
+        }
+        
+        /* The handles are filled in by init_gpu_cull */
+        if(func->gpu_cull_enabled)
+        {
+            func->graph_draw_commands = graph_import_buffer(graph, "draw commands", VK_NULL_HANDLE, 0);
+            func->graph_draw_count = graph_import_buffer(graph, "draw count", VK_NULL_HANDLE, 0);
+            func->graph_hiz = graph_import_image(graph, "depth pyramid", VK_NULL_HANDLE, VK_NULL_HANDLE,
+                VK_FORMAT_R32_SFLOAT, (VkExtent2D) {0, 0}, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            
+            reset_pass = graph_add_pass(graph, "cull reset", GRAPH_PASS_TRANSFER, record_cull_reset, NULL);
+            graph_use(graph, reset_pass, func->graph_draw_count, GRAPH_TRANSFER_WRITE);
+            
+            cull_pass = graph_add_pass(graph, "gpu cull", GRAPH_PASS_COMPUTE, record_gpu_cull, NULL);
+            graph_use(graph, cull_pass, func->graph_hiz, GRAPH_SAMPLED_READ);
+            graph_use(graph, cull_pass, func->graph_draw_commands, GRAPH_STORAGE_WRITE);
+            graph_use(graph, cull_pass, func->graph_draw_count, GRAPH_STORAGE_WRITE);
+        }
+        
+        /* With a prepass the main pass only tests against the finished
+         * depth buffer, so each pixel is shaded once                   */
+        if(func->app_info.depth_prepass)
+        {
+            func->graph_prepass = graph_add_pass(graph, "depth prepass", GRAPH_PASS_GRAPHICS, record_depth_prepass, NULL);
+            graph_use(graph, func->graph_prepass, func->graph_depth, GRAPH_DEPTH_WRITE);
+            graph_clear(graph, func->graph_prepass, func->graph_depth, depth_clear_value);
+            
+            if(func->gpu_cull_enabled)
+            {
+                graph_use(graph, func->graph_prepass, func->graph_draw_commands, GRAPH_INDIRECT_READ);
+                graph_use(graph, func->graph_prepass, func->graph_draw_count, GRAPH_INDIRECT_READ);
+            }
+        }
+        
+        func->graph_main_pass = graph_add_pass(graph, "main", GRAPH_PASS_GRAPHICS, record_main_pass, NULL);
+        graph_use(graph, func->graph_main_pass, func->graph_scene_color, GRAPH_COLOR_WRITE);
+        graph_clear(graph, func->graph_main_pass, func->graph_scene_color, clear_value);
+        
+        if(func->app_info.depth_prepass)
+        {
+            graph_use(graph, func->graph_main_pass, func->graph_depth, GRAPH_DEPTH_READ);
+        }
+        else
+        {
+            graph_use(graph, func->graph_main_pass, func->graph_depth, GRAPH_DEPTH_WRITE);
+            graph_clear(graph, func->graph_main_pass, func->graph_depth, depth_clear_value);
+        }
+        
+        /* The pyramid is built from this frame's depth for the next one */
+        if(func->gpu_cull_enabled)
+        {
+            graph_use(graph, func->graph_main_pass, func->graph_draw_commands, GRAPH_INDIRECT_READ);
+            graph_use(graph, func->graph_main_pass, func->graph_draw_count, GRAPH_INDIRECT_READ);
+            
+            hiz_pass = graph_add_pass(graph, "hiz", GRAPH_PASS_COMPUTE, record_hiz, NULL);
+            graph_use(graph, hiz_pass, func->graph_depth, GRAPH_SAMPLED_READ);
+            graph_use(graph, hiz_pass, func->graph_hiz, GRAPH_STORAGE_WRITE);
+        }
+        
+        /* Sprites are drawn after the upscale so the overlay stays sharp */
+        if(func->resolution_enabled)
+        {
+            func->graph_upscale_pass = graph_add_pass(graph, "upscale", GRAPH_PASS_TRANSFER, record_upscale, NULL);
+            graph_use(graph, func->graph_upscale_pass, func->graph_scene_color, GRAPH_TRANSFER_READ);
+            graph_use(graph, func->graph_upscale_pass, func->graph_backbuffer, GRAPH_TRANSFER_WRITE);
+            
+            func->graph_overlay_pass = graph_add_pass(graph, "overlay", GRAPH_PASS_GRAPHICS, record_overlay, NULL);
+            graph_use(graph, func->graph_overlay_pass, func->graph_backbuffer, GRAPH_COLOR_WRITE);
+        }
+        
+        /* Nothing in the graph reads the copy, the host does */
+        if(func->capture_enabled)
+        {
+            func->graph_capture_pass = graph_add_pass(graph, "capture", GRAPH_PASS_TRANSFER, record_capture, NULL);
+            graph_use(graph, func->graph_capture_pass, func->graph_backbuffer, GRAPH_TRANSFER_READ);
+            graph_keep(graph, func->graph_capture_pass);
+        }
+        
+        result = graph_compile(func, graph);
+    }
+    
+    if(result)
+    {
+        func->render_pass = graph_render_pass(graph, func->graph_main_pass);
+        func->sprite_render_pass = func->resolution_enabled ?
+            graph_render_pass(graph, func->graph_overlay_pass) : func->render_pass;
+        func->printf("Depth format %d, depth prepass %s\n", func->depth_format, func->app_info.depth_prepass ? "on" : "off");
+    }
+    
+    return result;
 }
 
 bool init_framebuffers(Interface *func)
 {
     VkResult result = VK_ERROR_INITIALIZATION_FAILED;
     VkImageViewCreateInfo image_view_create_info = {0};
-    VkFramebufferCreateInfo framebuffer_create_info = {0};
     
     image_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     image_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
@@ -438,14 +1178,6 @@ bool init_framebuffers(Interface *func)
     image_view_create_info.subresourceRange.baseArrayLayer = 0;
     image_view_create_info.subresourceRange.layerCount = 1;
     
-    framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    framebuffer_create_info.renderPass = func->render_pass;
-    framebuffer_create_info.attachmentCount = 1;
-    framebuffer_create_info.width = func->swapchain_extent.width;
-    framebuffer_create_info.height = func->swapchain_extent.height;
-    framebuffer_create_info.layers = 1;
-    
-    
     for(uint32_t i = 0; i < func->swapchain_image_count; i++)
     {
         image_view_create_info.image = func->swapchain_images[i];
@@ -454,59 +1186,174 @@ bool init_framebuffers(Interface *func)
         if(result != VK_SUCCESS)
         {
             func->printf("Failed to create image view %d\n", result);
+            break;
         }
-        else
+    }
+    
+    /* Framebuffers and transient resources need the swapchain views */
+    if(result == VK_SUCCESS && !graph_create_resources(func, func->render_graph))
+    {
+        result = VK_ERROR_INITIALIZATION_FAILED;
+    }
+    
+    if(result == VK_SUCCESS && func->gpu_cull_enabled)
+    {
+        gpu_cull_write_descriptors(func, graph_image_view(func->render_graph, func->graph_depth, 0));
+    }
+    
+    return result == VK_SUCCESS;
+}
+
+typedef struct
+{
+    const char *filename;
+    /* Missing optional files only disable the feature using them */
+    bool optional;
+    void *data;
+    size_t size;
+} ShaderFile;
+
+enum
+{
+    SHADER_FILE_VERT,
+    SHADER_FILE_FRAG,
+    SHADER_FILE_CULL,
+    SHADER_FILE_HIZ,
+    SHADER_FILE_SPRITE_VERT,
+    SHADER_FILE_SPRITE_FRAG,
+    SHADER_FILE_LIGHT_CLUSTER,
+    SHADER_FILE_LIT_FRAG,
+    SHADER_FILE_MESH_VERT,
+    SHADER_FILE_COUNT
+};
+
+/* Loaded by init_shader_files, which has no dependency on the
+ * device so file I/O happens while the device is being created */
+static ShaderFile shader_files[SHADER_FILE_COUNT] =
+{
+    [SHADER_FILE_VERT] = {"data/shaders/vert.spirv"},
+    [SHADER_FILE_FRAG] = {"data/shaders/frag.spirv"},
+    [SHADER_FILE_CULL] = {"data/shaders/cull.spirv", true},
+    [SHADER_FILE_HIZ] = {"data/shaders/hiz.spirv", true},
+    [SHADER_FILE_SPRITE_VERT] = {"data/shaders/sprite_vert.spirv", true},
+    [SHADER_FILE_SPRITE_FRAG] = {"data/shaders/sprite_frag.spirv", true},
+    [SHADER_FILE_LIGHT_CLUSTER] = {"data/shaders/light_cluster.spirv", true},
+    [SHADER_FILE_LIT_FRAG] = {"data/shaders/lit_frag.spirv", true},
+    [SHADER_FILE_MESH_VERT] = {"data/shaders/mesh_vert.spirv", true},
+};
+
+bool init_shader_files(Interface *func)
+{
+    bool result = true;
+    
+    for(uint32_t i = 0; i < SHADER_FILE_COUNT; i++)
+    {
+        util_load_whole_file(func, shader_files[i].filename, &shader_files[i].data, &shader_files[i].size);
+        
+        if(!shader_files[i].data && shader_files[i].optional)
         {
-            framebuffer_create_info.pAttachments = &func->swapchain_image_views[i];
-            result = func->vkCreateFramebuffer(func->device, &framebuffer_create_info, 0, &func->framebuffers[i]);
+            func->printf("Shader %s not found\n", shader_files[i].filename);
         }
-
-        if(result != VK_SUCCESS)
+        else if(!shader_files[i].data)
         {
-            break;
+            func->printf("Failed to load shader %s\n", shader_files[i].filename);
+            result = false;
         }
     }
     
-    return result == VK_SUCCESS;
+    /* Checked against the device when the render graph is declared */
+    func->gpu_cull_enabled = shader_files[SHADER_FILE_CULL].data && shader_files[SHADER_FILE_HIZ].data;
+    func->lights_enabled = shader_files[SHADER_FILE_LIGHT_CLUSTER].data && shader_files[SHADER_FILE_LIT_FRAG].data;
+    
+    return result;
 }
 
 bool init_shaders(Interface *func)
 {
     VkResult result = VK_ERROR_INITIALIZATION_FAILED;
     VkShaderModuleCreateInfo shader_create_info = {0}; 
-    void *vert_shader_data = NULL;
-    size_t vert_shader_size = 0;
-    void *frag_shader_data = NULL;
-    size_t frag_shader_size = 0;
     
-    util_load_whole_file(func, "data/shaders/vert.spirv", &vert_shader_data, &vert_shader_size);
-    util_load_whole_file(func, "data/shaders/frag.spirv", &frag_shader_data, &frag_shader_size);
+    shader_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shader_create_info.codeSize = shader_files[SHADER_FILE_VERT].size;
+    shader_create_info.pCode = shader_files[SHADER_FILE_VERT].data;
     
-    if(!vert_shader_data || !frag_shader_data)
+    result = func->vkCreateShaderModule(func->device, &shader_create_info, 0, &func->vert_shader);
+    
+    if(result != VK_SUCCESS)
     {
-        func->printf("Failed to load vertex or fragment shader\n");
+        func->printf("Failed to create vert shader module\n");
     }
     else
     {
-        shader_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        shader_create_info.codeSize = vert_shader_size;
-        shader_create_info.pCode = vert_shader_data;
+        shader_create_info.codeSize = shader_files[SHADER_FILE_FRAG].size;
+        shader_create_info.pCode = shader_files[SHADER_FILE_FRAG].data;
+        
+        result = func->vkCreateShaderModule(func->device, &shader_create_info, 0, &func->frag_shader);
+    }
+    
+    if(result == VK_SUCCESS && shader_files[SHADER_FILE_CULL].data && shader_files[SHADER_FILE_HIZ].data)
+    {
+        shader_create_info.codeSize = shader_files[SHADER_FILE_CULL].size;
+        shader_create_info.pCode = shader_files[SHADER_FILE_CULL].data;
         
-        result = func->vkCreateShaderModule(func->device, &shader_create_info, 0, &func->vert_shader);
+        result = func->vkCreateShaderModule(func->device, &shader_create_info, 0, &func->cull_shader);
         
-        if(result != VK_SUCCESS)
+        if(result == VK_SUCCESS)
         {
-            func->printf("Failed to create vert shader module\n");
+            shader_create_info.codeSize = shader_files[SHADER_FILE_HIZ].size;
+            shader_create_info.pCode = shader_files[SHADER_FILE_HIZ].data;
+            
+            result = func->vkCreateShaderModule(func->device, &shader_create_info, 0, &func->hiz_shader);
         }
-        else
+    }
+    
+    if(result == VK_SUCCESS && shader_files[SHADER_FILE_SPRITE_VERT].data && shader_files[SHADER_FILE_SPRITE_FRAG].data)
+    {
+        shader_create_info.codeSize = shader_files[SHADER_FILE_SPRITE_VERT].size;
+        shader_create_info.pCode = shader_files[SHADER_FILE_SPRITE_VERT].data;
+        
+        result = func->vkCreateShaderModule(func->device, &shader_create_info, 0, &func->sprite_vert_shader);
+        
+        if(result == VK_SUCCESS)
         {
-            shader_create_info.codeSize = frag_shader_size;
-            shader_create_info.pCode = frag_shader_data;
+            shader_create_info.codeSize = shader_files[SHADER_FILE_SPRITE_FRAG].size;
+            shader_create_info.pCode = shader_files[SHADER_FILE_SPRITE_FRAG].data;
             
-            result = func->vkCreateShaderModule(func->device, &shader_create_info, 0, &func->frag_shader);
+            result = func->vkCreateShaderModule(func->device, &shader_create_info, 0, &func->sprite_frag_shader);
         }
     }
     
+    if(result == VK_SUCCESS && shader_files[SHADER_FILE_LIGHT_CLUSTER].data && shader_files[SHADER_FILE_LIT_FRAG].data)
+    {
+        shader_create_info.codeSize = shader_files[SHADER_FILE_LIGHT_CLUSTER].size;
+        shader_create_info.pCode = shader_files[SHADER_FILE_LIGHT_CLUSTER].data;
+        
+        result = func->vkCreateShaderModule(func->device, &shader_create_info, 0, &func->light_cluster_shader);
+        
+        if(result == VK_SUCCESS)
+        {
+            shader_create_info.codeSize = shader_files[SHADER_FILE_LIT_FRAG].size;
+            shader_create_info.pCode = shader_files[SHADER_FILE_LIT_FRAG].data;
+            
+            result = func->vkCreateShaderModule(func->device, &shader_create_info, 0, &func->lit_frag_shader);
+        }
+    }
+    
+    if(result == VK_SUCCESS && shader_files[SHADER_FILE_MESH_VERT].data)
+    {
+        shader_create_info.codeSize = shader_files[SHADER_FILE_MESH_VERT].size;
+        shader_create_info.pCode = shader_files[SHADER_FILE_MESH_VERT].data;
+        
+        result = func->vkCreateShaderModule(func->device, &shader_create_info, 0, &func->mesh_vert_shader);
+    }
+    
+    /* The modules keep their own copy of the code */
+    for(uint32_t i = 0; i < SHADER_FILE_COUNT; i++)
+    {
+        func->free(shader_files[i].data);
+        shader_files[i].data = NULL;
+    }
+    
     return result == VK_SUCCESS;
 }
 
@@ -520,11 +1367,16 @@ bool init_pipeline(Interface *func)
     VkPipelineViewportStateCreateInfo viewport_state = {0};
     VkPipelineMultisampleStateCreateInfo multisample_state = {0};
     VkPipelineColorBlendStateCreateInfo color_blend_state = {0};
+    VkPipelineDepthStencilStateCreateInfo depth_stencil_state = {0};
     VkPipelineDynamicStateCreateInfo dynamic_state_create_info = {0};
     VkPipelineLayoutCreateInfo pipeline_layout_create_info = {0};
     VkGraphicsPipelineCreateInfo pipeline_create_info = {0};
     VkPipelineColorBlendAttachmentState color_blend_attachment_state[1] = {0};
     VkDynamicState dynamic_states[2] = {0};
+    VkDescriptorSetLayout set_layouts[2] = {func->frame_set_layout, func->bindless_set_layout};
+    VkPushConstantRange push_range = {VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshDrawConstants)};
+    /* Meshes pull their vertices through the bindless set */
+    bool meshes = func->mesh_vert_shader && func->bindless_supported;
     
     shader_stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     shader_stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
@@ -533,7 +1385,8 @@ bool init_pipeline(Interface *func)
     
     shader_stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     shader_stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    shader_stages[1].module = func->frag_shader;
+    /* The lit shader reads the light clusters through the bindless set */
+    shader_stages[1].module = func->lights_enabled ? func->lit_frag_shader : func->frag_shader;
     shader_stages[1].pName = "main";
     
     vertex_input_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -582,6 +1435,14 @@ bool init_pipeline(Interface *func)
     color_blend_attachment_state[0].alphaBlendOp = VK_BLEND_OP_ADD;
     color_blend_attachment_state[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
     
+    /* After a prepass the depth buffer is final, LESS_OR_EQUAL rather
+     * than EQUAL keeps this robust against position variance between
+     * the two pipelines                                               */
+    depth_stencil_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil_state.depthTestEnable = VK_TRUE;
+    depth_stencil_state.depthWriteEnable = func->app_info.depth_prepass ? VK_FALSE : VK_TRUE;
+    depth_stencil_state.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    
     dynamic_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
     dynamic_state_create_info.dynamicStateCount = 2;
     dynamic_state_create_info.pDynamicStates = dynamic_states;
@@ -590,6 +1451,10 @@ bool init_pipeline(Interface *func)
     dynamic_states[1] = VK_DYNAMIC_STATE_SCISSOR;
     
     pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_create_info.setLayoutCount = func->bindless_supported ? 2 : 1;
+    pipeline_layout_create_info.pSetLayouts = set_layouts;
+    pipeline_layout_create_info.pushConstantRangeCount = 1;
+    pipeline_layout_create_info.pPushConstantRanges = &push_range;
     
     result = func->vkCreatePipelineLayout(func->device, &pipeline_layout_create_info, 0, &func->pipeline_layout);
     
@@ -608,6 +1473,7 @@ bool init_pipeline(Interface *func)
         pipeline_create_info.pViewportState = &viewport_state;
         pipeline_create_info.pRasterizationState = &rasteriation_state;
         pipeline_create_info.pMultisampleState = &multisample_state;
+        pipeline_create_info.pDepthStencilState = &depth_stencil_state;
         pipeline_create_info.pColorBlendState = &color_blend_state;
         pipeline_create_info.pDynamicState = &dynamic_state_create_info;
         pipeline_create_info.layout = func->pipeline_layout;
@@ -617,5 +1483,38 @@ bool init_pipeline(Interface *func)
             func->device, VK_NULL_HANDLE, 1, &pipeline_create_info, 0, &func->pipeline);
     }
     
+    /* Same state with the mesh vertex stage */
+    if(result == VK_SUCCESS && meshes)
+    {
+        shader_stages[0].module = func->mesh_vert_shader;
+        
+        result = func->vkCreateGraphicsPipelines(
+            func->device, VK_NULL_HANDLE, 1, &pipeline_create_info, 0, &func->mesh_pipeline);
+        
+        shader_stages[0].module = func->vert_shader;
+    }
+    
+    /* The prepass only runs the vertex stage and writes depth */
+    if(result == VK_SUCCESS && func->graph_prepass != GRAPH_INVALID)
+    {
+        depth_stencil_state.depthWriteEnable = VK_TRUE;
+        depth_stencil_state.depthCompareOp = VK_COMPARE_OP_LESS;
+        color_blend_state.attachmentCount = 0;
+        
+        pipeline_create_info.stageCount = 1;
+        pipeline_create_info.renderPass = graph_render_pass(func->render_graph, func->graph_prepass);
+        
+        result = func->vkCreateGraphicsPipelines(
+            func->device, VK_NULL_HANDLE, 1, &pipeline_create_info, 0, &func->prepass_pipeline);
+        
+        if(result == VK_SUCCESS && meshes)
+        {
+            shader_stages[0].module = func->mesh_vert_shader;
+            
+            result = func->vkCreateGraphicsPipelines(
+                func->device, VK_NULL_HANDLE, 1, &pipeline_create_info, 0, &func->mesh_prepass_pipeline);
+        }
+    }
+    
     return result == VK_SUCCESS;
 }
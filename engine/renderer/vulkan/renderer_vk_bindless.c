@@ -0,0 +1,278 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "interface.h"
+#include "renderer_int.h"
+
+/* Every texture and storage buffer lives in one update-after-bind set
+ * that stays bound for the whole frame. Materials refer to resources
+ * by their index in it, so changing textures never needs a new
+ * descriptor set or breaks up a batch.
+ *
+ * Released indices go back to the free list only once the GPU is done
+ * with every submission that could still reference them.              */
+
+static bool prv_create_samplers(Interface *func)
+{
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    VkSamplerCreateInfo sampler_create_info = {0};
+    
+    sampler_create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_create_info.magFilter = VK_FILTER_LINEAR;
+    sampler_create_info.minFilter = VK_FILTER_LINEAR;
+    sampler_create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_create_info.anisotropyEnable = func->physical_device_features.samplerAnisotropy;
+    sampler_create_info.maxAnisotropy = MIN(16.0f, func->physical_device_properties.limits.maxSamplerAnisotropy);
+    sampler_create_info.maxLod = VK_LOD_CLAMP_NONE;
+    
+    result = func->vkCreateSampler(func->device, &sampler_create_info, 0, &func->bindless_samplers[BINDLESS_SAMPLER_LINEAR]);
+    
+    if(result == VK_SUCCESS)
+    {
+        sampler_create_info.magFilter = VK_FILTER_NEAREST;
+        sampler_create_info.minFilter = VK_FILTER_NEAREST;
+        sampler_create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_create_info.anisotropyEnable = VK_FALSE;
+        sampler_create_info.maxAnisotropy = 1.0f;
+        
+        result = func->vkCreateSampler(func->device, &sampler_create_info, 0, &func->bindless_samplers[BINDLESS_SAMPLER_NEAREST]);
+    }
+    
+    return result == VK_SUCCESS;
+}
+
+static bool prv_create_heap(Interface *func, BindlessHeap *heap, uint32_t capacity)
+{
+    *heap = (BindlessHeap) {0};
+    heap->free_list = func->malloc(capacity * sizeof(uint32_t));
+    
+    if(heap->free_list)
+    {
+        heap->capacity = capacity;
+    }
+    
+    return heap->free_list != NULL;
+}
+
+bool init_bindless(Interface *func)
+{
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    VkPhysicalDeviceDescriptorIndexingProperties indexing_properties = {0};
+    VkPhysicalDeviceProperties2 properties2 = {0};
+    VkDescriptorSetLayoutBinding bindings[3] = {0};
+    VkDescriptorBindingFlags binding_flags[3] = {0};
+    VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_create_info = {0};
+    VkDescriptorSetLayoutCreateInfo layout_create_info = {0};
+    VkDescriptorPoolSize pool_sizes[3] = {0};
+    VkDescriptorPoolCreateInfo pool_create_info = {0};
+    VkDescriptorSetAllocateInfo set_alloc_info = {0};
+    uint32_t image_count, buffer_count;
+    
+    if(!func->bindless_supported)
+    {
+        /* Not fatal, pipelines are simply created without set 1 */
+        func->printf("Descriptor indexing not supported, bindless resources disabled\n");
+        result = VK_SUCCESS;
+    }
+    else
+    {
+        indexing_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &indexing_properties;
+        
+        func->vkGetPhysicalDeviceProperties2(func->physical_device, &properties2);
+        
+        image_count = MIN(BINDLESS_MAX_IMAGES, MIN(
+            indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages,
+            indexing_properties.maxPerStageDescriptorUpdateAfterBindSampledImages));
+        buffer_count = MIN(BINDLESS_MAX_BUFFERS, MIN(
+            indexing_properties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+            indexing_properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers));
+        
+        if(prv_create_samplers(func))
+        {
+            bindings[BINDLESS_IMAGE].binding = BINDLESS_IMAGE;
+            bindings[BINDLESS_IMAGE].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            bindings[BINDLESS_IMAGE].descriptorCount = image_count;
+            bindings[BINDLESS_IMAGE].stageFlags = VK_SHADER_STAGE_ALL;
+            
+            bindings[BINDLESS_BUFFER].binding = BINDLESS_BUFFER;
+            bindings[BINDLESS_BUFFER].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[BINDLESS_BUFFER].descriptorCount = buffer_count;
+            bindings[BINDLESS_BUFFER].stageFlags = VK_SHADER_STAGE_ALL;
+            
+            bindings[BINDLESS_SAMPLER_BINDING].binding = BINDLESS_SAMPLER_BINDING;
+            bindings[BINDLESS_SAMPLER_BINDING].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+            bindings[BINDLESS_SAMPLER_BINDING].descriptorCount = BINDLESS_SAMPLER_COUNT;
+            bindings[BINDLESS_SAMPLER_BINDING].stageFlags = VK_SHADER_STAGE_ALL;
+            bindings[BINDLESS_SAMPLER_BINDING].pImmutableSamplers = func->bindless_samplers;
+            
+            binding_flags[BINDLESS_IMAGE] =
+                VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+                VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+            binding_flags[BINDLESS_BUFFER] = binding_flags[BINDLESS_IMAGE];
+            
+            binding_flags_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+            binding_flags_create_info.bindingCount = 3;
+            binding_flags_create_info.pBindingFlags = binding_flags;
+            
+            layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            layout_create_info.pNext = &binding_flags_create_info;
+            layout_create_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+            layout_create_info.bindingCount = 3;
+            layout_create_info.pBindings = bindings;
+            
+            result = func->vkCreateDescriptorSetLayout(func->device, &layout_create_info, 0, &func->bindless_set_layout);
+        }
+        
+        if(result == VK_SUCCESS)
+        {
+            pool_sizes[0] = (VkDescriptorPoolSize) {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, image_count};
+            pool_sizes[1] = (VkDescriptorPoolSize) {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffer_count};
+            pool_sizes[2] = (VkDescriptorPoolSize) {VK_DESCRIPTOR_TYPE_SAMPLER, BINDLESS_SAMPLER_COUNT};
+            
+            pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+            pool_create_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+            pool_create_info.maxSets = 1;
+            pool_create_info.poolSizeCount = 3;
+            pool_create_info.pPoolSizes = pool_sizes;
+            
+            result = func->vkCreateDescriptorPool(func->device, &pool_create_info, 0, &func->bindless_descriptor_pool);
+        }
+        
+        if(result == VK_SUCCESS)
+        {
+            set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            set_alloc_info.descriptorPool = func->bindless_descriptor_pool;
+            set_alloc_info.descriptorSetCount = 1;
+            set_alloc_info.pSetLayouts = &func->bindless_set_layout;
+            
+            result = func->vkAllocateDescriptorSets(func->device, &set_alloc_info, &func->bindless_set);
+        }
+        
+        if(result == VK_SUCCESS)
+        {
+            if(!prv_create_heap(func, &func->bindless_heaps[BINDLESS_IMAGE], image_count) ||
+               !prv_create_heap(func, &func->bindless_heaps[BINDLESS_BUFFER], buffer_count))
+            {
+                result = VK_ERROR_OUT_OF_HOST_MEMORY;
+            }
+        }
+        
+        if(result == VK_SUCCESS)
+        {
+            func->printf("Bindless set: %u images, %u storage buffers\n", image_count, buffer_count);
+        }
+    }
+    
+    return result == VK_SUCCESS;
+}
+
+static uint32_t prv_heap_alloc(BindlessHeap *heap)
+{
+    uint32_t index = BINDLESS_INVALID;
+    
+    /* Reusing freed indices first keeps the used range compact */
+    if(heap->free_count > 0)
+    {
+        heap->free_count -= 1;
+        index = heap->free_list[heap->free_count];
+    }
+    else if(heap->next < heap->capacity)
+    {
+        index = heap->next;
+        heap->next += 1;
+    }
+    
+    return index;
+}
+
+static void prv_release_index(Interface *func, void *data)
+{
+    uintptr_t packed = (uintptr_t)data;
+    BindlessHeap *heap = &func->bindless_heaps[packed % BINDLESS_TYPE_COUNT];
+    
+    heap->free_list[heap->free_count] = packed / BINDLESS_TYPE_COUNT;
+    heap->free_count += 1;
+}
+
+static void prv_write(Interface *func, BindlessType type, uint32_t index,
+    const VkDescriptorImageInfo *image_info, const VkDescriptorBufferInfo *buffer_info)
+{
+    VkWriteDescriptorSet write = {0};
+    
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = func->bindless_set;
+    write.dstBinding = type;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType = type == BINDLESS_IMAGE ? VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pImageInfo = image_info;
+    write.pBufferInfo = buffer_info;
+    
+    func->vkUpdateDescriptorSets(func->device, 1, &write, 0, NULL);
+}
+
+/* Returns the index shaders use to reach the image, or BINDLESS_INVALID.
+ * The image has to stay alive until the index is released.             */
+uint32_t renderer_bindless_add_image(Interface *func, VkImageView image_view, VkImageLayout layout)
+{
+    uint32_t index = BINDLESS_INVALID;
+    VkDescriptorImageInfo image_info = {VK_NULL_HANDLE, image_view, layout};
+    
+    if(func->bindless_supported)
+    {
+        index = prv_heap_alloc(&func->bindless_heaps[BINDLESS_IMAGE]);
+        
+        if(index != BINDLESS_INVALID)
+        {
+            prv_write(func, BINDLESS_IMAGE, index, &image_info, NULL);
+        }
+        else
+        {
+            func->printf("Max number of bindless images reached\n");
+        }
+    }
+    
+    return index;
+}
+
+uint32_t renderer_bindless_add_buffer(Interface *func, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+    uint32_t index = BINDLESS_INVALID;
+    VkDescriptorBufferInfo buffer_info = {buffer, offset, range};
+    
+    if(func->bindless_supported)
+    {
+        index = prv_heap_alloc(&func->bindless_heaps[BINDLESS_BUFFER]);
+        
+        if(index != BINDLESS_INVALID)
+        {
+            prv_write(func, BINDLESS_BUFFER, index, NULL, &buffer_info);
+        }
+        else
+        {
+            func->printf("Max number of bindless buffers reached\n");
+        }
+    }
+    
+    return index;
+}
+
+/* The index may still be referenced by the frame being recorded and
+ * any frame in flight, so it only becomes reusable after the next
+ * submission has completed                                          */
+void renderer_bindless_release(Interface *func, BindlessType type, uint32_t index)
+{
+    if(func->bindless_supported && index < func->bindless_heaps[type].next)
+    {
+        lifetime_defer(func, func->submit_value + 1, prv_release_index,
+            (void*)((uintptr_t)index * BINDLESS_TYPE_COUNT + type));
+    }
+}
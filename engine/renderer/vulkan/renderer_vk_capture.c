@@ -0,0 +1,430 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "interface.h"
+#include "util.h"
+#include "renderer_int.h"
+
+/* Frame capture. A transfer pass at the end of the graph copies the
+ * swapchain image into a free slot of a ring of host visible buffers.
+ * Once the submission that made the copy has completed, the slot is
+ * queued for an encoder thread that writes it out and frees it again,
+ * so the render loop never waits on the copy or the disk. A frame that
+ * finds every slot busy is dropped and counted instead.               */
+
+static bool prv_format_supported(VkFormat format, bool *bgra)
+{
+    bool supported = true;
+    
+    switch(format)
+    {
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+            *bgra = true;
+            break;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            *bgra = false;
+            break;
+        default:
+            supported = false;
+            break;
+    }
+    
+    return supported;
+}
+
+/* Checks the surface directly so it doesn't have to wait for the
+ * swapchain, init_swapchain adds the usage on the same condition  */
+bool capture_supported(Interface *func)
+{
+    const char *reason = NULL;
+    VkSurfaceCapabilitiesKHR surface_capabilities;
+    bool bgra;
+    
+    func->vkGetPhysicalDeviceSurfaceCapabilitiesKHR(func->physical_device, func->surface, &surface_capabilities);
+    
+    if(!(surface_capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
+    {
+        reason = "swapchain images can't be copied from";
+    }
+    else if(!prv_format_supported(func->surface_format.format, &bgra))
+    {
+        reason = "surface format isn't 8 bit RGBA";
+    }
+    
+    if(reason)
+    {
+        func->printf("Frame capture disabled, %s\n", reason);
+    }
+    
+    return reason == NULL;
+}
+
+/* Cached memory keeps the encoder's reads fast, it only needs an
+ * invalidate when it isn't also coherent                          */
+static bool prv_create_slots(Interface *func, CaptureState *capture)
+{
+    bool result = true;
+    uint32_t memory_type;
+    void *mapped = NULL;
+    CaptureSlot *slot;
+    
+    capture->slot_count = func->swapchain_image_count + CAPTURE_ENCODE_SLOTS;
+    capture->slot_count = capture->slot_count < MAX_CAPTURE_SLOTS ? capture->slot_count : MAX_CAPTURE_SLOTS;
+    
+    for(uint32_t i = 0; i < capture->slot_count && result; i++)
+    {
+        slot = &capture->slots[i];
+        
+        result = create_buffer(
+            func, capture->frame_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+            &slot->buffer, &slot->memory, &memory_type);
+        
+        if(result)
+        {
+            result = func->vkMapMemory(func->device, slot->memory, 0, VK_WHOLE_SIZE, 0, &mapped) == VK_SUCCESS;
+            slot->mapped = mapped;
+            slot->coherent = (func->memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+            atomic_init(&slot->state, CAPTURE_SLOT_FREE);
+        }
+    }
+    
+    if(!result)
+    {
+        func->printf("Failed to create capture buffers\n");
+    }
+    
+    return result;
+}
+
+static bool prv_open_output(Interface *func, CaptureState *capture)
+{
+    bool result = true;
+    const char *path = func->app_info.capture_path;
+    size_t length = strlen(path);
+    
+    capture->png = length > 4 && strcmp(path + length - 4, ".png") == 0;
+    
+    /* Room for the frame number and extension after the stem */
+    if(capture->png)
+    {
+        capture->stem_length = length - 4;
+        capture->filename = func->malloc(length + 16);
+        result = capture->filename != NULL;
+    }
+    else
+    {
+        capture->stream = func->fopen(path, "wb");
+        result = capture->stream != NULL;
+    }
+    
+    if(!result)
+    {
+        func->printf("Failed to open capture output %s\n", path);
+    }
+    
+    return result;
+}
+
+/* Writes out a slot the GPU has finished with, on the encoder thread */
+static bool prv_encode(Interface *func, CaptureState *capture, CaptureSlot *slot)
+{
+    bool result;
+    uint8_t *pixels = slot->mapped;
+    size_t pixel_count = (size_t)capture->extent.width * capture->extent.height;
+    uint8_t red;
+    
+    if(capture->png)
+    {
+        snprintf(capture->filename, capture->stem_length + 16, "%.*s_%06u.png",
+            (int)capture->stem_length, func->app_info.capture_path, slot->frame);
+        result = util_write_png(func, capture->filename, pixels, capture->extent.width, capture->extent.height, capture->bgra);
+    }
+    else
+    {
+        /* Raw frames are RGBA with the alpha the compositor ignores
+         * made opaque, the mapped copy is rewritten in place         */
+        for(size_t i = 0; i < pixel_count; i++)
+        {
+            red = pixels[i * 4 + (capture->bgra ? 2 : 0)];
+            pixels[i * 4 + 2] = pixels[i * 4 + (capture->bgra ? 0 : 2)];
+            pixels[i * 4 + 0] = red;
+            pixels[i * 4 + 3] = 0xFF;
+        }
+        
+        result = func->fwrite(pixels, 1, capture->frame_size, capture->stream) == capture->frame_size;
+        result = func->fflush(capture->stream) == 0 && result;
+    }
+    
+    return result;
+}
+
+static int prv_capture_worker(void *data)
+{
+    Interface *func = data;
+    CaptureState *capture = func->capture;
+    uint32_t limit = func->app_info.capture_frames;
+    uint32_t handled = 0;
+    uint32_t written, failures;
+    uint64_t start;
+    CaptureSlot *slot;
+    bool stopped = false;
+    
+    while((limit == 0 || handled < limit) && !stopped)
+    {
+        func->sem_wait(capture->ready);
+        
+        if(capture->queue_tail != atomic_load_explicit(&capture->queue_head, memory_order_acquire))
+        {
+            slot = &capture->slots[capture->queue[capture->queue_tail % MAX_CAPTURE_SLOTS]];
+            capture->queue_tail += 1;
+            
+            start = func->get_perf_counter();
+            
+            if(prv_encode(func, capture, slot))
+            {
+                atomic_fetch_add(&capture->frames_written, 1);
+            }
+            else
+            {
+                atomic_fetch_add(&capture->write_failures, 1);
+            }
+            
+            atomic_fetch_add(&capture->encode_ticks, func->get_perf_counter() - start);
+            atomic_store_explicit(&slot->state, CAPTURE_SLOT_FREE, memory_order_release);
+            handled += 1;
+        }
+        else
+        {
+            /* Every queued slot is posted once, so waking up to an
+             * empty queue can only be capture_shutdown              */
+            stopped = atomic_load_explicit(&capture->stopping, memory_order_acquire);
+        }
+    }
+    
+    /* Reached once the frame limit is met or at shutdown */
+    written = atomic_load(&capture->frames_written);
+    failures = atomic_load(&capture->write_failures);
+    
+    if(capture->stream)
+    {
+        func->fclose(capture->stream);
+        capture->stream = NULL;
+    }
+    
+    func->printf("Captured %u frames to %s, %u dropped, %u failed, %.2f ms average encode\n",
+        written, func->app_info.capture_path, atomic_load(&capture->frames_dropped), failures,
+        handled > 0 ? atomic_load(&capture->encode_ticks) * 1000.0 / func->get_perf_frequency() / handled : 0.0);
+    
+    return 0;
+}
+
+bool init_capture(Interface *func)
+{
+    bool result = true;
+    CaptureState *capture = NULL;
+    
+    func->capture = NULL;
+    
+    if(func->capture_enabled)
+    {
+        capture = func->malloc(sizeof(CaptureState));
+        result = capture != NULL;
+    }
+    
+    if(result && capture)
+    {
+        memset(capture, 0, sizeof(CaptureState));
+        func->capture = capture;
+        capture->extent = func->swapchain_extent;
+        capture->frame_size = (VkDeviceSize)capture->extent.width * capture->extent.height * 4;
+        capture->current_slot = CAPTURE_INVALID;
+        prv_format_supported(func->surface_format.format, &capture->bgra);
+        atomic_init(&capture->queue_head, 0);
+        atomic_init(&capture->stopping, false);
+        atomic_init(&capture->frames_dropped, 0);
+        atomic_init(&capture->frames_written, 0);
+        atomic_init(&capture->write_failures, 0);
+        atomic_init(&capture->encode_ticks, 0);
+        
+        result = prv_create_slots(func, capture);
+        result = result && prv_open_output(func, capture);
+        
+        if(result)
+        {
+            capture->ready = func->create_sem(0);
+            result = capture->ready != NULL;
+        }
+        
+        if(result)
+        {
+            capture->thread = func->create_thread(prv_capture_worker, "frame capture", func);
+            result = capture->thread != NULL;
+        }
+    }
+    
+    if(result && capture)
+    {
+        func->printf("Capturing %s frames from frame %u to %s, %u readback slots of %llu bytes\n",
+            capture->png ? "PNG" : "raw RGBA", func->app_info.capture_start, func->app_info.capture_path,
+            capture->slot_count, (unsigned long long)capture->frame_size);
+    }
+    
+    return result;
+}
+
+/* Hands the copies of completed submissions to the encoder, oldest
+ * first so raw frames are written in order                          */
+void capture_collect(Interface *func)
+{
+    CaptureState *capture = func->capture;
+    uint64_t completed = 0;
+    uint32_t head;
+    CaptureSlot *slot;
+    VkMappedMemoryRange range = {0};
+    
+    if(func->capture_enabled && capture->pending_count > 0)
+    {
+        completed = lifetime_completed_value(func);
+    }
+    
+    while(func->capture_enabled && capture->pending_count > 0 &&
+        capture->slots[capture->pending[capture->pending_head]].value <= completed)
+    {
+        slot = &capture->slots[capture->pending[capture->pending_head]];
+        
+        if(!slot->coherent)
+        {
+            range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+            range.memory = slot->memory;
+            range.offset = 0;
+            range.size = VK_WHOLE_SIZE;
+            func->vkInvalidateMappedMemoryRanges(func->device, 1, &range);
+        }
+        
+        atomic_store_explicit(&slot->state, CAPTURE_SLOT_READY, memory_order_relaxed);
+        
+        head = atomic_load_explicit(&capture->queue_head, memory_order_relaxed);
+        capture->queue[head % MAX_CAPTURE_SLOTS] = capture->pending[capture->pending_head];
+        atomic_store_explicit(&capture->queue_head, head + 1, memory_order_release);
+        func->sem_post(capture->ready);
+        
+        capture->pending_head = (capture->pending_head + 1) % MAX_CAPTURE_SLOTS;
+        capture->pending_count -= 1;
+    }
+}
+
+/* Picks the slot this frame is copied into, if it is captured at all */
+void capture_begin_frame(Interface *func, uint32_t image_index)
+{
+    CaptureState *capture = func->capture;
+    uint32_t limit = func->app_info.capture_frames;
+    uint32_t frame;
+    
+    if(func->capture_enabled)
+    {
+        frame = capture->frames_seen;
+        capture->frames_seen += 1;
+        capture->current_slot = CAPTURE_INVALID;
+        capture->current_image = image_index;
+        
+        if(frame >= func->app_info.capture_start && (limit == 0 || capture->frames_captured < limit))
+        {
+            for(uint32_t i = 0; i < capture->slot_count && capture->current_slot == CAPTURE_INVALID; i++)
+            {
+                if(atomic_load_explicit(&capture->slots[i].state, memory_order_acquire) == CAPTURE_SLOT_FREE)
+                {
+                    capture->current_slot = i;
+                }
+            }
+            
+            /* The encoder has fallen behind, waiting for it would
+             * stall the render loop                                */
+            if(capture->current_slot == CAPTURE_INVALID)
+            {
+                atomic_fetch_add(&capture->frames_dropped, 1);
+            }
+            else
+            {
+                capture->slots[capture->current_slot].frame = frame;
+                capture->frames_captured += 1;
+            }
+        }
+    }
+}
+
+/* The graph has the image in TRANSFER_SRC_OPTIMAL and moves it back
+ * to PRESENT_SRC_KHR afterwards                                      */
+void record_capture(Interface *func, VkCommandBuffer cmd, void *data)
+{
+    CaptureState *capture = func->capture;
+    CaptureSlot *slot;
+    VkBufferImageCopy region = {0};
+    VkBufferMemoryBarrier barrier = {0};
+    
+    if(capture->current_slot != CAPTURE_INVALID)
+    {
+        slot = &capture->slots[capture->current_slot];
+        
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = (VkExtent3D) {capture->extent.width, capture->extent.height, 1};
+        
+        func->vkCmdCopyImageToBuffer(
+            cmd, func->swapchain_images[capture->current_image], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            slot->buffer, 1, &region);
+        
+        /* Waiting on the submission then makes the copy visible to the host */
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = slot->buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+        
+        func->vkCmdPipelineBarrier(
+            cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+            0, NULL, 1, &barrier, 0, NULL);
+        
+        /* Recorded into the submission renderer_draw makes next */
+        slot->value = func->submit_value + 1;
+        atomic_store_explicit(&slot->state, CAPTURE_SLOT_PENDING, memory_order_relaxed);
+        
+        capture->pending[(capture->pending_head + capture->pending_count) % MAX_CAPTURE_SLOTS] = capture->current_slot;
+        capture->pending_count += 1;
+        capture->current_slot = CAPTURE_INVALID;
+    }
+}
+
+/* Waits for the copies still in flight, lets the encoder write them
+ * out and joins it. The encoder closes the output, unless it never
+ * started.                                                          */
+void capture_shutdown(Interface *func)
+{
+    CaptureState *capture = func->capture;
+    
+    if(capture && capture->thread)
+    {
+        if(capture->pending_count > 0)
+        {
+            lifetime_wait(func, func->submit_value);
+            capture_collect(func);
+        }
+        
+        atomic_store_explicit(&capture->stopping, true, memory_order_release);
+        func->sem_post(capture->ready);
+        func->wait_thread(capture->thread, NULL);
+        capture->thread = NULL;
+    }
+    
+    if(capture && capture->stream)
+    {
+        func->fclose(capture->stream);
+        capture->stream = NULL;
+    }
+}
@@ -0,0 +1,106 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "interface.h"
+#include "renderer_int.h"
+
+bool init_compute(Interface *func)
+{
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    VkCommandPoolCreateInfo cmd_pool_create_info = {0};
+    VkCommandBufferAllocateInfo cmd_buffer_alloc_info = {0};
+    VkSemaphoreCreateInfo sem_create_info = {0};
+    
+    cmd_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    cmd_pool_create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    cmd_pool_create_info.queueFamilyIndex = func->compute_queue_family_index;
+    
+    result = func->vkCreateCommandPool(func->device, &cmd_pool_create_info, 0, &func->compute_cmd_pool);
+    
+    if(result != VK_SUCCESS)
+    {
+        func->printf("Failed to create compute command pool\n");
+    }
+    else
+    {
+        cmd_buffer_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cmd_buffer_alloc_info.commandPool = func->compute_cmd_pool;
+        cmd_buffer_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        cmd_buffer_alloc_info.commandBufferCount = MAX_FRAMES;
+        
+        result = func->vkAllocateCommandBuffers(func->device, &cmd_buffer_alloc_info, func->compute_cmd_buffers);
+    }
+    
+    sem_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    
+    for(size_t i = 0; i < MAX_FRAMES && result == VK_SUCCESS; i++)
+    {
+        result = func->vkCreateSemaphore(func->device, &sem_create_info, 0, &func->compute_finished_sem[i]);
+    }
+    
+    if(result == VK_SUCCESS)
+    {
+        func->printf("Async compute on queue family %u (graphics on %u)\n",
+            func->compute_queue_family_index, func->queue_family_index);
+    }
+    
+    return result == VK_SUCCESS;
+}
+
+/* Passes run in registration order on the compute queue every frame.
+ * The graphics submission of the same frame waits for them. Buffers
+ * from create_buffer can be shared with graphics work as they are,
+ * graph resources and images are owned by the graphics family.      */
+bool renderer_add_compute_pass(Interface *func, PFN_record_compute record, void *data)
+{
+    bool result = false;
+    
+    if(func->compute_pass_count < MAX_COMPUTE_PASSES)
+    {
+        func->compute_passes[func->compute_pass_count] = (ComputePass) {record, data};
+        func->compute_pass_count += 1;
+        result = true;
+    }
+    else
+    {
+        func->printf("Max number of compute passes reached\n");
+    }
+    
+    return result;
+}
+
+bool record_compute(Interface *func, uint32_t frame)
+{
+    VkCommandBuffer cmd = func->compute_cmd_buffers[frame];
+    VkCommandBufferBeginInfo begin_info = {0};
+    VkSubmitInfo submit_info = {0};
+    bool submitted = false;
+    
+    if(func->compute_pass_count > 0)
+    {
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        
+        func->vkBeginCommandBuffer(cmd, &begin_info);
+        timing_begin(func, cmd, frame, TIMING_COMPUTE);
+        
+        for(uint32_t i = 0; i < func->compute_pass_count; i++)
+        {
+            func->compute_passes[i].record(func, cmd, func->compute_passes[i].data);
+        }
+        
+        timing_end(func, cmd, frame, TIMING_COMPUTE);
+        func->vkEndCommandBuffer(cmd);
+        
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &cmd;
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores = &func->compute_finished_sem[frame];
+        
+        /* No fence, the graphics submission waits on the semaphore
+         * so the frame fence covers the compute work as well        */
+        submitted = func->vkQueueSubmit(func->compute_queue, 1, &submit_info, VK_NULL_HANDLE) == VK_SUCCESS;
+    }
+    
+    return submitted;
+}
@@ -0,0 +1,578 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "interface.h"
+#include "job.h"
+#include "cull.h"
+#include "renderer_int.h"
+
+/* Culling on the GPU, the CPU only copies bounds into the frame's
+ * partition when the scene changed. A compute pass early in the frame
+ * tests every object against the frustum and against the depth
+ * pyramid built at the end of the previous frame, and writes the
+ * indirect draws both depth and main pass consume.
+ *
+ * Occlusion uses last frame's depth seen through last frame's camera,
+ * so an object that becomes visible can show up one frame late. With
+ * VK_KHR_draw_indirect_count the visible draws are compacted, without
+ * it every object keeps a slot and culled ones draw zero instances.  */
+
+#define CULL_BOUNDS_STRIDE (2 * 4 * sizeof(float))
+
+/* Frustum culling only needs the bounds, occlusion needs to sample a
+ * depth-only format and write the pyramid as a storage image         */
+bool gpu_cull_supported(Interface *func)
+{
+    const VkPhysicalDeviceFeatures *features = &func->physical_device_features;
+    VkFormatProperties depth_properties, pyramid_properties;
+    const char *reason = NULL;
+    
+    func->vkGetPhysicalDeviceFormatProperties(func->physical_device, func->depth_format, &depth_properties);
+    func->vkGetPhysicalDeviceFormatProperties(func->physical_device, VK_FORMAT_R32_SFLOAT, &pyramid_properties);
+    
+    if(!features->multiDrawIndirect || !features->drawIndirectFirstInstance)
+    {
+        reason = "multi draw indirect not supported";
+    }
+    else if(func->depth_format != VK_FORMAT_D32_SFLOAT && func->depth_format != VK_FORMAT_D16_UNORM)
+    {
+        reason = "depth format has stencil";
+    }
+    else if(!(depth_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
+    {
+        reason = "depth can't be sampled";
+    }
+    else if(!(pyramid_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT))
+    {
+        reason = "no R32 storage images";
+    }
+    
+    if(reason)
+    {
+        func->printf("GPU culling disabled, %s\n", reason);
+    }
+    
+    return reason == NULL;
+}
+
+static bool prv_create_buffers(Interface *func)
+{
+    bool result = false;
+    uint32_t indices[3] = {0, 1, 2};
+    void *mapped = NULL;
+    VkDeviceSize alignment = func->uniform_alignment;
+    
+    func->gpu_cull_capacity = MIN(GPU_CULL_MAX_OBJECTS, func->physical_device_properties.limits.maxDrawIndirectCount);
+    func->cull_bounds_partition = (func->gpu_cull_capacity * CULL_BOUNDS_STRIDE + alignment - 1) / alignment * alignment;
+    
+    /* Written by the CPU once per change, read by a single dispatch */
+    result = create_buffer(
+        func, func->cull_bounds_partition * MAX_FRAMES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &func->cull_bounds_buffer, &func->cull_bounds_memory, NULL);
+    
+    if(result)
+    {
+        result = func->vkMapMemory(func->device, func->cull_bounds_memory, 0, VK_WHOLE_SIZE, 0, &mapped) == VK_SUCCESS;
+        func->cull_bounds_mapped = mapped;
+    }
+    
+    if(result)
+    {
+        result = create_buffer(
+            func, func->gpu_cull_capacity * sizeof(VkDrawIndexedIndirectCommand),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+            &func->draw_command_buffer, &func->draw_command_memory, NULL);
+    }
+    
+    if(result)
+    {
+        result = create_buffer(
+            func, sizeof(uint32_t),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+            &func->draw_count_buffer, &func->draw_count_memory, NULL);
+    }
+    
+    /* Indexed draws for the placeholder triangle until objects have
+     * their own geometry in a shared index buffer                   */
+    if(result)
+    {
+        result = create_buffer(
+            func, sizeof(indices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0,
+            &func->placeholder_index_buffer, &func->placeholder_index_memory, NULL);
+    }
+    
+    if(result)
+    {
+        result = func->vkMapMemory(func->device, func->placeholder_index_memory, 0, VK_WHOLE_SIZE, 0, &mapped) == VK_SUCCESS;
+    }
+    
+    if(result)
+    {
+        memcpy(mapped, indices, sizeof(indices));
+    }
+    
+    for(uint32_t i = 0; i < MAX_FRAMES; i++)
+    {
+        func->cull_bounds_generation[i] = UINT64_MAX;
+        func->cull_bounds_count[i] = 0;
+    }
+    
+    return result;
+}
+
+/* Level 0 is half the swapchain, every level holds the farthest depth
+ * of the two by two block above it down to a single texel            */
+static bool prv_create_pyramid(Interface *func)
+{
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    VkImageCreateInfo image_create_info = {0};
+    VkImageViewCreateInfo view_create_info = {0};
+    VkSamplerCreateInfo sampler_create_info = {0};
+    VkMemoryAllocateInfo alloc_info = {0};
+    VkMemoryRequirements requirements;
+    uint32_t size;
+    
+    func->hiz_extent.width = MAX(func->swapchain_extent.width / 2, 1);
+    func->hiz_extent.height = MAX(func->swapchain_extent.height / 2, 1);
+    func->hiz_levels = 1;
+    
+    for(size = MAX(func->hiz_extent.width, func->hiz_extent.height); size > 1 && func->hiz_levels < MAX_HIZ_LEVELS; size /= 2)
+    {
+        func->hiz_levels += 1;
+    }
+    
+    image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_create_info.imageType = VK_IMAGE_TYPE_2D;
+    image_create_info.format = VK_FORMAT_R32_SFLOAT;
+    image_create_info.extent = (VkExtent3D) {func->hiz_extent.width, func->hiz_extent.height, 1};
+    image_create_info.mipLevels = func->hiz_levels;
+    image_create_info.arrayLayers = 1;
+    image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_create_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+    image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    
+    result = func->vkCreateImage(func->device, &image_create_info, 0, &func->hiz_image);
+    
+    if(result == VK_SUCCESS)
+    {
+        func->vkGetImageMemoryRequirements(func->device, func->hiz_image, &requirements);
+        
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize = requirements.size;
+        alloc_info.memoryTypeIndex = find_memory_type(func, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+        
+        result = alloc_info.memoryTypeIndex == UINT32_MAX ? VK_ERROR_INITIALIZATION_FAILED :
+            func->vkAllocateMemory(func->device, &alloc_info, 0, &func->hiz_memory);
+    }
+    
+    if(result == VK_SUCCESS)
+    {
+        result = func->vkBindImageMemory(func->device, func->hiz_image, func->hiz_memory, 0);
+    }
+    
+    view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_create_info.image = func->hiz_image;
+    view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_create_info.format = VK_FORMAT_R32_SFLOAT;
+    view_create_info.subresourceRange = (VkImageSubresourceRange) {VK_IMAGE_ASPECT_COLOR_BIT, 0, func->hiz_levels, 0, 1};
+    
+    if(result == VK_SUCCESS)
+    {
+        result = func->vkCreateImageView(func->device, &view_create_info, 0, &func->hiz_view);
+    }
+    
+    /* Storage images are bound one level at a time */
+    for(uint32_t i = 0; i < func->hiz_levels && result == VK_SUCCESS; i++)
+    {
+        view_create_info.subresourceRange.baseMipLevel = i;
+        view_create_info.subresourceRange.levelCount = 1;
+        
+        result = func->vkCreateImageView(func->device, &view_create_info, 0, &func->hiz_mip_views[i]);
+    }
+    
+    if(result == VK_SUCCESS)
+    {
+        sampler_create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        sampler_create_info.magFilter = VK_FILTER_NEAREST;
+        sampler_create_info.minFilter = VK_FILTER_NEAREST;
+        sampler_create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_create_info.maxAnisotropy = 1.0f;
+        sampler_create_info.maxLod = VK_LOD_CLAMP_NONE;
+        
+        result = func->vkCreateSampler(func->device, &sampler_create_info, 0, &func->hiz_sampler);
+    }
+    
+    if(result != VK_SUCCESS)
+    {
+        func->printf("Failed to create depth pyramid with error %d\n", result);
+    }
+    
+    func->hiz_frames = 0;
+    func->hiz_initialized = false;
+    
+    return result == VK_SUCCESS;
+}
+
+static bool prv_create_descriptors(Interface *func)
+{
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    VkDescriptorSetLayoutBinding cull_bindings[4] = {0};
+    VkDescriptorSetLayoutBinding hiz_bindings[3] = {0};
+    VkDescriptorSetLayoutCreateInfo layout_create_info = {0};
+    VkDescriptorPoolSize pool_sizes[4] = {0};
+    VkDescriptorPoolCreateInfo pool_create_info = {0};
+    VkDescriptorSetAllocateInfo set_alloc_info = {0};
+    VkDescriptorSetLayout hiz_layouts[MAX_HIZ_LEVELS];
+    
+    cull_bindings[0] = (VkDescriptorSetLayoutBinding) {0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_COMPUTE_BIT};
+    cull_bindings[1] = (VkDescriptorSetLayoutBinding) {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT};
+    cull_bindings[2] = (VkDescriptorSetLayoutBinding) {2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT};
+    cull_bindings[3] = (VkDescriptorSetLayoutBinding) {3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT};
+    
+    hiz_bindings[0] = (VkDescriptorSetLayoutBinding) {0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT};
+    hiz_bindings[1] = (VkDescriptorSetLayoutBinding) {1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT};
+    hiz_bindings[2] = (VkDescriptorSetLayoutBinding) {2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT};
+    
+    layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_create_info.bindingCount = 4;
+    layout_create_info.pBindings = cull_bindings;
+    
+    result = func->vkCreateDescriptorSetLayout(func->device, &layout_create_info, 0, &func->cull_set_layout);
+    
+    if(result == VK_SUCCESS)
+    {
+        layout_create_info.bindingCount = 3;
+        layout_create_info.pBindings = hiz_bindings;
+        
+        result = func->vkCreateDescriptorSetLayout(func->device, &layout_create_info, 0, &func->hiz_set_layout);
+    }
+    
+    if(result == VK_SUCCESS)
+    {
+        pool_sizes[0] = (VkDescriptorPoolSize) {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1};
+        pool_sizes[1] = (VkDescriptorPoolSize) {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2};
+        pool_sizes[2] = (VkDescriptorPoolSize) {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 + func->hiz_levels};
+        pool_sizes[3] = (VkDescriptorPoolSize) {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2 * func->hiz_levels};
+        
+        pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_create_info.maxSets = 1 + func->hiz_levels;
+        pool_create_info.poolSizeCount = 4;
+        pool_create_info.pPoolSizes = pool_sizes;
+        
+        result = func->vkCreateDescriptorPool(func->device, &pool_create_info, 0, &func->cull_descriptor_pool);
+    }
+    
+    if(result == VK_SUCCESS)
+    {
+        set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        set_alloc_info.descriptorPool = func->cull_descriptor_pool;
+        set_alloc_info.descriptorSetCount = 1;
+        set_alloc_info.pSetLayouts = &func->cull_set_layout;
+        
+        result = func->vkAllocateDescriptorSets(func->device, &set_alloc_info, &func->cull_set);
+    }
+    
+    if(result == VK_SUCCESS)
+    {
+        for(uint32_t i = 0; i < func->hiz_levels; i++)
+        {
+            hiz_layouts[i] = func->hiz_set_layout;
+        }
+        
+        set_alloc_info.descriptorSetCount = func->hiz_levels;
+        set_alloc_info.pSetLayouts = hiz_layouts;
+        
+        result = func->vkAllocateDescriptorSets(func->device, &set_alloc_info, func->hiz_sets);
+    }
+    
+    return result == VK_SUCCESS;
+}
+
+static bool prv_create_pipelines(Interface *func)
+{
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    VkPipelineLayoutCreateInfo layout_create_info = {0};
+    VkPushConstantRange push_range = {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HizConstants)};
+    VkComputePipelineCreateInfo pipeline_create_info = {0};
+    
+    /* Set 0 is the frame set so the constants come from the ring */
+    layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_create_info.setLayoutCount = 2;
+    layout_create_info.pSetLayouts = (VkDescriptorSetLayout[]) {func->frame_set_layout, func->cull_set_layout};
+    
+    result = func->vkCreatePipelineLayout(func->device, &layout_create_info, 0, &func->cull_pipeline_layout);
+    
+    if(result == VK_SUCCESS)
+    {
+        layout_create_info.setLayoutCount = 1;
+        layout_create_info.pSetLayouts = &func->hiz_set_layout;
+        layout_create_info.pushConstantRangeCount = 1;
+        layout_create_info.pPushConstantRanges = &push_range;
+        
+        result = func->vkCreatePipelineLayout(func->device, &layout_create_info, 0, &func->hiz_pipeline_layout);
+    }
+    
+    pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_create_info.stage.pName = "main";
+    
+    if(result == VK_SUCCESS)
+    {
+        pipeline_create_info.stage.module = func->cull_shader;
+        pipeline_create_info.layout = func->cull_pipeline_layout;
+        
+        result = func->vkCreateComputePipelines(func->device, VK_NULL_HANDLE, 1, &pipeline_create_info, 0, &func->cull_pipeline);
+    }
+    
+    if(result == VK_SUCCESS)
+    {
+        pipeline_create_info.stage.module = func->hiz_shader;
+        pipeline_create_info.layout = func->hiz_pipeline_layout;
+        
+        result = func->vkCreateComputePipelines(func->device, VK_NULL_HANDLE, 1, &pipeline_create_info, 0, &func->hiz_pipeline);
+    }
+    
+    return result == VK_SUCCESS;
+}
+
+/* Creates what the passes declared in init_render_pass use and hands
+ * the handles to the graph before its resources are created          */
+bool init_gpu_cull(Interface *func)
+{
+    bool result = true;
+    
+    if(func->gpu_cull_enabled)
+    {
+        result = prv_create_buffers(func) && prv_create_pyramid(func) &&
+            prv_create_descriptors(func) && prv_create_pipelines(func);
+    }
+    
+    if(result && func->gpu_cull_enabled)
+    {
+        graph_set_buffer(func->render_graph, func->graph_draw_commands, func->draw_command_buffer);
+        graph_set_buffer(func->render_graph, func->graph_draw_count, func->draw_count_buffer);
+        graph_set_image(func->render_graph, func->graph_hiz, func->hiz_image, func->hiz_view);
+        
+        func->printf("GPU culling: up to %u objects, %u level depth pyramid, %s\n",
+            func->gpu_cull_capacity, func->hiz_levels,
+            func->vkCmdDrawIndexedIndirectCount ? "compacted draws" : "one draw per object");
+    }
+    
+    return result;
+}
+
+/* The depth buffer is a graph transient, so its view only exists once
+ * the graph has created its resources                                 */
+void gpu_cull_write_descriptors(Interface *func, VkImageView depth_view)
+{
+    VkWriteDescriptorSet writes[4 + MAX_HIZ_LEVELS * 3] = {0};
+    VkDescriptorBufferInfo buffer_infos[3];
+    VkDescriptorImageInfo image_infos[1 + MAX_HIZ_LEVELS * 3];
+    uint32_t write_count = 0;
+    uint32_t image_count = 0;
+    
+    buffer_infos[0] = (VkDescriptorBufferInfo) {func->cull_bounds_buffer, 0, func->cull_bounds_partition};
+    buffer_infos[1] = (VkDescriptorBufferInfo) {func->draw_command_buffer, 0, VK_WHOLE_SIZE};
+    buffer_infos[2] = (VkDescriptorBufferInfo) {func->draw_count_buffer, 0, VK_WHOLE_SIZE};
+    image_infos[image_count++] = (VkDescriptorImageInfo) {func->hiz_sampler, func->hiz_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    
+    for(uint32_t i = 0; i < 4; i++)
+    {
+        writes[write_count].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[write_count].dstSet = func->cull_set;
+        writes[write_count].dstBinding = i;
+        writes[write_count].descriptorCount = 1;
+        writes[write_count].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC :
+            i == 3 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[write_count].pBufferInfo = i < 3 ? &buffer_infos[i] : NULL;
+        writes[write_count].pImageInfo = i == 3 ? &image_infos[0] : NULL;
+        write_count += 1;
+    }
+    
+    /* Level 0 reads depth and never touches src, it still needs a
+     * valid descriptor so it gets its own destination level        */
+    for(uint32_t i = 0; i < func->hiz_levels; i++)
+    {
+        image_infos[image_count] = (VkDescriptorImageInfo) {func->hiz_sampler, depth_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        image_infos[image_count + 1] = (VkDescriptorImageInfo) {VK_NULL_HANDLE, func->hiz_mip_views[i > 0 ? i - 1 : 0], VK_IMAGE_LAYOUT_GENERAL};
+        image_infos[image_count + 2] = (VkDescriptorImageInfo) {VK_NULL_HANDLE, func->hiz_mip_views[i], VK_IMAGE_LAYOUT_GENERAL};
+        
+        for(uint32_t j = 0; j < 3; j++)
+        {
+            writes[write_count].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[write_count].dstSet = func->hiz_sets[i];
+            writes[write_count].dstBinding = j;
+            writes[write_count].descriptorCount = 1;
+            writes[write_count].descriptorType = j == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            writes[write_count].pImageInfo = &image_infos[image_count + j];
+            write_count += 1;
+        }
+        
+        image_count += 3;
+    }
+    
+    func->vkUpdateDescriptorSets(func->device, write_count, writes, 0, NULL);
+}
+
+/* Scenes past the capacity fall back to culling on the CPU, as do
+ * scenes with meshes since their levels of detail are picked there  */
+bool gpu_cull_active(Interface *func)
+{
+    return func->gpu_cull_enabled && func->cull_scene->live_count > 0 &&
+        func->cull_scene->count <= func->gpu_cull_capacity && func->mesh_object_count == 0;
+}
+
+/* Must be called once the frame slot is no longer in use by the GPU */
+void gpu_cull_begin_frame(Interface *func, VkCommandBuffer cmd, uint32_t frame)
+{
+    CullScene *scene = func->cull_scene;
+    VkImageMemoryBarrier barrier = {0};
+    float *bounds;
+    
+    /* The graph expects the pyramid in its final layout when the
+     * frame starts, its contents are ignored until the first build */
+    if(func->gpu_cull_enabled && !func->hiz_initialized)
+    {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = func->hiz_image;
+        barrier.subresourceRange = (VkImageSubresourceRange) {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1};
+        
+        func->vkCmdPipelineBarrier(
+            cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            0, NULL, 0, NULL, 1, &barrier);
+        
+        func->hiz_initialized = true;
+    }
+    
+    /* Each slot keeps its own copy, so an unchanged scene costs nothing */
+    if(gpu_cull_active(func) &&
+       (func->cull_bounds_generation[frame] != scene->generation || func->cull_bounds_count[frame] != scene->count))
+    {
+        bounds = (float *)(func->cull_bounds_mapped + frame * func->cull_bounds_partition);
+        
+        for(uint32_t i = 0; i < scene->count; i++)
+        {
+            bounds[i * 8 + 0] = scene->center_x[i];
+            bounds[i * 8 + 1] = scene->center_y[i];
+            bounds[i * 8 + 2] = scene->center_z[i];
+            bounds[i * 8 + 3] = scene->radius[i];
+            bounds[i * 8 + 4] = scene->extent_x[i];
+            bounds[i * 8 + 5] = scene->extent_y[i];
+            bounds[i * 8 + 6] = scene->extent_z[i];
+            bounds[i * 8 + 7] = 0.0f;
+        }
+        
+        func->cull_bounds_generation[frame] = scene->generation;
+        func->cull_bounds_count[frame] = scene->count;
+    }
+}
+
+void record_cull_reset(Interface *func, VkCommandBuffer cmd, void *data)
+{
+    func->vkCmdFillBuffer(cmd, func->draw_count_buffer, 0, sizeof(uint32_t), 0);
+}
+
+void record_gpu_cull(Interface *func, VkCommandBuffer cmd, void *data)
+{
+    CullScene *scene = func->cull_scene;
+    CullConstants *constants = NULL;
+    uint32_t offset = 0;
+    uint32_t dynamic_offsets[3];
+    Frustum frustum;
+    
+    if(gpu_cull_active(func))
+    {
+        constants = renderer_alloc_uniform(func, sizeof(CullConstants), &offset);
+    }
+    
+    if(constants)
+    {
+        cull_frustum_from_matrix(&frustum, func->view_proj);
+        
+        for(uint32_t i = 0; i < 6; i++)
+        {
+            constants->planes[i][0] = frustum.a[i];
+            constants->planes[i][1] = frustum.b[i];
+            constants->planes[i][2] = frustum.c[i];
+            constants->planes[i][3] = frustum.d[i];
+        }
+        
+        memcpy(constants->prev_view_proj, func->prev_view_proj, sizeof(constants->prev_view_proj));
+        constants->hiz_size[0] = func->hiz_extent.width;
+        constants->hiz_size[1] = func->hiz_extent.height;
+        constants->hiz_scale[0] = func->hiz_scale[0];
+        constants->hiz_scale[1] = func->hiz_scale[1];
+        constants->object_count = scene->count;
+        constants->flags =
+            (func->hiz_frames > 0 ? CULL_FLAG_OCCLUSION : 0) |
+            (func->vkCmdDrawIndexedIndirectCount ? CULL_FLAG_COMPACT : 0);
+        
+        dynamic_offsets[0] = offset;
+        dynamic_offsets[1] = offset;
+        dynamic_offsets[2] = func->frame_index * func->cull_bounds_partition;
+        
+        func->vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, func->cull_pipeline);
+        func->vkCmdBindDescriptorSets(
+            cmd, VK_PIPELINE_BIND_POINT_COMPUTE, func->cull_pipeline_layout,
+            0, 2, (VkDescriptorSet[]) {func->frame_set, func->cull_set}, 3, dynamic_offsets);
+        func->vkCmdDispatch(cmd, (scene->count + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+    }
+}
+
+/* Runs after the main pass, the graph has already made depth readable
+ * and put the pyramid in the general layout for every level. Only the
+ * rendered part of depth is read, the clamp in the shader repeats its
+ * edge over the rest when the resolution is scaled down               */
+void record_hiz(Interface *func, VkCommandBuffer cmd, void *data)
+{
+    HizConstants constants;
+    VkMemoryBarrier barrier = {0};
+    VkExtent2D src = func->render_extent;
+    VkExtent2D dst = func->hiz_extent;
+    
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    
+    func->vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, func->hiz_pipeline);
+    
+    for(uint32_t i = 0; i < func->hiz_levels; i++)
+    {
+        /* Each level reads what the previous dispatch wrote */
+        if(i > 0)
+        {
+            func->vkCmdPipelineBarrier(
+                cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                1, &barrier, 0, NULL, 0, NULL);
+        }
+        
+        constants = (HizConstants) {{src.width, src.height}, {dst.width, dst.height}, i};
+        
+        func->vkCmdBindDescriptorSets(
+            cmd, VK_PIPELINE_BIND_POINT_COMPUTE, func->hiz_pipeline_layout, 0, 1, &func->hiz_sets[i], 0, NULL);
+        func->vkCmdPushConstants(cmd, func->hiz_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        func->vkCmdDispatch(cmd, (dst.width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (dst.height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+        
+        src = dst;
+        dst.width = MAX(dst.width / 2, 1);
+        dst.height = MAX(dst.height / 2, 1);
+    }
+    
+    func->hiz_frames += 1;
+}
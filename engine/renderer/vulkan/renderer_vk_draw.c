@@ -1,8 +1,384 @@
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 #include "interface.h"
+#include "job.h"
+#include "cull.h"
+#include "transform.h"
+#include "mesh.h"
 #include "renderer_int.h"
 
+bool init_scene(Interface *func)
+{
+    func->cull_scene = cull_scene_create(func);
+    func->transforms = transform_hierarchy_create(func);
+    
+    for(uint32_t i = 0; i < MAX_FRAMES; i++)
+    {
+        func->instance_bindless[i] = BINDLESS_INVALID;
+    }
+    
+    /* Identity until the application provides a camera */
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        func->view_proj[i] = i % 5 == 0 ? 1.0f : 0.0f;
+        func->view[i] = func->view_proj[i];
+        func->projection[i] = func->view_proj[i];
+        func->inverse_projection[i] = func->view_proj[i];
+    }
+    
+    func->camera_near = LIGHT_DEFAULT_NEAR;
+    func->camera_far = LIGHT_DEFAULT_FAR;
+    
+    if(func->cull_scene && func->transforms)
+    {
+        func->printf("Culling with the %s path\n",
+            func->cull_scene->path == CULL_PATH_AVX2 ? "avx2" : func->cull_scene->path == CULL_PATH_SSE2 ? "sse2" : "scalar");
+        func->printf("Transforms with the %s path\n",
+            func->transforms->path == TRANSFORM_PATH_AVX2 ? "avx2" : func->transforms->path == TRANSFORM_PATH_SSE2 ? "sse2" : "scalar");
+    }
+    
+    return func->cull_scene != NULL && func->transforms != NULL;
+}
+
+uint32_t renderer_add_object(Interface *func, const float center[3], const float extents[3], float radius)
+{
+    return cull_add_object(func, func->cull_scene, center, extents, radius);
+}
+
+void renderer_move_object(Interface *func, uint32_t object, const float center[3], const float extents[3], float radius)
+{
+    cull_set_object(func->cull_scene, object, center, extents, radius);
+}
+
+void renderer_remove_object(Interface *func, uint32_t object)
+{
+    renderer_set_object_mesh(func, object, MESH_INVALID, TRANSFORM_INVALID);
+    cull_remove_object(func->cull_scene, object);
+}
+
+/* The object's bounds pick the level of detail, its radius over the
+ * mesh's radius is taken as the scale of the transform. MESH_INVALID
+ * goes back to the placeholder. A mesh needs an existing transform
+ * node, the vertex shader reads its matrix without any check.        */
+void renderer_set_object_mesh(Interface *func, uint32_t object, uint32_t mesh, uint32_t transform)
+{
+    uint32_t capacity = func->cull_scene->capacity;
+    uint32_t *meshes = func->object_meshes;
+    uint32_t *transforms = func->object_transforms;
+    bool result = object < capacity && (mesh == MESH_INVALID || transform < func->transforms->count);
+    
+    if(result && capacity > func->object_mesh_capacity && mesh != MESH_INVALID)
+    {
+        meshes = func->realloc(func->object_meshes, sizeof(uint32_t) * capacity);
+        func->object_meshes = meshes ? meshes : func->object_meshes;
+        transforms = func->realloc(func->object_transforms, sizeof(uint32_t) * capacity);
+        func->object_transforms = transforms ? transforms : func->object_transforms;
+        result = meshes != NULL && transforms != NULL;
+        
+        for(uint32_t i = func->object_mesh_capacity; result && i < capacity; i++)
+        {
+            func->object_meshes[i] = MESH_INVALID;
+        }
+        
+        func->object_mesh_capacity = result ? capacity : func->object_mesh_capacity;
+    }
+    
+    if(result && object < func->object_mesh_capacity)
+    {
+        func->mesh_object_count -= func->object_meshes[object] != MESH_INVALID;
+        func->mesh_object_count += mesh != MESH_INVALID;
+        func->object_meshes[object] = mesh;
+        func->object_transforms[object] = transform;
+    }
+}
+
+/* Inverse through the adjugate, false for a singular matrix */
+static bool prv_invert(const float m[16], float out[16])
+{
+    float inverse[16];
+    float determinant;
+    
+    inverse[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    inverse[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    inverse[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    inverse[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    inverse[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    inverse[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    inverse[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    inverse[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    inverse[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+    inverse[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+    inverse[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+    inverse[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+    inverse[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+    inverse[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+    inverse[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+    inverse[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+    
+    determinant = m[0] * inverse[0] + m[1] * inverse[4] + m[2] * inverse[8] + m[3] * inverse[12];
+    
+    for(uint32_t i = 0; i < 16 && determinant != 0.0f; i++)
+    {
+        out[i] = inverse[i] / determinant;
+    }
+    
+    return determinant != 0.0f;
+}
+
+/* Matrices are column major. near and far bound the depth slices of
+ * the light clusters and must be positive distances with far > near  */
+void renderer_set_camera(Interface *func, const float view[16], const float projection[16], float near, float far)
+{
+    memcpy(func->view, view, sizeof(func->view));
+    memcpy(func->projection, projection, sizeof(func->projection));
+    
+    for(uint32_t column = 0; column < 4; column++)
+    {
+        for(uint32_t row = 0; row < 4; row++)
+        {
+            func->view_proj[column * 4 + row] =
+                projection[row] * view[column * 4] + projection[4 + row] * view[column * 4 + 1] +
+                projection[8 + row] * view[column * 4 + 2] + projection[12 + row] * view[column * 4 + 3];
+        }
+    }
+    
+    if(!prv_invert(projection, func->inverse_projection))
+    {
+        func->printf("Camera projection is singular, light clusters keep the previous one\n");
+    }
+    
+    func->camera_near = near > 0.0f ? near : LIGHT_DEFAULT_NEAR;
+    func->camera_far = far > func->camera_near ? far : func->camera_near * 2.0f;
+}
+
+/* parent must already exist, TRANSFORM_INVALID adds a root */
+uint32_t renderer_add_transform(Interface *func, uint32_t parent,
+    const float position[3], const float rotation[4], const float scale[3])
+{
+    return transform_add(func, func->transforms, parent, position, rotation, scale);
+}
+
+void renderer_set_transform(Interface *func, uint32_t node,
+    const float position[3], const float rotation[4], const float scale[3])
+{
+    transform_set_local(func->transforms, node, position, rotation, scale);
+}
+
+/* Replaces the instance buffer with one holding at least count
+ * matrices per frame. The old one may still be read by frames in
+ * flight, so it is only released after the next submission.        */
+static bool prv_grow_instances(Interface *func, uint32_t count)
+{
+    bool result = false;
+    uint32_t capacity = MAX(func->instance_capacity, INSTANCE_INITIAL_CAPACITY);
+    VkDeviceSize partition;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    void *mapped = NULL;
+    
+    while(capacity < count)
+    {
+        capacity *= 2;
+    }
+    
+    capacity = MIN(capacity, INSTANCE_MAX_CAPACITY);
+    partition = (VkDeviceSize)capacity * 16 * sizeof(float);
+    partition = (partition + func->uniform_alignment - 1) & ~(func->uniform_alignment - 1);
+    
+    if(capacity >= count)
+    {
+        result = create_buffer(
+            func, partition * MAX_FRAMES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffer, &memory, NULL);
+    }
+    
+    if(result)
+    {
+        result = func->vkMapMemory(func->device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) == VK_SUCCESS;
+        
+        if(!result)
+        {
+            func->vkDestroyBuffer(func->device, buffer, NULL);
+            func->vkFreeMemory(func->device, memory, NULL);
+        }
+    }
+    
+    if(result)
+    {
+        if(func->instance_buffer)
+        {
+            lifetime_defer_buffer(func, func->submit_value + 1, func->instance_buffer);
+            lifetime_defer_memory(func, func->submit_value + 1, func->instance_memory);
+        }
+        
+        func->instance_buffer = buffer;
+        func->instance_memory = memory;
+        func->instance_mapped = mapped;
+        func->instance_capacity = capacity;
+        func->instance_partition = partition;
+        
+        /* Every partition is new, so each gets all of the matrices */
+        for(uint32_t i = 0; i < MAX_FRAMES; i++)
+        {
+            renderer_bindless_release(func, BINDLESS_BUFFER, func->instance_bindless[i]);
+            func->instance_bindless[i] = renderer_bindless_add_buffer(func, buffer, partition * i, partition);
+            func->instance_updates[i] = 0;
+        }
+    }
+    else
+    {
+        func->printf("Failed to grow instance buffer to %u matrices\n", count);
+    }
+    
+    return result;
+}
+
+/* Brings the frame slot's partition up to date, writing only the
+ * matrices changed since the slot was last used. Must be called once
+ * the slot is no longer in use by the GPU.                           */
+void instance_begin_frame(Interface *func, uint32_t frame)
+{
+    TransformHierarchy *hierarchy = func->transforms;
+    bool ready = hierarchy->count > 0;
+    
+    if(ready && hierarchy->count > func->instance_capacity)
+    {
+        ready = prv_grow_instances(func, hierarchy->count);
+    }
+    
+    if(ready)
+    {
+        transform_update(hierarchy, (float*)(func->instance_mapped + func->instance_partition * frame), func->instance_updates[frame]);
+        func->instance_updates[frame] = hierarchy->update;
+    }
+}
+
+/* Visible objects with a mesh are drawn after the placeholders, each
+ * at the level its bounds pick for the size the scene is drawn at     */
+static void prv_draw_meshes(Interface *func, VkCommandBuffer cmd, VkPipeline pipeline)
+{
+    CullScene *scene = func->cull_scene;
+    MeshDrawConstants constants;
+    const GpuMesh *mesh;
+    const MeshLod *lod;
+    uint32_t object;
+    float center[3];
+    
+    func->vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    memcpy(constants.view_proj, func->view_proj, sizeof(constants.view_proj));
+    constants.position_offset[3] = 0.0f;
+    constants.position_scale[3] = 0.0f;
+    
+    for(uint32_t i = 0; i < scene->visible_count; i++)
+    {
+        object = scene->visible[i];
+        mesh = object < func->object_mesh_capacity && func->object_meshes[object] < func->mesh_count ?
+            &func->meshes[func->object_meshes[object]] : NULL;
+        
+        /* Nodes are never removed, the check is kept next to the read */
+        if(mesh && mesh->header && func->object_transforms[object] < func->transforms->count)
+        {
+            center[0] = scene->center_x[object];
+            center[1] = scene->center_y[object];
+            center[2] = scene->center_z[object];
+            lod = &mesh->header->lods[renderer_mesh_lod(func, func->object_meshes[object], center,
+                scene->radius[object] / mesh->header->radius)];
+            
+            memcpy(constants.position_offset, mesh->header->position_offset, sizeof(float) * 3);
+            memcpy(constants.position_scale, mesh->header->position_scale, sizeof(float) * 3);
+            constants.vertex_buffer = mesh->bindless;
+            constants.transform = func->object_transforms[object];
+            
+            func->vkCmdPushConstants(cmd, func->pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+            func->vkCmdBindIndexBuffer(cmd, mesh->buffer, mesh->index_offset, VK_INDEX_TYPE_UINT32);
+            func->vkCmdDrawIndexed(cmd, lod->index_count, 1, lod->first_index, 0, 0);
+        }
+    }
+}
+
+static void prv_draw_scene(Interface *func, VkCommandBuffer cmd, VkPipeline pipeline, VkPipeline mesh_pipeline)
+{
+    CullScene *scene = func->cull_scene;
+    uint32_t dynamic_offsets[2];
+    
+    func->vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    
+    /* Both sets are bound once per frame, per-object data only
+     * rebinds set 0 with new offsets and materials index set 1  */
+    dynamic_offsets[0] = func->frame_constants_offset;
+    dynamic_offsets[1] = func->frame_constants_offset;
+    func->vkCmdBindDescriptorSets(
+        cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, func->pipeline_layout,
+        0, func->bindless_supported ? 2 : 1, (VkDescriptorSet[]) {func->frame_set, func->bindless_set}, 2, dynamic_offsets);
+    
+    /* Objects without a mesh draw the placeholder triangle with their
+     * handle as instance, the GPU culled draws only know that one     */
+    if(scene->live_count == 0)
+    {
+        func->vkCmdDraw(cmd, 3, 1, 0, 0);
+    }
+    else if(gpu_cull_active(func))
+    {
+        func->vkCmdBindIndexBuffer(cmd, func->placeholder_index_buffer, 0, VK_INDEX_TYPE_UINT32);
+        
+        if(func->vkCmdDrawIndexedIndirectCount)
+        {
+            func->vkCmdDrawIndexedIndirectCount(
+                cmd, func->draw_command_buffer, 0, func->draw_count_buffer, 0,
+                scene->count, sizeof(VkDrawIndexedIndirectCommand));
+        }
+        else
+        {
+            func->vkCmdDrawIndexedIndirect(
+                cmd, func->draw_command_buffer, 0, scene->count, sizeof(VkDrawIndexedIndirectCommand));
+        }
+    }
+    else
+    {
+        for(uint32_t i = 0; i < scene->visible_count; i++)
+        {
+            if(!mesh_pipeline || scene->visible[i] >= func->object_mesh_capacity ||
+               func->object_meshes[scene->visible[i]] == MESH_INVALID)
+            {
+                func->vkCmdDraw(cmd, 3, 1, 0, scene->visible[i]);
+            }
+        }
+        
+        if(mesh_pipeline && func->mesh_object_count > 0)
+        {
+            prv_draw_meshes(func, cmd, mesh_pipeline);
+        }
+    }
+}
+
+/* Same geometry as the main pass, depth only */
+void record_depth_prepass(Interface *func, VkCommandBuffer cmd, void *data)
+{
+    prv_draw_scene(func, cmd, func->prepass_pipeline, func->mesh_prepass_pipeline);
+}
+
+/* Records the main graphics pass, the graph has already begun the
+ * render pass and set the viewport and scissor                     */
+void record_main_pass(Interface *func, VkCommandBuffer cmd, void *data)
+{
+    overdraw_begin(func, cmd, func->frame_index);
+    prv_draw_scene(func, cmd, func->pipeline, func->mesh_pipeline);
+    overdraw_end(func, cmd, func->frame_index);
+    
+    if(!func->resolution_enabled)
+    {
+        record_sprites(func, cmd);
+    }
+}
+
+/* Sprites at full size over the upscaled scene */
+void record_overlay(Interface *func, VkCommandBuffer cmd, void *data)
+{
+    record_sprites(func, cmd);
+}
+
 void renderer_draw(Interface *func)
 {
     uint32_t index = func->frame_index;
@@ -10,51 +386,92 @@ void renderer_draw(Interface *func)
     VkCommandBufferBeginInfo begin_info = {0};
     VkSubmitInfo submit_info = {0};
     VkPresentInfoKHR present_info = {0};
-    VkClearValue clear_value = {.color = {{ 0.0f, 0.1f, 0.2f, 1.0f }}};
-    VkRenderPassBeginInfo renderpass_begin = {0};
-    VkViewport viewport = {0.0f, 0.0f, func->swapchain_extent.width, func->swapchain_extent.height, 0.0f, 1.0f};
-    VkRect2D scissor = {{0, 0}, func->swapchain_extent};
+    VkSemaphore wait_sems[2];
+    VkPipelineStageFlags wait_stages[2];
+    uint32_t wait_count = 0;
+    Frustum frustum;
+    
+    /* Wait for the last submission that used this frame slot, then
+     * release anything that was only waiting on the GPU           */
+    lifetime_wait(func, func->frame_values[index]);
+    lifetime_collect(func);
+    capture_collect(func);
+    
+    /* The slot's timings feed the resolution controller */
+    timing_collect(func, index);
+    resolution_update(func);
+    
+    if(func->app_info.sprite_benchmark)
+    {
+        sprite_benchmark_frame(func);
+    }
     
-    func->vkWaitForFences(func->device, 1, &func->frame_fence[index], VK_TRUE, UINT64_MAX);
-    func->vkResetFences(func->device, 1, &func->frame_fence[index]);
+    if(func->app_info.light_benchmark)
+    {
+        light_benchmark_frame(func);
+    }
+    
+    instance_begin_frame(func, index);
+    light_begin_frame(func, index);
+    uniform_begin_frame(func, index);
+    
+    /* Recording reads the visible list of both passes, unless the
+     * GPU writes the draws itself                                  */
+    if(func->cull_scene->live_count > 0 && !gpu_cull_active(func))
+    {
+        cull_frustum_from_matrix(&frustum, func->view_proj);
+        cull_scene(func, func->cull_scene, &frustum, true);
+    }
+    
+    /* Compute is submitted before acquiring so it can start while
+     * the previous frame's graphics work is still in flight        */
+    if(record_compute(func, index))
+    {
+        wait_sems[wait_count] = func->compute_finished_sem[index];
+        wait_stages[wait_count] = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        wait_count += 1;
+    }
     
     func->vkAcquireNextImageKHR(
         func->device, func->swapchain, UINT64_MAX, func->img_avaliable_sem[index],
         VK_NULL_HANDLE, &image_index);
+    
+    wait_sems[wait_count] = func->img_avaliable_sem[index];
+    wait_stages[wait_count] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    wait_count += 1;
         
     begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
     
     func->vkBeginCommandBuffer(func->cmd_buffers[index], &begin_info);
+    timing_begin(func, func->cmd_buffers[index], index, TIMING_GRAPHICS);
+    gpu_cull_begin_frame(func, func->cmd_buffers[index], index);
+    texture_begin_frame(func, func->cmd_buffers[index], index);
+    sprite_begin_frame(func, func->cmd_buffers[index]);
+    capture_begin_frame(func, image_index);
     
-    renderpass_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderpass_begin.renderPass = func->render_pass;
-    renderpass_begin.framebuffer = func->framebuffers[image_index];
-    renderpass_begin.clearValueCount = 1;
-    renderpass_begin.pClearValues = &clear_value;
-    renderpass_begin.renderArea.offset = (VkOffset2D) { .x = 0,.y = 0 };
-    renderpass_begin.renderArea.extent = func->swapchain_extent;
-    
-    func->vkCmdBeginRenderPass(func->cmd_buffers[index], &renderpass_begin, VK_SUBPASS_CONTENTS_INLINE);
-    func->vkCmdBindPipeline(func->cmd_buffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, func->pipeline);
-    func->vkCmdSetViewport(func->cmd_buffers[index], 0, 1, &viewport);
-    func->vkCmdSetScissor(func->cmd_buffers[index], 0, 1, &scissor);
-    func->vkCmdDraw(func->cmd_buffers[index], 3, 1, 0, 0);
+    graph_execute(func, func->render_graph, func->cmd_buffers[index], image_index);
     
-    func->vkCmdEndRenderPass(func->cmd_buffers[index]);
+    /* Occlusion next frame tests against the pyramid built from this one */
+    memcpy(func->prev_view_proj, func->view_proj, sizeof(func->prev_view_proj));
+    func->hiz_scale[0] = (float)func->render_extent.width / func->swapchain_extent.width;
+    func->hiz_scale[1] = (float)func->render_extent.height / func->swapchain_extent.height;
     
+    timing_end(func, func->cmd_buffers[index], index, TIMING_GRAPHICS);
     func->vkEndCommandBuffer(func->cmd_buffers[index]);
     
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = &func->img_avaliable_sem[index];
-    submit_info.pWaitDstStageMask = (VkPipelineStageFlags[]) { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+    submit_info.waitSemaphoreCount = wait_count;
+    submit_info.pWaitSemaphores = wait_sems;
+    submit_info.pWaitDstStageMask = wait_stages;
     submit_info.commandBufferCount = 1;
     submit_info.pCommandBuffers = &func->cmd_buffers[index];
     submit_info.signalSemaphoreCount = 1;
     submit_info.pSignalSemaphores = &func->render_finished_sem[index];
     
-    func->vkQueueSubmit(func->queue, 1, &submit_info, func->frame_fence[index]);
+    func->frame_values[index] = lifetime_submit(func, &submit_info);
+    texture_end_frame(func);
+    sprite_end_frame(func);
     
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     present_info.waitSemaphoreCount = 1;
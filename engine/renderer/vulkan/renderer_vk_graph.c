@@ -0,0 +1,1136 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "interface.h"
+#include "renderer_int.h"
+
+/* Passes declare which resources they touch and how, in the order
+ * they should run. graph_compile drops passes nothing depends on and
+ * creates render passes, graph_create_resources places transient
+ * resources in one allocation and derives the barriers of a frame.
+ * Executing the graph then only replays what was computed here.
+ *
+ * Transient resources never keep their contents between frames and
+ * share memory with any other transient whose lifetime they don't
+ * overlap. A pass may only access a resource once.                   */
+
+#define WRITE_ACCESS_MASK (VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | \
+    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | \
+    VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT)
+
+typedef struct
+{
+    VkPipelineStageFlags stages;
+    VkAccessFlags access;
+    VkImageLayout layout;
+    VkImageUsageFlags image_usage;
+    VkBufferUsageFlags buffer_usage;
+    bool write;
+    bool attachment;
+} UsageInfo;
+
+/* Synchronization state of a resource while walking the frame */
+typedef struct
+{
+    VkImageLayout layout;
+    VkPipelineStageFlags write_stages;
+    VkAccessFlags write_access;
+    VkPipelineStageFlags read_stages;
+    VkPipelineStageFlags visible_stages;
+    VkAccessFlags visible_access;
+    VkPipelineStageFlags first_stages;
+} ResourceState;
+
+static UsageInfo prv_usage_info(GraphPassType type, GraphUsage usage)
+{
+    VkPipelineStageFlags shader_stages = type == GRAPH_PASS_COMPUTE ?
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT :
+        VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    VkPipelineStageFlags depth_stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    UsageInfo info = {0};
+    
+    switch(usage)
+    {
+        case GRAPH_COLOR_WRITE:
+            info = (UsageInfo) {
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 0, true, true};
+            break;
+        case GRAPH_DEPTH_WRITE:
+            info = (UsageInfo) {
+                depth_stages,
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0, true, true};
+            break;
+        case GRAPH_DEPTH_READ:
+            info = (UsageInfo) {
+                depth_stages,
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0, false, true};
+            break;
+        case GRAPH_SAMPLED_READ:
+            info = (UsageInfo) {
+                shader_stages, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_IMAGE_USAGE_SAMPLED_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false, false};
+            break;
+        case GRAPH_STORAGE_READ:
+            info = (UsageInfo) {
+                shader_stages, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL,
+                VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false, false};
+            break;
+        case GRAPH_STORAGE_WRITE:
+            info = (UsageInfo) {
+                shader_stages, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL,
+                VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true, false};
+            break;
+        case GRAPH_INDIRECT_READ:
+            info = (UsageInfo) {
+                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                0, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, false, false};
+            break;
+        case GRAPH_TRANSFER_READ:
+            info = (UsageInfo) {
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, false, false};
+            break;
+        case GRAPH_TRANSFER_WRITE:
+            info = (UsageInfo) {
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_BUFFER_USAGE_TRANSFER_DST_BIT, true, false};
+            break;
+        default:
+            break;
+    }
+    
+    return info;
+}
+
+static VkImageAspectFlags prv_format_aspect(VkFormat format)
+{
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    
+    switch(format)
+    {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_D32_SFLOAT:
+            aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+            break;
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            aspect = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+            break;
+        default:
+            break;
+    }
+    
+    return aspect;
+}
+
+RenderGraph *graph_create(Interface *func)
+{
+    RenderGraph *graph = func->malloc(sizeof(RenderGraph));
+    
+    if(graph)
+    {
+        *graph = (RenderGraph) {0};
+    }
+    
+    return graph;
+}
+
+static uint32_t prv_add_resource(RenderGraph *graph, const GraphResource *resource)
+{
+    uint32_t index = GRAPH_INVALID;
+    
+    if(graph->resource_count < MAX_GRAPH_RESOURCES && !graph->compiled)
+    {
+        index = graph->resource_count;
+        graph->resources[index] = *resource;
+        graph->resource_count += 1;
+    }
+    
+    return index;
+}
+
+/* The swapchain images are picked up when resources are created, so
+ * this can be declared before the swapchain exists                   */
+uint32_t graph_import_swapchain(RenderGraph *graph, Interface *func, const char *name)
+{
+    return prv_add_resource(graph, &(GraphResource) {
+        .name = name,
+        .type = GRAPH_RESOURCE_IMAGE,
+        .imported = true,
+        .discard = true,
+        .per_image = true,
+        .format = func->surface_format.format,
+        .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+        .final_layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        /* Chains with the acquire semaphore wait */
+        .initial_stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+    });
+}
+
+/* The image has to be in layout at the start of every frame, the
+ * graph transitions it back there once the frame is done. Barriers
+ * cover every mip level.                                           */
+uint32_t graph_import_image(RenderGraph *graph, const char *name, VkImage image, VkImageView view,
+    VkFormat format, VkExtent2D extent, VkImageLayout layout)
+{
+    return prv_add_resource(graph, &(GraphResource) {
+        .name = name,
+        .type = GRAPH_RESOURCE_IMAGE,
+        .imported = true,
+        .format = format,
+        .aspect = prv_format_aspect(format),
+        .extent = extent,
+        .final_layout = layout,
+        .images = {image},
+        .views = {view},
+    });
+}
+
+/* For imported resources declared before they exist, must be
+ * called before graph_create_resources                        */
+void graph_set_image(RenderGraph *graph, uint32_t resource, VkImage image, VkImageView view)
+{
+    if(resource < graph->resource_count)
+    {
+        graph->resources[resource].images[0] = image;
+        graph->resources[resource].views[0] = view;
+    }
+}
+
+void graph_set_buffer(RenderGraph *graph, uint32_t resource, VkBuffer buffer)
+{
+    if(resource < graph->resource_count)
+    {
+        graph->resources[resource].buffer = buffer;
+    }
+}
+
+uint32_t graph_import_buffer(RenderGraph *graph, const char *name, VkBuffer buffer, VkDeviceSize size)
+{
+    return prv_add_resource(graph, &(GraphResource) {
+        .name = name,
+        .type = GRAPH_RESOURCE_BUFFER,
+        .imported = true,
+        .size = size,
+        .buffer = buffer,
+    });
+}
+
+uint32_t graph_create_image(RenderGraph *graph, const char *name, VkFormat format, VkExtent2D extent)
+{
+    return prv_add_resource(graph, &(GraphResource) {
+        .name = name,
+        .type = GRAPH_RESOURCE_IMAGE,
+        .format = format,
+        .aspect = prv_format_aspect(format),
+        .extent = extent,
+    });
+}
+
+uint32_t graph_create_buffer(RenderGraph *graph, const char *name, VkDeviceSize size)
+{
+    return prv_add_resource(graph, &(GraphResource) {
+        .name = name,
+        .type = GRAPH_RESOURCE_BUFFER,
+        .size = size,
+    });
+}
+
+uint32_t graph_add_pass(RenderGraph *graph, const char *name, GraphPassType type, PFN_record_pass record, void *data)
+{
+    uint32_t index = GRAPH_INVALID;
+    
+    if(graph->pass_count < MAX_GRAPH_PASSES && !graph->compiled)
+    {
+        index = graph->pass_count;
+        graph->passes[index] = (GraphPass) {.name = name, .type = type, .record = record, .data = data};
+        graph->pass_count += 1;
+    }
+    
+    return index;
+}
+
+void graph_use(RenderGraph *graph, uint32_t pass, uint32_t resource, GraphUsage usage)
+{
+    GraphPass *graph_pass;
+    
+    if(pass < graph->pass_count && resource < graph->resource_count)
+    {
+        graph_pass = &graph->passes[pass];
+        
+        if(graph_pass->access_count < MAX_PASS_ACCESSES)
+        {
+            graph_pass->accesses[graph_pass->access_count] = (GraphAccess) {resource, usage, false, {{{0}}}};
+            graph_pass->access_count += 1;
+        }
+    }
+}
+
+/* Clears an attachment the pass already uses when the pass begins */
+void graph_clear(RenderGraph *graph, uint32_t pass, uint32_t resource, VkClearValue clear_value)
+{
+    if(pass < graph->pass_count)
+    {
+        for(uint32_t i = 0; i < graph->passes[pass].access_count; i++)
+        {
+            if(graph->passes[pass].accesses[i].resource == resource)
+            {
+                graph->passes[pass].accesses[i].clear = true;
+                graph->passes[pass].accesses[i].clear_value = clear_value;
+            }
+        }
+    }
+}
+
+/* Keeps a pass even if nothing in the graph reads what it writes */
+void graph_keep(RenderGraph *graph, uint32_t pass)
+{
+    if(pass < graph->pass_count)
+    {
+        graph->passes[pass].side_effects = true;
+    }
+}
+
+/* Limits drawing to the top left of the pass's attachments, set every
+ * frame by dynamic resolution. Clamped to the attachments when used. */
+void graph_set_render_area(RenderGraph *graph, uint32_t pass, VkExtent2D extent)
+{
+    if(pass < graph->pass_count)
+    {
+        graph->passes[pass].render_area = extent;
+    }
+}
+
+/* Walking backwards, a pass survives if it has side effects or writes
+ * something a later surviving pass reads or that leaves the graph     */
+static void prv_cull(RenderGraph *graph)
+{
+    bool needed[MAX_GRAPH_RESOURCES] = {false};
+    GraphPass *pass;
+    UsageInfo info;
+    bool keep;
+    
+    for(uint32_t i = 0; i < graph->resource_count; i++)
+    {
+        needed[i] = graph->resources[i].imported;
+    }
+    
+    for(uint32_t i = graph->pass_count; i-- > 0;)
+    {
+        pass = &graph->passes[i];
+        keep = pass->side_effects;
+        
+        for(uint32_t j = 0; j < pass->access_count && !keep; j++)
+        {
+            info = prv_usage_info(pass->type, pass->accesses[j].usage);
+            keep = info.write && needed[pass->accesses[j].resource];
+        }
+        
+        pass->culled = !keep;
+        
+        for(uint32_t j = 0; j < pass->access_count && keep; j++)
+        {
+            info = prv_usage_info(pass->type, pass->accesses[j].usage);
+            
+            /* Attachments that are loaded are read as well */
+            if(!info.write || !pass->accesses[j].clear)
+            {
+                needed[pass->accesses[j].resource] = true;
+            }
+        }
+    }
+}
+
+static void prv_lifetimes(RenderGraph *graph)
+{
+    GraphResource *resource;
+    GraphPass *pass;
+    UsageInfo info;
+    
+    for(uint32_t i = 0; i < graph->pass_count; i++)
+    {
+        pass = &graph->passes[i];
+        
+        for(uint32_t j = 0; j < pass->access_count && !pass->culled; j++)
+        {
+            resource = &graph->resources[pass->accesses[j].resource];
+            info = prv_usage_info(pass->type, pass->accesses[j].usage);
+            
+            if(!resource->used)
+            {
+                resource->used = true;
+                resource->first_pass = i;
+            }
+            
+            resource->last_pass = i;
+            resource->image_usage |= info.image_usage;
+            resource->buffer_usage |= info.buffer_usage;
+        }
+    }
+}
+
+static VkResult prv_create_render_pass(Interface *func, RenderGraph *graph, uint32_t pass_index)
+{
+    GraphPass *pass = &graph->passes[pass_index];
+    VkAttachmentDescription attachments[MAX_PASS_ACCESSES] = {0};
+    VkAttachmentReference color_refs[MAX_PASS_ACCESSES] = {0};
+    VkAttachmentReference depth_ref = {0};
+    VkSubpassDescription subpass_desc = {0};
+    VkRenderPassCreateInfo render_pass_create_info = {0};
+    uint32_t attachment_count = 0;
+    uint32_t color_count = 0;
+    bool has_depth = false;
+    GraphAccess *access;
+    GraphResource *resource;
+    UsageInfo info;
+    
+    for(uint32_t i = 0; i < pass->access_count; i++)
+    {
+        access = &pass->accesses[i];
+        resource = &graph->resources[access->resource];
+        info = prv_usage_info(pass->type, access->usage);
+        
+        if(info.attachment)
+        {
+            /* Layouts are handled by the graph's barriers so the
+             * render pass itself never transitions anything      */
+            attachments[attachment_count].format = resource->format;
+            attachments[attachment_count].samples = VK_SAMPLE_COUNT_1_BIT;
+            attachments[attachment_count].initialLayout = info.layout;
+            attachments[attachment_count].finalLayout = info.layout;
+            attachments[attachment_count].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            attachments[attachment_count].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            
+            if(access->clear)
+            {
+                attachments[attachment_count].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            }
+            else if(resource->first_pass < pass_index || (resource->imported && !resource->discard))
+            {
+                attachments[attachment_count].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+            }
+            else
+            {
+                attachments[attachment_count].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            }
+            
+            /* Nothing after this pass looks at it, so don't write it back */
+            attachments[attachment_count].storeOp = resource->last_pass > pass_index || resource->imported ?
+                VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            
+            pass->clear_values[attachment_count] = access->clear_value;
+            
+            if(access->usage == GRAPH_COLOR_WRITE)
+            {
+                color_refs[color_count] = (VkAttachmentReference) {attachment_count, info.layout};
+                color_count += 1;
+            }
+            else
+            {
+                depth_ref = (VkAttachmentReference) {attachment_count, info.layout};
+                has_depth = true;
+            }
+            
+            pass->per_image |= resource->per_image;
+            attachment_count += 1;
+        }
+    }
+    
+    pass->clear_count = attachment_count;
+    
+    subpass_desc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass_desc.colorAttachmentCount = color_count;
+    subpass_desc.pColorAttachments = color_refs;
+    subpass_desc.pDepthStencilAttachment = has_depth ? &depth_ref : NULL;
+    
+    render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_create_info.attachmentCount = attachment_count;
+    render_pass_create_info.pAttachments = attachments;
+    render_pass_create_info.subpassCount = 1;
+    render_pass_create_info.pSubpasses = &subpass_desc;
+    
+    return func->vkCreateRenderPass(func->device, &render_pass_create_info, 0, &pass->render_pass);
+}
+
+/* Only needs formats, so pipelines can be created before the
+ * swapchain and the resources exist                          */
+bool graph_compile(Interface *func, RenderGraph *graph)
+{
+    VkResult result = VK_SUCCESS;
+    uint32_t culled_count = 0;
+    
+    prv_cull(graph);
+    prv_lifetimes(graph);
+    
+    for(uint32_t i = 0; i < graph->pass_count && result == VK_SUCCESS; i++)
+    {
+        if(graph->passes[i].culled)
+        {
+            func->printf("Render graph: culled pass %s\n", graph->passes[i].name);
+            culled_count += 1;
+        }
+        else if(graph->passes[i].type == GRAPH_PASS_GRAPHICS)
+        {
+            result = prv_create_render_pass(func, graph, i);
+        }
+    }
+    
+    if(result != VK_SUCCESS)
+    {
+        func->printf("Failed to create render graph render pass with error %d\n", result);
+    }
+    
+    graph->compiled = result == VK_SUCCESS;
+    
+    return result == VK_SUCCESS;
+}
+
+static bool prv_lifetimes_overlap(const GraphResource *a, const GraphResource *b)
+{
+    return !(a->last_pass < b->first_pass || b->last_pass < a->first_pass);
+}
+
+static bool prv_memory_overlaps(const GraphResource *a, const GraphResource *b)
+{
+    return a->offset < b->offset + b->requirements.size && b->offset < a->offset + a->requirements.size;
+}
+
+static bool prv_is_transient(const GraphResource *resource)
+{
+    return resource->used && !resource->imported;
+}
+
+/* Greedy placement, largest first, each resource goes to the lowest
+ * offset that doesn't collide with anything alive at the same time  */
+static void prv_place_transients(Interface *func, RenderGraph *graph)
+{
+    uint32_t order[MAX_GRAPH_RESOURCES];
+    uint32_t placed[MAX_GRAPH_RESOURCES];
+    uint32_t order_count = 0;
+    uint32_t placed_count = 0;
+    VkDeviceSize granularity = func->physical_device_properties.limits.bufferImageGranularity;
+    VkDeviceSize alignment, candidate, best;
+    GraphResource *resource, *other;
+    bool collides;
+    
+    for(uint32_t i = 0; i < graph->resource_count; i++)
+    {
+        if(prv_is_transient(&graph->resources[i]))
+        {
+            uint32_t j = order_count;
+            while(j > 0 && graph->resources[order[j - 1]].requirements.size < graph->resources[i].requirements.size)
+            {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = i;
+            order_count += 1;
+        }
+    }
+    
+    graph->transient_size = 0;
+    graph->unaliased_size = 0;
+    
+    for(uint32_t i = 0; i < order_count; i++)
+    {
+        resource = &graph->resources[order[i]];
+        
+        /* Buffers and images share the allocation, so keep them
+         * apart by the buffer image granularity as well           */
+        alignment = MAX(resource->requirements.alignment, granularity);
+        best = UINT64_MAX;
+        
+        for(uint32_t j = 0; j <= placed_count; j++)
+        {
+            candidate = j == placed_count ? 0 : graph->resources[placed[j]].offset + graph->resources[placed[j]].requirements.size;
+            candidate = (candidate + alignment - 1) / alignment * alignment;
+            resource->offset = candidate;
+            collides = false;
+            
+            for(uint32_t k = 0; k < placed_count && !collides; k++)
+            {
+                other = &graph->resources[placed[k]];
+                collides = prv_lifetimes_overlap(resource, other) && prv_memory_overlaps(resource, other);
+            }
+            
+            if(!collides && candidate < best)
+            {
+                best = candidate;
+            }
+        }
+        
+        resource->offset = best;
+        placed[placed_count] = order[i];
+        placed_count += 1;
+        
+        graph->transient_size = MAX(graph->transient_size, best + resource->requirements.size);
+        graph->unaliased_size += (resource->requirements.size + alignment - 1) / alignment * alignment;
+    }
+}
+
+static void prv_access_state(ResourceState *state, const UsageInfo *info, VkImageLayout layout, bool barrier)
+{
+    if(info->write)
+    {
+        state->write_stages = info->stages;
+        state->write_access = info->access & WRITE_ACCESS_MASK;
+        state->read_stages = 0;
+        state->visible_stages = 0;
+        state->visible_access = 0;
+    }
+    else
+    {
+        state->read_stages |= info->stages;
+        
+        if(barrier)
+        {
+            state->visible_stages |= info->stages;
+            state->visible_access |= info->access;
+        }
+    }
+    
+    state->layout = layout;
+    
+    if(!state->first_stages)
+    {
+        state->first_stages = info->stages;
+    }
+}
+
+/* Walks the frame once and appends the barriers needed before every
+ * pass. With record false only the end of frame states are computed  */
+static void prv_build_barriers(RenderGraph *graph, ResourceState *states, bool record)
+{
+    GraphPass *pass;
+    GraphAccess *access;
+    GraphResource *resource;
+    GraphBarrierBatch *batch;
+    ResourceState *state;
+    UsageInfo info;
+    VkImageLayout layout;
+    VkPipelineStageFlags src_stages;
+    bool needs_layout, needs_barrier;
+    
+    for(uint32_t i = 0; i < graph->pass_count; i++)
+    {
+        pass = &graph->passes[i];
+        batch = &pass->barriers;
+        
+        if(record)
+        {
+            *batch = (GraphBarrierBatch) {0};
+            batch->first_image_barrier = graph->image_barrier_count;
+        }
+        
+        for(uint32_t j = 0; j < pass->access_count && !pass->culled; j++)
+        {
+            access = &pass->accesses[j];
+            resource = &graph->resources[access->resource];
+            state = &states[access->resource];
+            info = prv_usage_info(pass->type, access->usage);
+            
+            layout = resource->type == GRAPH_RESOURCE_IMAGE ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+            needs_layout = state->layout != layout;
+            
+            if(info.write)
+            {
+                /* Write after write or after read */
+                src_stages = state->write_stages | state->read_stages;
+                needs_barrier = needs_layout || src_stages;
+            }
+            else
+            {
+                /* Read after write, unless an earlier barrier already
+                 * made the write visible to these stages              */
+                src_stages = state->write_stages | (needs_layout ? state->read_stages : 0);
+                needs_barrier = needs_layout || (state->write_access &&
+                    ((info.stages & ~state->visible_stages) || (info.access & ~state->visible_access)));
+            }
+            
+            if(needs_barrier && record)
+            {
+                batch->src_stages |= src_stages ? src_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+                batch->dst_stages |= info.stages;
+                
+                if(needs_layout && graph->image_barrier_count < MAX_GRAPH_IMAGE_BARRIERS)
+                {
+                    graph->image_barriers[graph->image_barrier_count] = (GraphImageBarrier) {
+                        access->resource, state->layout, layout, state->write_access, info.access};
+                    graph->image_barrier_count += 1;
+                    batch->image_barrier_count += 1;
+                }
+                else
+                {
+                    batch->src_access |= state->write_access;
+                    batch->dst_access |= info.access;
+                }
+            }
+            
+            prv_access_state(state, &info, layout, needs_barrier);
+        }
+        
+        if(record && batch->dst_stages)
+        {
+            graph->barrier_batch_count += 1;
+        }
+    }
+}
+
+/* Where every resource stands when a frame starts, which is where the
+ * previous frame left it. Transients start undefined but still have to
+ * wait for whatever last used their memory.                            */
+static void prv_initial_states(RenderGraph *graph, const ResourceState *end_states, ResourceState *states)
+{
+    GraphResource *resource, *other;
+    
+    for(uint32_t i = 0; i < graph->resource_count; i++)
+    {
+        resource = &graph->resources[i];
+        states[i] = (ResourceState) {0};
+        
+        if(resource->per_image)
+        {
+            /* Presentation is ordered by the acquire semaphore */
+            states[i].write_stages = resource->initial_stages;
+        }
+        else if(resource->imported && resource->type == GRAPH_RESOURCE_IMAGE && end_states[i].layout != resource->final_layout)
+        {
+            /* Chains with the final barrier of the previous frame */
+            states[i].layout = resource->final_layout;
+            states[i].write_stages = end_states[i].first_stages;
+        }
+        else if(resource->imported)
+        {
+            states[i].layout = end_states[i].layout;
+            states[i].write_stages = end_states[i].write_stages | end_states[i].read_stages;
+            states[i].write_access = end_states[i].write_access;
+        }
+        else if(resource->used)
+        {
+            for(uint32_t j = 0; j < graph->resource_count; j++)
+            {
+                other = &graph->resources[j];
+                
+                if(prv_is_transient(other) && (i == j || prv_memory_overlaps(resource, other)))
+                {
+                    states[i].write_stages |= end_states[j].write_stages | end_states[j].read_stages;
+                    states[i].write_access |= end_states[j].write_access;
+                }
+            }
+        }
+        
+        if(resource->discard)
+        {
+            states[i].layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        }
+    }
+}
+
+static void prv_final_barriers(RenderGraph *graph, const ResourceState *states)
+{
+    GraphBarrierBatch *batch = &graph->final_barriers;
+    GraphResource *resource;
+    
+    *batch = (GraphBarrierBatch) {0};
+    batch->first_image_barrier = graph->image_barrier_count;
+    
+    for(uint32_t i = 0; i < graph->resource_count; i++)
+    {
+        resource = &graph->resources[i];
+        
+        if(resource->used && resource->imported && resource->type == GRAPH_RESOURCE_IMAGE &&
+           states[i].layout != resource->final_layout && graph->image_barrier_count < MAX_GRAPH_IMAGE_BARRIERS)
+        {
+            graph->image_barriers[graph->image_barrier_count] = (GraphImageBarrier) {
+                i, states[i].layout, resource->final_layout, states[i].write_access, 0};
+            graph->image_barrier_count += 1;
+            batch->image_barrier_count += 1;
+            
+            batch->src_stages |= states[i].write_stages | states[i].read_stages;
+            batch->dst_stages |= resource->per_image ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : states[i].first_stages;
+        }
+    }
+    
+    if(batch->dst_stages)
+    {
+        graph->barrier_batch_count += 1;
+    }
+}
+
+static VkResult prv_create_transient(Interface *func, GraphResource *resource)
+{
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    VkImageCreateInfo image_create_info = {0};
+    VkBufferCreateInfo buffer_create_info = {0};
+    
+    if(resource->type == GRAPH_RESOURCE_IMAGE)
+    {
+        image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_create_info.imageType = VK_IMAGE_TYPE_2D;
+        image_create_info.format = resource->format;
+        image_create_info.extent = (VkExtent3D) {resource->extent.width, resource->extent.height, 1};
+        image_create_info.mipLevels = 1;
+        image_create_info.arrayLayers = 1;
+        image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_create_info.usage = resource->image_usage;
+        image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        
+        result = func->vkCreateImage(func->device, &image_create_info, 0, &resource->images[0]);
+        
+        if(result == VK_SUCCESS)
+        {
+            func->vkGetImageMemoryRequirements(func->device, resource->images[0], &resource->requirements);
+        }
+    }
+    else
+    {
+        buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buffer_create_info.size = resource->size;
+        buffer_create_info.usage = resource->buffer_usage;
+        buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        
+        result = func->vkCreateBuffer(func->device, &buffer_create_info, 0, &resource->buffer);
+        
+        if(result == VK_SUCCESS)
+        {
+            func->vkGetBufferMemoryRequirements(func->device, resource->buffer, &resource->requirements);
+        }
+    }
+    
+    return result;
+}
+
+static VkResult prv_create_view(Interface *func, GraphResource *resource)
+{
+    VkImageViewCreateInfo image_view_create_info = {0};
+    
+    image_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    image_view_create_info.image = resource->images[0];
+    image_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    image_view_create_info.format = resource->format;
+    image_view_create_info.subresourceRange.aspectMask = resource->aspect;
+    image_view_create_info.subresourceRange.levelCount = 1;
+    image_view_create_info.subresourceRange.layerCount = 1;
+    
+    return func->vkCreateImageView(func->device, &image_view_create_info, 0, &resource->views[0]);
+}
+
+static VkResult prv_bind_transients(Interface *func, RenderGraph *graph)
+{
+    VkResult result = VK_SUCCESS;
+    VkMemoryAllocateInfo alloc_info = {0};
+    uint32_t type_bits = UINT32_MAX;
+    GraphResource *resource;
+    
+    for(uint32_t i = 0; i < graph->resource_count; i++)
+    {
+        if(prv_is_transient(&graph->resources[i]))
+        {
+            type_bits &= graph->resources[i].requirements.memoryTypeBits;
+        }
+    }
+    
+    if(graph->transient_size > 0)
+    {
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize = graph->transient_size;
+        alloc_info.memoryTypeIndex = find_memory_type(func, type_bits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+        
+        if(alloc_info.memoryTypeIndex == UINT32_MAX)
+        {
+            func->printf("Transient resources have no memory type in common\n");
+            result = VK_ERROR_INITIALIZATION_FAILED;
+        }
+        else
+        {
+            result = func->vkAllocateMemory(func->device, &alloc_info, 0, &graph->transient_memory);
+        }
+    }
+    
+    for(uint32_t i = 0; i < graph->resource_count && result == VK_SUCCESS; i++)
+    {
+        resource = &graph->resources[i];
+        
+        if(prv_is_transient(resource) && resource->type == GRAPH_RESOURCE_IMAGE)
+        {
+            result = func->vkBindImageMemory(func->device, resource->images[0], graph->transient_memory, resource->offset);
+            
+            if(result == VK_SUCCESS)
+            {
+                result = prv_create_view(func, resource);
+            }
+        }
+        else if(prv_is_transient(resource))
+        {
+            result = func->vkBindBufferMemory(func->device, resource->buffer, graph->transient_memory, resource->offset);
+        }
+    }
+    
+    return result;
+}
+
+static VkResult prv_create_framebuffers(Interface *func, RenderGraph *graph, GraphPass *pass)
+{
+    VkResult result = VK_SUCCESS;
+    VkFramebufferCreateInfo framebuffer_create_info = {0};
+    VkImageView views[MAX_PASS_ACCESSES];
+    uint32_t framebuffer_count = pass->per_image ? func->swapchain_image_count : 1;
+    uint32_t view_count;
+    GraphResource *resource;
+    
+    pass->extent = (VkExtent2D) {0, 0};
+    
+    for(uint32_t i = 0; i < framebuffer_count && result == VK_SUCCESS; i++)
+    {
+        view_count = 0;
+        
+        for(uint32_t j = 0; j < pass->access_count; j++)
+        {
+            resource = &graph->resources[pass->accesses[j].resource];
+            
+            if(prv_usage_info(pass->type, pass->accesses[j].usage).attachment)
+            {
+                views[view_count] = resource->views[resource->per_image ? i : 0];
+                view_count += 1;
+                
+                if(pass->extent.width == 0)
+                {
+                    pass->extent = resource->extent;
+                }
+            }
+        }
+        
+        framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebuffer_create_info.renderPass = pass->render_pass;
+        framebuffer_create_info.attachmentCount = view_count;
+        framebuffer_create_info.pAttachments = views;
+        framebuffer_create_info.width = pass->extent.width;
+        framebuffer_create_info.height = pass->extent.height;
+        framebuffer_create_info.layers = 1;
+        
+        result = func->vkCreateFramebuffer(func->device, &framebuffer_create_info, 0, &pass->framebuffers[i]);
+    }
+    
+    return result;
+}
+
+static void prv_report(Interface *func, RenderGraph *graph)
+{
+    uint32_t pass_count = 0;
+    uint32_t access_count = 0;
+    
+    for(uint32_t i = 0; i < graph->pass_count; i++)
+    {
+        if(!graph->passes[i].culled)
+        {
+            pass_count += 1;
+            access_count += graph->passes[i].access_count;
+        }
+    }
+    
+    func->printf("Render graph: %u of %u passes, %u barrier calls and %u image barriers for %u accesses\n",
+        pass_count, graph->pass_count, graph->barrier_batch_count, graph->image_barrier_count, access_count);
+    func->printf("Render graph: %llu KiB transient memory, %llu KiB saved by aliasing\n",
+        (unsigned long long)(graph->transient_size / 1024),
+        (unsigned long long)((graph->unaliased_size - MIN(graph->unaliased_size, graph->transient_size)) / 1024));
+}
+
+/* Needs the swapchain, the graph has to be compiled first */
+bool graph_create_resources(Interface *func, RenderGraph *graph)
+{
+    VkResult result = graph->compiled ? VK_SUCCESS : VK_ERROR_INITIALIZATION_FAILED;
+    ResourceState end_states[MAX_GRAPH_RESOURCES];
+    ResourceState states[MAX_GRAPH_RESOURCES];
+    GraphResource *resource;
+    
+    for(uint32_t i = 0; i < graph->resource_count && result == VK_SUCCESS; i++)
+    {
+        resource = &graph->resources[i];
+        
+        if(resource->extent.width == 0)
+        {
+            resource->extent = func->swapchain_extent;
+        }
+        
+        if(resource->per_image)
+        {
+            for(uint32_t j = 0; j < func->swapchain_image_count; j++)
+            {
+                resource->images[j] = func->swapchain_images[j];
+                resource->views[j] = func->swapchain_image_views[j];
+            }
+        }
+        else if(prv_is_transient(resource))
+        {
+            result = prv_create_transient(func, resource);
+        }
+    }
+    
+    if(result == VK_SUCCESS)
+    {
+        prv_place_transients(func, graph);
+        result = prv_bind_transients(func, graph);
+    }
+    
+    for(uint32_t i = 0; i < graph->pass_count && result == VK_SUCCESS; i++)
+    {
+        if(!graph->passes[i].culled && graph->passes[i].type == GRAPH_PASS_GRAPHICS)
+        {
+            result = prv_create_framebuffers(func, graph, &graph->passes[i]);
+        }
+    }
+    
+    if(result == VK_SUCCESS)
+    {
+        /* The first walk only finds out how a frame ends, which is
+         * what the next frame has to synchronize against           */
+        for(uint32_t i = 0; i < graph->resource_count; i++)
+        {
+            end_states[i] = (ResourceState) {0};
+            end_states[i].layout = graph->resources[i].imported && !graph->resources[i].discard ?
+                graph->resources[i].final_layout : VK_IMAGE_LAYOUT_UNDEFINED;
+        }
+        prv_build_barriers(graph, end_states, false);
+        
+        graph->image_barrier_count = 0;
+        graph->barrier_batch_count = 0;
+        prv_initial_states(graph, end_states, states);
+        prv_build_barriers(graph, states, true);
+        prv_final_barriers(graph, states);
+        
+        prv_report(func, graph);
+    }
+    else
+    {
+        func->printf("Failed to create render graph resources with error %d\n", result);
+    }
+    
+    return result == VK_SUCCESS;
+}
+
+static void prv_emit_barriers(Interface *func, RenderGraph *graph, const GraphBarrierBatch *batch,
+    VkCommandBuffer cmd, uint32_t image_index)
+{
+    VkImageMemoryBarrier image_barriers[MAX_GRAPH_RESOURCES] = {0};
+    VkMemoryBarrier memory_barrier = {0};
+    const GraphImageBarrier *barrier;
+    const GraphResource *resource;
+    uint32_t count = MIN(batch->image_barrier_count, MAX_GRAPH_RESOURCES);
+    
+    for(uint32_t i = 0; i < count; i++)
+    {
+        barrier = &graph->image_barriers[batch->first_image_barrier + i];
+        resource = &graph->resources[barrier->resource];
+        
+        image_barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        image_barriers[i].srcAccessMask = barrier->src_access;
+        image_barriers[i].dstAccessMask = barrier->dst_access;
+        image_barriers[i].oldLayout = barrier->old_layout;
+        image_barriers[i].newLayout = barrier->new_layout;
+        image_barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        image_barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        image_barriers[i].image = resource->images[resource->per_image ? image_index : 0];
+        image_barriers[i].subresourceRange = (VkImageSubresourceRange) {resource->aspect, 0, VK_REMAINING_MIP_LEVELS, 0, 1};
+    }
+    
+    memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memory_barrier.srcAccessMask = batch->src_access;
+    memory_barrier.dstAccessMask = batch->dst_access;
+    
+    func->vkCmdPipelineBarrier(
+        cmd, batch->src_stages, batch->dst_stages, 0,
+        batch->dst_access ? 1 : 0, &memory_barrier, 0, NULL, count, image_barriers);
+}
+
+void graph_execute(Interface *func, RenderGraph *graph, VkCommandBuffer cmd, uint32_t image_index)
+{
+    GraphPass *pass;
+    VkRenderPassBeginInfo renderpass_begin = {0};
+    VkViewport viewport;
+    VkRect2D scissor;
+    VkExtent2D area;
+    
+    graph->image_index = image_index;
+    
+    for(uint32_t i = 0; i < graph->pass_count; i++)
+    {
+        pass = &graph->passes[i];
+        
+        if(!pass->culled && pass->barriers.dst_stages)
+        {
+            prv_emit_barriers(func, graph, &pass->barriers, cmd, image_index);
+        }
+        
+        if(!pass->culled && pass->type == GRAPH_PASS_GRAPHICS)
+        {
+            area = pass->extent;
+            
+            if(pass->render_area.width > 0 && pass->render_area.height > 0)
+            {
+                area.width = MIN(pass->render_area.width, pass->extent.width);
+                area.height = MIN(pass->render_area.height, pass->extent.height);
+            }
+            
+            viewport = (VkViewport) {0.0f, 0.0f, area.width, area.height, 0.0f, 1.0f};
+            scissor = (VkRect2D) {{0, 0}, area};
+            
+            renderpass_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            renderpass_begin.renderPass = pass->render_pass;
+            renderpass_begin.framebuffer = pass->framebuffers[pass->per_image ? image_index : 0];
+            renderpass_begin.renderArea = scissor;
+            renderpass_begin.clearValueCount = pass->clear_count;
+            renderpass_begin.pClearValues = pass->clear_values;
+            
+            func->vkCmdBeginRenderPass(cmd, &renderpass_begin, VK_SUBPASS_CONTENTS_INLINE);
+            func->vkCmdSetViewport(cmd, 0, 1, &viewport);
+            func->vkCmdSetScissor(cmd, 0, 1, &scissor);
+            
+            pass->record(func, cmd, pass->data);
+            
+            func->vkCmdEndRenderPass(cmd);
+        }
+        else if(!pass->culled)
+        {
+            pass->record(func, cmd, pass->data);
+        }
+    }
+    
+    if(graph->final_barriers.dst_stages)
+    {
+        prv_emit_barriers(func, graph, &graph->final_barriers, cmd, image_index);
+    }
+}
+
+VkRenderPass graph_render_pass(RenderGraph *graph, uint32_t pass)
+{
+    return pass < graph->pass_count ? graph->passes[pass].render_pass : VK_NULL_HANDLE;
+}
+
+VkImageView graph_image_view(RenderGraph *graph, uint32_t resource, uint32_t image_index)
+{
+    GraphResource *graph_resource = &graph->resources[resource];
+    
+    return graph_resource->views[graph_resource->per_image ? image_index : 0];
+}
+
+VkBuffer graph_buffer(RenderGraph *graph, uint32_t resource)
+{
+    return graph->resources[resource].buffer;
+}
+
+/* For record callbacks, per-image resources give the image of the
+ * frame being recorded                                             */
+VkImage graph_image(RenderGraph *graph, uint32_t resource)
+{
+    GraphResource *graph_resource = &graph->resources[resource];
+    
+    return graph_resource->images[graph_resource->per_image ? graph->image_index : 0];
+}
@@ -0,0 +1,299 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "interface.h"
+#include "renderer_int.h"
+
+#define MAX_SUBMIT_SIGNALS 4
+#define INITIAL_DEFERRED_RELEASES 64
+
+/* Every graphics queue submission goes through lifetime_submit and is
+ * tagged with the next value of a monotonically increasing counter.
+ * With timeline semaphores the submission signals that value directly,
+ * otherwise it signals a fence from a small ring that is polled in
+ * submission order. Either way "value N has completed" means every
+ * submission up to and including N has finished on the GPU.
+ *
+ * All of this is meant to be used from the render thread only.         */
+
+bool init_lifetime(Interface *func)
+{
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    VkSemaphoreCreateInfo sem_create_info = {0};
+    VkSemaphoreTypeCreateInfo sem_type_create_info = {0};
+    VkFenceCreateInfo fence_create_info = {0};
+    
+    func->submit_value = 0;
+    func->completed_value = 0;
+    func->submit_fence_head = 0;
+    func->submit_fence_count = 0;
+    
+    if(func->timeline_supported)
+    {
+        sem_type_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        sem_type_create_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        sem_type_create_info.initialValue = 0;
+        
+        sem_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        sem_create_info.pNext = &sem_type_create_info;
+        
+        result = func->vkCreateSemaphore(func->device, &sem_create_info, 0, &func->timeline_sem);
+        
+        if(result != VK_SUCCESS)
+        {
+            func->printf("Failed to create timeline semaphore, falling back to fences\n");
+            func->timeline_supported = false;
+        }
+    }
+    
+    if(!func->timeline_supported)
+    {
+        fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        
+        for(uint32_t i = 0; i < MAX_PENDING_SUBMITS; i++)
+        {
+            result = func->vkCreateFence(func->device, &fence_create_info, 0, &func->submit_fences[i]);
+            
+            if(result != VK_SUCCESS)
+            {
+                break;
+            }
+        }
+    }
+    
+    if(result == VK_SUCCESS)
+    {
+        func->printf("Tracking submissions with %s\n", func->timeline_supported ? "a timeline semaphore" : "fences");
+    }
+    
+    return result == VK_SUCCESS;
+}
+
+/* Submits a single batch to the graphics queue and returns the value
+ * that will be reached once it completes, or 0 if submission failed  */
+uint64_t lifetime_submit(Interface *func, const VkSubmitInfo *submit_info)
+{
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    VkSubmitInfo info = *submit_info;
+    VkSemaphore signal_sems[MAX_SUBMIT_SIGNALS + 1];
+    uint64_t signal_values[MAX_SUBMIT_SIGNALS + 1] = {0};
+    VkTimelineSemaphoreSubmitInfo timeline_info = {0};
+    VkFence fence = VK_NULL_HANDLE;
+    uint64_t value = func->submit_value + 1;
+    
+    if(func->timeline_supported)
+    {
+        if(info.signalSemaphoreCount < MAX_SUBMIT_SIGNALS)
+        {
+            for(uint32_t i = 0; i < info.signalSemaphoreCount; i++)
+            {
+                signal_sems[i] = info.pSignalSemaphores[i];
+            }
+            
+            /* Binary semaphores ignore their value */
+            signal_sems[info.signalSemaphoreCount] = func->timeline_sem;
+            signal_values[info.signalSemaphoreCount] = value;
+            info.signalSemaphoreCount += 1;
+            info.pSignalSemaphores = signal_sems;
+            
+            timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            timeline_info.pNext = info.pNext;
+            timeline_info.signalSemaphoreValueCount = info.signalSemaphoreCount;
+            timeline_info.pSignalSemaphoreValues = signal_values;
+            info.pNext = &timeline_info;
+            
+            result = func->vkQueueSubmit(func->queue, 1, &info, VK_NULL_HANDLE);
+        }
+        else
+        {
+            func->printf("Max number of signal semaphores reached\n");
+        }
+    }
+    else
+    {
+        /* Make room in the ring by waiting on the oldest submission */
+        if(func->submit_fence_count == MAX_PENDING_SUBMITS)
+        {
+            lifetime_wait(func, func->submit_fence_values[func->submit_fence_head]);
+        }
+        
+        fence = func->submit_fences[(func->submit_fence_head + func->submit_fence_count) % MAX_PENDING_SUBMITS];
+        result = func->vkQueueSubmit(func->queue, 1, &info, fence);
+        
+        if(result == VK_SUCCESS)
+        {
+            func->submit_fence_values[(func->submit_fence_head + func->submit_fence_count) % MAX_PENDING_SUBMITS] = value;
+            func->submit_fence_count += 1;
+        }
+    }
+    
+    if(result == VK_SUCCESS)
+    {
+        func->submit_value = value;
+    }
+    else
+    {
+        func->printf("Failed to submit with error %d\n", result);
+        value = 0;
+    }
+    
+    return value;
+}
+
+/* Never blocks */
+uint64_t lifetime_completed_value(Interface *func)
+{
+    uint64_t value;
+    
+    if(func->timeline_supported)
+    {
+        if(func->vkGetSemaphoreCounterValue(func->device, func->timeline_sem, &value) == VK_SUCCESS &&
+           value > func->completed_value)
+        {
+            func->completed_value = value;
+        }
+    }
+    else
+    {
+        while(func->submit_fence_count > 0 &&
+              func->vkGetFenceStatus(func->device, func->submit_fences[func->submit_fence_head]) == VK_SUCCESS)
+        {
+            func->completed_value = func->submit_fence_values[func->submit_fence_head];
+            func->vkResetFences(func->device, 1, &func->submit_fences[func->submit_fence_head]);
+            func->submit_fence_head = (func->submit_fence_head + 1) % MAX_PENDING_SUBMITS;
+            func->submit_fence_count -= 1;
+        }
+    }
+    
+    return func->completed_value;
+}
+
+bool lifetime_wait(Interface *func, uint64_t value)
+{
+    VkSemaphoreWaitInfo wait_info = {0};
+    
+    /* Waiting on something never submitted would block forever */
+    if(value > func->submit_value)
+    {
+        func->printf("Waiting on value %llu which was never submitted\n", (unsigned long long)value);
+    }
+    else if(value > lifetime_completed_value(func))
+    {
+        if(func->timeline_supported)
+        {
+            wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+            wait_info.semaphoreCount = 1;
+            wait_info.pSemaphores = &func->timeline_sem;
+            wait_info.pValues = &value;
+            
+            if(func->vkWaitSemaphores(func->device, &wait_info, UINT64_MAX) == VK_SUCCESS)
+            {
+                lifetime_completed_value(func);
+            }
+        }
+        else
+        {
+            while(func->completed_value < value && func->submit_fence_count > 0)
+            {
+                func->vkWaitForFences(func->device, 1, &func->submit_fences[func->submit_fence_head], VK_TRUE, UINT64_MAX);
+                lifetime_completed_value(func);
+            }
+        }
+    }
+    
+    return func->completed_value >= value;
+}
+
+static void prv_defer(Interface *func, const DeferredRelease *release)
+{
+    uint32_t capacity = func->deferred_release_capacity ? func->deferred_release_capacity * 2 : INITIAL_DEFERRED_RELEASES;
+    DeferredRelease *releases;
+    
+    if(func->deferred_release_count == func->deferred_release_capacity)
+    {
+        releases = func->realloc(func->deferred_releases, capacity * sizeof(DeferredRelease));
+        
+        if(releases)
+        {
+            func->deferred_releases = releases;
+            func->deferred_release_capacity = capacity;
+        }
+    }
+    
+    if(func->deferred_release_count < func->deferred_release_capacity)
+    {
+        func->deferred_releases[func->deferred_release_count] = *release;
+        func->deferred_release_count += 1;
+    }
+    else
+    {
+        /* Leaking is better than destroying something still in use */
+        func->printf("Failed to grow deferred release queue\n");
+    }
+}
+
+/* Runs release once every submission up to value has completed */
+void lifetime_defer(Interface *func, uint64_t value, PFN_release release, void *data)
+{
+    prv_defer(func, &(DeferredRelease) {.value = value, .type = RELEASE_CALLBACK, .callback = {release, data}});
+}
+
+void lifetime_defer_buffer(Interface *func, uint64_t value, VkBuffer buffer)
+{
+    prv_defer(func, &(DeferredRelease) {.value = value, .type = RELEASE_BUFFER, .buffer = buffer});
+}
+
+void lifetime_defer_image(Interface *func, uint64_t value, VkImage image)
+{
+    prv_defer(func, &(DeferredRelease) {.value = value, .type = RELEASE_IMAGE, .image = image});
+}
+
+void lifetime_defer_image_view(Interface *func, uint64_t value, VkImageView image_view)
+{
+    prv_defer(func, &(DeferredRelease) {.value = value, .type = RELEASE_IMAGE_VIEW, .image_view = image_view});
+}
+
+void lifetime_defer_memory(Interface *func, uint64_t value, VkDeviceMemory memory)
+{
+    prv_defer(func, &(DeferredRelease) {.value = value, .type = RELEASE_MEMORY, .memory = memory});
+}
+
+void lifetime_collect(Interface *func)
+{
+    uint64_t completed = lifetime_completed_value(func);
+    DeferredRelease release;
+    uint32_t i = 0;
+    
+    while(i < func->deferred_release_count)
+    {
+        if(func->deferred_releases[i].value > completed)
+        {
+            i++;
+        }
+        else
+        {
+            /* Remove before releasing since callbacks may defer more work */
+            release = func->deferred_releases[i];
+            func->deferred_release_count -= 1;
+            func->deferred_releases[i] = func->deferred_releases[func->deferred_release_count];
+            
+            switch(release.type)
+            {
+                case RELEASE_CALLBACK:
+                    release.callback.release(func, release.callback.data);
+                    break;
+                case RELEASE_BUFFER:
+                    func->vkDestroyBuffer(func->device, release.buffer, 0);
+                    break;
+                case RELEASE_IMAGE:
+                    func->vkDestroyImage(func->device, release.image, 0);
+                    break;
+                case RELEASE_IMAGE_VIEW:
+                    func->vkDestroyImageView(func->device, release.image_view, 0);
+                    break;
+                case RELEASE_MEMORY:
+                    func->vkFreeMemory(func->device, release.memory, 0);
+                    break;
+            }
+        }
+    }
+}
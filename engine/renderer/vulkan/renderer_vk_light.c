@@ -0,0 +1,388 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include "interface.h"
+#include "cull.h"
+#include "renderer_int.h"
+
+/* Clustered forward lighting. The view frustum is split into a grid of
+ * CLUSTER_X by CLUSTER_Y screen tiles and CLUSTER_Z exponential depth
+ * slices. Each frame the CPU writes the lights inside the frustum in
+ * view space, a pass on the async compute queue writes the lights
+ * touching each cluster as a compact range of one index array and
+ * the lit fragment shader only walks the range of the cluster it
+ * falls in.                                                          */
+
+static const uint32_t light_benchmark_counts[] = {0, 64, 256, 1024, 4096, 16384};
+#define LIGHT_BENCHMARK_STEPS (sizeof(light_benchmark_counts) / sizeof(light_benchmark_counts[0]))
+
+bool light_supported(Interface *func)
+{
+    const char *reason = NULL;
+    
+    if(!func->bindless_supported)
+    {
+        reason = "bindless resources not supported";
+    }
+    else if(func->physical_device_properties.limits.maxStorageBufferRange < CLUSTER_BUFFER_SIZE)
+    {
+        reason = "storage buffer range too small for the cluster lists";
+    }
+    
+    if(reason)
+    {
+        func->printf("Clustered lighting disabled, %s\n", reason);
+    }
+    
+    return reason == NULL;
+}
+
+/* One partition of lights per frame slot, written by light_begin_frame
+ * once the slot is no longer in use by the GPU                        */
+static bool prv_create_buffers(Interface *func)
+{
+    bool result;
+    void *mapped = NULL;
+    
+    func->light_partition = (VkDeviceSize)LIGHT_MAX_LIGHTS * sizeof(Light);
+    func->light_partition = (func->light_partition + func->uniform_alignment - 1) & ~(func->uniform_alignment - 1);
+    
+    result = create_buffer(
+        func, func->light_partition * MAX_FRAMES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &func->light_buffer, &func->light_memory, NULL);
+    
+    if(result)
+    {
+        result = func->vkMapMemory(func->device, func->light_memory, 0, VK_WHOLE_SIZE, 0, &mapped) == VK_SUCCESS;
+        func->light_mapped = mapped;
+    }
+    
+    for(uint32_t i = 0; i < MAX_FRAMES && result; i++)
+    {
+        func->light_bindless[i] = renderer_bindless_add_buffer(func, func->light_buffer, func->light_partition * i, func->light_partition);
+        result = func->light_bindless[i] != BINDLESS_INVALID;
+    }
+    
+    /* The cluster lists are binned on the compute queue, which can
+     * run ahead into the next slot while graphics still reads the
+     * current one, so each slot gets its own partition             */
+    func->cluster_partition = (CLUSTER_BUFFER_SIZE + func->uniform_alignment - 1) & ~(func->uniform_alignment - 1);
+    
+    if(result)
+    {
+        result = create_buffer(
+            func, func->cluster_partition * MAX_FRAMES,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, &func->cluster_buffer, &func->cluster_memory, NULL);
+    }
+    
+    for(uint32_t i = 0; i < MAX_FRAMES && result; i++)
+    {
+        func->cluster_bindless[i] = renderer_bindless_add_buffer(func, func->cluster_buffer, func->cluster_partition * i, CLUSTER_BUFFER_SIZE);
+        result = func->cluster_bindless[i] != BINDLESS_INVALID;
+    }
+    
+    if(!result)
+    {
+        func->printf("Failed to create light buffers\n");
+    }
+    
+    return result;
+}
+
+static bool prv_create_pipeline(Interface *func)
+{
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    VkPipelineLayoutCreateInfo layout_create_info = {0};
+    VkComputePipelineCreateInfo pipeline_create_info = {0};
+    
+    /* Lights and clusters are both reached through the bindless set */
+    layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_create_info.setLayoutCount = 2;
+    layout_create_info.pSetLayouts = (VkDescriptorSetLayout[]) {func->frame_set_layout, func->bindless_set_layout};
+    
+    result = func->vkCreatePipelineLayout(func->device, &layout_create_info, 0, &func->light_pipeline_layout);
+    
+    if(result == VK_SUCCESS)
+    {
+        pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipeline_create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipeline_create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipeline_create_info.stage.module = func->light_cluster_shader;
+        pipeline_create_info.stage.pName = "main";
+        pipeline_create_info.layout = func->light_pipeline_layout;
+        
+        result = func->vkCreateComputePipelines(func->device, VK_NULL_HANDLE, 1, &pipeline_create_info, 0, &func->light_pipeline);
+    }
+    
+    if(result != VK_SUCCESS)
+    {
+        func->printf("Failed to create light binning pipeline with error %d\n", result);
+    }
+    
+    return result == VK_SUCCESS;
+}
+
+bool init_lights(Interface *func)
+{
+    bool result = true;
+    
+    func->light_visible_count = 0;
+    
+    for(uint32_t i = 0; i < MAX_FRAMES; i++)
+    {
+        func->light_bindless[i] = BINDLESS_INVALID;
+        func->cluster_bindless[i] = BINDLESS_INVALID;
+    }
+    
+    /* Without it the main pass keeps the unlit fragment shader and
+     * lights can't be added                                        */
+    if(func->lights_enabled)
+    {
+        func->lights = func->malloc(sizeof(LightSet));
+        result = func->lights != NULL;
+        result = result && prv_create_buffers(func);
+        result = result && prv_create_pipeline(func);
+        result = result && renderer_add_compute_pass(func, record_light_binning, NULL);
+    }
+    
+    if(result && func->lights_enabled)
+    {
+        memset(func->lights, 0, sizeof(LightSet));
+        
+        func->printf("Clustered lighting: up to %u lights, %ux%ux%u clusters, %u light indices\n",
+            LIGHT_MAX_LIGHTS, CLUSTER_X, CLUSTER_Y, CLUSTER_Z, CLUSTER_MAX_INDICES);
+    }
+    
+    return result;
+}
+
+void renderer_set_light(Interface *func, uint32_t light, const float position[3], float radius, const float color[3], float intensity)
+{
+    LightSet *set = func->lights;
+    
+    if(set && light < set->count && set->lights[light].radius > 0.0f)
+    {
+        set->lights[light] = (Light) {
+            {position[0], position[1], position[2]}, MAX(radius, FLT_MIN),
+            {color[0], color[1], color[2]}, intensity};
+    }
+}
+
+/* A radius of zero or less is raised to the smallest positive one,
+ * LIGHT_INVALID once LIGHT_MAX_LIGHTS are in use                   */
+uint32_t renderer_add_light(Interface *func, const float position[3], float radius, const float color[3], float intensity)
+{
+    LightSet *set = func->lights;
+    uint32_t light = LIGHT_INVALID;
+    
+    if(set && set->free_count > 0)
+    {
+        set->free_count -= 1;
+        light = set->free_list[set->free_count];
+    }
+    else if(set && set->count < LIGHT_MAX_LIGHTS)
+    {
+        light = set->count;
+        set->count += 1;
+    }
+    
+    if(light != LIGHT_INVALID)
+    {
+        set->live_count += 1;
+        set->lights[light].radius = FLT_MIN;
+        renderer_set_light(func, light, position, radius, color, intensity);
+    }
+    
+    return light;
+}
+
+void renderer_remove_light(Interface *func, uint32_t light)
+{
+    LightSet *set = func->lights;
+    
+    if(set && light < set->count && set->lights[light].radius > 0.0f)
+    {
+        set->lights[light].radius = 0.0f;
+        set->free_list[set->free_count] = light;
+        set->free_count += 1;
+        set->live_count -= 1;
+    }
+}
+
+/* Writes the lights whose spheres touch the view frustum into the
+ * frame slot's partition in view space. Must be called once the slot
+ * is no longer in use by the GPU.                                     */
+void light_begin_frame(Interface *func, uint32_t frame)
+{
+    LightSet *set = func->lights;
+    const float *view = func->view;
+    uint64_t start_ticks = func->get_perf_counter();
+    uint32_t visible = 0;
+    const Light *light;
+    Light *lights;
+    Frustum frustum;
+    bool inside;
+    
+    if(set && set->live_count > 0)
+    {
+        lights = (Light*)(func->light_mapped + func->light_partition * frame);
+        cull_frustum_from_matrix(&frustum, func->view_proj);
+        
+        for(uint32_t i = 0; i < set->count; i++)
+        {
+            light = &set->lights[i];
+            inside = light->radius > 0.0f;
+            
+            for(uint32_t j = 0; j < 6 && inside; j++)
+            {
+                inside = frustum.a[j] * light->position[0] + frustum.b[j] * light->position[1] +
+                    frustum.c[j] * light->position[2] + frustum.d[j] >= -light->radius;
+            }
+            
+            if(inside)
+            {
+                lights[visible].position[0] = view[0] * light->position[0] + view[4] * light->position[1] + view[8] * light->position[2] + view[12];
+                lights[visible].position[1] = view[1] * light->position[0] + view[5] * light->position[1] + view[9] * light->position[2] + view[13];
+                lights[visible].position[2] = view[2] * light->position[0] + view[6] * light->position[1] + view[10] * light->position[2] + view[14];
+                lights[visible].radius = light->radius;
+                memcpy(lights[visible].color, light->color, sizeof(light->color));
+                lights[visible].intensity = light->intensity;
+                visible += 1;
+            }
+        }
+    }
+    
+    func->light_visible_count = visible;
+    
+    if(set)
+    {
+        set->benchmark_cpu_ticks += func->get_perf_counter() - start_ticks;
+    }
+}
+
+/* Recorded on the async compute queue, the main pass of the same
+ * frame waits on it before fragment shading. Only the header is
+ * cleared, every range is written by the binning, and it runs with
+ * no lights as well so every cluster gets an empty range.          */
+void record_light_binning(Interface *func, VkCommandBuffer cmd, void *data)
+{
+    uint32_t frame = func->frame_index;
+    uint32_t dynamic_offsets[2] = {func->frame_constants_offset, func->frame_constants_offset};
+    VkBufferMemoryBarrier barrier = {0};
+    
+    func->vkCmdFillBuffer(cmd, func->cluster_buffer, func->cluster_partition * frame, CLUSTER_HEADER_SIZE, 0);
+    
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = func->cluster_buffer;
+    barrier.offset = func->cluster_partition * frame;
+    barrier.size = CLUSTER_HEADER_SIZE;
+    
+    func->vkCmdPipelineBarrier(
+        cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 0, NULL, 1, &barrier, 0, NULL);
+    
+    func->vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, func->light_pipeline);
+    func->vkCmdBindDescriptorSets(
+        cmd, VK_PIPELINE_BIND_POINT_COMPUTE, func->light_pipeline_layout,
+        0, 2, (VkDescriptorSet[]) {func->frame_set, func->bindless_set}, 2, dynamic_offsets);
+    func->vkCmdDispatch(cmd, (CLUSTER_COUNT + LIGHT_GROUP_SIZE - 1) / LIGHT_GROUP_SIZE, 1, 1);
+}
+
+/* Deterministic values in [0, 1) so every run bins the same lights */
+static float prv_random(uint32_t *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    
+    return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+/* Lights spread through the frustum of a fixed camera, with depths
+ * spread evenly over the slices and radii growing with depth so each
+ * light covers about the same number of clusters                     */
+static void prv_benchmark_lights(Interface *func, uint32_t count)
+{
+    LightSet *set = func->lights;
+    float aspect = (float)func->swapchain_extent.width / MAX(func->swapchain_extent.height, 1);
+    float near = 0.1f, far = 100.0f;
+    float focal = 1.7320508f;
+    float view[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+    float projection[16] = {0.0f};
+    float position[3], color[3];
+    float depth;
+    uint32_t state = 1;
+    
+    /* 60 degrees vertically, looking down -z with depth from 0 to 1 */
+    projection[0] = focal / aspect;
+    projection[5] = -focal;
+    projection[10] = far / (near - far);
+    projection[11] = -1.0f;
+    projection[14] = near * far / (near - far);
+    renderer_set_camera(func, view, projection, near, far);
+    
+    /* Slots past count are never read, so dropping them is enough */
+    set->count = 0;
+    set->live_count = 0;
+    set->free_count = 0;
+    
+    for(uint32_t i = 0; i < count; i++)
+    {
+        depth = near * 2.0f * powf(far / (near * 2.0f), prv_random(&state));
+        position[0] = (prv_random(&state) * 2.0f - 1.0f) * depth * aspect / focal;
+        position[1] = (prv_random(&state) * 2.0f - 1.0f) * depth / focal;
+        position[2] = -depth;
+        color[0] = prv_random(&state);
+        color[1] = prv_random(&state);
+        color[2] = prv_random(&state);
+        
+        renderer_add_light(func, position, depth * 0.1f, color, 1.0f);
+    }
+}
+
+/* Steps through light_benchmark_counts, holding each count for
+ * LIGHT_BENCHMARK_FRAMES and skipping the frames still in flight
+ * with the previous count before averaging the GPU frame time.
+ * Binning runs on the compute queue and is timed separately.     */
+void light_benchmark_frame(Interface *func)
+{
+    LightSet *set = func->lights;
+    uint32_t measured;
+    
+    if(set && set->benchmark_step < LIGHT_BENCHMARK_STEPS)
+    {
+        if(set->benchmark_frames == 0)
+        {
+            prv_benchmark_lights(func, light_benchmark_counts[set->benchmark_step]);
+            set->benchmark_gpu_ms = 0.0;
+            set->benchmark_binning_ms = 0.0;
+            set->benchmark_cpu_ticks = 0;
+        }
+        else if(set->benchmark_frames > MAX_FRAMES)
+        {
+            set->benchmark_gpu_ms += func->gpu_frame_ms;
+            set->benchmark_binning_ms += func->gpu_compute_ms;
+        }
+        
+        set->benchmark_frames += 1;
+        
+        if(set->benchmark_frames == LIGHT_BENCHMARK_FRAMES)
+        {
+            measured = LIGHT_BENCHMARK_FRAMES - MAX_FRAMES - 1;
+            
+            func->printf("Light benchmark: %5u lights, %5u visible, %.3f ms GPU frame, %.3f ms binning, %.3f ms CPU upload\n",
+                light_benchmark_counts[set->benchmark_step], func->light_visible_count,
+                set->benchmark_gpu_ms / measured, set->benchmark_binning_ms / measured,
+                set->benchmark_cpu_ticks * 1000.0 / func->get_perf_frequency() / LIGHT_BENCHMARK_FRAMES);
+            
+            set->benchmark_step += 1;
+            set->benchmark_frames = 0;
+        }
+    }
+}
@@ -0,0 +1,116 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "interface.h"
+#include "renderer_int.h"
+
+/* Picks the first memory type that has all the required properties,
+ * favouring one that also has the preferred ones. Returns UINT32_MAX
+ * if nothing suitable exists.                                         */
+uint32_t find_memory_type(Interface *func, uint32_t type_bits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred)
+{
+    const VkPhysicalDeviceMemoryProperties *properties = &func->memory_properties;
+    uint32_t fallback = UINT32_MAX;
+    uint32_t found = UINT32_MAX;
+    VkMemoryPropertyFlags flags;
+    
+    for(uint32_t i = 0; i < properties->memoryTypeCount && found == UINT32_MAX; i++)
+    {
+        flags = properties->memoryTypes[i].propertyFlags;
+        
+        if((type_bits & (1u << i)) && (flags & required) == required)
+        {
+            if((flags & preferred) == preferred)
+            {
+                found = i;
+            }
+            else if(fallback == UINT32_MAX)
+            {
+                fallback = i;
+            }
+        }
+    }
+    
+    return found != UINT32_MAX ? found : fallback;
+}
+
+/* Creates a buffer with its own allocation, the memory type used
+ * is returned so callers can tell whether they got the preferred
+ * properties                                                       */
+bool create_buffer(Interface *func, VkDeviceSize size, VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+    VkBuffer *buffer, VkDeviceMemory *memory, uint32_t *memory_type)
+{
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    VkBufferCreateInfo buffer_create_info = {0};
+    VkMemoryAllocateInfo alloc_info = {0};
+    VkMemoryRequirements requirements;
+    uint32_t queue_families[2] = {func->queue_family_index, func->compute_queue_family_index};
+    
+    *buffer = VK_NULL_HANDLE;
+    *memory = VK_NULL_HANDLE;
+    
+    buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_create_info.size = size;
+    buffer_create_info.usage = usage;
+    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    
+    /* Async compute passes read the uniform ring and the bindless
+     * buffers as well, concurrent sharing spares every one of them
+     * a queue family ownership transfer                            */
+    if(func->compute_queue_family_index != func->queue_family_index)
+    {
+        buffer_create_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        buffer_create_info.queueFamilyIndexCount = 2;
+        buffer_create_info.pQueueFamilyIndices = queue_families;
+    }
+    
+    result = func->vkCreateBuffer(func->device, &buffer_create_info, 0, buffer);
+    
+    if(result == VK_SUCCESS)
+    {
+        func->vkGetBufferMemoryRequirements(func->device, *buffer, &requirements);
+        
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize = requirements.size;
+        alloc_info.memoryTypeIndex = find_memory_type(func, requirements.memoryTypeBits, required, preferred);
+        
+        if(alloc_info.memoryTypeIndex == UINT32_MAX)
+        {
+            func->printf("Failed to find a memory type for buffer\n");
+            result = VK_ERROR_INITIALIZATION_FAILED;
+        }
+        else
+        {
+            result = func->vkAllocateMemory(func->device, &alloc_info, 0, memory);
+        }
+        
+        if(result == VK_SUCCESS)
+        {
+            result = func->vkBindBufferMemory(func->device, *buffer, *memory, 0);
+        }
+        
+        if(result == VK_SUCCESS && memory_type)
+        {
+            *memory_type = alloc_info.memoryTypeIndex;
+        }
+    }
+    
+    if(result != VK_SUCCESS)
+    {
+        func->printf("Failed to create buffer of %llu bytes with error %d\n", (unsigned long long)size, result);
+        
+        if(*memory)
+        {
+            func->vkFreeMemory(func->device, *memory, 0);
+            *memory = VK_NULL_HANDLE;
+        }
+        
+        if(*buffer)
+        {
+            func->vkDestroyBuffer(func->device, *buffer, 0);
+            *buffer = VK_NULL_HANDLE;
+        }
+    }
+    
+    return result == VK_SUCCESS;
+}
@@ -0,0 +1,140 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "interface.h"
+#include "util.h"
+#include "mesh.h"
+#include "renderer_int.h"
+
+/* Cooked meshes are copied into their buffer without any processing,
+ * vertex pulling reads them through the bindless set and the index
+ * data follows the vertices so a draw binds the same buffer twice.  */
+
+static uint32_t prv_free_slot(Interface *func)
+{
+    uint32_t slot = MESH_INVALID;
+    
+    for(uint32_t i = 0; i < func->mesh_count && slot == MESH_INVALID; i++)
+    {
+        slot = func->meshes[i].header ? MESH_INVALID : i;
+    }
+    
+    if(slot == MESH_INVALID && func->mesh_count < MAX_MESHES)
+    {
+        slot = func->mesh_count;
+        func->mesh_count += 1;
+    }
+    
+    return slot;
+}
+
+uint32_t renderer_load_mesh(Interface *func, const char *filename)
+{
+    uint32_t slot = MESH_INVALID;
+    void *data = NULL;
+    size_t size = 0;
+    void *mapped = NULL;
+    GpuMesh mesh = {0};
+    bool result;
+    
+    util_load_whole_file(func, filename, &data, &size);
+    result = mesh_validate(data, size);
+    
+    if(result)
+    {
+        mesh.header = func->malloc(sizeof(MeshHeader));
+        result = mesh.header != NULL;
+    }
+    
+    if(result)
+    {
+        memcpy(mesh.header, data, sizeof(MeshHeader));
+        mesh.index_offset = (VkDeviceSize)mesh.header->vertex_count * sizeof(MeshVertex);
+        
+        result = create_buffer(
+            func, size - sizeof(MeshHeader),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mesh.buffer, &mesh.memory, NULL);
+    }
+    
+    if(result)
+    {
+        result = func->vkMapMemory(func->device, mesh.memory, 0, VK_WHOLE_SIZE, 0, &mapped) == VK_SUCCESS;
+    }
+    
+    if(result)
+    {
+        memcpy(mapped, (uint8_t*)data + sizeof(MeshHeader), size - sizeof(MeshHeader));
+        slot = prv_free_slot(func);
+        result = slot != MESH_INVALID;
+    }
+    
+    if(result)
+    {
+        mesh.bindless = renderer_bindless_add_buffer(func, mesh.buffer, 0, mesh.index_offset);
+        result = mesh.bindless != BINDLESS_INVALID;
+    }
+    
+    if(result)
+    {
+        func->meshes[slot] = mesh;
+        
+        func->printf("Loaded mesh %s, %u vertices, %u levels of detail\n", filename, mesh.header->vertex_count, mesh.header->lod_count);
+    }
+    else
+    {
+        /* Nothing has been submitted that could use the buffer yet */
+        if(mesh.buffer)
+        {
+            func->vkDestroyBuffer(func->device, mesh.buffer, NULL);
+        }
+        
+        if(mesh.memory)
+        {
+            func->vkFreeMemory(func->device, mesh.memory, NULL);
+        }
+        
+        /* A slot taken already stays free, it has no header */
+        func->free(mesh.header);
+        func->printf("Failed to load mesh %s\n", filename);
+        slot = MESH_INVALID;
+    }
+    
+    func->free(data);
+    
+    return slot;
+}
+
+/* Frames in flight may still draw the mesh, so its buffer is only
+ * released after the next submission has completed                */
+void renderer_unload_mesh(Interface *func, uint32_t mesh)
+{
+    GpuMesh *gpu_mesh = mesh < func->mesh_count ? &func->meshes[mesh] : NULL;
+    
+    if(gpu_mesh && gpu_mesh->header)
+    {
+        renderer_bindless_release(func, BINDLESS_BUFFER, gpu_mesh->bindless);
+        lifetime_defer_buffer(func, func->submit_value + 1, gpu_mesh->buffer);
+        lifetime_defer_memory(func, func->submit_value + 1, gpu_mesh->memory);
+        
+        func->free(gpu_mesh->header);
+        *gpu_mesh = (GpuMesh) {0};
+    }
+}
+
+/* Level of detail to draw a mesh with at a world space center and
+ * uniform scale this frame, from the current camera and the size
+ * the scene is drawn at                                           */
+uint32_t renderer_mesh_lod(Interface *func, uint32_t mesh, const float center[3], float scale)
+{
+    uint32_t lod = 0;
+    
+    if(mesh < func->mesh_count && func->meshes[mesh].header)
+    {
+        lod = mesh_select_lod(func->meshes[mesh].header, func->view_proj, center, scale,
+            (float)func->render_extent.height, MESH_LOD_THRESHOLD_PIXELS);
+    }
+    
+    return lod;
+}
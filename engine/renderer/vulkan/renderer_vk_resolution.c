@@ -0,0 +1,145 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include "interface.h"
+#include "renderer_int.h"
+
+/* Dynamic resolution. The scene target is allocated at the swapchain
+ * size and each frame only its top left render_extent is drawn, so a
+ * change of scale never recreates anything. GPU time is roughly
+ * proportional to the pixels shaded, so the scale is moved by the
+ * square root of the ratio between the target and the smoothed frame
+ * time whenever that leaves the hysteresis band, then held until the
+ * frames in flight at the old scale have been measured.               */
+
+static float prv_min_scale(Interface *func)
+{
+    float scale = func->app_info.resolution_min_scale;
+    
+    return scale > 0.0f ? CLAMP(scale, RESOLUTION_SCALE_FLOOR, 1.0f) : RESOLUTION_DEFAULT_MIN_SCALE;
+}
+
+/* The target is only as big as the swapchain, so the scale tops out at 1 */
+static float prv_max_scale(Interface *func)
+{
+    float scale = func->app_info.resolution_max_scale;
+    
+    scale = scale > 0.0f ? CLAMP(scale, RESOLUTION_SCALE_FLOOR, 1.0f) : RESOLUTION_DEFAULT_MAX_SCALE;
+    
+    return MAX(scale, prv_min_scale(func));
+}
+
+/* Blits the scene target up to the swapchain image, the formats are
+ * the same so a blit is enough for both scaling and filtering        */
+bool resolution_supported(Interface *func)
+{
+    const char *reason = NULL;
+    VkFormatProperties properties;
+    VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+    
+    func->vkGetPhysicalDeviceFormatProperties(func->physical_device, func->surface_format.format, &properties);
+    
+    if((properties.optimalTilingFeatures & needed) != needed)
+    {
+        reason = "surface format can't be blitted";
+    }
+    
+    if(reason)
+    {
+        func->printf("Dynamic resolution disabled, %s\n", reason);
+    }
+    else
+    {
+        func->printf("Dynamic resolution targeting %.2f ms GPU, scale %.2f to %.2f\n",
+            func->app_info.resolution_target_ms, prv_min_scale(func), prv_max_scale(func));
+    }
+    
+    func->upscale_filter = properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT ?
+        VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+    
+    return reason == NULL;
+}
+
+/* Moves the scale from the GPU time of the last collected frame and
+ * sets the render area of every pass that draws the scene            */
+void resolution_update(Interface *func)
+{
+    double target = func->app_info.resolution_target_ms;
+    double hysteresis = func->app_info.resolution_hysteresis > 0.0f ?
+        func->app_info.resolution_hysteresis : RESOLUTION_DEFAULT_HYSTERESIS;
+    float min_scale = prv_min_scale(func);
+    float max_scale = prv_max_scale(func);
+    float scale;
+    
+    if(func->resolution_enabled && func->gpu_frame_ms > 0.0)
+    {
+        func->resolution_filtered_ms = func->resolution_filtered_ms > 0.0 ?
+            func->resolution_filtered_ms + (func->gpu_frame_ms - func->resolution_filtered_ms) * RESOLUTION_SMOOTHING :
+            func->gpu_frame_ms;
+        
+        if(func->resolution_settle > 0)
+        {
+            func->resolution_settle -= 1;
+        }
+        else if(func->resolution_filtered_ms > target * (1.0 + hysteresis) ||
+            func->resolution_filtered_ms < target * (1.0 - hysteresis))
+        {
+            scale = func->render_scale * sqrtf((float)(target / func->resolution_filtered_ms));
+            scale = CLAMP(scale, func->render_scale - RESOLUTION_MAX_STEP, func->render_scale + RESOLUTION_MAX_STEP);
+            scale = CLAMP(scale, min_scale, max_scale);
+            
+            /* Stays put when already pinned against a limit */
+            if(scale != func->render_scale)
+            {
+                func->render_scale = scale;
+                func->resolution_settle = func->swapchain_image_count + 1;
+                func->resolution_changes += 1;
+            }
+        }
+    }
+    
+    func->render_extent = func->swapchain_extent;
+    
+    if(func->resolution_enabled)
+    {
+        /* Starts from 1 and the limits can be tighter */
+        func->render_scale = CLAMP(func->render_scale, min_scale, max_scale);
+        func->render_extent.width = MAX((uint32_t)(func->swapchain_extent.width * func->render_scale + 0.5f), 1);
+        func->render_extent.height = MAX((uint32_t)(func->swapchain_extent.height * func->render_scale + 0.5f), 1);
+        
+        graph_set_render_area(func->render_graph, func->graph_main_pass, func->render_extent);
+        
+        if(func->graph_prepass != GRAPH_INVALID)
+        {
+            graph_set_render_area(func->render_graph, func->graph_prepass, func->render_extent);
+        }
+        
+        func->resolution_frames += 1;
+        
+        if(func->resolution_frames % RESOLUTION_REPORT_FRAMES == 0)
+        {
+            func->printf("Dynamic resolution: scale %.2f (%ux%u), %.2f ms GPU against %.2f ms target, %u changes\n",
+                func->render_scale, func->render_extent.width, func->render_extent.height,
+                func->resolution_filtered_ms, target, func->resolution_changes);
+        }
+    }
+}
+
+/* The graph has the scene target in TRANSFER_SRC_OPTIMAL and the
+ * swapchain image in TRANSFER_DST_OPTIMAL                          */
+void record_upscale(Interface *func, VkCommandBuffer cmd, void *data)
+{
+    VkImageBlit region = {0};
+    
+    region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.srcSubresource.layerCount = 1;
+    region.srcOffsets[1] = (VkOffset3D) {func->render_extent.width, func->render_extent.height, 1};
+    region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.dstSubresource.layerCount = 1;
+    region.dstOffsets[1] = (VkOffset3D) {func->swapchain_extent.width, func->swapchain_extent.height, 1};
+    
+    func->vkCmdBlitImage(
+        cmd, graph_image(func->render_graph, func->graph_scene_color), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        graph_image(func->render_graph, func->graph_backbuffer), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        1, &region, func->upscale_filter);
+}
@@ -0,0 +1,779 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "interface.h"
+#include "renderer_int.h"
+
+/* 2D overlay for the HUD and tools. Quads are written by the caller
+ * straight into persistently mapped memory that the vertex shader pulls
+ * from, so there is no intermediate copy, sort or vertex layout. Every
+ * quad carries the bindless index of its atlas, which lets quads from
+ * any number of atlases share one instanced draw in submission order.
+ *
+ * The stream has one partition more than there are frame slots. The
+ * partition being written was last read by the submission the previous
+ * renderer_draw already waited for, so writing never races the GPU.
+ *
+ * Text uses an embedded 5x7 font, rasterized with a box filter at the
+ * requested pixel height into a cell of the glyph atlas the first time
+ * it is drawn. Cells are recycled least recently used first.           */
+
+#define FONT_FIRST 32
+#define FONT_COUNT 95
+#define FONT_WIDTH 5
+#define FONT_ROWS 8
+#define FONT_ADVANCE 6
+#define FONT_LINE 10
+
+/* Rows top to bottom with bit 4 the leftmost column, descenders use row 7 */
+static const uint8_t font_glyphs[FONT_COUNT][FONT_ROWS] =
+{
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, /* space */
+    {0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04, 0x00}, /* ! */
+    {0x0A, 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00}, /* " */
+    {0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A, 0x00}, /* # */
+    {0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04, 0x00}, /* $ */
+    {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03, 0x00}, /* % */
+    {0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D, 0x00}, /* & */
+    {0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00}, /* ' */
+    {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02, 0x00}, /* ( */
+    {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08, 0x00}, /* ) */
+    {0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00, 0x00}, /* * */
+    {0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00, 0x00}, /* + */
+    {0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08, 0x00}, /* , */
+    {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00, 0x00}, /* - */
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00}, /* . */
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00, 0x00}, /* / */
+    {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E, 0x00}, /* 0 */
+    {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E, 0x00}, /* 1 */
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F, 0x00}, /* 2 */
+    {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E, 0x00}, /* 3 */
+    {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02, 0x00}, /* 4 */
+    {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E, 0x00}, /* 5 */
+    {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E, 0x00}, /* 6 */
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08, 0x00}, /* 7 */
+    {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E, 0x00}, /* 8 */
+    {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C, 0x00}, /* 9 */
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00, 0x00}, /* : */
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08, 0x00}, /* ; */
+    {0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02, 0x00}, /* < */
+    {0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00, 0x00}, /* = */
+    {0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08, 0x00}, /* > */
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04, 0x00}, /* ? */
+    {0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E, 0x00}, /* @ */
+    {0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x00}, /* A */
+    {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E, 0x00}, /* B */
+    {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E, 0x00}, /* C */
+    {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C, 0x00}, /* D */
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F, 0x00}, /* E */
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10, 0x00}, /* F */
+    {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F, 0x00}, /* G */
+    {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11, 0x00}, /* H */
+    {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E, 0x00}, /* I */
+    {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C, 0x00}, /* J */
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11, 0x00}, /* K */
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F, 0x00}, /* L */
+    {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11, 0x00}, /* M */
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11, 0x00}, /* N */
+    {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E, 0x00}, /* O */
+    {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10, 0x00}, /* P */
+    {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D, 0x00}, /* Q */
+    {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11, 0x00}, /* R */
+    {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E, 0x00}, /* S */
+    {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00}, /* T */
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E, 0x00}, /* U */
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04, 0x00}, /* V */
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A, 0x00}, /* W */
+    {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11, 0x00}, /* X */
+    {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x00}, /* Y */
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F, 0x00}, /* Z */
+    {0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E, 0x00}, /* [ */
+    {0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00, 0x00}, /* \ */
+    {0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E, 0x00}, /* ] */
+    {0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00}, /* ^ */
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x00}, /* _ */
+    {0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00}, /* ` */
+    {0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F, 0x00}, /* a */
+    {0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1E, 0x00}, /* b */
+    {0x00, 0x00, 0x0E, 0x10, 0x10, 0x11, 0x0E, 0x00}, /* c */
+    {0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F, 0x00}, /* d */
+    {0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E, 0x00}, /* e */
+    {0x06, 0x09, 0x08, 0x1C, 0x08, 0x08, 0x08, 0x00}, /* f */
+    {0x00, 0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x0E}, /* g */
+    {0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11, 0x00}, /* h */
+    {0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E, 0x00}, /* i */
+    {0x02, 0x00, 0x06, 0x02, 0x02, 0x02, 0x12, 0x0C}, /* j */
+    {0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12, 0x00}, /* k */
+    {0x0C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E, 0x00}, /* l */
+    {0x00, 0x00, 0x1A, 0x15, 0x15, 0x11, 0x11, 0x00}, /* m */
+    {0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11, 0x00}, /* n */
+    {0x00, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E, 0x00}, /* o */
+    {0x00, 0x00, 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10}, /* p */
+    {0x00, 0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x01}, /* q */
+    {0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10, 0x00}, /* r */
+    {0x00, 0x00, 0x0E, 0x10, 0x0E, 0x01, 0x1E, 0x00}, /* s */
+    {0x08, 0x08, 0x1C, 0x08, 0x08, 0x09, 0x06, 0x00}, /* t */
+    {0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0D, 0x00}, /* u */
+    {0x00, 0x00, 0x11, 0x11, 0x11, 0x0A, 0x04, 0x00}, /* v */
+    {0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0A, 0x00}, /* w */
+    {0x00, 0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x00}, /* x */
+    {0x00, 0x00, 0x11, 0x11, 0x11, 0x0F, 0x01, 0x0E}, /* y */
+    {0x00, 0x00, 0x1F, 0x02, 0x04, 0x08, 0x1F, 0x00}, /* z */
+    {0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02, 0x00}, /* { */
+    {0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00}, /* | */
+    {0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08, 0x00}, /* } */
+    {0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00, 0x00}, /* ~ */
+};
+
+static bool prv_create_stream(Interface *func)
+{
+    bool result;
+    VkDeviceSize quad_bytes = (VkDeviceSize)SPRITE_MAX_QUADS * sizeof(SpriteQuad);
+    void *mapped = NULL;
+    
+    func->sprite_partition_count = func->swapchain_image_count + 1;
+    func->sprite_partition_size = quad_bytes + GLYPH_MAX_UPLOADS * GLYPH_CELL_SIZE * GLYPH_CELL_SIZE;
+    func->sprite_partition_size = (func->sprite_partition_size + func->uniform_alignment - 1) & ~(func->uniform_alignment - 1);
+    
+    /* Every quad is read once, plain host memory leaves the small
+     * device local host visible heap to uniforms and instances    */
+    result = create_buffer(
+        func, func->sprite_partition_size * func->sprite_partition_count,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0,
+        &func->sprite_buffer, &func->sprite_memory, NULL);
+    
+    if(result)
+    {
+        result = func->vkMapMemory(func->device, func->sprite_memory, 0, VK_WHOLE_SIZE, 0, &mapped) == VK_SUCCESS;
+        func->sprite_mapped = mapped;
+    }
+    
+    for(uint32_t i = 0; i < func->sprite_partition_count && result; i++)
+    {
+        func->sprite_bindless[i] = renderer_bindless_add_buffer(func, func->sprite_buffer, func->sprite_partition_size * i, quad_bytes);
+        result = func->sprite_bindless[i] != BINDLESS_INVALID;
+    }
+    
+    return result;
+}
+
+static bool prv_create_atlas(Interface *func)
+{
+    VkResult result;
+    VkImageCreateInfo image_create_info = {0};
+    VkImageViewCreateInfo view_create_info = {0};
+    VkMemoryAllocateInfo alloc_info = {0};
+    VkMemoryRequirements requirements;
+    
+    image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_create_info.imageType = VK_IMAGE_TYPE_2D;
+    image_create_info.format = VK_FORMAT_R8_UNORM;
+    image_create_info.extent = (VkExtent3D) {GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE, 1};
+    image_create_info.mipLevels = 1;
+    image_create_info.arrayLayers = 1;
+    image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_create_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    
+    result = func->vkCreateImage(func->device, &image_create_info, 0, &func->glyph_atlas);
+    
+    if(result == VK_SUCCESS)
+    {
+        func->vkGetImageMemoryRequirements(func->device, func->glyph_atlas, &requirements);
+        
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize = requirements.size;
+        alloc_info.memoryTypeIndex = find_memory_type(func, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+        
+        result = alloc_info.memoryTypeIndex == UINT32_MAX ? VK_ERROR_OUT_OF_DEVICE_MEMORY :
+            func->vkAllocateMemory(func->device, &alloc_info, 0, &func->glyph_atlas_memory);
+    }
+    
+    if(result == VK_SUCCESS)
+    {
+        result = func->vkBindImageMemory(func->device, func->glyph_atlas, func->glyph_atlas_memory, 0);
+    }
+    
+    if(result == VK_SUCCESS)
+    {
+        view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_create_info.image = func->glyph_atlas;
+        view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_create_info.format = VK_FORMAT_R8_UNORM;
+        view_create_info.subresourceRange = (VkImageSubresourceRange) {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        
+        result = func->vkCreateImageView(func->device, &view_create_info, 0, &func->glyph_atlas_view);
+    }
+    
+    /* The atlas reaches this layout when the first frame clears it */
+    if(result == VK_SUCCESS)
+    {
+        func->glyph_atlas_bindless = renderer_bindless_add_image(func, func->glyph_atlas_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        result = func->glyph_atlas_bindless != BINDLESS_INVALID ? VK_SUCCESS : VK_ERROR_INITIALIZATION_FAILED;
+    }
+    
+    return result == VK_SUCCESS;
+}
+
+/* Same layout as the scene, blended over it without depth in the main
+ * pass or the overlay pass after the upscale                          */
+static bool prv_create_pipeline(Interface *func)
+{
+    VkPipelineShaderStageCreateInfo shader_stages[2] = {0};
+    VkPipelineVertexInputStateCreateInfo vertex_input_state = {0};
+    VkPipelineInputAssemblyStateCreateInfo input_assembly_state = {0};
+    VkPipelineRasterizationStateCreateInfo rasterization_state = {0};
+    VkPipelineViewportStateCreateInfo viewport_state = {0};
+    VkPipelineMultisampleStateCreateInfo multisample_state = {0};
+    VkPipelineColorBlendStateCreateInfo color_blend_state = {0};
+    VkPipelineColorBlendAttachmentState color_blend_attachment_state = {0};
+    VkPipelineDepthStencilStateCreateInfo depth_stencil_state = {0};
+    VkPipelineDynamicStateCreateInfo dynamic_state_create_info = {0};
+    VkGraphicsPipelineCreateInfo pipeline_create_info = {0};
+    VkDynamicState dynamic_states[2] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    
+    shader_stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shader_stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shader_stages[0].module = func->sprite_vert_shader;
+    shader_stages[0].pName = "main";
+    
+    shader_stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shader_stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shader_stages[1].module = func->sprite_frag_shader;
+    shader_stages[1].pName = "main";
+    
+    vertex_input_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    
+    input_assembly_state.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly_state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    
+    rasterization_state.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterization_state.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterization_state.cullMode = VK_CULL_MODE_NONE;
+    rasterization_state.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    rasterization_state.lineWidth = 1.0f;
+    
+    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount = 1;
+    viewport_state.scissorCount = 1;
+    
+    multisample_state.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisample_state.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisample_state.minSampleShading = 1.0f;
+    
+    color_blend_attachment_state.blendEnable = VK_TRUE;
+    color_blend_attachment_state.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    color_blend_attachment_state.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    color_blend_attachment_state.colorBlendOp = VK_BLEND_OP_ADD;
+    color_blend_attachment_state.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    color_blend_attachment_state.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    color_blend_attachment_state.alphaBlendOp = VK_BLEND_OP_ADD;
+    color_blend_attachment_state.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    
+    color_blend_state.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blend_state.attachmentCount = 1;
+    color_blend_state.pAttachments = &color_blend_attachment_state;
+    
+    depth_stencil_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil_state.depthTestEnable = VK_FALSE;
+    depth_stencil_state.depthWriteEnable = VK_FALSE;
+    
+    dynamic_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state_create_info.dynamicStateCount = 2;
+    dynamic_state_create_info.pDynamicStates = dynamic_states;
+    
+    pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_create_info.stageCount = 2;
+    pipeline_create_info.pStages = shader_stages;
+    pipeline_create_info.pVertexInputState = &vertex_input_state;
+    pipeline_create_info.pInputAssemblyState = &input_assembly_state;
+    pipeline_create_info.pViewportState = &viewport_state;
+    pipeline_create_info.pRasterizationState = &rasterization_state;
+    pipeline_create_info.pMultisampleState = &multisample_state;
+    pipeline_create_info.pDepthStencilState = &depth_stencil_state;
+    pipeline_create_info.pColorBlendState = &color_blend_state;
+    pipeline_create_info.pDynamicState = &dynamic_state_create_info;
+    pipeline_create_info.layout = func->pipeline_layout;
+    pipeline_create_info.renderPass = func->sprite_render_pass;
+    
+    return func->vkCreateGraphicsPipelines(
+        func->device, VK_NULL_HANDLE, 1, &pipeline_create_info, 0, &func->sprite_pipeline) == VK_SUCCESS;
+}
+
+bool init_sprites(Interface *func)
+{
+    bool result = true;
+    
+    func->glyph_atlas_bindless = BINDLESS_INVALID;
+    
+    for(uint32_t i = 0; i < MAX_FRAMES + 1; i++)
+    {
+        func->sprite_bindless[i] = BINDLESS_INVALID;
+    }
+    
+    if(!func->bindless_supported || !func->sprite_vert_shader || !func->sprite_frag_shader)
+    {
+        /* Not fatal, quads and text are simply not drawn */
+        func->printf("Sprite shaders or bindless resources missing, 2D overlay disabled\n");
+    }
+    else
+    {
+        func->glyph_cache = func->malloc(sizeof(GlyphCache));
+        result = func->glyph_cache != NULL;
+        result = result && prv_create_stream(func);
+        result = result && prv_create_atlas(func);
+        result = result && prv_create_pipeline(func);
+        
+        if(result)
+        {
+            memset(func->glyph_cache, 0, sizeof(GlyphCache));
+            func->sprite_partition = 0;
+            func->sprite_count = 0;
+            func->sprite_frames = 0;
+            
+            func->printf("Sprites: %u quads per frame in %u partitions, %ux%u glyph atlas with %u cells\n",
+                SPRITE_MAX_QUADS, func->sprite_partition_count, GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE, GLYPH_CELL_COUNT);
+        }
+    }
+    
+    return result;
+}
+
+static SpriteQuad *prv_partition(Interface *func)
+{
+    return (SpriteQuad*)(func->sprite_mapped + func->sprite_partition_size * func->sprite_partition);
+}
+
+static VkDeviceSize prv_upload_offset(Interface *func, uint32_t upload)
+{
+    return func->sprite_partition_size * func->sprite_partition +
+        (VkDeviceSize)SPRITE_MAX_QUADS * sizeof(SpriteQuad) + upload * GLYPH_CELL_SIZE * GLYPH_CELL_SIZE;
+}
+
+/* Quads past the capacity of the partition are dropped and counted */
+void renderer_draw_quads(Interface *func, const SpriteQuad *quads, uint32_t count)
+{
+    uint32_t written = func->sprite_mapped ? MIN(count, SPRITE_MAX_QUADS - func->sprite_count) : 0;
+    
+    if(written > 0)
+    {
+        memcpy(prv_partition(func) + func->sprite_count, quads, written * sizeof(SpriteQuad));
+    }
+    
+    func->sprite_count += written;
+    func->sprite_dropped += count - written;
+}
+
+/* rect is the top left corner and size in pixels, a NULL uv covers the
+ * whole texture. texture is a bindless image index, optionally with
+ * SPRITE_TEXTURE_COVERAGE, or SPRITE_TEXTURE_NONE.                     */
+void renderer_draw_quad(Interface *func, const float rect[4], const float uv[4], uint32_t color, uint32_t texture)
+{
+    SpriteQuad *quad;
+    
+    if(func->sprite_mapped && func->sprite_count < SPRITE_MAX_QUADS)
+    {
+        quad = prv_partition(func) + func->sprite_count;
+        func->sprite_count += 1;
+        
+        /* One whole write in order, the memory may be write combined */
+        *quad = (SpriteQuad) {
+            {rect[0], rect[1], rect[2], rect[3]},
+            {
+                uv ? (uint16_t)(CLAMP(0.0f, uv[0], 1.0f) * 65535.0f + 0.5f) : 0,
+                uv ? (uint16_t)(CLAMP(0.0f, uv[1], 1.0f) * 65535.0f + 0.5f) : 0,
+                uv ? (uint16_t)(CLAMP(0.0f, uv[2], 1.0f) * 65535.0f + 0.5f) : UINT16_MAX,
+                uv ? (uint16_t)(CLAMP(0.0f, uv[3], 1.0f) * 65535.0f + 0.5f) : UINT16_MAX
+            },
+            color, texture
+        };
+    }
+    else
+    {
+        func->sprite_dropped += 1;
+    }
+}
+
+static uint32_t prv_glyph_home(uint32_t key)
+{
+    return (key * 2654435761u) >> (32 - GLYPH_TABLE_BITS);
+}
+
+/* Slot holding key, or the empty slot it would be inserted at */
+static uint32_t prv_glyph_slot(const GlyphCache *cache, uint32_t key)
+{
+    uint32_t slot = prv_glyph_home(key);
+    
+    while(cache->table[slot] && cache->cells[cache->table[slot] - 1].key != key)
+    {
+        slot = (slot + 1) & (GLYPH_TABLE_SIZE - 1);
+    }
+    
+    return slot;
+}
+
+/* Backward shift deletion, probe sequences stay unbroken without
+ * tombstones piling up as glyphs are evicted                     */
+static void prv_glyph_remove(GlyphCache *cache, uint32_t key)
+{
+    uint32_t hole = prv_glyph_slot(cache, key);
+    uint32_t slot = (hole + 1) & (GLYPH_TABLE_SIZE - 1);
+    uint32_t home;
+    
+    cache->table[hole] = 0;
+    
+    while(cache->table[slot])
+    {
+        home = prv_glyph_home(cache->cells[cache->table[slot] - 1].key);
+        
+        /* Only entries whose probe passed through the hole may move into it */
+        if(((slot - home) & (GLYPH_TABLE_SIZE - 1)) >= ((slot - hole) & (GLYPH_TABLE_SIZE - 1)))
+        {
+            cache->table[hole] = cache->table[slot];
+            cache->table[slot] = 0;
+            hole = slot;
+        }
+        
+        slot = (slot + 1) & (GLYPH_TABLE_SIZE - 1);
+    }
+}
+
+static float prv_overlap(float a0, float a1, float b0, float b1)
+{
+    return MAX(0.0f, MIN(a1, b1) - MAX(a0, b0));
+}
+
+/* Box filters the glyph to pixels high into a zeroed cell, leaving a
+ * one pixel border so linear filtering never reaches a neighbour.
+ * Returns the width in pixels.                                        */
+static uint16_t prv_rasterize(uint32_t codepoint, uint32_t pixels, uint8_t *cell)
+{
+    const uint8_t *rows = font_glyphs[codepoint - FONT_FIRST];
+    float scale = pixels / (float)FONT_ROWS;
+    uint32_t width = (FONT_WIDTH * pixels + FONT_ROWS - 1) / FONT_ROWS;
+    float overlap_x[GLYPH_MAX_PIXELS][FONT_WIDTH];
+    float overlap_y[GLYPH_MAX_PIXELS][FONT_ROWS];
+    float coverage, row;
+    
+    memset(cell, 0, GLYPH_CELL_SIZE * GLYPH_CELL_SIZE);
+    
+    /* Fraction of each pixel covered by each column and row of the font */
+    for(uint32_t x = 0; x < width; x++)
+    {
+        for(uint32_t column = 0; column < FONT_WIDTH; column++)
+        {
+            overlap_x[x][column] = prv_overlap(x / scale, (x + 1) / scale, column, column + 1) * scale;
+        }
+    }
+    
+    for(uint32_t y = 0; y < pixels; y++)
+    {
+        for(uint32_t i = 0; i < FONT_ROWS; i++)
+        {
+            overlap_y[y][i] = prv_overlap(y / scale, (y + 1) / scale, i, i + 1) * scale;
+        }
+    }
+    
+    for(uint32_t y = 0; y < pixels; y++)
+    {
+        for(uint32_t x = 0; x < width; x++)
+        {
+            coverage = 0.0f;
+            
+            for(uint32_t i = 0; i < FONT_ROWS; i++)
+            {
+                row = 0.0f;
+                
+                for(uint32_t column = 0; column < FONT_WIDTH; column++)
+                {
+                    row += (rows[i] >> (FONT_WIDTH - 1 - column) & 1) ? overlap_x[x][column] : 0.0f;
+                }
+                
+                coverage += row * overlap_y[y][i];
+            }
+            
+            cell[(y + 1) * GLYPH_CELL_SIZE + x + 1] = (uint8_t)(MIN(coverage, 1.0f) * 255.0f + 0.5f);
+        }
+    }
+    
+    return (uint16_t)width;
+}
+
+/* Cell holding the glyph, rasterized into this partition's upload area
+ * on a miss. GLYPH_CELL_COUNT when it can't be cached this frame, either
+ * because the uploads are used up or every cell is already drawn.       */
+static uint32_t prv_glyph(Interface *func, GlyphCache *cache, uint32_t key)
+{
+    uint32_t slot = prv_glyph_slot(cache, key);
+    uint32_t cell = cache->table[slot] ? cache->table[slot] - 1u : GLYPH_CELL_COUNT;
+    uint32_t oldest = GLYPH_CELL_COUNT;
+    
+    if(cell == GLYPH_CELL_COUNT)
+    {
+        cache->misses += 1;
+    }
+    
+    if(cell == GLYPH_CELL_COUNT && cache->upload_count < GLYPH_MAX_UPLOADS)
+    {
+        if(cache->cell_count < GLYPH_CELL_COUNT)
+        {
+            oldest = cache->cell_count;
+            cache->cell_count += 1;
+        }
+        else
+        {
+            /* Earlier frames sampling a replaced cell are ordered before
+             * the upload by its barrier, this frame's quads are not      */
+            for(uint32_t i = 0; i < GLYPH_CELL_COUNT; i++)
+            {
+                if(cache->cells[i].last_used < func->sprite_frames &&
+                    (oldest == GLYPH_CELL_COUNT || cache->cells[i].last_used < cache->cells[oldest].last_used))
+                {
+                    oldest = i;
+                }
+            }
+            
+            if(oldest != GLYPH_CELL_COUNT)
+            {
+                prv_glyph_remove(cache, cache->cells[oldest].key);
+                slot = prv_glyph_slot(cache, key);
+                cache->evictions += 1;
+            }
+        }
+        
+        if(oldest != GLYPH_CELL_COUNT)
+        {
+            cell = oldest;
+            cache->cells[cell].key = key;
+            cache->cells[cell].height = (uint16_t)(key & 0xFF);
+            cache->cells[cell].width = prv_rasterize(key >> 8, key & 0xFF, func->sprite_mapped + prv_upload_offset(func, cache->upload_count));
+            cache->table[slot] = (uint16_t)(cell + 1);
+            cache->uploads[cache->upload_count] = (uint16_t)cell;
+            cache->upload_count += 1;
+        }
+    }
+    
+    if(cell != GLYPH_CELL_COUNT)
+    {
+        cache->cells[cell].last_used = func->sprite_frames;
+    }
+    
+    return cell;
+}
+
+/* Decodes one UTF-8 sequence, truncated ones end at the terminator */
+static uint32_t prv_next_codepoint(const uint8_t **text)
+{
+    const uint8_t *c = *text;
+    uint32_t length = c[0] < 0x80 ? 1 : c[0] < 0xE0 ? 2 : c[0] < 0xF0 ? 3 : 4;
+    uint32_t codepoint = length == 1 ? c[0] : c[0] & (0x3Fu >> (length - 1));
+    uint32_t i = 1;
+    
+    while(i < length && (c[i] & 0xC0) == 0x80)
+    {
+        codepoint = codepoint << 6 | (c[i] & 0x3F);
+        i += 1;
+    }
+    
+    *text = c + i;
+    
+    return codepoint;
+}
+
+/* Draws UTF-8 text with its top left corner at x, y, size pixels per
+ * line of the font. Codepoints outside printable ASCII draw as '?'.
+ * Returns the width of the widest line in pixels.                   */
+float renderer_draw_text(Interface *func, float x, float y, float size, uint32_t color, const char *text)
+{
+    GlyphCache *cache = func->glyph_cache;
+    uint32_t pixels = (uint32_t)CLAMP((float)GLYPH_MIN_PIXELS, size + 0.5f, (float)GLYPH_MAX_PIXELS);
+    uint32_t cells_per_row = GLYPH_ATLAS_SIZE / GLYPH_CELL_SIZE;
+    float scale = size / pixels;
+    float advance = size * FONT_ADVANCE / FONT_ROWS;
+    float pen = x, width = 0.0f;
+    const uint8_t *c = (const uint8_t*)text;
+    uint32_t codepoint, cell, cell_x, cell_y;
+    SpriteQuad *quad;
+    
+    while(cache && *c)
+    {
+        codepoint = prv_next_codepoint(&c);
+        codepoint = codepoint == '\n' || (codepoint >= FONT_FIRST && codepoint < FONT_FIRST + FONT_COUNT) ? codepoint : '?';
+        cell = codepoint == '\n' || codepoint == ' ' ? GLYPH_CELL_COUNT : prv_glyph(func, cache, codepoint << 8 | pixels);
+        
+        if(cell != GLYPH_CELL_COUNT && func->sprite_count < SPRITE_MAX_QUADS)
+        {
+            cell_x = cell % cells_per_row * GLYPH_CELL_SIZE + 1;
+            cell_y = cell / cells_per_row * GLYPH_CELL_SIZE + 1;
+            quad = prv_partition(func) + func->sprite_count;
+            func->sprite_count += 1;
+            
+            *quad = (SpriteQuad) {
+                {pen, y, cache->cells[cell].width * scale, pixels * scale},
+                {
+                    (uint16_t)(cell_x * 65535u / GLYPH_ATLAS_SIZE),
+                    (uint16_t)(cell_y * 65535u / GLYPH_ATLAS_SIZE),
+                    (uint16_t)((cell_x + cache->cells[cell].width) * 65535u / GLYPH_ATLAS_SIZE),
+                    (uint16_t)((cell_y + pixels) * 65535u / GLYPH_ATLAS_SIZE)
+                },
+                color, func->glyph_atlas_bindless | SPRITE_TEXTURE_COVERAGE
+            };
+        }
+        else if(cell != GLYPH_CELL_COUNT)
+        {
+            func->sprite_dropped += 1;
+        }
+        
+        if(codepoint == '\n')
+        {
+            width = MAX(width, pen - x);
+            pen = x;
+            y += size * FONT_LINE / FONT_ROWS;
+        }
+        else
+        {
+            pen += advance;
+        }
+    }
+    
+    return MAX(width, pen - x);
+}
+
+/* Copies the glyphs rasterized since the last frame into the atlas,
+ * recorded outside the render pass before the overlay samples it   */
+void sprite_begin_frame(Interface *func, VkCommandBuffer cmd)
+{
+    GlyphCache *cache = func->glyph_cache;
+    uint32_t cells_per_row = GLYPH_ATLAS_SIZE / GLYPH_CELL_SIZE;
+    VkBufferImageCopy copies[GLYPH_MAX_UPLOADS] = {0};
+    VkImageMemoryBarrier barrier = {0};
+    VkClearColorValue clear_color = {0};
+    VkImageSubresourceRange range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    
+    if(cache && (cache->upload_count > 0 || !func->glyph_atlas_initialized))
+    {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = func->glyph_atlas_initialized ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = func->glyph_atlas_initialized ? VK_ACCESS_SHADER_READ_BIT : 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = func->glyph_atlas;
+        barrier.subresourceRange = range;
+        
+        func->vkCmdPipelineBarrier(
+            cmd, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, NULL, 0, NULL, 1, &barrier);
+        
+        if(!func->glyph_atlas_initialized)
+        {
+            func->vkCmdClearColorImage(cmd, func->glyph_atlas, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear_color, 1, &range);
+        }
+        
+        for(uint32_t i = 0; i < cache->upload_count; i++)
+        {
+            copies[i].bufferOffset = prv_upload_offset(func, i);
+            copies[i].imageSubresource = (VkImageSubresourceLayers) {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+            copies[i].imageOffset = (VkOffset3D) {
+                (int32_t)(cache->uploads[i] % cells_per_row * GLYPH_CELL_SIZE),
+                (int32_t)(cache->uploads[i] / cells_per_row * GLYPH_CELL_SIZE), 0};
+            copies[i].imageExtent = (VkExtent3D) {GLYPH_CELL_SIZE, GLYPH_CELL_SIZE, 1};
+        }
+        
+        if(cache->upload_count > 0)
+        {
+            func->vkCmdCopyBufferToImage(
+                cmd, func->sprite_buffer, func->glyph_atlas, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, cache->upload_count, copies);
+        }
+        
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        
+        func->vkCmdPipelineBarrier(
+            cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0, 0, NULL, 0, NULL, 1, &barrier);
+        
+        func->glyph_atlas_initialized = true;
+        cache->upload_count = 0;
+    }
+}
+
+/* Every quad of the frame in one draw, six vertices per instance */
+void record_sprites(Interface *func, VkCommandBuffer cmd)
+{
+    if(func->sprite_pipeline && func->sprite_count > 0)
+    {
+        /* The scene already bound both sets with the same layout */
+        func->vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, func->sprite_pipeline);
+        func->vkCmdDraw(cmd, 6, func->sprite_count, 0, 0);
+    }
+}
+
+/* Called once the frame is submitted, quads written from here on go
+ * into the next partition                                           */
+void sprite_end_frame(Interface *func)
+{
+    GlyphCache *cache = func->glyph_cache;
+    
+    func->sprite_peak = MAX(func->sprite_peak, func->sprite_count);
+    func->sprite_frames += 1;
+    
+    if(cache && func->sprite_frames % TIMING_REPORT_FRAMES == 0 && func->sprite_peak > 0)
+    {
+        func->printf("Sprites: peak %u quads per frame, %u dropped, %u of %u glyph cells, %u misses, %u evictions\n",
+            func->sprite_peak, func->sprite_dropped, cache->cell_count, GLYPH_CELL_COUNT, cache->misses, cache->evictions);
+        
+        if(func->app_info.sprite_benchmark)
+        {
+            func->printf("Sprite benchmark: %.3f ms CPU per frame for %u quads and %u lines of text\n",
+                func->sprite_benchmark_ticks * 1000.0 / func->get_perf_frequency() / TIMING_REPORT_FRAMES,
+                SPRITE_BENCHMARK_QUADS, SPRITE_BENCHMARK_LINES);
+        }
+        
+        func->sprite_peak = 0;
+        func->sprite_dropped = 0;
+        func->sprite_benchmark_ticks = 0;
+        cache->misses = 0;
+        cache->evictions = 0;
+    }
+    
+    if(func->sprite_partition_count > 0)
+    {
+        func->sprite_partition = (func->sprite_partition + 1) % func->sprite_partition_count;
+    }
+    
+    func->sprite_count = 0;
+}
+
+/* A HUD far larger than any real one, timed from the first write to
+ * the last so the report shows what the overlay costs the caller    */
+void sprite_benchmark_frame(Interface *func)
+{
+    static const char *line = "The quick brown fox jumps over the lazy dog 0123456789 (){}[]<>!?";
+    uint64_t start_ticks = func->get_perf_counter();
+    uint32_t columns = MAX(func->swapchain_extent.width / 4, 1);
+    uint32_t rows = MAX(func->swapchain_extent.height / 4, 1);
+    float rect[4] = {0.0f, 0.0f, 3.0f, 3.0f};
+    
+    for(uint32_t i = 0; i < SPRITE_BENCHMARK_QUADS; i++)
+    {
+        rect[0] = (float)(i % columns * 4);
+        rect[1] = (float)(i / columns % rows * 4);
+        
+        renderer_draw_quad(func, rect, NULL, 0x40000000u | ((i * 2654435761u) & 0x00FFFFFFu), SPRITE_TEXTURE_NONE);
+    }
+    
+    /* Three sizes keep the working set well inside the atlas */
+    for(uint32_t i = 0; i < SPRITE_BENCHMARK_LINES; i++)
+    {
+        renderer_draw_text(func, 8.0f, (float)(i * 8 % MAX(func->swapchain_extent.height, 1)), 12.0f + (i % 3) * 4.0f, 0xFFFFFFFFu, line);
+    }
+    
+    func->sprite_benchmark_ticks += func->get_perf_counter() - start_ticks;
+}
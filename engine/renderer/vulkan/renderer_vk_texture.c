@@ -0,0 +1,595 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "interface.h"
+#include "renderer_int.h"
+
+/* Textures are KTX2 containers holding BC1, BC5 or BC7 levels. Loading
+ * only reads the header, level data goes from the file straight into
+ * staging memory and is copied into the image without being decoded.
+ *
+ * Without sparse residency an image holds a contiguous tail of levels,
+ * so changing what is resident builds a new image, copies the levels
+ * both have on the GPU and reads only the new ones from disk. The old
+ * image is released once the frames that sampled it have completed.   */
+
+#define KTX2_HEADER_SIZE 80
+#define KTX2_LEVEL_INDEX_SIZE 24
+
+static const uint8_t ktx2_identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+/* Bytes per 4x4 block, 0 for formats that are not supported */
+static uint32_t prv_block_size(VkFormat format)
+{
+    uint32_t size = 0;
+    
+    switch(format)
+    {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            size = 8;
+            break;
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC5_SNORM_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            size = 16;
+            break;
+        default:
+            break;
+    }
+    
+    return size;
+}
+
+/* Finest level of the tail that is always resident */
+static uint32_t prv_tail_level(const GpuTexture *texture)
+{
+    uint32_t level = 0;
+    
+    while(level + 1 < texture->level_count && MAX(texture->width >> level, texture->height >> level) > TEXTURE_TAIL_SIZE)
+    {
+        level += 1;
+    }
+    
+    return level;
+}
+
+/* floor(log2(max(width, height))) + 1, a full mip chain */
+static uint32_t prv_max_levels(uint32_t width, uint32_t height)
+{
+    uint32_t size = MAX(width, height);
+    uint32_t levels = 1;
+    
+    while(size > 1)
+    {
+        size >>= 1;
+        levels += 1;
+    }
+    
+    return levels;
+}
+
+static bool prv_read_header(Interface *func, const char *filename, GpuTexture *texture)
+{
+    FILE *fp = func->fopen(filename, "rb");
+    uint8_t header[KTX2_HEADER_SIZE];
+    uint32_t fields[11];
+    uint64_t level_index[MAX_TEXTURE_LEVELS][3];
+    uint32_t block_size = 0;
+    uint64_t blocks;
+    long file_size = 0;
+    bool result = fp != NULL && func->fread(header, sizeof(header), 1, fp) == 1;
+    
+    if(result)
+    {
+        /* vkFormat through supercompressionScheme follow the identifier */
+        memcpy(fields, header + sizeof(ktx2_identifier), sizeof(fields));
+        block_size = prv_block_size((VkFormat)fields[0]);
+        
+        result = memcmp(header, ktx2_identifier, sizeof(ktx2_identifier)) == 0 &&
+            block_size != 0 && fields[2] > 0 && fields[3] > 0 && fields[4] == 0 &&
+            fields[5] <= 1 && fields[6] == 1 && fields[7] > 0 && fields[7] <= MAX_TEXTURE_LEVELS && fields[8] == 0;
+        
+        /* An image can't have more levels than its full mip chain */
+        result = result && fields[7] <= prv_max_levels(fields[2], fields[3]);
+    }
+    
+    if(result)
+    {
+        texture->format = (VkFormat)fields[0];
+        texture->width = fields[2];
+        texture->height = fields[3];
+        texture->level_count = fields[7];
+        
+        result = func->fread(level_index, KTX2_LEVEL_INDEX_SIZE, texture->level_count, fp) == texture->level_count;
+    }
+    
+    if(result)
+    {
+        func->fseek(fp, 0, SEEK_END);
+        file_size = func->ftell(fp);
+    }
+    
+    /* Levels must be tightly packed blocks inside the file */
+    for(uint32_t i = 0; result && i < texture->level_count; i++)
+    {
+        blocks = (uint64_t)((MAX(texture->width >> i, 1) + 3) / 4) * ((MAX(texture->height >> i, 1) + 3) / 4);
+        texture->level_offsets[i] = level_index[i][0];
+        texture->level_sizes[i] = level_index[i][1];
+        
+        result = level_index[i][1] == blocks * block_size && level_index[i][0] + level_index[i][1] <= (uint64_t)file_size &&
+            level_index[i][1] <= TEXTURE_STAGING_FRAME_SIZE;
+    }
+    
+    if(fp)
+    {
+        func->fclose(fp);
+    }
+    
+    return result;
+}
+
+static bool prv_create_staging(Interface *func)
+{
+    bool result = create_buffer(
+        func, (VkDeviceSize)TEXTURE_STAGING_FRAME_SIZE * func->swapchain_image_count, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0,
+        &func->texture_staging_buffer, &func->texture_staging_memory, NULL);
+    void *mapped = NULL;
+    
+    if(result)
+    {
+        result = func->vkMapMemory(func->device, func->texture_staging_memory, 0, VK_WHOLE_SIZE, 0, &mapped) == VK_SUCCESS;
+        func->texture_staging_mapped = mapped;
+    }
+    
+    return result;
+}
+
+bool init_textures(Interface *func)
+{
+    func->texture_budget = (VkDeviceSize)(func->app_info.texture_budget_mb ? func->app_info.texture_budget_mb : TEXTURE_DEFAULT_BUDGET_MB) * 1024 * 1024;
+    func->texture_resident_bytes = 0;
+    func->texture_streamed_bytes = 0;
+    func->texture_evictions = 0;
+    func->texture_frames = 0;
+    
+    func->printf("Texture streaming: %llu MiB budget, BCn %s\n",
+        (unsigned long long)(func->texture_budget / (1024 * 1024)),
+        func->physical_device_features.textureCompressionBC ? "supported" : "not supported");
+    
+    return true;
+}
+
+/* Image holding level and everything coarser */
+static bool prv_create_image(Interface *func, const GpuTexture *texture, uint32_t level,
+    VkImage *image, VkDeviceMemory *memory, VkImageView *view, VkDeviceSize *size)
+{
+    VkResult result;
+    VkImageCreateInfo image_create_info = {0};
+    VkImageViewCreateInfo view_create_info = {0};
+    VkMemoryAllocateInfo alloc_info = {0};
+    VkMemoryRequirements requirements;
+    
+    *image = VK_NULL_HANDLE;
+    *memory = VK_NULL_HANDLE;
+    *view = VK_NULL_HANDLE;
+    
+    image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_create_info.imageType = VK_IMAGE_TYPE_2D;
+    image_create_info.format = texture->format;
+    image_create_info.extent = (VkExtent3D) {MAX(texture->width >> level, 1), MAX(texture->height >> level, 1), 1};
+    image_create_info.mipLevels = texture->level_count - level;
+    image_create_info.arrayLayers = 1;
+    image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_create_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    
+    result = func->vkCreateImage(func->device, &image_create_info, 0, image);
+    
+    if(result == VK_SUCCESS)
+    {
+        func->vkGetImageMemoryRequirements(func->device, *image, &requirements);
+        
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize = requirements.size;
+        alloc_info.memoryTypeIndex = find_memory_type(func, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+        *size = requirements.size;
+        
+        result = alloc_info.memoryTypeIndex == UINT32_MAX ? VK_ERROR_OUT_OF_DEVICE_MEMORY :
+            func->vkAllocateMemory(func->device, &alloc_info, 0, memory);
+    }
+    
+    if(result == VK_SUCCESS)
+    {
+        result = func->vkBindImageMemory(func->device, *image, *memory, 0);
+    }
+    
+    if(result == VK_SUCCESS)
+    {
+        view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_create_info.image = *image;
+        view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_create_info.format = texture->format;
+        view_create_info.subresourceRange = (VkImageSubresourceRange) {VK_IMAGE_ASPECT_COLOR_BIT, 0, texture->level_count - level, 0, 1};
+        
+        result = func->vkCreateImageView(func->device, &view_create_info, 0, view);
+    }
+    
+    /* Nothing has been recorded against a failed image yet */
+    if(result != VK_SUCCESS)
+    {
+        if(*image)
+        {
+            func->vkDestroyImage(func->device, *image, 0);
+        }
+        
+        if(*memory)
+        {
+            func->vkFreeMemory(func->device, *memory, 0);
+        }
+    }
+    
+    return result == VK_SUCCESS;
+}
+
+/* Reads levels first to last - 1 into staging at head, tightly packed
+ * and aligned for the largest block                                   */
+static bool prv_read_levels(Interface *func, const GpuTexture *texture, uint32_t first, uint32_t last,
+    uint8_t *staging, uint32_t *head, uint32_t offsets[MAX_TEXTURE_LEVELS])
+{
+    FILE *fp = NULL;
+    uint32_t position = *head;
+    bool result = true;
+    
+    for(uint32_t i = first; i < last && result; i++)
+    {
+        offsets[i] = (position + 15) & ~15u;
+        position = offsets[i] + (uint32_t)texture->level_sizes[i];
+        result = position <= TEXTURE_STAGING_FRAME_SIZE;
+    }
+    
+    if(result && first < last)
+    {
+        fp = func->fopen(texture->filename, "rb");
+        result = fp != NULL;
+    }
+    
+    for(uint32_t i = first; i < last && result; i++)
+    {
+        func->fseek(fp, (long)texture->level_offsets[i], SEEK_SET);
+        result = func->fread(staging + offsets[i], texture->level_sizes[i], 1, fp) == 1;
+    }
+    
+    if(fp)
+    {
+        func->fclose(fp);
+    }
+    
+    if(result)
+    {
+        func->texture_streamed_bytes += position - *head;
+        *head = position;
+    }
+    
+    return result;
+}
+
+/* Makes level the finest resident one, finer levels are read from disk
+ * and coarser ones copied from the current image                       */
+static bool prv_set_resident(Interface *func, VkCommandBuffer cmd, GpuTexture *texture, uint32_t level,
+    uint32_t frame, uint32_t *head)
+{
+    uint32_t offsets[MAX_TEXTURE_LEVELS];
+    uint32_t old_level = texture->resident_level;
+    uint32_t read_head = *head;
+    uint8_t *staging = func->texture_staging_mapped + (VkDeviceSize)frame * TEXTURE_STAGING_FRAME_SIZE;
+    VkImage image;
+    VkDeviceMemory memory;
+    VkImageView view;
+    VkDeviceSize size = 0;
+    VkImageMemoryBarrier barriers[2] = {0};
+    VkBufferImageCopy buffer_copy = {0};
+    VkImageCopy image_copy = {0};
+    bool result = prv_read_levels(func, texture, level, MIN(old_level, texture->level_count), staging, &read_head, offsets);
+    
+    result = result && prv_create_image(func, texture, level, &image, &memory, &view, &size);
+    
+    if(result)
+    {
+        *head = read_head;
+        
+        for(uint32_t i = 0; i < 2; i++)
+        {
+            barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barriers[i].subresourceRange = (VkImageSubresourceRange) {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1};
+        }
+        
+        barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[0].image = image;
+        
+        /* Earlier frames may still be sampling the old image */
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barriers[1].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barriers[1].image = texture->image;
+        
+        func->vkCmdPipelineBarrier(
+            cmd, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, NULL, 0, NULL, texture->image ? 2 : 1, barriers);
+        
+        for(uint32_t i = level; i < MIN(old_level, texture->level_count); i++)
+        {
+            buffer_copy.bufferOffset = (VkDeviceSize)frame * TEXTURE_STAGING_FRAME_SIZE + offsets[i];
+            buffer_copy.imageSubresource = (VkImageSubresourceLayers) {VK_IMAGE_ASPECT_COLOR_BIT, i - level, 0, 1};
+            buffer_copy.imageExtent = (VkExtent3D) {MAX(texture->width >> i, 1), MAX(texture->height >> i, 1), 1};
+            
+            func->vkCmdCopyBufferToImage(cmd, func->texture_staging_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buffer_copy);
+        }
+        
+        for(uint32_t i = MAX(level, old_level); texture->image && i < texture->level_count; i++)
+        {
+            image_copy.srcSubresource = (VkImageSubresourceLayers) {VK_IMAGE_ASPECT_COLOR_BIT, i - old_level, 0, 1};
+            image_copy.dstSubresource = (VkImageSubresourceLayers) {VK_IMAGE_ASPECT_COLOR_BIT, i - level, 0, 1};
+            image_copy.extent = (VkExtent3D) {MAX(texture->width >> i, 1), MAX(texture->height >> i, 1), 1};
+            
+            func->vkCmdCopyImage(
+                cmd, texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &image_copy);
+        }
+        
+        barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        
+        /* The rest of the frame still samples the old image through
+         * the index handed out at its start                          */
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        
+        func->vkCmdPipelineBarrier(
+            cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, NULL, 0, NULL, texture->image ? 2 : 1, barriers);
+        
+        /* The handed out index is swapped by texture_end_frame, only an
+         * image replaced earlier this frame has one nothing has seen   */
+        if(texture->image)
+        {
+            renderer_bindless_release(func, BINDLESS_IMAGE, texture->next_bindless);
+            lifetime_defer_image_view(func, func->submit_value + 1, texture->view);
+            lifetime_defer_image(func, func->submit_value + 1, texture->image);
+            lifetime_defer_memory(func, func->submit_value + 1, texture->memory);
+            func->texture_resident_bytes -= texture->memory_size;
+        }
+        
+        texture->image = image;
+        texture->memory = memory;
+        texture->view = view;
+        texture->memory_size = size;
+        texture->resident_level = level;
+        texture->next_bindless = renderer_bindless_add_image(func, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        func->texture_resident_bytes += size;
+        
+        /* Out of indices, the old one must not outlive its image */
+        if(texture->next_bindless == BINDLESS_INVALID)
+        {
+            renderer_bindless_release(func, BINDLESS_IMAGE, texture->bindless);
+            texture->bindless = BINDLESS_INVALID;
+        }
+    }
+    
+    return result;
+}
+
+/* Drops the finest level of the least recently used textures until
+ * needed more bytes fit the budget. Textures holding more than they
+ * were asked for go first, the tail of every texture always stays.  */
+static bool prv_make_room(Interface *func, VkCommandBuffer cmd, const GpuTexture *keep, VkDeviceSize needed,
+    uint32_t frame, uint32_t *head)
+{
+    GpuTexture *victim = NULL;
+    GpuTexture *texture;
+    bool evicted = true;
+    
+    while(func->texture_resident_bytes + needed > func->texture_budget && evicted)
+    {
+        victim = NULL;
+        
+        for(uint32_t i = 0; i < func->texture_count; i++)
+        {
+            texture = &func->textures[i];
+            
+            if(texture != keep && texture->filename && texture->resident_level < prv_tail_level(texture) &&
+                (texture->wanted_level > texture->resident_level || texture->last_used < keep->last_used))
+            {
+                victim = !victim ||
+                    (texture->wanted_level > texture->resident_level) > (victim->wanted_level > victim->resident_level) ||
+                    ((texture->wanted_level > texture->resident_level) == (victim->wanted_level > victim->resident_level) &&
+                        texture->last_used < victim->last_used) ? texture : victim;
+            }
+        }
+        
+        evicted = victim && prv_set_resident(func, cmd, victim, victim->resident_level + 1, frame, head);
+        func->texture_evictions += evicted ? 1 : 0;
+    }
+    
+    return func->texture_resident_bytes + needed <= func->texture_budget;
+}
+
+/* Streams in at most a staging partition of levels, textures with
+ * nothing resident get their tail before any texture gets finer    */
+void texture_begin_frame(Interface *func, VkCommandBuffer cmd, uint32_t frame)
+{
+    GpuTexture *texture;
+    uint32_t head = 0;
+    uint32_t level;
+    VkDeviceSize needed;
+    
+    for(uint32_t pass = 0; pass < 2 && func->texture_staging_mapped; pass++)
+    {
+        for(uint32_t i = 0; i < func->texture_count; i++)
+        {
+            texture = &func->textures[i];
+            
+            if(texture->filename && texture->wanted_level < texture->resident_level &&
+                (texture->resident_level == texture->level_count) == (pass == 0))
+            {
+                level = pass == 0 ? MAX(prv_tail_level(texture), texture->wanted_level) : texture->resident_level - 1;
+                needed = 0;
+                
+                /* Level sizes stand in for the image's memory requirements */
+                for(uint32_t j = level; j < texture->level_count; j++)
+                {
+                    needed += texture->level_sizes[j];
+                }
+                
+                if(prv_make_room(func, cmd, texture, needed > texture->memory_size ? needed - texture->memory_size : 0, frame, &head))
+                {
+                    prv_set_resident(func, cmd, texture, level, frame, &head);
+                }
+            }
+        }
+    }
+    
+    func->texture_frames += 1;
+    
+    if(func->texture_count > 0 && func->texture_frames % TIMING_REPORT_FRAMES == 0)
+    {
+        func->printf("Textures: %llu of %llu MiB resident, %llu MiB streamed, %u evictions\n",
+            (unsigned long long)(func->texture_resident_bytes / (1024 * 1024)),
+            (unsigned long long)(func->texture_budget / (1024 * 1024)),
+            (unsigned long long)(func->texture_streamed_bytes / (1024 * 1024)), func->texture_evictions);
+    }
+}
+
+uint32_t renderer_load_texture(Interface *func, const char *filename)
+{
+    uint32_t slot = TEXTURE_INVALID;
+    GpuTexture texture = {0};
+    size_t length = strlen(filename);
+    bool result = func->physical_device_features.textureCompressionBC;
+    
+    result = result && prv_read_header(func, filename, &texture);
+    
+    if(result && !func->texture_staging_mapped)
+    {
+        /* Created on first use, most scenes without textures never pay for it */
+        result = prv_create_staging(func);
+    }
+    
+    for(uint32_t i = 0; result && i < func->texture_count && slot == TEXTURE_INVALID; i++)
+    {
+        slot = func->textures[i].filename ? TEXTURE_INVALID : i;
+    }
+    
+    if(result && slot == TEXTURE_INVALID && func->texture_count < MAX_TEXTURES)
+    {
+        slot = func->texture_count;
+        func->texture_count += 1;
+    }
+    
+    if(result && slot != TEXTURE_INVALID)
+    {
+        texture.filename = func->malloc(length + 1);
+        result = texture.filename != NULL;
+    }
+    
+    if(result && slot != TEXTURE_INVALID)
+    {
+        memcpy(texture.filename, filename, length + 1);
+        texture.resident_level = texture.level_count;
+        texture.wanted_level = prv_tail_level(&texture);
+        texture.last_used = func->texture_frames;
+        texture.bindless = BINDLESS_INVALID;
+        texture.next_bindless = BINDLESS_INVALID;
+        func->textures[slot] = texture;
+    }
+    else
+    {
+        func->printf("Failed to load texture %s\n", filename);
+        slot = TEXTURE_INVALID;
+    }
+    
+    return slot;
+}
+
+void renderer_unload_texture(Interface *func, uint32_t texture)
+{
+    GpuTexture *gpu_texture = texture < func->texture_count ? &func->textures[texture] : NULL;
+    
+    if(gpu_texture && gpu_texture->filename)
+    {
+        if(gpu_texture->image)
+        {
+            renderer_bindless_release(func, BINDLESS_IMAGE, gpu_texture->bindless);
+            renderer_bindless_release(func, BINDLESS_IMAGE, gpu_texture->next_bindless);
+            lifetime_defer_image_view(func, func->submit_value + 1, gpu_texture->view);
+            lifetime_defer_image(func, func->submit_value + 1, gpu_texture->image);
+            lifetime_defer_memory(func, func->submit_value + 1, gpu_texture->memory);
+            func->texture_resident_bytes -= gpu_texture->memory_size;
+        }
+        
+        func->free(gpu_texture->filename);
+        *gpu_texture = (GpuTexture) {0};
+    }
+}
+
+/* Called once the frame is submitted, images made resident during it
+ * are handed out from the next frame on. The old index stays valid
+ * until the next submission has completed.                          */
+void texture_end_frame(Interface *func)
+{
+    GpuTexture *texture;
+    
+    for(uint32_t i = 0; i < func->texture_count; i++)
+    {
+        texture = &func->textures[i];
+        
+        if(texture->filename && texture->next_bindless != BINDLESS_INVALID)
+        {
+            renderer_bindless_release(func, BINDLESS_IMAGE, texture->bindless);
+            texture->bindless = texture->next_bindless;
+            texture->next_bindless = BINDLESS_INVALID;
+        }
+    }
+}
+
+/* Asks for level and everything coarser to be resident, it streams in
+ * over the next frames as staging and the budget allow               */
+void renderer_request_texture(Interface *func, uint32_t texture, uint32_t level)
+{
+    GpuTexture *gpu_texture = texture < func->texture_count ? &func->textures[texture] : NULL;
+    
+    if(gpu_texture && gpu_texture->filename)
+    {
+        gpu_texture->wanted_level = MIN(level, gpu_texture->level_count - 1);
+        gpu_texture->last_used = func->texture_frames;
+    }
+}
+
+/* Bindless image index to sample with this frame, BINDLESS_INVALID
+ * until the tail has streamed in                                   */
+uint32_t renderer_texture_index(Interface *func, uint32_t texture)
+{
+    uint32_t index = BINDLESS_INVALID;
+    
+    if(texture < func->texture_count && func->textures[texture].filename)
+    {
+        index = func->textures[texture].bindless;
+    }
+    
+    return index;
+}
@@ -0,0 +1,252 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "interface.h"
+#include "renderer_int.h"
+
+static uint64_t prv_timestamp_mask(uint32_t valid_bits)
+{
+    return valid_bits >= 64 ? UINT64_MAX : ((uint64_t)1 << valid_bits) - 1;
+}
+
+/* Ticks from one timestamp to another within the bits of the mask,
+ * negative when the second one came first                          */
+static int64_t prv_ticks_between(uint64_t from, uint64_t to, uint64_t mask)
+{
+    uint64_t ticks = (to - from) & mask;
+    
+    return ticks > mask >> 1 ? (int64_t)(ticks - mask) - 1 : (int64_t)ticks;
+}
+
+/* Ticks of the first interval that fall inside the second */
+static int64_t prv_overlap(uint64_t begin, uint64_t end, uint64_t other_begin, uint64_t other_end, uint64_t mask)
+{
+    int64_t length = prv_ticks_between(begin, end, mask);
+    int64_t other_start = prv_ticks_between(begin, other_begin, mask);
+    int64_t other_stop = prv_ticks_between(begin, other_end, mask);
+    
+    return MAX(MIN(length, other_stop) - MAX(other_start, 0), 0);
+}
+
+bool init_timing(Interface *func)
+{
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    VkQueryPoolCreateInfo query_pool_create_info = {0};
+    uint32_t queue_family_count = MAX_QUEUE_COUNT;
+    VkQueueFamilyProperties queue_family_properties[MAX_QUEUE_COUNT];
+    
+    func->vkGetPhysicalDeviceQueueFamilyProperties(
+        func->physical_device, &queue_family_count, queue_family_properties);
+    
+    /* Families without valid bits simply don't get timed */
+    func->graphics_timestamp_mask = prv_timestamp_mask(
+        queue_family_properties[func->queue_family_index].timestampValidBits);
+    func->compute_timestamp_mask = prv_timestamp_mask(
+        queue_family_properties[func->compute_queue_family_index].timestampValidBits);
+    
+    /* One queue is trivially on one clock, two separate ones only
+     * when the device exposes its time domain                     */
+    func->timing_overlap = func->graphics_timestamp_mask && func->compute_timestamp_mask &&
+        (func->device_time_domain || func->compute_queue_family_index == func->queue_family_index);
+    func->previous_graphics_valid = false;
+    
+    if(!func->timing_overlap)
+    {
+        func->printf("Queue overlap not timed, the queues don't share a timestamp clock\n");
+    }
+    
+    query_pool_create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_pool_create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_create_info.queryCount = MAX_FRAMES * TIMESTAMPS_PER_FRAME;
+    
+    result = func->vkCreateQueryPool(func->device, &query_pool_create_info, 0, &func->timestamp_pool);
+    
+    /* Counting fragment shader invocations of the main pass shows how
+     * many times each pixel gets shaded, which is what a depth prepass
+     * is meant to bring down to one. Objects without a mesh all draw
+     * the same placeholder triangle at depth 0, a scene of only those
+     * gives the prepass nothing to reject and the figure shows nothing. */
+    func->overdraw_pool = VK_NULL_HANDLE;
+    
+    if(result == VK_SUCCESS && func->physical_device_features.pipelineStatisticsQuery)
+    {
+        query_pool_create_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        query_pool_create_info.queryCount = MAX_FRAMES;
+        query_pool_create_info.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+        
+        if(func->vkCreateQueryPool(func->device, &query_pool_create_info, 0, &func->overdraw_pool) != VK_SUCCESS)
+        {
+            func->printf("Failed to create overdraw query pool\n");
+            func->overdraw_pool = VK_NULL_HANDLE;
+        }
+    }
+    
+    func->timing_stats = (GpuTimingStats) {0};
+    
+    return result == VK_SUCCESS;
+}
+
+void timing_begin(Interface *func, VkCommandBuffer cmd, uint32_t frame, uint32_t timing)
+{
+    uint32_t query = frame * TIMESTAMPS_PER_FRAME + timing * 2;
+    uint64_t mask = timing == TIMING_COMPUTE ? func->compute_timestamp_mask : func->graphics_timestamp_mask;
+    
+    /* Each pair is reset by the command buffer that writes it so
+     * the two queues never touch each other's queries. Graphics waits
+     * for the swapchain image and for compute at or before color
+     * output, timing from that stage leaves the waits out. Work that
+     * runs ahead of them, like uploads, is left out with them.         */
+    if(mask)
+    {
+        func->vkCmdResetQueryPool(cmd, func->timestamp_pool, query, 2);
+        func->vkCmdWriteTimestamp(
+            cmd, timing == TIMING_GRAPHICS ? VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            func->timestamp_pool, query);
+    }
+    
+    /* Queries can't be reset inside a render pass */
+    if(timing == TIMING_GRAPHICS && func->overdraw_pool)
+    {
+        func->vkCmdResetQueryPool(cmd, func->overdraw_pool, frame, 1);
+    }
+}
+
+void timing_end(Interface *func, VkCommandBuffer cmd, uint32_t frame, uint32_t timing)
+{
+    uint32_t query = frame * TIMESTAMPS_PER_FRAME + timing * 2;
+    uint64_t mask = timing == TIMING_COMPUTE ? func->compute_timestamp_mask : func->graphics_timestamp_mask;
+    
+    if(mask)
+    {
+        func->vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, func->timestamp_pool, query + 1);
+        func->timestamps_written[frame] |= 1u << timing;
+    }
+}
+
+/* Wraps the draws whose overdraw gets reported, must be inside the
+ * command buffer timing_begin was recorded into for this frame     */
+void overdraw_begin(Interface *func, VkCommandBuffer cmd, uint32_t frame)
+{
+    if(func->overdraw_pool)
+    {
+        func->vkCmdBeginQuery(cmd, func->overdraw_pool, frame, 0);
+    }
+}
+
+void overdraw_end(Interface *func, VkCommandBuffer cmd, uint32_t frame)
+{
+    if(func->overdraw_pool)
+    {
+        func->vkCmdEndQuery(cmd, func->overdraw_pool, frame);
+        func->overdraw_written[frame] = true;
+        func->overdraw_extent[frame] = func->render_extent;
+    }
+}
+
+/* Must be called once the frame fence has signaled, so the results
+ * are ready and reading them never stalls                          */
+void timing_collect(Interface *func, uint32_t frame)
+{
+    VkResult result;
+    GpuTimingStats *stats = &func->timing_stats;
+    double ms_per_tick = func->physical_device_properties.limits.timestampPeriod / 1000000.0;
+    uint64_t timestamps[TIMESTAMPS_PER_FRAME];
+    bool valid[TIMING_COUNT] = {false};
+    uint64_t graphics_begin, graphics_end, compute_begin, compute_end;
+    uint64_t shared_mask = func->graphics_timestamp_mask & func->compute_timestamp_mask;
+    int64_t overlap;
+    uint64_t fragment_invocations;
+    double pixel_count = (double)func->overdraw_extent[frame].width * func->overdraw_extent[frame].height;
+    
+    for(uint32_t i = 0; i < TIMING_COUNT; i++)
+    {
+        if(func->timestamps_written[frame] & (1u << i))
+        {
+            result = func->vkGetQueryPoolResults(
+                func->device, func->timestamp_pool, frame * TIMESTAMPS_PER_FRAME + i * 2, 2,
+                sizeof(uint64_t) * 2, &timestamps[i * 2], sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+            valid[i] = result == VK_SUCCESS;
+        }
+    }
+    
+    func->timestamps_written[frame] = 0;
+    
+    if(func->overdraw_written[frame] && pixel_count > 0.0 &&
+       func->vkGetQueryPoolResults(
+           func->device, func->overdraw_pool, frame, 1, sizeof(uint64_t), &fragment_invocations,
+           sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+    {
+        stats->fragments_per_pixel += fragment_invocations / pixel_count;
+        stats->overdraw_count += 1;
+    }
+    
+    func->overdraw_written[frame] = false;
+    
+    if(valid[TIMING_GRAPHICS])
+    {
+        graphics_begin = timestamps[TIMING_GRAPHICS * 2] & func->graphics_timestamp_mask;
+        graphics_end = timestamps[TIMING_GRAPHICS * 2 + 1] & func->graphics_timestamp_mask;
+        
+        func->gpu_frame_ms = (graphics_end - graphics_begin) * ms_per_tick;
+        stats->graphics_ms += func->gpu_frame_ms;
+        func->gpu_compute_ms = 0.0;
+        
+        if(valid[TIMING_COMPUTE])
+        {
+            compute_begin = timestamps[TIMING_COMPUTE * 2] & func->compute_timestamp_mask;
+            compute_end = timestamps[TIMING_COMPUTE * 2 + 1] & func->compute_timestamp_mask;
+            
+            func->gpu_compute_ms = (compute_end - compute_begin) * ms_per_tick;
+            stats->compute_ms += func->gpu_compute_ms;
+            
+            /* Compute is submitted ahead of its own frame's graphics work,
+             * which waits for it, so it mostly runs alongside the previous
+             * frame's. Both timelines are compared in the bits both queue
+             * families have.                                               */
+            if(func->timing_overlap)
+            {
+                overlap = prv_overlap(compute_begin, compute_end, graphics_begin, graphics_end, shared_mask);
+                
+                if(func->previous_graphics_valid)
+                {
+                    overlap += prv_overlap(compute_begin, compute_end,
+                        func->previous_graphics[0], func->previous_graphics[1], shared_mask);
+                }
+                
+                stats->overlap_ms += overlap * ms_per_tick;
+            }
+        }
+        
+        func->previous_graphics[0] = graphics_begin;
+        func->previous_graphics[1] = graphics_end;
+        stats->frame_count += 1;
+    }
+    
+    func->previous_graphics_valid = valid[TIMING_GRAPHICS];
+    
+    if(stats->frame_count == TIMING_REPORT_FRAMES)
+    {
+        if(func->timing_overlap)
+        {
+            func->printf("GPU frame: graphics queue %.3f ms, compute queue %.3f ms, %.3f ms of compute overlapping graphics\n",
+                stats->graphics_ms / stats->frame_count,
+                stats->compute_ms / stats->frame_count,
+                stats->overlap_ms / stats->frame_count);
+        }
+        else
+        {
+            func->printf("GPU frame: graphics queue %.3f ms, compute queue %.3f ms\n",
+                stats->graphics_ms / stats->frame_count,
+                stats->compute_ms / stats->frame_count);
+        }
+        
+        if(stats->overdraw_count > 0)
+        {
+            func->printf("Overdraw: %.2f fragments shaded per pixel, depth prepass %s%s\n",
+                stats->fragments_per_pixel / stats->overdraw_count,
+                func->app_info.depth_prepass ? "on" : "off",
+                func->mesh_object_count == 0 ? ", placeholder geometry only" : "");
+        }
+        
+        *stats = (GpuTimingStats) {0};
+    }
+}
@@ -0,0 +1,218 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <math.h>
+#include "interface.h"
+#include "renderer_int.h"
+
+/* One buffer holds a partition per frame slot. A slot is only reused
+ * once lifetime_wait has returned for its last submission, so writing
+ * into the partition never races the GPU and nothing has to be mapped,
+ * flushed or re-written in a descriptor set while recording.
+ *
+ * The descriptors cover a fixed range starting at offset 0, so the
+ * buffer is padded by the largest range to keep any dynamic offset
+ * inside a partition valid.                                           */
+
+static bool prv_create_frame_set(Interface *func)
+{
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    VkDescriptorSetLayoutBinding bindings[2] = {0};
+    VkDescriptorSetLayoutCreateInfo layout_create_info = {0};
+    VkDescriptorPoolSize pool_sizes[2] = {0};
+    VkDescriptorPoolCreateInfo pool_create_info = {0};
+    VkDescriptorSetAllocateInfo set_alloc_info = {0};
+    VkDescriptorBufferInfo buffer_infos[2] = {0};
+    VkWriteDescriptorSet writes[2] = {0};
+    
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT;
+    
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT;
+    
+    layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_create_info.bindingCount = 2;
+    layout_create_info.pBindings = bindings;
+    
+    result = func->vkCreateDescriptorSetLayout(func->device, &layout_create_info, 0, &func->frame_set_layout);
+    
+    if(result == VK_SUCCESS)
+    {
+        pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        pool_sizes[0].descriptorCount = 1;
+        pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+        pool_sizes[1].descriptorCount = 1;
+        
+        pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_create_info.maxSets = 1;
+        pool_create_info.poolSizeCount = 2;
+        pool_create_info.pPoolSizes = pool_sizes;
+        
+        result = func->vkCreateDescriptorPool(func->device, &pool_create_info, 0, &func->frame_descriptor_pool);
+    }
+    
+    if(result == VK_SUCCESS)
+    {
+        set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        set_alloc_info.descriptorPool = func->frame_descriptor_pool;
+        set_alloc_info.descriptorSetCount = 1;
+        set_alloc_info.pSetLayouts = &func->frame_set_layout;
+        
+        result = func->vkAllocateDescriptorSets(func->device, &set_alloc_info, &func->frame_set);
+    }
+    
+    if(result == VK_SUCCESS)
+    {
+        buffer_infos[0] = (VkDescriptorBufferInfo) {func->uniform_buffer, 0, func->uniform_range};
+        buffer_infos[1] = (VkDescriptorBufferInfo) {func->uniform_buffer, 0, STORAGE_RANGE};
+        
+        for(uint32_t i = 0; i < 2; i++)
+        {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = func->frame_set;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = bindings[i].descriptorType;
+            writes[i].pBufferInfo = &buffer_infos[i];
+        }
+        
+        /* The only descriptor write the ring ever needs */
+        func->vkUpdateDescriptorSets(func->device, 2, writes, 0, NULL);
+    }
+    
+    return result == VK_SUCCESS;
+}
+
+bool init_uniforms(Interface *func)
+{
+    bool result = false;
+    const VkPhysicalDeviceLimits *limits = &func->physical_device_properties.limits;
+    VkDeviceSize size;
+    uint32_t memory_type;
+    void *mapped = NULL;
+    
+    /* Both alignments are powers of two so one allocation can be
+     * bound as either kind of buffer                              */
+    func->uniform_alignment = MAX(limits->minUniformBufferOffsetAlignment, limits->minStorageBufferOffsetAlignment);
+    func->uniform_alignment = MAX(func->uniform_alignment, 16);
+    func->uniform_range = MIN(limits->maxUniformBufferRange, UNIFORM_MAX_RANGE);
+    
+    size = (VkDeviceSize)UNIFORM_FRAME_SIZE * MAX_FRAMES + MAX(func->uniform_range, STORAGE_RANGE);
+    
+    /* Device local host visible memory lets the GPU read constants
+     * without crossing the bus where the platform exposes it       */
+    result = create_buffer(
+        func, size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &func->uniform_buffer, &func->uniform_memory, &memory_type);
+    
+    if(result)
+    {
+        result = func->vkMapMemory(func->device, func->uniform_memory, 0, VK_WHOLE_SIZE, 0, &mapped) == VK_SUCCESS;
+        func->uniform_mapped = mapped;
+    }
+    
+    if(result)
+    {
+        result = prv_create_frame_set(func);
+    }
+    
+    if(result)
+    {
+        func->uniform_base = 0;
+        atomic_store(&func->uniform_head, 0);
+        atomic_store(&func->uniform_failed, 0);
+        func->uniform_peak = 0;
+        func->uniform_frames = 0;
+        func->start_ticks = func->get_perf_counter();
+        
+        func->printf("Uniform ring: %u KiB per frame, %llu byte alignment, %s memory\n",
+            UNIFORM_FRAME_SIZE / 1024, (unsigned long long)func->uniform_alignment,
+            func->memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT ? "device local" : "host");
+    }
+    else
+    {
+        func->printf("Failed to create uniform ring\n");
+    }
+    
+    return result;
+}
+
+/* Returns size bytes from the current frame's partition, written by the
+ * CPU and read by the GPU once the frame is submitted. offset receives
+ * the dynamic offset to bind for either binding of set 0. Safe to call
+ * from worker threads, NULL once the partition is exhausted.           */
+void *renderer_alloc_uniform(Interface *func, uint32_t size, uint32_t *offset)
+{
+    uint32_t aligned = (size + func->uniform_alignment - 1) & ~(uint32_t)(func->uniform_alignment - 1);
+    uint32_t head = atomic_fetch_add(&func->uniform_head, aligned);
+    void *data = NULL;
+    
+    if(head + aligned <= UNIFORM_FRAME_SIZE)
+    {
+        *offset = func->uniform_base + head;
+        data = func->uniform_mapped + *offset;
+    }
+    else
+    {
+        atomic_fetch_add(&func->uniform_failed, 1);
+    }
+    
+    return data;
+}
+
+/* Must be called once the frame slot is no longer in use by the GPU */
+void uniform_begin_frame(Interface *func, uint32_t frame)
+{
+    uint32_t used = MIN(atomic_load(&func->uniform_head), UNIFORM_FRAME_SIZE);
+    FrameConstants *constants;
+    float slice_scale = CLUSTER_Z / logf(func->camera_far / func->camera_near);
+    
+    func->uniform_peak = MAX(func->uniform_peak, used);
+    func->uniform_frames += 1;
+    
+    if(func->uniform_frames % TIMING_REPORT_FRAMES == 0)
+    {
+        func->printf("Uniform ring: peak %u of %u KiB per frame, %u failed allocations\n",
+            (func->uniform_peak + 1023) / 1024, UNIFORM_FRAME_SIZE / 1024, atomic_load(&func->uniform_failed));
+        
+        func->uniform_peak = 0;
+        atomic_store(&func->uniform_failed, 0);
+    }
+    
+    func->uniform_base = frame * UNIFORM_FRAME_SIZE;
+    atomic_store(&func->uniform_head, 0);
+    
+    constants = renderer_alloc_uniform(func, sizeof(FrameConstants), &func->frame_constants_offset);
+    
+    if(constants)
+    {
+        constants->resolution[0] = func->swapchain_extent.width;
+        constants->resolution[1] = func->swapchain_extent.height;
+        constants->time = (func->get_perf_counter() - func->start_ticks) / (double)func->get_perf_frequency();
+        constants->frame = func->uniform_frames;
+        constants->instance_buffer = func->instance_bindless[frame];
+        constants->sprite_buffer = func->sprite_bindless[func->sprite_partition];
+        constants->light_buffer = func->light_bindless[frame];
+        constants->cluster_buffer = func->cluster_bindless[frame];
+        memcpy(constants->inverse_projection, func->inverse_projection, sizeof(constants->inverse_projection));
+        constants->cluster_grid[0] = CLUSTER_X;
+        constants->cluster_grid[1] = CLUSTER_Y;
+        constants->cluster_grid[2] = CLUSTER_Z;
+        constants->cluster_grid[3] = func->light_visible_count;
+        constants->cluster_depth[0] = func->camera_near;
+        constants->cluster_depth[1] = func->camera_far;
+        constants->cluster_depth[2] = slice_scale;
+        constants->cluster_depth[3] = -logf(func->camera_near) * slice_scale;
+        constants->render_size[0] = func->render_extent.width;
+        constants->render_size[1] = func->render_extent.height;
+        constants->render_scale = func->render_scale;
+    }
+}
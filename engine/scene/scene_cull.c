@@ -0,0 +1,509 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "interface.h"
+#include "job.h"
+#include "cull.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CULL_X86 1
+#endif
+
+static const char *path_names[CULL_PATH_COUNT] = {"scalar", "sse2", "avx2"};
+
+static bool prv_grow(Interface *func, CullScene *scene)
+{
+    uint32_t capacity = scene->capacity ? scene->capacity * 2 : CULL_INITIAL_CAPACITY;
+    float **arrays[] = {
+        &scene->center_x, &scene->center_y, &scene->center_z,
+        &scene->extent_x, &scene->extent_y, &scene->extent_z, &scene->radius};
+    bool result = true;
+    void *grown;
+    
+    for(uint32_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]) && result; i++)
+    {
+        grown = func->realloc(*arrays[i], capacity * sizeof(float));
+        result = grown != NULL;
+        
+        if(result)
+        {
+            *arrays[i] = grown;
+        }
+    }
+    
+    if(result)
+    {
+        grown = func->realloc(scene->free_list, capacity * sizeof(uint32_t));
+        result = grown != NULL;
+        scene->free_list = result ? grown : scene->free_list;
+    }
+    
+    if(result)
+    {
+        grown = func->realloc(scene->visible, capacity * sizeof(uint32_t));
+        result = grown != NULL;
+        scene->visible = result ? grown : scene->visible;
+    }
+    
+    /* Arrays that did grow are still valid, only the capacity stays */
+    if(result)
+    {
+        scene->capacity = capacity;
+    }
+    
+    return result;
+}
+
+CullScene *cull_scene_create(Interface *func)
+{
+    CullScene *scene = func->malloc(sizeof(CullScene));
+    
+    if(scene)
+    {
+        *scene = (CullScene) {0};
+        scene->path = cull_best_path();
+        
+        if(!prv_grow(func, scene))
+        {
+            cull_scene_destroy(func, scene);
+            scene = NULL;
+        }
+    }
+    
+    return scene;
+}
+
+void cull_scene_destroy(Interface *func, CullScene *scene)
+{
+    func->free(scene->center_x);
+    func->free(scene->center_y);
+    func->free(scene->center_z);
+    func->free(scene->extent_x);
+    func->free(scene->extent_y);
+    func->free(scene->extent_z);
+    func->free(scene->radius);
+    func->free(scene->free_list);
+    func->free(scene->visible);
+    
+    if(scene->group.done)
+    {
+        func->destroy_sem(scene->group.done);
+    }
+    
+    func->free(scene);
+}
+
+void cull_set_object(CullScene *scene, uint32_t object, const float center[3], const float extents[3], float radius)
+{
+    if(object < scene->count)
+    {
+        scene->center_x[object] = center[0];
+        scene->center_y[object] = center[1];
+        scene->center_z[object] = center[2];
+        scene->extent_x[object] = fabsf(extents[0]);
+        scene->extent_y[object] = fabsf(extents[1]);
+        scene->extent_z[object] = fabsf(extents[2]);
+        scene->radius[object] = radius > 0.0f ? radius :
+            sqrtf(extents[0] * extents[0] + extents[1] * extents[1] + extents[2] * extents[2]);
+        scene->generation += 1;
+    }
+}
+
+uint32_t cull_add_object(Interface *func, CullScene *scene, const float center[3], const float extents[3], float radius)
+{
+    uint32_t object = CULL_INVALID;
+    
+    if(scene->free_count > 0)
+    {
+        scene->free_count -= 1;
+        object = scene->free_list[scene->free_count];
+    }
+    else if(scene->count < scene->capacity || prv_grow(func, scene))
+    {
+        object = scene->count;
+        scene->count += 1;
+    }
+    
+    if(object != CULL_INVALID)
+    {
+        scene->live_count += 1;
+        cull_set_object(scene, object, center, extents, radius);
+    }
+    
+    return object;
+}
+
+void cull_remove_object(CullScene *scene, uint32_t object)
+{
+    if(object < scene->count && scene->radius[object] >= 0.0f)
+    {
+        /* Fails every plane test without a branch in the loops */
+        scene->radius[object] = -FLT_MAX;
+        scene->extent_x[object] = 0.0f;
+        scene->extent_y[object] = 0.0f;
+        scene->extent_z[object] = 0.0f;
+        scene->free_list[scene->free_count] = object;
+        scene->free_count += 1;
+        scene->live_count -= 1;
+        scene->generation += 1;
+    }
+}
+
+void cull_frustum_from_matrix(Frustum *frustum, const float view_proj[16])
+{
+    const float *m = view_proj;
+    float rows[4][4];
+    float planes[6][4];
+    float length;
+    
+    for(uint32_t i = 0; i < 4; i++)
+    {
+        for(uint32_t j = 0; j < 4; j++)
+        {
+            rows[i][j] = m[j * 4 + i];
+        }
+    }
+    
+    for(uint32_t j = 0; j < 4; j++)
+    {
+        planes[0][j] = rows[3][j] + rows[0][j];
+        planes[1][j] = rows[3][j] - rows[0][j];
+        planes[2][j] = rows[3][j] + rows[1][j];
+        planes[3][j] = rows[3][j] - rows[1][j];
+        planes[4][j] = rows[2][j];
+        planes[5][j] = rows[3][j] - rows[2][j];
+    }
+    
+    for(uint32_t i = 0; i < 6; i++)
+    {
+        length = sqrtf(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+        length = length > 0.0f ? 1.0f / length : 0.0f;
+        
+        frustum->a[i] = planes[i][0] * length;
+        frustum->b[i] = planes[i][1] * length;
+        frustum->c[i] = planes[i][2] * length;
+        frustum->d[i] = planes[i][3] * length;
+        frustum->abs_a[i] = fabsf(frustum->a[i]);
+        frustum->abs_b[i] = fabsf(frustum->b[i]);
+        frustum->abs_c[i] = fabsf(frustum->c[i]);
+    }
+}
+
+/* An object is outside once its center is further behind a plane than
+ * the tighter of its sphere and the box's extent along the normal     */
+static uint32_t prv_cull_scalar(const CullScene *scene, const Frustum *frustum, uint32_t begin, uint32_t end, uint32_t *visible)
+{
+    uint32_t count = 0;
+    float distance, box, reach;
+    bool inside;
+    
+    for(uint32_t i = begin; i < end; i++)
+    {
+        inside = true;
+        
+        for(uint32_t p = 0; p < 6; p++)
+        {
+            distance = frustum->a[p] * scene->center_x[i] + frustum->b[p] * scene->center_y[i] +
+                       frustum->c[p] * scene->center_z[i] + frustum->d[p];
+            box = frustum->abs_a[p] * scene->extent_x[i] + frustum->abs_b[p] * scene->extent_y[i] +
+                  frustum->abs_c[p] * scene->extent_z[i];
+            reach = scene->radius[i] < box ? scene->radius[i] : box;
+            inside &= distance + reach >= 0.0f;
+        }
+        
+        visible[count] = i;
+        count += inside;
+    }
+    
+    return count;
+}
+
+#ifdef CULL_X86
+
+__attribute__((target("sse2")))
+static uint32_t prv_cull_sse2(const CullScene *scene, const Frustum *frustum, uint32_t begin, uint32_t end, uint32_t *visible)
+{
+    uint32_t count = 0;
+    uint32_t i = begin;
+    __m128 x, y, z, ex, ey, ez, radius, distance, box, inside;
+    __m128 zero = _mm_setzero_ps();
+    uint32_t mask;
+    
+    for(; i + 4 <= end; i += 4)
+    {
+        x = _mm_loadu_ps(&scene->center_x[i]);
+        y = _mm_loadu_ps(&scene->center_y[i]);
+        z = _mm_loadu_ps(&scene->center_z[i]);
+        ex = _mm_loadu_ps(&scene->extent_x[i]);
+        ey = _mm_loadu_ps(&scene->extent_y[i]);
+        ez = _mm_loadu_ps(&scene->extent_z[i]);
+        radius = _mm_loadu_ps(&scene->radius[i]);
+        inside = _mm_cmpeq_ps(zero, zero);
+        
+        for(uint32_t p = 0; p < 6; p++)
+        {
+            distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(frustum->a[p]), x), _mm_mul_ps(_mm_set1_ps(frustum->b[p]), y)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(frustum->c[p]), z), _mm_set1_ps(frustum->d[p])));
+            box = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(frustum->abs_a[p]), ex), _mm_mul_ps(_mm_set1_ps(frustum->abs_b[p]), ey)),
+                _mm_mul_ps(_mm_set1_ps(frustum->abs_c[p]), ez));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, _mm_min_ps(radius, box)), zero));
+        }
+        
+        mask = _mm_movemask_ps(inside);
+        
+        while(mask)
+        {
+            visible[count] = i + __builtin_ctz(mask);
+            count += 1;
+            mask &= mask - 1;
+        }
+    }
+    
+    return count + prv_cull_scalar(scene, frustum, i, end, visible + count);
+}
+
+__attribute__((target("avx2,fma")))
+static uint32_t prv_cull_avx2(const CullScene *scene, const Frustum *frustum, uint32_t begin, uint32_t end, uint32_t *visible)
+{
+    uint32_t count = 0;
+    uint32_t i = begin;
+    __m256 x, y, z, ex, ey, ez, radius, distance, box, inside;
+    __m256 zero = _mm256_setzero_ps();
+    uint32_t mask;
+    
+    for(; i + 8 <= end; i += 8)
+    {
+        x = _mm256_loadu_ps(&scene->center_x[i]);
+        y = _mm256_loadu_ps(&scene->center_y[i]);
+        z = _mm256_loadu_ps(&scene->center_z[i]);
+        ex = _mm256_loadu_ps(&scene->extent_x[i]);
+        ey = _mm256_loadu_ps(&scene->extent_y[i]);
+        ez = _mm256_loadu_ps(&scene->extent_z[i]);
+        radius = _mm256_loadu_ps(&scene->radius[i]);
+        inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+        
+        for(uint32_t p = 0; p < 6; p++)
+        {
+            distance = _mm256_fmadd_ps(_mm256_set1_ps(frustum->a[p]), x, _mm256_set1_ps(frustum->d[p]));
+            distance = _mm256_fmadd_ps(_mm256_set1_ps(frustum->b[p]), y, distance);
+            distance = _mm256_fmadd_ps(_mm256_set1_ps(frustum->c[p]), z, distance);
+            box = _mm256_mul_ps(_mm256_set1_ps(frustum->abs_a[p]), ex);
+            box = _mm256_fmadd_ps(_mm256_set1_ps(frustum->abs_b[p]), ey, box);
+            box = _mm256_fmadd_ps(_mm256_set1_ps(frustum->abs_c[p]), ez, box);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, _mm256_min_ps(radius, box)), zero, _CMP_GE_OQ));
+        }
+        
+        mask = _mm256_movemask_ps(inside);
+        
+        while(mask)
+        {
+            visible[count] = i + __builtin_ctz(mask);
+            count += 1;
+            mask &= mask - 1;
+        }
+    }
+    
+    return count + prv_cull_scalar(scene, frustum, i, end, visible + count);
+}
+
+#endif
+
+CullPath cull_best_path(void)
+{
+    CullPath path = CULL_PATH_SCALAR;
+
+#ifdef CULL_X86
+    __builtin_cpu_init();
+    
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        path = CULL_PATH_AVX2;
+    }
+    else if(__builtin_cpu_supports("sse2"))
+    {
+        path = CULL_PATH_SSE2;
+    }
+#endif
+    
+    return path;
+}
+
+static uint32_t prv_cull_range(CullPath path, const CullScene *scene, const Frustum *frustum,
+    uint32_t begin, uint32_t end, uint32_t *visible)
+{
+    uint32_t count;
+    
+    switch(path)
+    {
+#ifdef CULL_X86
+        case CULL_PATH_AVX2:
+            count = prv_cull_avx2(scene, frustum, begin, end, visible);
+            break;
+        case CULL_PATH_SSE2:
+            count = prv_cull_sse2(scene, frustum, begin, end, visible);
+            break;
+#endif
+        default:
+            count = prv_cull_scalar(scene, frustum, begin, end, visible);
+            break;
+    }
+    
+    return count;
+}
+
+/* Each chunk writes into its own range of the visible list, so
+ * workers never share anything and the result is compacted after */
+static bool prv_cull_job(Interface *func, void *data)
+{
+    CullChunk *chunk = data;
+    
+    chunk->visible_count = prv_cull_range(
+        chunk->path, chunk->scene, chunk->frustum, chunk->begin, chunk->end, chunk->scene->visible + chunk->begin);
+    
+    return true;
+}
+
+static uint32_t prv_cull_with_path(Interface *func, CullScene *scene, const Frustum *frustum, CullPath path, bool parallel)
+{
+    uint32_t job_count = 1;
+    uint32_t chunk_size = scene->count;
+    uint32_t offset = 0;
+    CullChunk *chunk;
+    
+    if(parallel && func->job_pool && scene->count >= 2 * CULL_MIN_JOB_OBJECTS)
+    {
+        /* A couple of chunks per worker evens out uneven finishes,
+         * chunks stay a multiple of the widest register            */
+        job_count = (func->job_pool->worker_count + 1) * 2;
+        job_count = job_count < MAX_CULL_JOBS ? job_count : MAX_CULL_JOBS;
+        chunk_size = (scene->count + job_count - 1) / job_count;
+        chunk_size = chunk_size > CULL_MIN_JOB_OBJECTS ? chunk_size : CULL_MIN_JOB_OBJECTS;
+        chunk_size = (chunk_size + CULL_LANES - 1) / CULL_LANES * CULL_LANES;
+        job_count = (scene->count + chunk_size - 1) / chunk_size;
+    }
+    
+    for(uint32_t i = 0; i < job_count; i++)
+    {
+        scene->chunks[i] = (CullChunk) {scene, frustum, path, i * chunk_size, (i + 1) * chunk_size, 0};
+        scene->chunks[i].end = scene->chunks[i].end < scene->count ? scene->chunks[i].end : scene->count;
+        job_init(&scene->jobs[i], "cull", prv_cull_job, &scene->chunks[i]);
+    }
+    
+    if(job_count > 1)
+    {
+        job_submit(func->job_pool, &scene->group, scene->jobs, job_count);
+        job_wait(func->job_pool, &scene->group);
+    }
+    else
+    {
+        prv_cull_job(func, &scene->chunks[0]);
+    }
+    
+    for(uint32_t i = 0; i < job_count; i++)
+    {
+        chunk = &scene->chunks[i];
+        
+        if(offset != chunk->begin)
+        {
+            memmove(scene->visible + offset, scene->visible + chunk->begin, chunk->visible_count * sizeof(uint32_t));
+        }
+        
+        offset += chunk->visible_count;
+    }
+    
+    scene->visible_count = offset;
+    
+    return offset;
+}
+
+uint32_t cull_scene(Interface *func, CullScene *scene, const Frustum *frustum, bool parallel)
+{
+    return prv_cull_with_path(func, scene, frustum, scene->path, parallel);
+}
+
+static float prv_random(uint32_t *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    
+    return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+/* Objects per millisecond for every path the CPU supports, best of
+ * a few runs over a random scene around a 90 degree camera          */
+void cull_benchmark(Interface *func, uint32_t object_count)
+{
+    const uint32_t runs = 16;
+    CullScene *scene = cull_scene_create(func);
+    CullPath best_path = cull_best_path();
+    Frustum frustum;
+    float view_proj[16] = {0};
+    float center[3], extents[3];
+    uint32_t seed = 1;
+    uint32_t visible = 0;
+    uint64_t start, ticks, best;
+    double ms;
+    bool parallel;
+    
+    /* Perspective looking down -z, near 0.1 and far 200 */
+    view_proj[0] = 1.0f;
+    view_proj[5] = -1.0f;
+    view_proj[10] = 200.0f / (0.1f - 200.0f);
+    view_proj[11] = -1.0f;
+    view_proj[14] = 0.1f * 200.0f / (0.1f - 200.0f);
+    cull_frustum_from_matrix(&frustum, view_proj);
+    
+    for(uint32_t i = 0; i < object_count && scene; i++)
+    {
+        center[0] = prv_random(&seed) * 400.0f - 200.0f;
+        center[1] = prv_random(&seed) * 400.0f - 200.0f;
+        center[2] = prv_random(&seed) * 400.0f - 200.0f;
+        extents[0] = 0.5f + prv_random(&seed) * 2.0f;
+        extents[1] = 0.5f + prv_random(&seed) * 2.0f;
+        extents[2] = 0.5f + prv_random(&seed) * 2.0f;
+        
+        if(cull_add_object(func, scene, center, extents, 0.0f) == CULL_INVALID)
+        {
+            cull_scene_destroy(func, scene);
+            scene = NULL;
+        }
+    }
+    
+    if(!scene)
+    {
+        func->printf("Failed to create cull benchmark scene\n");
+    }
+    
+    for(uint32_t path = 0; path <= CULL_PATH_COUNT && scene; path++)
+    {
+        /* The extra round is the best path spread over the job pool */
+        parallel = path == CULL_PATH_COUNT;
+        
+        if(path <= best_path || parallel)
+        {
+            best = UINT64_MAX;
+            
+            for(uint32_t i = 0; i < runs; i++)
+            {
+                start = func->get_perf_counter();
+                visible = prv_cull_with_path(func, scene, &frustum, parallel ? best_path : path, parallel);
+                ticks = func->get_perf_counter() - start;
+                best = ticks < best ? ticks : best;
+            }
+            
+            ms = best * 1000.0 / (double)func->get_perf_frequency();
+            func->printf("Cull benchmark: %-8s %s %10.0f objects/ms, %u of %u visible\n",
+                path_names[parallel ? best_path : path], parallel ? "parallel" : "serial  ",
+                ms > 0.0 ? object_count / ms : 0.0, visible, object_count);
+        }
+    }
+    
+    if(scene)
+    {
+        cull_scene_destroy(func, scene);
+    }
+}
@@ -0,0 +1,69 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include "mesh.h"
+
+/* Cooked files may come from anywhere, every index is checked so a
+ * bad one can't make the GPU read past the vertices               */
+bool mesh_validate(const void *data, size_t size)
+{
+    const MeshHeader *header = data;
+    bool result = data != NULL && size >= sizeof(MeshHeader);
+    uint64_t expected = 0;
+    const uint32_t *indices;
+    
+    if(result)
+    {
+        expected = sizeof(MeshHeader) + (uint64_t)header->vertex_count * sizeof(MeshVertex) + (uint64_t)header->index_count * sizeof(uint32_t);
+        
+        result = header->magic == MESH_MAGIC && header->version == MESH_VERSION &&
+            header->vertex_stride == sizeof(MeshVertex) && expected == size &&
+            header->lod_count > 0 && header->lod_count <= MESH_MAX_LODS &&
+            header->radius > 0.0f;
+    }
+    
+    for(uint32_t i = 0; result && i < header->lod_count; i++)
+    {
+        result = (uint64_t)header->lods[i].first_index + header->lods[i].index_count <= header->index_count &&
+            header->lods[i].index_count % 3 == 0;
+    }
+    
+    if(result)
+    {
+        indices = (const uint32_t*)((const uint8_t*)data + sizeof(MeshHeader) + (size_t)header->vertex_count * sizeof(MeshVertex));
+        
+        for(uint32_t i = 0; i < header->index_count && result; i++)
+        {
+            result = indices[i] < header->vertex_count;
+        }
+    }
+    
+    return result;
+}
+
+uint32_t mesh_select_lod(const MeshHeader *header, const float view_proj[16],
+    const float center[3], float scale, float viewport_height, float threshold)
+{
+    uint32_t lod = 0;
+    float depth = view_proj[3] * center[0] + view_proj[7] * center[1] + view_proj[11] * center[2] + view_proj[15];
+    /* The view has no scale, so the length of the projection's y row
+     * is the focal length in half viewport units                      */
+    float projection = sqrtf(view_proj[1] * view_proj[1] + view_proj[5] * view_proj[5] + view_proj[9] * view_proj[9]);
+    float pixels_per_unit;
+    
+    /* Anything the camera is inside of keeps full detail */
+    if(depth > header->radius * scale)
+    {
+        pixels_per_unit = projection * viewport_height * 0.5f / depth;
+        
+        for(uint32_t i = 1; i < header->lod_count; i++)
+        {
+            if(header->lods[i].error * scale * pixels_per_unit <= threshold)
+            {
+                lod = i;
+            }
+        }
+    }
+    
+    return lod;
+}
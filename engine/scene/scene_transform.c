@@ -0,0 +1,603 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "interface.h"
+#include "transform.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TRANSFORM_X86 1
+#endif
+
+static const char *path_names[TRANSFORM_PATH_COUNT] = {"scalar", "sse2", "avx2"};
+
+/* Roots multiply against this so every node takes the same path */
+static const float identity[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+
+/* Local matrices of a block without the constant row, element e is
+ * column e / 3, row e % 3 for every node in the block              */
+typedef float LocalBlock[12][TRANSFORM_BLOCK];
+
+static bool prv_grow(Interface *func, TransformHierarchy *hierarchy)
+{
+    uint32_t capacity = hierarchy->capacity ? hierarchy->capacity * 2 : TRANSFORM_INITIAL_CAPACITY;
+    void **arrays[] = {
+        (void **)&hierarchy->parent,
+        (void **)&hierarchy->position_x, (void **)&hierarchy->position_y, (void **)&hierarchy->position_z,
+        (void **)&hierarchy->rotation_x, (void **)&hierarchy->rotation_y, (void **)&hierarchy->rotation_z,
+        (void **)&hierarchy->rotation_w,
+        (void **)&hierarchy->scale_x, (void **)&hierarchy->scale_y, (void **)&hierarchy->scale_z,
+        (void **)&hierarchy->changed, (void **)&hierarchy->dirty, (void **)&hierarchy->world};
+    const size_t sizes[] = {
+        sizeof(uint32_t),
+        sizeof(float), sizeof(float), sizeof(float),
+        sizeof(float), sizeof(float), sizeof(float), sizeof(float),
+        sizeof(float), sizeof(float), sizeof(float),
+        sizeof(uint32_t), sizeof(uint8_t), 16 * sizeof(float)};
+    bool result = true;
+    void *grown;
+    
+    for(uint32_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]) && result; i++)
+    {
+        grown = func->realloc(*arrays[i], capacity * sizes[i]);
+        result = grown != NULL;
+        
+        if(result)
+        {
+            *arrays[i] = grown;
+        }
+    }
+    
+    /* Arrays that did grow are still valid, only the capacity stays */
+    if(result)
+    {
+        hierarchy->capacity = capacity;
+    }
+    
+    return result;
+}
+
+TransformHierarchy *transform_hierarchy_create(Interface *func)
+{
+    TransformHierarchy *hierarchy = func->malloc(sizeof(TransformHierarchy));
+    
+    if(hierarchy)
+    {
+        *hierarchy = (TransformHierarchy) {0};
+        hierarchy->path = transform_best_path();
+        
+        if(!prv_grow(func, hierarchy))
+        {
+            transform_hierarchy_destroy(func, hierarchy);
+            hierarchy = NULL;
+        }
+    }
+    
+    return hierarchy;
+}
+
+void transform_hierarchy_destroy(Interface *func, TransformHierarchy *hierarchy)
+{
+    func->free(hierarchy->parent);
+    func->free(hierarchy->position_x);
+    func->free(hierarchy->position_y);
+    func->free(hierarchy->position_z);
+    func->free(hierarchy->rotation_x);
+    func->free(hierarchy->rotation_y);
+    func->free(hierarchy->rotation_z);
+    func->free(hierarchy->rotation_w);
+    func->free(hierarchy->scale_x);
+    func->free(hierarchy->scale_y);
+    func->free(hierarchy->scale_z);
+    func->free(hierarchy->changed);
+    func->free(hierarchy->dirty);
+    func->free(hierarchy->world);
+    func->free(hierarchy);
+}
+
+void transform_set_local(TransformHierarchy *hierarchy, uint32_t node,
+    const float position[3], const float rotation[4], const float scale[3])
+{
+    if(node < hierarchy->count)
+    {
+        hierarchy->position_x[node] = position[0];
+        hierarchy->position_y[node] = position[1];
+        hierarchy->position_z[node] = position[2];
+        hierarchy->rotation_x[node] = rotation[0];
+        hierarchy->rotation_y[node] = rotation[1];
+        hierarchy->rotation_z[node] = rotation[2];
+        hierarchy->rotation_w[node] = rotation[3];
+        hierarchy->scale_x[node] = scale[0];
+        hierarchy->scale_y[node] = scale[1];
+        hierarchy->scale_z[node] = scale[2];
+        hierarchy->dirty[node] = 1;
+    }
+}
+
+/* Appending keeps the parent first order without ever sorting */
+uint32_t transform_add(Interface *func, TransformHierarchy *hierarchy, uint32_t parent,
+    const float position[3], const float rotation[4], const float scale[3])
+{
+    uint32_t node = TRANSFORM_INVALID;
+    
+    if(parent != TRANSFORM_INVALID && parent >= hierarchy->count)
+    {
+        func->printf("Transform parent %u doesn't exist\n", parent);
+    }
+    else if(hierarchy->count < hierarchy->capacity || prv_grow(func, hierarchy))
+    {
+        node = hierarchy->count;
+        hierarchy->count += 1;
+        hierarchy->parent[node] = parent;
+        hierarchy->changed[node] = 0;
+        transform_set_local(hierarchy, node, position, rotation, scale);
+    }
+    
+    return node;
+}
+
+static void prv_locals_scalar(const TransformHierarchy *hierarchy, uint32_t base, uint32_t begin, uint32_t end, LocalBlock local)
+{
+    float x, y, z, w, xx, yy, zz, xy, xz, yz, wx, wy, wz;
+    uint32_t n;
+    
+    for(uint32_t lane = begin; lane < end; lane++)
+    {
+        n = base + lane;
+        x = hierarchy->rotation_x[n];
+        y = hierarchy->rotation_y[n];
+        z = hierarchy->rotation_z[n];
+        w = hierarchy->rotation_w[n];
+        
+        xx = x * x * 2.0f;
+        yy = y * y * 2.0f;
+        zz = z * z * 2.0f;
+        xy = x * y * 2.0f;
+        xz = x * z * 2.0f;
+        yz = y * z * 2.0f;
+        wx = w * x * 2.0f;
+        wy = w * y * 2.0f;
+        wz = w * z * 2.0f;
+        
+        local[0][lane] = (1.0f - yy - zz) * hierarchy->scale_x[n];
+        local[1][lane] = (xy + wz) * hierarchy->scale_x[n];
+        local[2][lane] = (xz - wy) * hierarchy->scale_x[n];
+        local[3][lane] = (xy - wz) * hierarchy->scale_y[n];
+        local[4][lane] = (1.0f - xx - zz) * hierarchy->scale_y[n];
+        local[5][lane] = (yz + wx) * hierarchy->scale_y[n];
+        local[6][lane] = (xz + wy) * hierarchy->scale_z[n];
+        local[7][lane] = (yz - wx) * hierarchy->scale_z[n];
+        local[8][lane] = (1.0f - xx - yy) * hierarchy->scale_z[n];
+        local[9][lane] = hierarchy->position_x[n];
+        local[10][lane] = hierarchy->position_y[n];
+        local[11][lane] = hierarchy->position_z[n];
+    }
+}
+
+static void prv_block_scalar(TransformHierarchy *hierarchy, uint32_t base, uint32_t count, const uint8_t *mask, LocalBlock local)
+{
+    const float *parent;
+    float *world;
+    
+    prv_locals_scalar(hierarchy, base, 0, count, local);
+    
+    for(uint32_t lane = 0; lane < count; lane++)
+    {
+        if(mask[lane])
+        {
+            parent = hierarchy->parent[base + lane] == TRANSFORM_INVALID ? identity :
+                &hierarchy->world[hierarchy->parent[base + lane] * 16];
+            world = &hierarchy->world[(base + lane) * 16];
+            
+            for(uint32_t column = 0; column < 4; column++)
+            {
+                for(uint32_t row = 0; row < 4; row++)
+                {
+                    world[column * 4 + row] =
+                        parent[row] * local[column * 3][lane] +
+                        parent[4 + row] * local[column * 3 + 1][lane] +
+                        parent[8 + row] * local[column * 3 + 2][lane] +
+                        (column == 3 ? parent[12 + row] : 0.0f);
+                }
+            }
+        }
+    }
+}
+
+#ifdef TRANSFORM_X86
+
+__attribute__((target("sse2")))
+static void prv_block_sse2(TransformHierarchy *hierarchy, uint32_t base, uint32_t count, const uint8_t *mask, LocalBlock local)
+{
+    __m128 x, y, z, w, xx, yy, zz, xy, xz, yz, wx, wy, wz, sx, sy, sz;
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 p0, p1, p2, p3;
+    const float *parent;
+    float *world;
+    uint32_t lane = 0;
+    uint32_t n;
+    
+    /* Four nodes per register, straight from the arrays */
+    for(; lane + 4 <= count; lane += 4)
+    {
+        n = base + lane;
+        x = _mm_loadu_ps(&hierarchy->rotation_x[n]);
+        y = _mm_loadu_ps(&hierarchy->rotation_y[n]);
+        z = _mm_loadu_ps(&hierarchy->rotation_z[n]);
+        w = _mm_loadu_ps(&hierarchy->rotation_w[n]);
+        sx = _mm_loadu_ps(&hierarchy->scale_x[n]);
+        sy = _mm_loadu_ps(&hierarchy->scale_y[n]);
+        sz = _mm_loadu_ps(&hierarchy->scale_z[n]);
+        
+        xx = _mm_mul_ps(_mm_mul_ps(x, x), two);
+        yy = _mm_mul_ps(_mm_mul_ps(y, y), two);
+        zz = _mm_mul_ps(_mm_mul_ps(z, z), two);
+        xy = _mm_mul_ps(_mm_mul_ps(x, y), two);
+        xz = _mm_mul_ps(_mm_mul_ps(x, z), two);
+        yz = _mm_mul_ps(_mm_mul_ps(y, z), two);
+        wx = _mm_mul_ps(_mm_mul_ps(w, x), two);
+        wy = _mm_mul_ps(_mm_mul_ps(w, y), two);
+        wz = _mm_mul_ps(_mm_mul_ps(w, z), two);
+        
+        _mm_storeu_ps(&local[0][lane], _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(one, yy), zz), sx));
+        _mm_storeu_ps(&local[1][lane], _mm_mul_ps(_mm_add_ps(xy, wz), sx));
+        _mm_storeu_ps(&local[2][lane], _mm_mul_ps(_mm_sub_ps(xz, wy), sx));
+        _mm_storeu_ps(&local[3][lane], _mm_mul_ps(_mm_sub_ps(xy, wz), sy));
+        _mm_storeu_ps(&local[4][lane], _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(one, xx), zz), sy));
+        _mm_storeu_ps(&local[5][lane], _mm_mul_ps(_mm_add_ps(yz, wx), sy));
+        _mm_storeu_ps(&local[6][lane], _mm_mul_ps(_mm_add_ps(xz, wy), sz));
+        _mm_storeu_ps(&local[7][lane], _mm_mul_ps(_mm_sub_ps(yz, wx), sz));
+        _mm_storeu_ps(&local[8][lane], _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(one, xx), yy), sz));
+        _mm_storeu_ps(&local[9][lane], _mm_loadu_ps(&hierarchy->position_x[n]));
+        _mm_storeu_ps(&local[10][lane], _mm_loadu_ps(&hierarchy->position_y[n]));
+        _mm_storeu_ps(&local[11][lane], _mm_loadu_ps(&hierarchy->position_z[n]));
+    }
+    
+    prv_locals_scalar(hierarchy, base, lane, count, local);
+    
+    /* Every world column is the parent columns scaled by one local column */
+    for(lane = 0; lane < count; lane++)
+    {
+        if(mask[lane])
+        {
+            parent = hierarchy->parent[base + lane] == TRANSFORM_INVALID ? identity :
+                &hierarchy->world[hierarchy->parent[base + lane] * 16];
+            world = &hierarchy->world[(base + lane) * 16];
+            
+            p0 = _mm_loadu_ps(&parent[0]);
+            p1 = _mm_loadu_ps(&parent[4]);
+            p2 = _mm_loadu_ps(&parent[8]);
+            p3 = _mm_loadu_ps(&parent[12]);
+            
+            for(uint32_t column = 0; column < 4; column++)
+            {
+                x = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(p0, _mm_set1_ps(local[column * 3][lane])), _mm_mul_ps(p1, _mm_set1_ps(local[column * 3 + 1][lane]))),
+                    _mm_mul_ps(p2, _mm_set1_ps(local[column * 3 + 2][lane])));
+                _mm_storeu_ps(&world[column * 4], column == 3 ? _mm_add_ps(x, p3) : x);
+            }
+        }
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void prv_block_avx2(TransformHierarchy *hierarchy, uint32_t base, uint32_t count, const uint8_t *mask, LocalBlock local)
+{
+    __m256 x, y, z, w, xx, yy, zz, xy, xz, yz, wx, wy, wz, sx, sy, sz;
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 two = _mm256_set1_ps(2.0f);
+    __m128 p0, p1, p2, p3, column_sum;
+    const float *parent;
+    float *world;
+    uint32_t lane = 0;
+    uint32_t n;
+    
+    for(; lane + 8 <= count; lane += 8)
+    {
+        n = base + lane;
+        x = _mm256_loadu_ps(&hierarchy->rotation_x[n]);
+        y = _mm256_loadu_ps(&hierarchy->rotation_y[n]);
+        z = _mm256_loadu_ps(&hierarchy->rotation_z[n]);
+        w = _mm256_loadu_ps(&hierarchy->rotation_w[n]);
+        sx = _mm256_loadu_ps(&hierarchy->scale_x[n]);
+        sy = _mm256_loadu_ps(&hierarchy->scale_y[n]);
+        sz = _mm256_loadu_ps(&hierarchy->scale_z[n]);
+        
+        xx = _mm256_mul_ps(_mm256_mul_ps(x, x), two);
+        yy = _mm256_mul_ps(_mm256_mul_ps(y, y), two);
+        zz = _mm256_mul_ps(_mm256_mul_ps(z, z), two);
+        xy = _mm256_mul_ps(_mm256_mul_ps(x, y), two);
+        xz = _mm256_mul_ps(_mm256_mul_ps(x, z), two);
+        yz = _mm256_mul_ps(_mm256_mul_ps(y, z), two);
+        wx = _mm256_mul_ps(_mm256_mul_ps(w, x), two);
+        wy = _mm256_mul_ps(_mm256_mul_ps(w, y), two);
+        wz = _mm256_mul_ps(_mm256_mul_ps(w, z), two);
+        
+        _mm256_storeu_ps(&local[0][lane], _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(one, yy), zz), sx));
+        _mm256_storeu_ps(&local[1][lane], _mm256_mul_ps(_mm256_add_ps(xy, wz), sx));
+        _mm256_storeu_ps(&local[2][lane], _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx));
+        _mm256_storeu_ps(&local[3][lane], _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy));
+        _mm256_storeu_ps(&local[4][lane], _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(one, xx), zz), sy));
+        _mm256_storeu_ps(&local[5][lane], _mm256_mul_ps(_mm256_add_ps(yz, wx), sy));
+        _mm256_storeu_ps(&local[6][lane], _mm256_mul_ps(_mm256_add_ps(xz, wy), sz));
+        _mm256_storeu_ps(&local[7][lane], _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz));
+        _mm256_storeu_ps(&local[8][lane], _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(one, xx), yy), sz));
+        _mm256_storeu_ps(&local[9][lane], _mm256_loadu_ps(&hierarchy->position_x[n]));
+        _mm256_storeu_ps(&local[10][lane], _mm256_loadu_ps(&hierarchy->position_y[n]));
+        _mm256_storeu_ps(&local[11][lane], _mm256_loadu_ps(&hierarchy->position_z[n]));
+    }
+    
+    prv_locals_scalar(hierarchy, base, lane, count, local);
+    
+    /* Every world column is the parent columns scaled by one local column */
+    for(lane = 0; lane < count; lane++)
+    {
+        if(mask[lane])
+        {
+            parent = hierarchy->parent[base + lane] == TRANSFORM_INVALID ? identity :
+                &hierarchy->world[hierarchy->parent[base + lane] * 16];
+            world = &hierarchy->world[(base + lane) * 16];
+            
+            p0 = _mm_loadu_ps(&parent[0]);
+            p1 = _mm_loadu_ps(&parent[4]);
+            p2 = _mm_loadu_ps(&parent[8]);
+            p3 = _mm_loadu_ps(&parent[12]);
+            
+            for(uint32_t column = 0; column < 4; column++)
+            {
+                column_sum = column == 3 ? p3 : _mm_setzero_ps();
+                column_sum = _mm_fmadd_ps(p0, _mm_broadcast_ss(&local[column * 3][lane]), column_sum);
+                column_sum = _mm_fmadd_ps(p1, _mm_broadcast_ss(&local[column * 3 + 1][lane]), column_sum);
+                column_sum = _mm_fmadd_ps(p2, _mm_broadcast_ss(&local[column * 3 + 2][lane]), column_sum);
+                _mm_storeu_ps(&world[column * 4], column_sum);
+            }
+        }
+    }
+}
+
+/* dst is usually write combined GPU memory, streaming stores skip
+ * reading it into the cache only to overwrite the whole line      */
+__attribute__((target("sse2")))
+static uint32_t prv_copy_sse2(const TransformHierarchy *hierarchy, uint32_t base, uint32_t count, float *dst, uint32_t dst_update)
+{
+    const float *world;
+    float *out;
+    uint32_t written = 0;
+    bool aligned = ((uintptr_t)dst & 15) == 0;
+    
+    for(uint32_t n = base; n < base + count; n++)
+    {
+        if(hierarchy->changed[n] > dst_update)
+        {
+            world = &hierarchy->world[n * 16];
+            out = &dst[n * 16];
+            
+            for(uint32_t i = 0; i < 16; i += 4)
+            {
+                if(aligned)
+                {
+                    _mm_stream_ps(&out[i], _mm_loadu_ps(&world[i]));
+                }
+                else
+                {
+                    _mm_storeu_ps(&out[i], _mm_loadu_ps(&world[i]));
+                }
+            }
+            
+            written += 1;
+        }
+    }
+    
+    return written;
+}
+
+#endif
+
+static uint32_t prv_copy_scalar(const TransformHierarchy *hierarchy, uint32_t base, uint32_t count, float *dst, uint32_t dst_update)
+{
+    uint32_t written = 0;
+    
+    for(uint32_t n = base; n < base + count; n++)
+    {
+        if(hierarchy->changed[n] > dst_update)
+        {
+            memcpy(&dst[n * 16], &hierarchy->world[n * 16], 16 * sizeof(float));
+            written += 1;
+        }
+    }
+    
+    return written;
+}
+
+TransformPath transform_best_path(void)
+{
+    TransformPath path = TRANSFORM_PATH_SCALAR;
+
+#ifdef TRANSFORM_X86
+    __builtin_cpu_init();
+    
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        path = TRANSFORM_PATH_AVX2;
+    }
+    else if(__builtin_cpu_supports("sse2"))
+    {
+        path = TRANSFORM_PATH_SSE2;
+    }
+#endif
+    
+    return path;
+}
+
+static void prv_block(TransformPath path, TransformHierarchy *hierarchy, uint32_t base, uint32_t count,
+    const uint8_t *mask, LocalBlock local)
+{
+    switch(path)
+    {
+#ifdef TRANSFORM_X86
+        case TRANSFORM_PATH_AVX2:
+            prv_block_avx2(hierarchy, base, count, mask, local);
+            break;
+        case TRANSFORM_PATH_SSE2:
+            prv_block_sse2(hierarchy, base, count, mask, local);
+            break;
+#endif
+        default:
+            prv_block_scalar(hierarchy, base, count, mask, local);
+            break;
+    }
+}
+
+uint32_t transform_update(TransformHierarchy *hierarchy, float *dst, uint32_t dst_update)
+{
+    LocalBlock local;
+    uint8_t mask[TRANSFORM_BLOCK];
+    uint32_t parent, count;
+    uint32_t written = 0;
+    bool any;
+    
+    hierarchy->update += 1;
+    
+    for(uint32_t base = 0; base < hierarchy->count; base += TRANSFORM_BLOCK)
+    {
+        count = hierarchy->count - base < TRANSFORM_BLOCK ? hierarchy->count - base : TRANSFORM_BLOCK;
+        any = false;
+        
+        /* Parents come first, so a parent changed in this update is
+         * already marked when its children are looked at, even when
+         * both are in the same block                                */
+        for(uint32_t lane = 0; lane < count; lane++)
+        {
+            parent = hierarchy->parent[base + lane];
+            mask[lane] = hierarchy->dirty[base + lane] ||
+                (parent != TRANSFORM_INVALID && hierarchy->changed[parent] == hierarchy->update);
+            
+            if(mask[lane])
+            {
+                hierarchy->changed[base + lane] = hierarchy->update;
+                hierarchy->dirty[base + lane] = 0;
+                any = true;
+            }
+        }
+        
+        /* Static blocks cost one pass over the flags */
+        if(any)
+        {
+            prv_block(hierarchy->path, hierarchy, base, count, mask, local);
+        }
+        
+        if(dst)
+        {
+#ifdef TRANSFORM_X86
+            written += hierarchy->path != TRANSFORM_PATH_SCALAR ?
+                prv_copy_sse2(hierarchy, base, count, dst, dst_update) :
+                prv_copy_scalar(hierarchy, base, count, dst, dst_update);
+#else
+            written += prv_copy_scalar(hierarchy, base, count, dst, dst_update);
+#endif
+        }
+    }
+
+#ifdef TRANSFORM_X86
+    /* Streaming stores have to land before the GPU is told to read */
+    if(dst && hierarchy->path != TRANSFORM_PATH_SCALAR)
+    {
+        _mm_sfence();
+    }
+#endif
+    
+    return written;
+}
+
+static float prv_random(uint32_t *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    
+    return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+static double prv_best_ms(Interface *func, TransformHierarchy *hierarchy, uint32_t runs, uint32_t dirty_stride, float *dst)
+{
+    uint64_t start, ticks;
+    uint64_t best = UINT64_MAX;
+    
+    for(uint32_t i = 0; i < runs; i++)
+    {
+        for(uint32_t n = 0; n < hierarchy->count; n += dirty_stride)
+        {
+            hierarchy->dirty[n] = 1;
+        }
+        
+        start = func->get_perf_counter();
+        transform_update(hierarchy, dst, dst ? hierarchy->update : 0);
+        ticks = func->get_perf_counter() - start;
+        best = ticks < best ? ticks : best;
+    }
+    
+    return best * 1000.0 / (double)func->get_perf_frequency();
+}
+
+/* Best of a few updates of a random forest for every path the CPU
+ * supports, with everything dirty and with one node in a hundred
+ * dirty. The last row also writes the changed matrices out the way
+ * a frame does.                                                    */
+void transform_benchmark(Interface *func, uint32_t node_count)
+{
+    const uint32_t runs = 8;
+    TransformHierarchy *hierarchy = transform_hierarchy_create(func);
+    TransformPath best_path = transform_best_path();
+    float position[3], rotation[4] = {0.0f, 0.0f, 0.0f, 1.0f}, scale[3] = {1.0f, 1.0f, 1.0f};
+    float *dst = NULL;
+    uint32_t seed = 1;
+    uint32_t parent;
+    double all_ms, sparse_ms;
+    
+    /* Random trees of a few thousand nodes each */
+    for(uint32_t i = 0; i < node_count && hierarchy; i++)
+    {
+        parent = i % 4096 == 0 ? TRANSFORM_INVALID : i - i % 4096 + (uint32_t)(prv_random(&seed) * (i % 4096));
+        position[0] = prv_random(&seed) * 2.0f - 1.0f;
+        position[1] = prv_random(&seed) * 2.0f - 1.0f;
+        position[2] = prv_random(&seed) * 2.0f - 1.0f;
+        rotation[1] = prv_random(&seed) * 0.2f;
+        rotation[3] = 1.0f - rotation[1] * rotation[1] * 0.5f;
+        
+        if(transform_add(func, hierarchy, parent, position, rotation, scale) == TRANSFORM_INVALID)
+        {
+            transform_hierarchy_destroy(func, hierarchy);
+            hierarchy = NULL;
+        }
+    }
+    
+    if(hierarchy)
+    {
+        dst = func->malloc((size_t)node_count * 16 * sizeof(float));
+    }
+    
+    if(!hierarchy || !dst)
+    {
+        func->printf("Failed to create transform benchmark hierarchy\n");
+    }
+    
+    for(uint32_t path = 0; path <= TRANSFORM_PATH_COUNT && hierarchy && dst; path++)
+    {
+        if(path <= best_path || path == TRANSFORM_PATH_COUNT)
+        {
+            hierarchy->path = path == TRANSFORM_PATH_COUNT ? best_path : path;
+            all_ms = prv_best_ms(func, hierarchy, runs, 1, path == TRANSFORM_PATH_COUNT ? dst : NULL);
+            sparse_ms = prv_best_ms(func, hierarchy, runs, 100, path == TRANSFORM_PATH_COUNT ? dst : NULL);
+            
+            func->printf("Transform benchmark: %-6s %s %8.2f ms all dirty (%.0f nodes/ms), %8.2f ms 1%% dirty, %u nodes\n",
+                path_names[hierarchy->path], path == TRANSFORM_PATH_COUNT ? "+upload" : "       ",
+                all_ms, all_ms > 0.0 ? node_count / all_ms : 0.0, sparse_ms, node_count);
+        }
+    }
+    
+    func->free(dst);
+    
+    if(hierarchy)
+    {
+        transform_hierarchy_destroy(func, hierarchy);
+    }
+}
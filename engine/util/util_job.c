@@ -0,0 +1,255 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "interface.h"
+#include "job.h"
+
+static void prv_job_execute(JobPool *pool, Job *job);
+
+static bool prv_job_push(JobPool *pool, Job *job)
+{
+    Interface *func = pool->func;
+    bool pushed = false;
+    
+    func->lock_mutex(pool->lock);
+    if(pool->tail - pool->head < MAX_JOB_QUEUE)
+    {
+        pool->queue[pool->tail % MAX_JOB_QUEUE] = job;
+        pool->tail += 1;
+        pushed = true;
+    }
+    func->unlock_mutex(pool->lock);
+    
+    if(pushed)
+    {
+        func->sem_post(pool->ready);
+    }
+    
+    return pushed;
+}
+
+static Job *prv_job_pop(JobPool *pool)
+{
+    Interface *func = pool->func;
+    Job *job = NULL;
+    
+    func->lock_mutex(pool->lock);
+    if(pool->head != pool->tail)
+    {
+        job = pool->queue[pool->head % MAX_JOB_QUEUE];
+        pool->head += 1;
+    }
+    func->unlock_mutex(pool->lock);
+    
+    return job;
+}
+
+static void prv_job_schedule(JobPool *pool, Job *job)
+{
+    /* A full queue should never stall progress so just
+     * run the job on the calling thread instead         */
+    if(!prv_job_push(pool, job))
+    {
+        prv_job_execute(pool, job);
+    }
+}
+
+static void prv_job_execute(JobPool *pool, Job *job)
+{
+    Interface *func = pool->func;
+    JobGroup *group = job->group;
+    
+    if(atomic_load(&job->dependency_failed))
+    {
+        job->result = false;
+    }
+    else
+    {
+        job->start_ticks = func->get_perf_counter();
+        job->result = job->run(func, job->data);
+        job->end_ticks = func->get_perf_counter();
+    }
+    
+    for(uint32_t i = 0; i < job->dependent_count; i++)
+    {
+        Job *dependent = job->dependents[i];
+        
+        if(!job->result)
+        {
+            atomic_store(&dependent->dependency_failed, true);
+        }
+        
+        if(atomic_fetch_sub(&dependent->pending, 1) == 1)
+        {
+            prv_job_schedule(pool, dependent);
+        }
+    }
+    
+    /* The job must not be touched after this point since
+     * the waiting thread is free to release it           */
+    if(atomic_fetch_sub(&group->remaining, 1) == 1)
+    {
+        func->sem_post(group->done);
+    }
+}
+
+static int prv_job_worker(void *data)
+{
+    JobPool *pool = data;
+    Job *job;
+    
+    while(true)
+    {
+        pool->func->sem_wait(pool->ready);
+        
+        if(atomic_load(&pool->quit))
+        {
+            break;
+        }
+        
+        job = prv_job_pop(pool);
+        if(job)
+        {
+            prv_job_execute(pool, job);
+        }
+    }
+    
+    return 0;
+}
+
+JobPool *job_pool_create(Interface *func)
+{
+    JobPool *pool = func->malloc(sizeof(JobPool));
+    int cpu_count = func->get_cpu_count();
+    
+    if(pool)
+    {
+        *pool = (JobPool) {0};
+        pool->func = func;
+        pool->lock = func->create_mutex();
+        pool->ready = func->create_sem(0);
+        atomic_init(&pool->quit, false);
+        
+        /* Leave one core for the thread submitting work,
+         * it helps out while it waits anyway              */
+        pool->worker_count = cpu_count > 1 ? cpu_count - 1 : 1;
+        if(pool->worker_count > MAX_JOB_WORKERS)
+        {
+            pool->worker_count = MAX_JOB_WORKERS;
+        }
+        
+        for(uint32_t i = 0; i < pool->worker_count; i++)
+        {
+            pool->workers[i] = func->create_thread(prv_job_worker, "engine worker", pool);
+            
+            if(!pool->workers[i])
+            {
+                func->printf("Failed to create worker thread %u\n", i);
+                pool->worker_count = i;
+                break;
+            }
+        }
+    }
+    
+    return pool;
+}
+
+void job_pool_destroy(JobPool *pool)
+{
+    Interface *func = pool->func;
+    
+    atomic_store(&pool->quit, true);
+    
+    for(uint32_t i = 0; i < pool->worker_count; i++)
+    {
+        func->sem_post(pool->ready);
+    }
+    
+    for(uint32_t i = 0; i < pool->worker_count; i++)
+    {
+        func->wait_thread(pool->workers[i], NULL);
+    }
+    
+    func->destroy_sem(pool->ready);
+    func->destroy_mutex(pool->lock);
+    func->free(pool);
+}
+
+void job_init(Job *job, const char *name, PFN_job run, void *data)
+{
+    *job = (Job) {0};
+    job->name = name;
+    job->run = run;
+    job->data = data;
+}
+
+bool job_depends_on(Job *job, Job *dependency)
+{
+    bool result = false;
+    
+    if(dependency->dependent_count < MAX_JOB_DEPENDENTS)
+    {
+        dependency->dependents[dependency->dependent_count] = job;
+        dependency->dependent_count += 1;
+        job->dependency_count += 1;
+        result = true;
+    }
+    
+    return result;
+}
+
+void job_submit(JobPool *pool, JobGroup *group, Job *jobs, uint32_t count)
+{
+    if(!group->done)
+    {
+        group->done = pool->func->create_sem(0);
+    }
+    
+    atomic_store(&group->remaining, count);
+    
+    /* Every counter has to be in place before the first job
+     * runs since it may immediately release its dependents  */
+    for(uint32_t i = 0; i < count; i++)
+    {
+        jobs[i].group = group;
+        jobs[i].result = false;
+        atomic_store(&jobs[i].pending, jobs[i].dependency_count);
+        atomic_store(&jobs[i].dependency_failed, false);
+    }
+    
+    for(uint32_t i = 0; i < count; i++)
+    {
+        if(jobs[i].dependency_count == 0)
+        {
+            prv_job_schedule(pool, &jobs[i]);
+        }
+    }
+}
+
+void job_wait(JobPool *pool, JobGroup *group)
+{
+    Job *job;
+    bool signaled = false;
+    
+    /* Help with queued work instead of idling, this also
+     * keeps things moving if the pool has no workers      */
+    while(atomic_load(&group->remaining) > 0)
+    {
+        job = prv_job_pop(pool);
+        if(job)
+        {
+            prv_job_execute(pool, job);
+        }
+        else
+        {
+            pool->func->sem_wait(group->done);
+            signaled = true;
+        }
+    }
+    
+    /* Consume the completion signal so the group can be reused */
+    if(!signaled)
+    {
+        pool->func->sem_wait(group->done);
+    }
+}
@@ -0,0 +1,201 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "util.h"
+
+/* Writes 8 bit RGB PNGs without compressing them. The image data is a
+ * zlib stream of stored deflate blocks, so its size is known up front
+ * and the whole file is streamed a row at a time with no filtering.  */
+
+#define PNG_STORED_BLOCK_SIZE 65535
+/* Largest run of bytes Adler-32 can sum before its sums overflow */
+#define PNG_ADLER_RUN 5552
+
+typedef struct
+{
+    Interface *func;
+    FILE *fp;
+    bool result;
+    uint32_t crc;
+    uint32_t crc_table[256];
+    uint32_t adler_a;
+    uint32_t adler_b;
+    /* Uncompressed bytes left in the stream and in the current block */
+    uint64_t remaining;
+    uint32_t block_remaining;
+} PngWriter;
+
+static void prv_write(PngWriter *writer, const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    
+    writer->result = writer->result && writer->func->fwrite(data, 1, size, writer->fp) == size;
+    
+    for(size_t i = 0; i < size; i++)
+    {
+        writer->crc = writer->crc_table[(writer->crc ^ bytes[i]) & 0xFF] ^ (writer->crc >> 8);
+    }
+}
+
+static void prv_write_u32(PngWriter *writer, uint32_t value)
+{
+    uint8_t bytes[4] = {value >> 24, value >> 16, value >> 8, value};
+    
+    prv_write(writer, bytes, 4);
+}
+
+/* Length and type, the CRC covers the type and everything after it */
+static void prv_begin_chunk(PngWriter *writer, const char *type, uint32_t length)
+{
+    prv_write_u32(writer, length);
+    writer->crc = 0xFFFFFFFFu;
+    prv_write(writer, type, 4);
+}
+
+static void prv_end_chunk(PngWriter *writer)
+{
+    prv_write_u32(writer, writer->crc ^ 0xFFFFFFFFu);
+}
+
+/* Appends image bytes to the stored blocks, starting a new block
+ * whenever the current one is full                               */
+static void prv_deflate(PngWriter *writer, const uint8_t *data, uint32_t size)
+{
+    uint8_t header[5];
+    uint32_t length, run;
+    
+    while(size > 0 && writer->result)
+    {
+        if(writer->block_remaining == 0)
+        {
+            length = writer->remaining > PNG_STORED_BLOCK_SIZE ? PNG_STORED_BLOCK_SIZE : (uint32_t)writer->remaining;
+            header[0] = writer->remaining == length ? 1 : 0;
+            header[1] = length & 0xFF;
+            header[2] = length >> 8;
+            header[3] = ~length & 0xFF;
+            header[4] = (~length >> 8) & 0xFF;
+            prv_write(writer, header, 5);
+            writer->block_remaining = length;
+        }
+        
+        length = size < writer->block_remaining ? size : writer->block_remaining;
+        prv_write(writer, data, length);
+        
+        for(uint32_t i = 0; i < length; i += run)
+        {
+            run = length - i < PNG_ADLER_RUN ? length - i : PNG_ADLER_RUN;
+            
+            for(uint32_t j = 0; j < run; j++)
+            {
+                writer->adler_a += data[i + j];
+                writer->adler_b += writer->adler_a;
+            }
+            
+            writer->adler_a %= 65521;
+            writer->adler_b %= 65521;
+        }
+        
+        writer->block_remaining -= length;
+        writer->remaining -= length;
+        data += length;
+        size -= length;
+    }
+}
+
+/* pixels holds width * height four byte pixels, top row first. The
+ * fourth byte is dropped and bgra swaps the first and third.        */
+bool util_write_png(Interface *func, const char *filename, const uint8_t *pixels,
+    uint32_t width, uint32_t height, bool bgra)
+{
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    PngWriter writer = {0};
+    uint64_t raw_size = (uint64_t)height * (1 + (uint64_t)width * 3);
+    uint64_t block_count = (raw_size + PNG_STORED_BLOCK_SIZE - 1) / PNG_STORED_BLOCK_SIZE;
+    uint64_t data_size = 2 + raw_size + block_count * 5 + 4;
+    uint8_t *row = NULL;
+    uint8_t header[13] = {0};
+    uint8_t zlib_header[2] = {0x78, 0x01};
+    uint32_t crc;
+    
+    writer.func = func;
+    writer.result = width > 0 && height > 0 && data_size <= UINT32_MAX;
+    
+    if(writer.result)
+    {
+        row = func->malloc(1 + (size_t)width * 3);
+        writer.fp = row ? func->fopen(filename, "wb") : NULL;
+        writer.result = writer.fp != NULL;
+    }
+    
+    for(uint32_t i = 0; i < 256; i++)
+    {
+        crc = i;
+        
+        for(uint32_t j = 0; j < 8; j++)
+        {
+            crc = crc & 1 ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+        }
+        
+        writer.crc_table[i] = crc;
+    }
+    
+    if(writer.result)
+    {
+        prv_write(&writer, signature, sizeof(signature));
+        
+        /* 8 bits per channel, truecolor, no interlacing */
+        header[0] = width >> 24;
+        header[1] = width >> 16;
+        header[2] = width >> 8;
+        header[3] = width;
+        header[4] = height >> 24;
+        header[5] = height >> 16;
+        header[6] = height >> 8;
+        header[7] = height;
+        header[8] = 8;
+        header[9] = 2;
+        
+        prv_begin_chunk(&writer, "IHDR", sizeof(header));
+        prv_write(&writer, header, sizeof(header));
+        prv_end_chunk(&writer);
+        
+        prv_begin_chunk(&writer, "IDAT", (uint32_t)data_size);
+        prv_write(&writer, zlib_header, sizeof(zlib_header));
+        
+        writer.adler_a = 1;
+        writer.adler_b = 0;
+        writer.remaining = raw_size;
+        writer.block_remaining = 0;
+        row[0] = 0;
+    }
+    
+    for(uint32_t y = 0; y < height && writer.result; y++)
+    {
+        for(uint32_t x = 0; x < width; x++)
+        {
+            row[1 + x * 3 + 0] = pixels[((size_t)y * width + x) * 4 + (bgra ? 2 : 0)];
+            row[1 + x * 3 + 1] = pixels[((size_t)y * width + x) * 4 + 1];
+            row[1 + x * 3 + 2] = pixels[((size_t)y * width + x) * 4 + (bgra ? 0 : 2)];
+        }
+        
+        prv_deflate(&writer, row, 1 + width * 3);
+    }
+    
+    if(writer.result)
+    {
+        prv_write_u32(&writer, writer.adler_b << 16 | writer.adler_a);
+        prv_end_chunk(&writer);
+        
+        prv_begin_chunk(&writer, "IEND", 0);
+        prv_end_chunk(&writer);
+    }
+    
+    if(writer.fp)
+    {
+        writer.result = func->fclose(writer.fp) == 0 && writer.result;
+    }
+    
+    func->free(row);
+    
+    return writer.result;
+}
@@ -9,6 +9,7 @@
 #include <unistd.h>
 
 #include <interface.h>
+#include "sim.h"
 
 #define LIBRARY_FILE "libengine.so"
 
@@ -19,8 +20,17 @@ typedef struct
     Interface func;
     PFN_renderer_init renderer_init;
     PFN_renderer_draw renderer_draw;
+    PFN_renderer_set_camera renderer_set_camera;
+    PFN_renderer_shutdown renderer_shutdown;
 } LibraryState;
 
+typedef struct
+{
+    LibraryState *lib_state;
+    SimState *sim;
+    uint64_t frames;
+} RenderThread;
+
 void get_app_info(Interface *func)
 {
     AppInfo *app_info = &func->app_info;
@@ -55,6 +65,8 @@ void register_engine_functions(LibraryState *lib_state)
 {
     lib_state->renderer_init = SDL_LoadFunction(lib_state->library, "renderer_init");
     lib_state->renderer_draw = SDL_LoadFunction(lib_state->library, "renderer_draw");
+    lib_state->renderer_set_camera = SDL_LoadFunction(lib_state->library, "renderer_set_camera");
+    lib_state->renderer_shutdown = SDL_LoadFunction(lib_state->library, "renderer_shutdown");
 }
 
 void register_framework_functions(Interface *func)
@@ -68,6 +80,22 @@ void register_framework_functions(Interface *func)
     func->fseek = fseek;
     func->ftell = ftell;
     func->fread = fread;
+    func->fwrite = fwrite;
+    func->fflush = fflush;
+    
+    func->create_thread = SDL_CreateThread;
+    func->wait_thread = SDL_WaitThread;
+    func->create_mutex = SDL_CreateMutex;
+    func->lock_mutex = SDL_LockMutex;
+    func->unlock_mutex = SDL_UnlockMutex;
+    func->destroy_mutex = SDL_DestroyMutex;
+    func->create_sem = SDL_CreateSemaphore;
+    func->sem_wait = SDL_SemWait;
+    func->sem_post = SDL_SemPost;
+    func->destroy_sem = SDL_DestroySemaphore;
+    func->get_cpu_count = SDL_GetCPUCount;
+    func->get_perf_counter = SDL_GetPerformanceCounter;
+    func->get_perf_frequency = SDL_GetPerformanceFrequency;
     
     func->create_surface = create_surface;
     
@@ -76,8 +104,12 @@ void register_framework_functions(Interface *func)
     func->vkGetInstanceProcAddr = vkGetInstanceProcAddr;
     func->vkEnumeratePhysicalDevices = vkEnumeratePhysicalDevices;
     func->vkGetPhysicalDeviceQueueFamilyProperties = vkGetPhysicalDeviceQueueFamilyProperties;
+    func->vkGetPhysicalDeviceProperties = vkGetPhysicalDeviceProperties;
+    func->vkGetPhysicalDeviceFeatures = vkGetPhysicalDeviceFeatures;
+    func->vkGetPhysicalDeviceMemoryProperties = vkGetPhysicalDeviceMemoryProperties;
     func->vkGetPhysicalDeviceSurfaceSupportKHR = vkGetPhysicalDeviceSurfaceSupportKHR;
     func->vkCreateDevice = vkCreateDevice;
+    func->vkGetDeviceProcAddr = vkGetDeviceProcAddr;
     func->vkGetDeviceQueue = vkGetDeviceQueue;
     func->vkGetPhysicalDeviceSurfaceFormatsKHR = vkGetPhysicalDeviceSurfaceFormatsKHR;
     func->vkGetPhysicalDeviceSurfacePresentModesKHR = vkGetPhysicalDeviceSurfacePresentModesKHR;
@@ -90,6 +122,7 @@ void register_framework_functions(Interface *func)
     func->vkCreateFence = vkCreateFence;
     func->vkWaitForFences = vkWaitForFences;
     func->vkResetFences = vkResetFences;
+    func->vkGetFenceStatus = vkGetFenceStatus;
     func->vkAcquireNextImageKHR = vkAcquireNextImageKHR;
     func->vkBeginCommandBuffer = vkBeginCommandBuffer;
     func->vkEndCommandBuffer = vkEndCommandBuffer;
@@ -109,6 +142,44 @@ void register_framework_functions(Interface *func)
     func->vkCmdSetViewport = vkCmdSetViewport;
     func->vkCmdSetScissor = vkCmdSetScissor;
     func->vkCmdDraw = vkCmdDraw;
+    func->vkCreateQueryPool = vkCreateQueryPool;
+    func->vkCmdResetQueryPool = vkCmdResetQueryPool;
+    func->vkCmdBeginQuery = vkCmdBeginQuery;
+    func->vkCmdEndQuery = vkCmdEndQuery;
+    func->vkCmdWriteTimestamp = vkCmdWriteTimestamp;
+    func->vkGetQueryPoolResults = vkGetQueryPoolResults;
+    func->vkCreateBuffer = vkCreateBuffer;
+    func->vkDestroyBuffer = vkDestroyBuffer;
+    func->vkGetBufferMemoryRequirements = vkGetBufferMemoryRequirements;
+    func->vkAllocateMemory = vkAllocateMemory;
+    func->vkBindBufferMemory = vkBindBufferMemory;
+    func->vkMapMemory = vkMapMemory;
+    func->vkInvalidateMappedMemoryRanges = vkInvalidateMappedMemoryRanges;
+    func->vkGetPhysicalDeviceFormatProperties = vkGetPhysicalDeviceFormatProperties;
+    func->vkCreateImage = vkCreateImage;
+    func->vkGetImageMemoryRequirements = vkGetImageMemoryRequirements;
+    func->vkBindImageMemory = vkBindImageMemory;
+    func->vkDestroyImage = vkDestroyImage;
+    func->vkDestroyImageView = vkDestroyImageView;
+    func->vkFreeMemory = vkFreeMemory;
+    func->vkCreateSampler = vkCreateSampler;
+    func->vkCreateDescriptorSetLayout = vkCreateDescriptorSetLayout;
+    func->vkCreateDescriptorPool = vkCreateDescriptorPool;
+    func->vkAllocateDescriptorSets = vkAllocateDescriptorSets;
+    func->vkUpdateDescriptorSets = vkUpdateDescriptorSets;
+    func->vkCmdBindDescriptorSets = vkCmdBindDescriptorSets;
+    func->vkEnumerateDeviceExtensionProperties = vkEnumerateDeviceExtensionProperties;
+    func->vkCreateComputePipelines = vkCreateComputePipelines;
+    func->vkCmdDispatch = vkCmdDispatch;
+    func->vkCmdPushConstants = vkCmdPushConstants;
+    func->vkCmdFillBuffer = vkCmdFillBuffer;
+    func->vkCmdCopyBufferToImage = vkCmdCopyBufferToImage;
+    func->vkCmdCopyImage = vkCmdCopyImage;
+    func->vkCmdBlitImage = vkCmdBlitImage;
+    func->vkCmdCopyImageToBuffer = vkCmdCopyImageToBuffer;
+    func->vkCmdBindIndexBuffer = vkCmdBindIndexBuffer;
+    func->vkCmdDrawIndexed = vkCmdDrawIndexed;
+    func->vkCmdDrawIndexedIndirect = vkCmdDrawIndexedIndirect;
 }
 
 void reload_library(LibraryState *lib_state)
@@ -162,6 +233,40 @@ bool init(LibraryState *lib_state)
     return true;
 }
 
+/* Draws the newest simulation snapshot, interpolated by how far the
+ * next tick is along, until the input thread stops the simulation   */
+int render_thread(void *data)
+{
+    RenderThread *render = data;
+    LibraryState *lib_state = render->lib_state;
+    Interface *func = &lib_state->func;
+    const SimSnapshot *snapshot;
+    uint64_t step = SDL_GetPerformanceFrequency() / SIM_TICK_RATE;
+    uint64_t now;
+    float alpha;
+    float aspect = (float)func->swapchain_extent.width / (func->swapchain_extent.height > 0 ? func->swapchain_extent.height : 1);
+    float view[16], projection[16];
+    
+    while(atomic_load(&render->sim->running))
+    {
+        snapshot = snapshot_acquire(&render->sim->snapshots);
+        now = SDL_GetPerformanceCounter();
+        alpha = now > snapshot->time ? (float)(now - snapshot->time) / step : 0.0f;
+        alpha = alpha < 1.0f ? alpha : 1.0f;
+        
+        if(lib_state->renderer_set_camera)
+        {
+            sim_camera_matrices(snapshot, alpha, aspect, view, projection);
+            lib_state->renderer_set_camera(func, view, projection, CAMERA_NEAR, CAMERA_FAR);
+        }
+        
+        lib_state->renderer_draw(func);
+        render->frames += 1;
+    }
+    
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     bool running = true;
@@ -171,9 +276,69 @@ int main(int argc, char *argv[])
         printf("Error during SDL init\n%s\n", SDL_GetError());
     }
     
-    if(argc > 1 && strcmp(argv[1], "-d") == 0)
+    for(int i = 1; i < argc; i++)
     {
-        lib_state.func.app_info.debug = true;
+        if(strcmp(argv[i], "-d") == 0)
+        {
+            lib_state.func.app_info.debug = true;
+        }
+        else if(strcmp(argv[i], "-gpu") == 0 && i + 1 < argc)
+        {
+            /* Device name substring or UUID from the ranking log */
+            lib_state.func.app_info.device_override = argv[++i];
+        }
+        else if(strcmp(argv[i], "-prepass") == 0)
+        {
+            lib_state.func.app_info.depth_prepass = true;
+        }
+        else if(strcmp(argv[i], "-cullbench") == 0)
+        {
+            lib_state.func.app_info.cull_benchmark = true;
+        }
+        else if(strcmp(argv[i], "-transformbench") == 0)
+        {
+            lib_state.func.app_info.transform_benchmark = true;
+        }
+        else if(strcmp(argv[i], "-spritebench") == 0)
+        {
+            lib_state.func.app_info.sprite_benchmark = true;
+        }
+        else if(strcmp(argv[i], "-lightbench") == 0)
+        {
+            lib_state.func.app_info.light_benchmark = true;
+        }
+        else if(strcmp(argv[i], "-texbudget") == 0 && i + 1 < argc)
+        {
+            /* Megabytes of device memory for streamed textures */
+            lib_state.func.app_info.texture_budget_mb = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "-capture") == 0 && i + 1 < argc)
+        {
+            /* frames.png for numbered images, any other path for raw video */
+            lib_state.func.app_info.capture_path = argv[++i];
+        }
+        else if(strcmp(argv[i], "-capturestart") == 0 && i + 1 < argc)
+        {
+            lib_state.func.app_info.capture_start = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "-captureframes") == 0 && i + 1 < argc)
+        {
+            lib_state.func.app_info.capture_frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "-dynres") == 0 && i + 1 < argc)
+        {
+            /* Target GPU frame time in milliseconds */
+            lib_state.func.app_info.resolution_target_ms = strtof(argv[++i], NULL);
+        }
+        else if(strcmp(argv[i], "-dynresscale") == 0 && i + 2 < argc)
+        {
+            lib_state.func.app_info.resolution_min_scale = strtof(argv[++i], NULL);
+            lib_state.func.app_info.resolution_max_scale = strtof(argv[++i], NULL);
+        }
+        else if(strcmp(argv[i], "-dynreshysteresis") == 0 && i + 1 < argc)
+        {
+            lib_state.func.app_info.resolution_hysteresis = strtof(argv[++i], NULL);
+        }
     }
     
     if(!init(&lib_state))
@@ -190,20 +355,63 @@ int main(int argc, char *argv[])
         }
         else
         {
+            /* Events have to be pumped on the thread that made the
+             * window, so this one only polls and forwards them      */
             SDL_Event e;
+            SimState *sim = malloc(sizeof(SimState));
+            RenderThread render = {&lib_state, sim, 0};
+            SDL_Thread *threads[2] = {NULL, NULL};
+            
+            if(sim)
+            {
+                sim_init(sim);
+                threads[0] = SDL_CreateThread(sim_thread, "simulation", sim);
+                threads[1] = SDL_CreateThread(render_thread, "render", &render);
+            }
+            
+            running = threads[0] != NULL && threads[1] != NULL;
+            
+            if(!running)
+            {
+                printf("Failed to start simulation and render threads\n%s\n", SDL_GetError());
+            }
+            
             while(running)
             {
-                while(SDL_PollEvent(&e))
+                if(SDL_WaitEventTimeout(&e, 100))
                 {
                     if(e.type == SDL_QUIT)
                     {
                         running = false;
                     }
+                    else if(e.type == SDL_KEYDOWN || e.type == SDL_KEYUP || e.type == SDL_WINDOWEVENT)
+                    {
+                        input_queue_push(&sim->input, &e);
+                    }
                 }
+            }
+            
+            if(sim)
+            {
+                atomic_store(&sim->running, false);
                 
-                lib_state.renderer_draw(&lib_state.func);
+                for(uint32_t i = 0; i < 2; i++)
+                {
+                    if(threads[i])
+                    {
+                        SDL_WaitThread(threads[i], NULL);
+                    }
+                }
+                
+                printf("Rendered %llu frames\n", (unsigned long long)render.frames);
+                free(sim);
             }
         }
+        
+        if(lib_state.renderer_shutdown)
+        {
+            lib_state.renderer_shutdown(&lib_state.func);
+        }
     }
     
     return 0;
@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "sim.h"
+
+/* Fixed timestep simulation. Input events reach it through a lock-free
+ * queue from the thread polling SDL and every tick is published as a
+ * snapshot in a triple buffer, so neither side ever waits on the
+ * render thread. The render thread interpolates between the last two
+ * ticks by how far it is into the next one.                           */
+
+bool input_queue_push(InputQueue *queue, const SDL_Event *event)
+{
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    bool result = head - atomic_load_explicit(&queue->tail, memory_order_acquire) < INPUT_QUEUE_SIZE;
+    
+    if(result)
+    {
+        queue->events[head % INPUT_QUEUE_SIZE] = *event;
+        atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    }
+    else
+    {
+        atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+    }
+    
+    return result;
+}
+
+bool input_queue_pop(InputQueue *queue, SDL_Event *event)
+{
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    bool result = tail != atomic_load_explicit(&queue->head, memory_order_acquire);
+    
+    if(result)
+    {
+        *event = queue->events[tail % INPUT_QUEUE_SIZE];
+        atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    }
+    
+    return result;
+}
+
+/* Hands the filled snapshot over and takes back the previous newest
+ * one to fill next, it was either never read or already let go of   */
+static void prv_snapshot_publish(SnapshotBuffer *buffer)
+{
+    unsigned int previous = atomic_exchange_explicit(
+        &buffer->latest, buffer->write_index | SNAPSHOT_FRESH, memory_order_acq_rel);
+    
+    buffer->write_index = previous & ~SNAPSHOT_FRESH;
+}
+
+/* Swaps in the newest snapshot if one was published since the last
+ * call, otherwise keeps reading the current one                      */
+const SimSnapshot *snapshot_acquire(SnapshotBuffer *buffer)
+{
+    unsigned int previous;
+    
+    if(atomic_load_explicit(&buffer->latest, memory_order_relaxed) & SNAPSHOT_FRESH)
+    {
+        previous = atomic_exchange_explicit(&buffer->latest, buffer->read_index, memory_order_acq_rel);
+        buffer->read_index = previous & ~SNAPSHOT_FRESH;
+    }
+    
+    return &buffer->snapshots[buffer->read_index];
+}
+
+void sim_init(SimState *sim)
+{
+    memset(sim, 0, sizeof(SimState));
+    
+    atomic_init(&sim->input.head, 0);
+    atomic_init(&sim->input.tail, 0);
+    atomic_init(&sim->input.dropped, 0);
+    atomic_init(&sim->running, true);
+    
+    /* Every snapshot starts out as the initial camera, so the render
+     * thread has something valid to read before the first tick      */
+    sim->snapshots.write_index = 0;
+    atomic_init(&sim->snapshots.latest, 1);
+    sim->snapshots.read_index = 2;
+    
+    for(uint32_t i = 0; i < 3; i++)
+    {
+        sim->snapshots.snapshots[i].time = SDL_GetPerformanceCounter();
+        sim->snapshots.snapshots[i].previous = sim->camera;
+        sim->snapshots.snapshots[i].current = sim->camera;
+    }
+}
+
+static void prv_handle_event(SimState *sim, const SDL_Event *event)
+{
+    switch(event->type)
+    {
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            if(event->key.keysym.scancode < SDL_NUM_SCANCODES)
+            {
+                sim->keys[event->key.keysym.scancode] = event->type == SDL_KEYDOWN;
+            }
+            break;
+        case SDL_WINDOWEVENT:
+            /* Key releases go to whichever window has focus next */
+            if(event->window.event == SDL_WINDOWEVENT_FOCUS_LOST)
+            {
+                memset(sim->keys, 0, sizeof(sim->keys));
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static float prv_axis(const SimState *sim, SDL_Scancode positive, SDL_Scancode negative)
+{
+    return (sim->keys[positive] ? 1.0f : 0.0f) - (sim->keys[negative] ? 1.0f : 0.0f);
+}
+
+/* WASD moves along the view, Q and E move down and up and the arrow
+ * keys turn                                                          */
+static void prv_tick(SimState *sim, uint64_t time)
+{
+    const float dt = 1.0f / SIM_TICK_RATE;
+    CameraState *camera = &sim->camera;
+    SimSnapshot *snapshot = &sim->snapshots.snapshots[sim->snapshots.write_index];
+    SDL_Event event;
+    float forward, right, up;
+    
+    while(input_queue_pop(&sim->input, &event))
+    {
+        prv_handle_event(sim, &event);
+    }
+    
+    snapshot->previous = *camera;
+    
+    forward = prv_axis(sim, SDL_SCANCODE_W, SDL_SCANCODE_S) * CAMERA_MOVE_SPEED * dt;
+    right = prv_axis(sim, SDL_SCANCODE_D, SDL_SCANCODE_A) * CAMERA_MOVE_SPEED * dt;
+    up = prv_axis(sim, SDL_SCANCODE_E, SDL_SCANCODE_Q) * CAMERA_MOVE_SPEED * dt;
+    
+    camera->yaw += prv_axis(sim, SDL_SCANCODE_LEFT, SDL_SCANCODE_RIGHT) * CAMERA_TURN_SPEED * dt;
+    camera->pitch += prv_axis(sim, SDL_SCANCODE_UP, SDL_SCANCODE_DOWN) * CAMERA_TURN_SPEED * dt;
+    camera->pitch = fminf(fmaxf(camera->pitch, -1.5f), 1.5f);
+    
+    camera->position[0] += -sinf(camera->yaw) * cosf(camera->pitch) * forward + cosf(camera->yaw) * right;
+    camera->position[1] += sinf(camera->pitch) * forward + up;
+    camera->position[2] += -cosf(camera->yaw) * cosf(camera->pitch) * forward - sinf(camera->yaw) * right;
+    
+    snapshot->tick = sim->tick;
+    snapshot->time = time;
+    snapshot->current = *camera;
+    sim->tick += 1;
+    
+    prv_snapshot_publish(&sim->snapshots);
+}
+
+int sim_thread(void *data)
+{
+    SimState *sim = data;
+    uint64_t frequency = SDL_GetPerformanceFrequency();
+    uint64_t step = frequency / SIM_TICK_RATE;
+    uint64_t next = SDL_GetPerformanceCounter();
+    uint64_t now;
+    
+    while(atomic_load(&sim->running))
+    {
+        now = SDL_GetPerformanceCounter();
+        
+        /* Ticks carry their scheduled time, so a late one still
+         * interpolates as if it had run on time                  */
+        for(uint32_t i = 0; i < SIM_MAX_CATCHUP && next <= now; i++)
+        {
+            prv_tick(sim, next);
+            next += step;
+        }
+        
+        if(next <= now)
+        {
+            sim->skipped_ticks += (now - next) / step + 1;
+            next += ((now - next) / step + 1) * step;
+        }
+        
+        now = SDL_GetPerformanceCounter();
+        
+        if(next > now)
+        {
+            SDL_Delay((Uint32)((next - now) * 1000 / frequency));
+        }
+    }
+    
+    printf("Simulation ran %llu ticks, %llu skipped, %u input events dropped\n",
+        (unsigned long long)sim->tick, (unsigned long long)sim->skipped_ticks,
+        atomic_load(&sim->input.dropped));
+    
+    return 0;
+}
+
+/* Column major, the view is the inverse of the camera's rotation and
+ * translation and the projection maps depth from 0 to 1 with y down,
+ * matching the rest of the engine                                     */
+void sim_camera_matrices(const SimSnapshot *snapshot, float alpha, float aspect, float view[16], float projection[16])
+{
+    const CameraState *a = &snapshot->previous;
+    const CameraState *b = &snapshot->current;
+    float yaw = a->yaw + (b->yaw - a->yaw) * alpha;
+    float pitch = a->pitch + (b->pitch - a->pitch) * alpha;
+    float position[3];
+    float right[3] = {cosf(yaw), 0.0f, -sinf(yaw)};
+    float forward[3] = {-sinf(yaw) * cosf(pitch), sinf(pitch), -cosf(yaw) * cosf(pitch)};
+    float up[3];
+    float focal = 1.0f / tanf(CAMERA_FOV * 0.5f);
+    
+    for(uint32_t i = 0; i < 3; i++)
+    {
+        position[i] = a->position[i] + (b->position[i] - a->position[i]) * alpha;
+    }
+    
+    up[0] = right[1] * forward[2] - right[2] * forward[1];
+    up[1] = right[2] * forward[0] - right[0] * forward[2];
+    up[2] = right[0] * forward[1] - right[1] * forward[0];
+    
+    memset(view, 0, sizeof(float) * 16);
+    memset(projection, 0, sizeof(float) * 16);
+    
+    for(uint32_t i = 0; i < 3; i++)
+    {
+        view[i * 4 + 0] = right[i];
+        view[i * 4 + 1] = up[i];
+        view[i * 4 + 2] = -forward[i];
+    }
+    
+    view[12] = -(right[0] * position[0] + right[1] * position[1] + right[2] * position[2]);
+    view[13] = -(up[0] * position[0] + up[1] * position[1] + up[2] * position[2]);
+    view[14] = forward[0] * position[0] + forward[1] * position[1] + forward[2] * position[2];
+    view[15] = 1.0f;
+    
+    projection[0] = focal / aspect;
+    projection[5] = -focal;
+    projection[10] = CAMERA_FAR / (CAMERA_NEAR - CAMERA_FAR);
+    projection[11] = -1.0f;
+    projection[14] = CAMERA_NEAR * CAMERA_FAR / (CAMERA_NEAR - CAMERA_FAR);
+}
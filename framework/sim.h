@@ -0,0 +1,81 @@
+#ifndef SIM_H
+#define SIM_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <SDL2/SDL.h>
+
+#define SIM_TICK_RATE 60
+/* Ticks run back to back after a stall before the rest are skipped */
+#define SIM_MAX_CATCHUP 5
+/* Power of two so the free running indices wrap cleanly */
+#define INPUT_QUEUE_SIZE 256
+#define SNAPSHOT_FRESH 4u
+#define CAMERA_MOVE_SPEED 5.0f
+#define CAMERA_TURN_SPEED 1.5f
+#define CAMERA_FOV 1.0471976f
+#define CAMERA_NEAR 0.1f
+#define CAMERA_FAR 100.0f
+
+/* Single producer single consumer ring, the input thread pushes
+ * and the simulation thread pops                                 */
+typedef struct
+{
+    SDL_Event events[INPUT_QUEUE_SIZE];
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_uint dropped;
+} InputQueue;
+
+/* Fly camera looking down -z at zero yaw and pitch */
+typedef struct
+{
+    float position[3];
+    float yaw;
+    float pitch;
+} CameraState;
+
+/* Everything the render thread needs from one tick, the previous
+ * state is kept so frames between ticks can be interpolated       */
+typedef struct
+{
+    uint64_t tick;
+    /* Performance counter when the tick was published */
+    uint64_t time;
+    CameraState previous;
+    CameraState current;
+} SimSnapshot;
+
+/* Triple buffer, the simulation fills one snapshot while the render
+ * thread reads another and the third holds the newest finished one.
+ * latest is that index, with SNAPSHOT_FRESH set until it is read.    */
+typedef struct
+{
+    SimSnapshot snapshots[3];
+    atomic_uint latest;
+    /* Owned by the simulation and render threads respectively */
+    uint32_t write_index;
+    uint32_t read_index;
+} SnapshotBuffer;
+
+typedef struct
+{
+    InputQueue input;
+    SnapshotBuffer snapshots;
+    atomic_bool running;
+
+    /* Simulation thread only */
+    bool keys[SDL_NUM_SCANCODES];
+    CameraState camera;
+    uint64_t tick;
+    uint64_t skipped_ticks;
+} SimState;
+
+bool input_queue_push(InputQueue *queue, const SDL_Event *event);
+bool input_queue_pop(InputQueue *queue, SDL_Event *event);
+const SimSnapshot *snapshot_acquire(SnapshotBuffer *buffer);
+void sim_init(SimState *sim);
+int sim_thread(void *data);
+void sim_camera_matrices(const SimSnapshot *snapshot, float alpha, float aspect, float view[16], float projection[16]);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef CULL_H
+#define CULL_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "interface.h"
+#include "job.h"
+
+#define CULL_INVALID UINT32_MAX
+#define CULL_LANES 8
+#define CULL_INITIAL_CAPACITY 1024
+/* Below this a chunk costs more to schedule than to cull */
+#define CULL_MIN_JOB_OBJECTS 4096
+#define MAX_CULL_JOBS 64
+#define CULL_BENCHMARK_OBJECTS 131072
+
+typedef enum
+{
+    CULL_PATH_SCALAR,
+    CULL_PATH_SSE2,
+    CULL_PATH_AVX2,
+    CULL_PATH_COUNT
+} CullPath;
+
+/* Six normalized planes, a point is inside when a*x + b*y + c*z + d >= 0
+ * for all of them. The absolute normals are kept for the box test.      */
+typedef struct
+{
+    float a[6], b[6], c[6], d[6];
+    float abs_a[6], abs_b[6], abs_c[6];
+} Frustum;
+
+typedef struct CullScene CullScene;
+
+typedef struct
+{
+    CullScene *scene;
+    const Frustum *frustum;
+    CullPath path;
+    uint32_t begin;
+    uint32_t end;
+    uint32_t visible_count;
+} CullChunk;
+
+/* Bounds are stored as structure of arrays so a whole register of
+ * objects is tested against a plane at once. Object handles are slot
+ * indices, removed slots get a negative radius and are never visible. */
+struct CullScene
+{
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t live_count;
+    /* Bumped on every change so copies of the bounds know when to update */
+    uint64_t generation;
+    float *center_x;
+    float *center_y;
+    float *center_z;
+    float *extent_x;
+    float *extent_y;
+    float *extent_z;
+    float *radius;
+    uint32_t *free_list;
+    uint32_t free_count;
+
+    /* Written by cull_scene, indices of the visible objects in order */
+    uint32_t *visible;
+    uint32_t visible_count;
+
+    CullPath path;
+    Job jobs[MAX_CULL_JOBS];
+    CullChunk chunks[MAX_CULL_JOBS];
+    JobGroup group;
+};
+
+CullScene *cull_scene_create(Interface *func);
+void cull_scene_destroy(Interface *func, CullScene *scene);
+
+/* A radius of zero or less uses the sphere around the box */
+uint32_t cull_add_object(Interface *func, CullScene *scene, const float center[3], const float extents[3], float radius);
+void cull_set_object(CullScene *scene, uint32_t object, const float center[3], const float extents[3], float radius);
+void cull_remove_object(CullScene *scene, uint32_t object);
+
+/* Column major, clip space depth in [0, 1] as Vulkan uses it */
+void cull_frustum_from_matrix(Frustum *frustum, const float view_proj[16]);
+
+/* Fills scene->visible and returns how many objects passed, large
+ * scenes are split across the job pool when parallel is set        */
+uint32_t cull_scene(Interface *func, CullScene *scene, const Frustum *frustum, bool parallel);
+
+CullPath cull_best_path(void);
+void cull_benchmark(Interface *func, uint32_t object_count);
+
+#endif
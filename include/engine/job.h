@@ -0,0 +1,68 @@
+#ifndef JOB_H
+#define JOB_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "interface.h"
+
+#define MAX_JOB_WORKERS 16
+#define MAX_JOB_QUEUE 256
+#define MAX_JOB_DEPENDENTS 16
+
+typedef bool (*PFN_job)(Interface *func, void *data);
+
+typedef struct JobGroup JobGroup;
+typedef struct Job Job;
+
+struct Job
+{
+    const char *name;
+    PFN_job run;
+    void *data;
+
+    /* Jobs that can only start once this one has finished */
+    uint32_t dependent_count;
+    Job *dependents[MAX_JOB_DEPENDENTS];
+    uint32_t dependency_count;
+
+    /* Runtime state, reset by job_submit */
+    atomic_uint pending;
+    atomic_bool dependency_failed;
+    JobGroup *group;
+    bool result;
+    uint64_t start_ticks;
+    uint64_t end_ticks;
+};
+
+struct JobGroup
+{
+    atomic_uint remaining;
+    SDL_sem *done;
+};
+
+typedef struct JobPool
+{
+    Interface *func;
+    SDL_Thread *workers[MAX_JOB_WORKERS];
+    uint32_t worker_count;
+    SDL_mutex *lock;
+    SDL_sem *ready;
+    Job *queue[MAX_JOB_QUEUE];
+    uint32_t head;
+    uint32_t tail;
+    atomic_bool quit;
+} JobPool;
+
+JobPool *job_pool_create(Interface *func);
+void job_pool_destroy(JobPool *pool);
+
+void job_init(Job *job, const char *name, PFN_job run, void *data);
+bool job_depends_on(Job *job, Job *dependency);
+
+/* All dependencies of the submitted jobs must be part of the same
+ * submission. Jobs whose dependencies fail are skipped and report
+ * a false result.                                                  */
+void job_submit(JobPool *pool, JobGroup *group, Job *jobs, uint32_t count);
+void job_wait(JobPool *pool, JobGroup *group);
+
+#endif
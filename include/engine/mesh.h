@@ -0,0 +1,62 @@
+#ifndef MESH_H
+#define MESH_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Engine native mesh file, written by tools/cooker. The header is
+ * followed by vertex_count vertices and then index_count uint32
+ * indices, already in the layout the GPU reads, so everything after
+ * the header is copied into one buffer as is.                        */
+
+#define MESH_MAGIC 0x48534D45
+#define MESH_VERSION 1
+#define MESH_MAX_LODS 8
+/* A level is used while its error covers less than this many pixels */
+#define MESH_LOD_THRESHOLD_PIXELS 1.0f
+
+/* Position is unorm in the mesh bounds, position_offset plus position
+ * times position_scale in object space. Normal is octahedral snorm and
+ * uv is half float.                                                   */
+typedef struct
+{
+    uint16_t position[4];
+    uint16_t uv[2];
+    int8_t normal[2];
+    uint8_t padding[2];
+} MeshVertex;
+
+/* error is the largest object space distance the level moved the
+ * surface from the full detail mesh                               */
+typedef struct
+{
+    uint32_t first_index;
+    uint32_t index_count;
+    float error;
+} MeshLod;
+
+typedef struct MeshHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertex_count;
+    uint32_t vertex_stride;
+    uint32_t index_count;
+    uint32_t lod_count;
+    float position_offset[3];
+    float position_scale[3];
+    float center[3];
+    float radius;
+    /* Finest level first, all levels index the same vertices */
+    MeshLod lods[MESH_MAX_LODS];
+} MeshHeader;
+
+bool mesh_validate(const void *data, size_t size);
+
+/* Picks the coarsest level whose error stays under threshold pixels
+ * for a mesh at center with the given uniform scale. view_proj is
+ * column major, the projection scale is taken from its y row.        */
+uint32_t mesh_select_lod(const MeshHeader *header, const float view_proj[16],
+    const float center[3], float scale, float viewport_height, float threshold);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "interface.h"
+
+#define TRANSFORM_INVALID UINT32_MAX
+#define TRANSFORM_INITIAL_CAPACITY 1024
+/* Local matrices are built this many nodes at a time */
+#define TRANSFORM_BLOCK 64
+#define TRANSFORM_BENCHMARK_NODES (1024 * 1024)
+
+typedef enum
+{
+    TRANSFORM_PATH_SCALAR,
+    TRANSFORM_PATH_SSE2,
+    TRANSFORM_PATH_AVX2,
+    TRANSFORM_PATH_COUNT
+} TransformPath;
+
+/* Local position, rotation and scale are stored as structure of arrays
+ * so a block of local matrices is built a register of nodes at a time.
+ * Nodes are kept parent first, a parent always has a lower index than
+ * its children, so a single forward pass sees every parent's world
+ * matrix before the children that need it.
+ *
+ * changed holds the update a node's world matrix last changed in, a
+ * copy of the matrices only needs the nodes changed since it was made. */
+typedef struct TransformHierarchy
+{
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t *parent;
+    float *position_x;
+    float *position_y;
+    float *position_z;
+    float *rotation_x;
+    float *rotation_y;
+    float *rotation_z;
+    float *rotation_w;
+    float *scale_x;
+    float *scale_y;
+    float *scale_z;
+    uint8_t *dirty;
+    uint32_t *changed;
+    /* Column major, 16 floats per node */
+    float *world;
+
+    uint32_t update;
+    TransformPath path;
+} TransformHierarchy;
+
+TransformHierarchy *transform_hierarchy_create(Interface *func);
+void transform_hierarchy_destroy(Interface *func, TransformHierarchy *hierarchy);
+
+/* parent is TRANSFORM_INVALID for a root, rotation is a unit quaternion
+ * as x, y, z, w. Nodes are never moved so handles stay valid.          */
+uint32_t transform_add(Interface *func, TransformHierarchy *hierarchy, uint32_t parent,
+    const float position[3], const float rotation[4], const float scale[3]);
+void transform_set_local(TransformHierarchy *hierarchy, uint32_t node,
+    const float position[3], const float rotation[4], const float scale[3]);
+
+/* Recomputes the world matrix of every dirty node and of everything
+ * below it. With dst set, the matrices changed since dst_update are
+ * also written to dst at 16 floats per node, pass 0 to write all of
+ * them. Returns the number of matrices written to dst.               */
+uint32_t transform_update(TransformHierarchy *hierarchy, float *dst, uint32_t dst_update);
+
+TransformPath transform_best_path(void);
+void transform_benchmark(Interface *func, uint32_t node_count);
+
+#endif
@@ -4,5 +4,7 @@
 #include "interface.h"
 
 void util_load_whole_file(Interface *func, const char *filename, void **data, size_t *size);
+bool util_write_png(Interface *func, const char *filename, const uint8_t *pixels,
+    uint32_t width, uint32_t height, bool bgra);
 
 #endif
@@ -3,16 +3,24 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdatomic.h>
 #define VK_NO_PROTOTYPES
 #include <vulkan/vulkan.h>
 #include <SDL2/SDL.h>
 
 #define MAX_EXTENSIONS 16
-#define MAX_DEVICE_COUNT 2
-#define MAX_QUEUE_COUNT 4
+#define MAX_DEVICE_COUNT 16
+#define MAX_QUEUE_COUNT 16
 #define MAX_PRESENT_MODES_COUNT 6
+#define MAX_TIME_DOMAINS 8
 #define MAX_SWAPCHAIN_IMAGES 6
 #define MAX_FRAMES MAX_SWAPCHAIN_IMAGES
+#define MAX_COMPUTE_PASSES 8
+#define MAX_PENDING_SUBMITS 16
+#define MAX_HIZ_LEVELS 16
+#define MAX_MESHES 256
+#define MAX_TEXTURES 1024
+#define MAX_TEXTURE_LEVELS 16
 
 #define DEFAULT_WIDTH 800
 #define DEFAULT_HEIGHT 600
@@ -23,11 +31,46 @@ typedef struct
     unsigned int extension_count;
     const char *enabled_extensions[MAX_EXTENSIONS];
     bool debug;
+    /* Device name substring or UUID, NULL picks the best ranked GPU */
+    const char *device_override;
+    /* Lay down depth before shading so hidden fragments are rejected early */
+    bool depth_prepass;
+    /* Time frustum culling on every supported path after startup */
+    bool cull_benchmark;
+    /* Time world matrix updates of a large hierarchy after startup */
+    bool transform_benchmark;
+    /* Device memory streamed textures may use, 0 for the default */
+    uint32_t texture_budget_mb;
+    /* Time writing a large overlay of quads and text every frame */
+    bool sprite_benchmark;
+    /* Sweep the number of dynamic lights and report the frame time of each */
+    bool light_benchmark;
+    /* Frames are written as numbered PNGs when this ends in .png,
+     * otherwise as raw RGBA appended to this file or named pipe     */
+    const char *capture_path;
+    uint32_t capture_start;
+    /* Frames to capture, 0 captures until exit */
+    uint32_t capture_frames;
+    /* GPU frame time dynamic resolution aims for, 0 renders at full size */
+    float resolution_target_ms;
+    /* Scale range and the fraction off target tolerated, 0 for defaults */
+    float resolution_min_scale;
+    float resolution_max_scale;
+    float resolution_hysteresis;
 } AppInfo;
 
 struct Interface;
 typedef struct Interface Interface;
 
+struct JobPool;
+struct CullScene;
+struct TransformHierarchy;
+struct MeshHeader;
+struct GlyphCache;
+struct LightSet;
+struct CaptureState;
+struct DeferredRelease;
+
 /* Framework exported functions */
 typedef void*(*PFN_malloc)(size_t size);
 typedef void (*PFN_free)(void *ptr);
@@ -38,9 +81,134 @@ typedef int (*PFN_fclose)(FILE *stream);
 typedef int (*PFN_fseek)(FILE *stream, long offset, int whence);
 typedef long (*PFN_ftell)(FILE *stream);
 typedef size_t (*PFN_fread)(void *ptr, size_t size, size_t nmemb, FILE *stream);
+typedef size_t (*PFN_fwrite)(const void *ptr, size_t size, size_t nmemb, FILE *stream);
+typedef int (*PFN_fflush)(FILE *stream);
+typedef SDL_Thread* (*PFN_create_thread)(SDL_ThreadFunction fn, const char *name, void *data);
+typedef void (*PFN_wait_thread)(SDL_Thread *thread, int *status);
+typedef SDL_mutex* (*PFN_create_mutex)(void);
+typedef int (*PFN_lock_mutex)(SDL_mutex *mutex);
+typedef int (*PFN_unlock_mutex)(SDL_mutex *mutex);
+typedef void (*PFN_destroy_mutex)(SDL_mutex *mutex);
+typedef SDL_sem* (*PFN_create_sem)(Uint32 initial_value);
+typedef int (*PFN_sem_wait)(SDL_sem *sem);
+typedef int (*PFN_sem_post)(SDL_sem *sem);
+typedef void (*PFN_destroy_sem)(SDL_sem *sem);
+typedef int (*PFN_get_cpu_count)(void);
+typedef Uint64 (*PFN_get_perf_counter)(void);
+typedef Uint64 (*PFN_get_perf_frequency)(void);
 
 typedef bool (*PFN_create_surface)(Interface *func);
 
+/* Records work into the async compute command buffer of a frame */
+typedef void (*PFN_record_compute)(Interface *func, VkCommandBuffer cmd, void *data);
+
+typedef struct
+{
+    PFN_record_compute record;
+    void *data;
+} ComputePass;
+
+/* Kinds of resources in the bindless set, the value is also
+ * the binding they live at in set 1                          */
+typedef enum
+{
+    BINDLESS_IMAGE,
+    BINDLESS_BUFFER,
+    BINDLESS_TYPE_COUNT
+} BindlessType;
+
+#define BINDLESS_INVALID UINT32_MAX
+
+/* Immutable samplers at binding 2 of the bindless set */
+enum
+{
+    BINDLESS_SAMPLER_LINEAR,
+    BINDLESS_SAMPLER_NEAREST,
+    BINDLESS_SAMPLER_COUNT
+};
+
+/* Index allocator for one binding of the bindless set */
+typedef struct
+{
+    uint32_t capacity;
+    uint32_t next;
+    uint32_t free_count;
+    uint32_t *free_list;
+} BindlessHeap;
+
+/* GPU time accumulated since the last timing report */
+typedef struct
+{
+    uint32_t frame_count;
+    double graphics_ms;
+    double compute_ms;
+    double overlap_ms;
+    uint32_t overdraw_count;
+    double fragments_per_pixel;
+} GpuTimingStats;
+
+#define MESH_INVALID UINT32_MAX
+
+/* A cooked mesh, vertices then indices in one buffer exactly as laid
+ * out in the file after its header. A free slot has no header.       */
+typedef struct
+{
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    struct MeshHeader *header;
+    VkDeviceSize index_offset;
+    uint32_t bindless;
+} GpuMesh;
+
+#define TEXTURE_INVALID UINT32_MAX
+
+/* A KTX2 texture whose image only holds levels resident_level and
+ * coarser, level data is read from the file as it streams in. A free
+ * slot has no filename.                                              */
+typedef struct
+{
+    char *filename;
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;
+    uint64_t level_offsets[MAX_TEXTURE_LEVELS];
+    uint64_t level_sizes[MAX_TEXTURE_LEVELS];
+    
+    VkImage image;
+    VkDeviceMemory memory;
+    VkImageView view;
+    VkDeviceSize memory_size;
+    /* Index handed out this frame, the current image's index replaces
+     * it once the frame is submitted so it never changes mid-frame    */
+    uint32_t bindless;
+    uint32_t next_bindless;
+    /* level_count while nothing is resident */
+    uint32_t resident_level;
+    uint32_t wanted_level;
+    uint64_t last_used;
+} GpuTexture;
+
+/* Quads without a texture are filled with their color. Coverage marks
+ * a single channel texture whose red channel scales the color's alpha */
+#define SPRITE_TEXTURE_NONE UINT32_MAX
+#define SPRITE_TEXTURE_COVERAGE 0x80000000u
+
+/* One 2D quad, laid out exactly as the sprite shader reads it */
+typedef struct
+{
+    /* Top left corner then size, in pixels */
+    float rect[4];
+    /* unorm16 u0, v0, u1, v1 */
+    uint16_t uv[4];
+    /* RGBA8 with red in the lowest byte */
+    uint32_t color;
+    /* Bindless image index or SPRITE_TEXTURE_NONE */
+    uint32_t texture;
+} SpriteQuad;
+
+#define LIGHT_INVALID UINT32_MAX
+
 struct Interface
 {
     /* Platform functions */
@@ -53,6 +221,23 @@ struct Interface
     PFN_fseek fseek;
     PFN_ftell ftell;
     PFN_fread fread;
+    PFN_fwrite fwrite;
+    PFN_fflush fflush;
+    
+    /* Threading and timing functions */
+    PFN_create_thread create_thread;
+    PFN_wait_thread wait_thread;
+    PFN_create_mutex create_mutex;
+    PFN_lock_mutex lock_mutex;
+    PFN_unlock_mutex unlock_mutex;
+    PFN_destroy_mutex destroy_mutex;
+    PFN_create_sem create_sem;
+    PFN_sem_wait sem_wait;
+    PFN_sem_post sem_post;
+    PFN_destroy_sem destroy_sem;
+    PFN_get_cpu_count get_cpu_count;
+    PFN_get_perf_counter get_perf_counter;
+    PFN_get_perf_frequency get_perf_frequency;
     
     PFN_create_surface create_surface;
     
@@ -62,8 +247,14 @@ struct Interface
     PFN_vkCreateDebugReportCallbackEXT vkCreateDebugReportCallbackEXT;
     PFN_vkEnumeratePhysicalDevices vkEnumeratePhysicalDevices;
     PFN_vkGetPhysicalDeviceQueueFamilyProperties vkGetPhysicalDeviceQueueFamilyProperties;
+    PFN_vkGetPhysicalDeviceProperties vkGetPhysicalDeviceProperties;
+    PFN_vkGetPhysicalDeviceProperties2 vkGetPhysicalDeviceProperties2;
+    PFN_vkGetPhysicalDeviceFeatures vkGetPhysicalDeviceFeatures;
+    PFN_vkGetPhysicalDeviceFeatures2 vkGetPhysicalDeviceFeatures2;
+    PFN_vkGetPhysicalDeviceMemoryProperties vkGetPhysicalDeviceMemoryProperties;
     PFN_vkGetPhysicalDeviceSurfaceSupportKHR vkGetPhysicalDeviceSurfaceSupportKHR;
     PFN_vkCreateDevice vkCreateDevice;
+    PFN_vkGetDeviceProcAddr vkGetDeviceProcAddr;
     PFN_vkGetDeviceQueue vkGetDeviceQueue;
     PFN_vkGetPhysicalDeviceSurfaceFormatsKHR vkGetPhysicalDeviceSurfaceFormatsKHR;
     PFN_vkGetPhysicalDeviceSurfacePresentModesKHR vkGetPhysicalDeviceSurfacePresentModesKHR;
@@ -76,6 +267,9 @@ struct Interface
     PFN_vkCreateFence vkCreateFence;
     PFN_vkWaitForFences vkWaitForFences;
     PFN_vkResetFences vkResetFences;
+    PFN_vkGetFenceStatus vkGetFenceStatus;
+    PFN_vkGetSemaphoreCounterValue vkGetSemaphoreCounterValue;
+    PFN_vkWaitSemaphores vkWaitSemaphores;
     PFN_vkAcquireNextImageKHR vkAcquireNextImageKHR;
     PFN_vkBeginCommandBuffer vkBeginCommandBuffer;
     PFN_vkEndCommandBuffer vkEndCommandBuffer;
@@ -95,6 +289,46 @@ struct Interface
     PFN_vkCmdSetViewport vkCmdSetViewport;
     PFN_vkCmdSetScissor vkCmdSetScissor;
     PFN_vkCmdDraw vkCmdDraw;
+    PFN_vkCreateQueryPool vkCreateQueryPool;
+    PFN_vkCmdResetQueryPool vkCmdResetQueryPool;
+    PFN_vkCmdBeginQuery vkCmdBeginQuery;
+    PFN_vkCmdEndQuery vkCmdEndQuery;
+    PFN_vkCmdWriteTimestamp vkCmdWriteTimestamp;
+    PFN_vkGetQueryPoolResults vkGetQueryPoolResults;
+    PFN_vkCreateBuffer vkCreateBuffer;
+    PFN_vkDestroyBuffer vkDestroyBuffer;
+    PFN_vkGetBufferMemoryRequirements vkGetBufferMemoryRequirements;
+    PFN_vkAllocateMemory vkAllocateMemory;
+    PFN_vkBindBufferMemory vkBindBufferMemory;
+    PFN_vkMapMemory vkMapMemory;
+    PFN_vkInvalidateMappedMemoryRanges vkInvalidateMappedMemoryRanges;
+    PFN_vkGetPhysicalDeviceFormatProperties vkGetPhysicalDeviceFormatProperties;
+    PFN_vkCreateImage vkCreateImage;
+    PFN_vkGetImageMemoryRequirements vkGetImageMemoryRequirements;
+    PFN_vkBindImageMemory vkBindImageMemory;
+    PFN_vkDestroyImage vkDestroyImage;
+    PFN_vkDestroyImageView vkDestroyImageView;
+    PFN_vkFreeMemory vkFreeMemory;
+    PFN_vkCreateSampler vkCreateSampler;
+    PFN_vkCreateDescriptorSetLayout vkCreateDescriptorSetLayout;
+    PFN_vkCreateDescriptorPool vkCreateDescriptorPool;
+    PFN_vkAllocateDescriptorSets vkAllocateDescriptorSets;
+    PFN_vkUpdateDescriptorSets vkUpdateDescriptorSets;
+    PFN_vkCmdBindDescriptorSets vkCmdBindDescriptorSets;
+    PFN_vkEnumerateDeviceExtensionProperties vkEnumerateDeviceExtensionProperties;
+    PFN_vkCreateComputePipelines vkCreateComputePipelines;
+    PFN_vkCmdDispatch vkCmdDispatch;
+    PFN_vkCmdPushConstants vkCmdPushConstants;
+    PFN_vkCmdFillBuffer vkCmdFillBuffer;
+    PFN_vkCmdCopyBufferToImage vkCmdCopyBufferToImage;
+    PFN_vkCmdCopyImage vkCmdCopyImage;
+    PFN_vkCmdBlitImage vkCmdBlitImage;
+    PFN_vkCmdCopyImageToBuffer vkCmdCopyImageToBuffer;
+    PFN_vkCmdBindIndexBuffer vkCmdBindIndexBuffer;
+    PFN_vkCmdDrawIndexed vkCmdDrawIndexed;
+    PFN_vkCmdDrawIndexedIndirect vkCmdDrawIndexedIndirect;
+    /* From VK_KHR_draw_indirect_count, NULL without it */
+    PFN_vkCmdDrawIndexedIndirectCount vkCmdDrawIndexedIndirectCount;
     
     /* Data */
     AppInfo app_info;
@@ -102,11 +336,134 @@ struct Interface
     /* SDL information */
     SDL_Window *window;
     
+    /* Worker threads shared by the engine */
+    struct JobPool *job_pool;
+    
+    /* Bounds of everything drawn, culled against view_proj every frame */
+    struct CullScene *cull_scene;
+    float view_proj[16];
+    
+    /* World matrices are written into this frame's partition of the
+     * instance buffer, only nodes changed since it was last used     */
+    struct TransformHierarchy *transforms;
+    VkBuffer instance_buffer;
+    VkDeviceMemory instance_memory;
+    uint8_t *instance_mapped;
+    uint32_t instance_capacity;
+    VkDeviceSize instance_partition;
+    uint32_t instance_updates[MAX_FRAMES];
+    uint32_t instance_bindless[MAX_FRAMES];
+    
+    GpuMesh meshes[MAX_MESHES];
+    uint32_t mesh_count;
+    
+    /* Objects given a mesh draw it, at the level of detail picked from
+     * their bounds, with the world matrix of their transform node.
+     * Indexed by object handle, MESH_INVALID draws the placeholder.    */
+    uint32_t *object_meshes;
+    uint32_t *object_transforms;
+    uint32_t object_mesh_capacity;
+    uint32_t mesh_object_count;
+    VkShaderModule mesh_vert_shader;
+    VkPipeline mesh_pipeline;
+    VkPipeline mesh_prepass_pipeline;
+    
+    /* Levels are read from disk straight into this frame's partition
+     * of the staging buffer and copied on the graphics queue          */
+    GpuTexture textures[MAX_TEXTURES];
+    uint32_t texture_count;
+    VkDeviceSize texture_budget;
+    VkDeviceSize texture_resident_bytes;
+    VkDeviceSize texture_streamed_bytes;
+    uint32_t texture_evictions;
+    uint64_t texture_frames;
+    VkBuffer texture_staging_buffer;
+    VkDeviceMemory texture_staging_memory;
+    uint8_t *texture_staging_mapped;
+    
+    /* 2D overlay, quads go straight into the partition of the sprite
+     * stream no submission in flight can read and are drawn after the
+     * scene in one draw. Glyphs are rasterized into an atlas on use.  */
+    VkBuffer sprite_buffer;
+    VkDeviceMemory sprite_memory;
+    uint8_t *sprite_mapped;
+    VkDeviceSize sprite_partition_size;
+    uint32_t sprite_partition_count;
+    uint32_t sprite_partition;
+    uint32_t sprite_bindless[MAX_FRAMES + 1];
+    uint32_t sprite_count;
+    uint32_t sprite_peak;
+    uint32_t sprite_dropped;
+    uint64_t sprite_frames;
+    VkShaderModule sprite_vert_shader, sprite_frag_shader;
+    VkPipeline sprite_pipeline;
+    struct GlyphCache *glyph_cache;
+    VkImage glyph_atlas;
+    VkDeviceMemory glyph_atlas_memory;
+    VkImageView glyph_atlas_view;
+    uint32_t glyph_atlas_bindless;
+    bool glyph_atlas_initialized;
+    uint64_t sprite_benchmark_ticks;
+    
+    /* Clustered lighting, lights in the view frustum are written in
+     * view space into this frame's partition of the light buffer and
+     * a pass on the async compute queue bins them into the slot's
+     * per-cluster index lists that the lit fragment shader walks     */
+    float view[16];
+    float projection[16];
+    float inverse_projection[16];
+    float camera_near, camera_far;
+    bool lights_enabled;
+    struct LightSet *lights;
+    VkShaderModule light_cluster_shader, lit_frag_shader;
+    VkBuffer light_buffer;
+    VkDeviceMemory light_memory;
+    uint8_t *light_mapped;
+    VkDeviceSize light_partition;
+    uint32_t light_bindless[MAX_FRAMES];
+    uint32_t light_visible_count;
+    VkBuffer cluster_buffer;
+    VkDeviceMemory cluster_memory;
+    VkDeviceSize cluster_partition;
+    uint32_t cluster_bindless[MAX_FRAMES];
+    VkPipelineLayout light_pipeline_layout;
+    VkPipeline light_pipeline;
+    
+    /* Frame capture, swapchain images are copied into a ring of host
+     * buffers and handed to an encoder thread once the GPU is done    */
+    bool capture_enabled;
+    struct CaptureState *capture;
+    uint32_t graph_capture_pass;
+    
+    /* Dynamic resolution, the scene is drawn into the top left corner
+     * of an offscreen target, blitted up to the swapchain image and
+     * the overlay is drawn on top at full size. The scale follows the
+     * GPU frame time.                                                  */
+    bool resolution_enabled;
+    float render_scale;
+    VkExtent2D render_extent;
+    double resolution_filtered_ms;
+    uint32_t resolution_settle;
+    uint32_t resolution_changes;
+    uint64_t resolution_frames;
+    VkFilter upscale_filter;
+    uint32_t graph_scene_color;
+    uint32_t graph_upscale_pass;
+    uint32_t graph_overlay_pass;
+    /* Render pass of whichever pass draws the sprites */
+    VkRenderPass sprite_render_pass;
+    
     /* Vulkan information */
     VkInstance instance;
+    uint32_t instance_version;
     VkDebugReportCallbackEXT debug_callback;
     VkSurfaceKHR surface;
     VkPhysicalDevice physical_device;
+    VkPhysicalDeviceProperties physical_device_properties;
+    /* Only the features actually enabled on the device */
+    VkPhysicalDeviceFeatures physical_device_features;
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    uint32_t api_version;
     VkDevice device;
     VkQueue queue;
     uint32_t queue_family_index;
@@ -114,24 +471,174 @@ struct Interface
     VkSwapchainKHR swapchain;
     VkImage swapchain_images[MAX_SWAPCHAIN_IMAGES];
     VkImageView swapchain_image_views[MAX_SWAPCHAIN_IMAGES];
-    VkFramebuffer framebuffers[MAX_SWAPCHAIN_IMAGES];
     VkCommandPool cmd_pool;
     VkCommandBuffer cmd_buffers[MAX_FRAMES];
     VkSemaphore img_avaliable_sem[MAX_FRAMES];
     VkSemaphore render_finished_sem[MAX_FRAMES];
-    VkFence frame_fence[MAX_FRAMES];
     uint32_t frame_index;
     VkRenderPass render_pass;
+    /* Owns the render passes, framebuffers and transient resources */
+    struct RenderGraph *render_graph;
+    uint32_t graph_backbuffer;
+    uint32_t graph_main_pass;
+    uint32_t graph_prepass;
+    uint32_t graph_depth;
+    VkFormat depth_format;
     VkSurfaceFormatKHR surface_format;
     VkExtent2D swapchain_extent;
     VkPipelineLayout pipeline_layout;
     VkPipeline pipeline;
+    VkPipeline prepass_pipeline;
     VkShaderModule vert_shader, frag_shader;
+    
+    /* Async compute */
+    VkQueue compute_queue;
+    uint32_t compute_queue_family_index;
+    VkCommandPool compute_cmd_pool;
+    VkCommandBuffer compute_cmd_buffers[MAX_FRAMES];
+    VkSemaphore compute_finished_sem[MAX_FRAMES];
+    ComputePass compute_passes[MAX_COMPUTE_PASSES];
+    uint32_t compute_pass_count;
+    
+    /* GPU timing */
+    VkQueryPool timestamp_pool;
+    uint64_t graphics_timestamp_mask;
+    uint64_t compute_timestamp_mask;
+    uint32_t timestamps_written[MAX_FRAMES];
+    /* Both queues' timestamps can be compared, see timing_collect */
+    bool device_time_domain;
+    bool timing_overlap;
+    bool previous_graphics_valid;
+    uint64_t previous_graphics[2];
+    /* Fragment shader invocations of the main pass, if supported */
+    VkQueryPool overdraw_pool;
+    bool overdraw_written[MAX_FRAMES];
+    /* Size the counted frame was drawn at, it may since have changed */
+    VkExtent2D overdraw_extent[MAX_FRAMES];
+    double gpu_frame_ms;
+    double gpu_compute_ms;
+    GpuTimingStats timing_stats;
+    
+    /* Submission tracking, every graphics submission signals
+     * the next value of a timeline or a fence when timeline
+     * semaphores aren't supported                             */
+    bool timeline_supported;
+    VkSemaphore timeline_sem;
+    VkFence submit_fences[MAX_PENDING_SUBMITS];
+    uint64_t submit_fence_values[MAX_PENDING_SUBMITS];
+    uint32_t submit_fence_head;
+    uint32_t submit_fence_count;
+    uint64_t submit_value;
+    uint64_t completed_value;
+    uint64_t frame_values[MAX_FRAMES];
+    struct DeferredRelease *deferred_releases;
+    uint32_t deferred_release_count;
+    uint32_t deferred_release_capacity;
+    
+    /* Per-frame uniform ring, persistently mapped and split into
+     * one partition per frame slot. Set 0 of every pipeline layout
+     * exposes it as a dynamic uniform buffer and a dynamic storage
+     * buffer so per-object data only needs a new dynamic offset   */
+    VkBuffer uniform_buffer;
+    VkDeviceMemory uniform_memory;
+    uint8_t *uniform_mapped;
+    VkDeviceSize uniform_alignment;
+    VkDeviceSize uniform_range;
+    uint32_t uniform_base;
+    atomic_uint uniform_head;
+    atomic_uint uniform_failed;
+    uint32_t uniform_peak;
+    uint32_t uniform_frames;
+    VkDescriptorPool frame_descriptor_pool;
+    VkDescriptorSetLayout frame_set_layout;
+    VkDescriptorSet frame_set;
+    uint32_t frame_constants_offset;
+    uint64_t start_ticks;
+    
+    /* Bindless resources, set 1 of every pipeline layout when
+     * descriptor indexing is available                          */
+    bool bindless_supported;
+    VkDescriptorPool bindless_descriptor_pool;
+    VkDescriptorSetLayout bindless_set_layout;
+    VkDescriptorSet bindless_set;
+    VkSampler bindless_samplers[BINDLESS_SAMPLER_COUNT];
+    BindlessHeap bindless_heaps[BINDLESS_TYPE_COUNT];
+    
+    /* GPU culling, a compute pass writes the indirect draws of the
+     * frame using bounds uploaded from cull_scene and the depth
+     * pyramid built at the end of the previous frame              */
+    bool gpu_cull_enabled;
+    uint32_t gpu_cull_capacity;
+    VkShaderModule cull_shader, hiz_shader;
+    VkBuffer cull_bounds_buffer;
+    VkDeviceMemory cull_bounds_memory;
+    uint8_t *cull_bounds_mapped;
+    VkDeviceSize cull_bounds_partition;
+    uint64_t cull_bounds_generation[MAX_FRAMES];
+    uint32_t cull_bounds_count[MAX_FRAMES];
+    VkBuffer draw_command_buffer;
+    VkDeviceMemory draw_command_memory;
+    VkBuffer draw_count_buffer;
+    VkDeviceMemory draw_count_memory;
+    VkBuffer placeholder_index_buffer;
+    VkDeviceMemory placeholder_index_memory;
+    VkImage hiz_image;
+    VkDeviceMemory hiz_memory;
+    VkImageView hiz_view;
+    VkImageView hiz_mip_views[MAX_HIZ_LEVELS];
+    VkExtent2D hiz_extent;
+    uint32_t hiz_levels;
+    uint32_t hiz_frames;
+    bool hiz_initialized;
+    VkSampler hiz_sampler;
+    VkDescriptorSetLayout cull_set_layout;
+    VkDescriptorSetLayout hiz_set_layout;
+    VkDescriptorPool cull_descriptor_pool;
+    VkDescriptorSet cull_set;
+    VkDescriptorSet hiz_sets[MAX_HIZ_LEVELS];
+    VkPipelineLayout cull_pipeline_layout;
+    VkPipelineLayout hiz_pipeline_layout;
+    VkPipeline cull_pipeline;
+    VkPipeline hiz_pipeline;
+    float prev_view_proj[16];
+    /* Part of the pyramid the previous frame's render extent covers */
+    float hiz_scale[2];
+    uint32_t graph_draw_commands;
+    uint32_t graph_draw_count;
+    uint32_t graph_hiz;
 };
 
 /* Engine exported functions */
 typedef void (*PFN_test)(Interface *func);
 typedef int (*PFN_renderer_init)(Interface *func);
 typedef void (*PFN_renderer_draw)(Interface *func);
+typedef void (*PFN_renderer_shutdown)(Interface *func);
+typedef bool (*PFN_renderer_add_compute_pass)(Interface *func, PFN_record_compute record, void *data);
+typedef void* (*PFN_renderer_alloc_uniform)(Interface *func, uint32_t size, uint32_t *offset);
+typedef uint32_t (*PFN_renderer_bindless_add_image)(Interface *func, VkImageView image_view, VkImageLayout layout);
+typedef uint32_t (*PFN_renderer_bindless_add_buffer)(Interface *func, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+typedef void (*PFN_renderer_bindless_release)(Interface *func, BindlessType type, uint32_t index);
+typedef uint32_t (*PFN_renderer_add_object)(Interface *func, const float center[3], const float extents[3], float radius);
+typedef void (*PFN_renderer_move_object)(Interface *func, uint32_t object, const float center[3], const float extents[3], float radius);
+typedef void (*PFN_renderer_remove_object)(Interface *func, uint32_t object);
+typedef uint32_t (*PFN_renderer_add_transform)(Interface *func, uint32_t parent,
+    const float position[3], const float rotation[4], const float scale[3]);
+typedef void (*PFN_renderer_set_transform)(Interface *func, uint32_t node,
+    const float position[3], const float rotation[4], const float scale[3]);
+typedef uint32_t (*PFN_renderer_load_mesh)(Interface *func, const char *filename);
+typedef void (*PFN_renderer_unload_mesh)(Interface *func, uint32_t mesh);
+typedef uint32_t (*PFN_renderer_mesh_lod)(Interface *func, uint32_t mesh, const float center[3], float scale);
+typedef void (*PFN_renderer_set_object_mesh)(Interface *func, uint32_t object, uint32_t mesh, uint32_t transform);
+typedef uint32_t (*PFN_renderer_load_texture)(Interface *func, const char *filename);
+typedef void (*PFN_renderer_unload_texture)(Interface *func, uint32_t texture);
+typedef void (*PFN_renderer_request_texture)(Interface *func, uint32_t texture, uint32_t level);
+typedef uint32_t (*PFN_renderer_texture_index)(Interface *func, uint32_t texture);
+typedef void (*PFN_renderer_draw_quads)(Interface *func, const SpriteQuad *quads, uint32_t count);
+typedef void (*PFN_renderer_draw_quad)(Interface *func, const float rect[4], const float uv[4], uint32_t color, uint32_t texture);
+typedef float (*PFN_renderer_draw_text)(Interface *func, float x, float y, float size, uint32_t color, const char *text);
+typedef void (*PFN_renderer_set_camera)(Interface *func, const float view[16], const float projection[16], float near, float far);
+typedef uint32_t (*PFN_renderer_add_light)(Interface *func, const float position[3], float radius, const float color[3], float intensity);
+typedef void (*PFN_renderer_set_light)(Interface *func, uint32_t light, const float position[3], float radius, const float color[3], float intensity);
+typedef void (*PFN_renderer_remove_light)(Interface *func, uint32_t light);
 
 #endif
@@ -0,0 +1,249 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "cooker.h"
+
+/* Offline mesh cooker, turns an OBJ or glTF file into the engine's
+ * native mesh format. Usage: cooker input output [-lods count]      */
+
+bool cook_load_file(const char *filename, void **data, size_t *size)
+{
+    FILE *fp = fopen(filename, "rb");
+    bool result = fp != NULL;
+    long length = 0;
+    
+    *data = NULL;
+    *size = 0;
+    
+    if(result)
+    {
+        fseek(fp, 0, SEEK_END);
+        length = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        
+        *data = malloc(length + 1);
+        result = length >= 0 && *data != NULL && fread(*data, 1, length, fp) == (size_t)length;
+        
+        fclose(fp);
+    }
+    
+    if(result)
+    {
+        ((char*)*data)[length] = '\0';
+        *size = length;
+    }
+    else
+    {
+        free(*data);
+        *data = NULL;
+        printf("Failed to read %s\n", filename);
+    }
+    
+    return result;
+}
+
+void cook_mesh_free(CookMesh *mesh)
+{
+    free(mesh->vertices);
+    free(mesh->indices);
+    *mesh = (CookMesh) {0};
+}
+
+static bool prv_has_extension(const char *filename, const char *extension)
+{
+    size_t length = strlen(filename);
+    size_t extension_length = strlen(extension);
+    
+    return length >= extension_length && strcmp(filename + length - extension_length, extension) == 0;
+}
+
+static float prv_bounding_radius(const CookMesh *mesh)
+{
+    float min[3] = {INFINITY, INFINITY, INFINITY};
+    float max[3] = {-INFINITY, -INFINITY, -INFINITY};
+    float radius = 0.0f;
+    
+    for(uint32_t i = 0; i < mesh->vertex_count; i++)
+    {
+        for(uint32_t j = 0; j < 3; j++)
+        {
+            min[j] = fminf(min[j], mesh->vertices[i].position[j]);
+            max[j] = fmaxf(max[j], mesh->vertices[i].position[j]);
+        }
+    }
+    
+    for(uint32_t j = 0; j < 3 && mesh->vertex_count > 0; j++)
+    {
+        radius += (max[j] - min[j]) * (max[j] - min[j]) * 0.25f;
+    }
+    
+    return sqrtf(radius);
+}
+
+/* Every level after the first is simplified from the full detail
+ * indices, then reordered for the cache like the first. The chain
+ * stops once a level drifts too far from the original shape.      */
+static uint32_t prv_build_lods(CookMesh *mesh, MeshHeader *header, uint32_t max_lods, uint32_t **all_indices)
+{
+    uint32_t *indices = malloc(mesh->index_count * sizeof(uint32_t) * 2);
+    uint32_t *lod = malloc(mesh->index_count * sizeof(uint32_t));
+    uint32_t total = mesh->index_count;
+    uint32_t previous = mesh->index_count;
+    uint32_t count = 0, capacity = mesh->index_count * 2;
+    float error = 0.0f;
+    float max_error = prv_bounding_radius(mesh) * COOK_LOD_MAX_ERROR;
+    bool building = indices != NULL && lod != NULL;
+    void *grown;
+    
+    header->lod_count = 0;
+    
+    if(building)
+    {
+        memcpy(indices, mesh->indices, mesh->index_count * sizeof(uint32_t));
+        header->lods[0] = (MeshLod) {0, mesh->index_count, 0.0f};
+        header->lod_count = 1;
+    }
+    
+    while(building && header->lod_count < max_lods)
+    {
+        count = cook_simplify(mesh, mesh->indices, mesh->index_count, (uint32_t)(previous * COOK_LOD_RATIO) / 3 * 3, lod, &error);
+        building = count > 0 && count <= previous * COOK_LOD_MIN_REDUCTION && error <= max_error;
+        
+        if(building && total + count > capacity)
+        {
+            capacity = (total + count) * 2;
+            grown = realloc(indices, capacity * sizeof(uint32_t));
+            building = grown != NULL;
+            indices = building ? grown : indices;
+        }
+        
+        if(building)
+        {
+            cook_optimize_cache(lod, count, mesh->vertex_count);
+            memcpy(&indices[total], lod, count * sizeof(uint32_t));
+            
+            /* Errors must grow with the level for selection to stay monotonic */
+            error = error > header->lods[header->lod_count - 1].error ? error : header->lods[header->lod_count - 1].error;
+            header->lods[header->lod_count] = (MeshLod) {total, count, error};
+            header->lod_count += 1;
+            total += count;
+            previous = count;
+        }
+    }
+    
+    free(lod);
+    *all_indices = indices;
+    
+    return indices ? total : 0;
+}
+
+static bool prv_write(const char *filename, const MeshHeader *header, const MeshVertex *vertices, const uint32_t *indices)
+{
+    FILE *fp = fopen(filename, "wb");
+    bool result = fp != NULL;
+    
+    if(result)
+    {
+        result = fwrite(header, sizeof(MeshHeader), 1, fp) == 1 &&
+            fwrite(vertices, sizeof(MeshVertex), header->vertex_count, fp) == header->vertex_count &&
+            fwrite(indices, sizeof(uint32_t), header->index_count, fp) == header->index_count;
+        result = fclose(fp) == 0 && result;
+    }
+    
+    if(!result)
+    {
+        printf("Failed to write %s\n", filename);
+    }
+    
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    bool result = argc >= 3;
+    uint32_t max_lods = MESH_MAX_LODS;
+    void *data = NULL;
+    size_t size = 0;
+    CookMesh mesh = {0};
+    MeshHeader header = {0};
+    MeshVertex *vertices = NULL;
+    uint32_t *indices = NULL;
+    uint32_t imported_vertices = 0;
+    float acmr_before = 0.0f;
+    
+    for(int i = 3; result && i < argc; i++)
+    {
+        if(strcmp(argv[i], "-lods") == 0 && i + 1 < argc)
+        {
+            max_lods = (uint32_t)strtoul(argv[++i], NULL, 10);
+            max_lods = max_lods < 1 ? 1 : max_lods > MESH_MAX_LODS ? MESH_MAX_LODS : max_lods;
+        }
+        else
+        {
+            result = false;
+        }
+    }
+    
+    if(!result)
+    {
+        printf("Usage: %s input.obj|input.gltf|input.glb output.mesh [-lods count]\n", argv[0]);
+    }
+    
+    result = result && cook_load_file(argv[1], &data, &size);
+    
+    if(result)
+    {
+        result = prv_has_extension(argv[1], ".obj") ? cook_import_obj(data, size, &mesh) : cook_import_gltf(argv[1], data, size, &mesh);
+    }
+    
+    if(result)
+    {
+        imported_vertices = mesh.vertex_count;
+        cook_weld(&mesh);
+        
+        acmr_before = cook_cache_acmr(mesh.indices, mesh.index_count, mesh.vertex_count);
+        cook_optimize_cache(mesh.indices, mesh.index_count, mesh.vertex_count);
+        cook_optimize_overdraw(&mesh, mesh.indices, mesh.index_count);
+        cook_optimize_fetch(&mesh);
+        
+        printf("%u triangles, %u vertices welded to %u\n", mesh.index_count / 3, imported_vertices, mesh.vertex_count);
+        printf("ACMR %.3f before, %.3f after reordering for a %u entry cache\n",
+            acmr_before, cook_cache_acmr(mesh.indices, mesh.index_count, mesh.vertex_count), COOK_CACHE_SIZE);
+        
+        header.index_count = prv_build_lods(&mesh, &header, max_lods, &indices);
+        vertices = malloc(mesh.vertex_count * sizeof(MeshVertex));
+        result = header.index_count > 0 && vertices != NULL;
+    }
+    
+    if(result)
+    {
+        header.magic = MESH_MAGIC;
+        header.version = MESH_VERSION;
+        header.vertex_count = mesh.vertex_count;
+        header.vertex_stride = sizeof(MeshVertex);
+        cook_quantize(&mesh, &header, vertices);
+        
+        for(uint32_t i = 0; i < header.lod_count; i++)
+        {
+            printf("LOD %u: %u triangles, error %g\n", i, header.lods[i].index_count / 3, header.lods[i].error);
+        }
+        
+        result = prv_write(argv[2], &header, vertices, indices);
+    }
+    
+    if(result)
+    {
+        printf("Wrote %s, %zu bytes\n", argv[2],
+            sizeof(MeshHeader) + header.vertex_count * sizeof(MeshVertex) + header.index_count * sizeof(uint32_t));
+    }
+    
+    cook_mesh_free(&mesh);
+    free(data);
+    free(vertices);
+    free(indices);
+    
+    return result ? 0 : 1;
+}
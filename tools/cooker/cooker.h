@@ -0,0 +1,60 @@
+#ifndef COOKER_H
+#define COOKER_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mesh.h"
+
+/* Full precision vertex used until the mesh is quantized */
+typedef struct
+{
+    float position[3];
+    float normal[3];
+    float uv[2];
+} CookVertex;
+
+typedef struct
+{
+    CookVertex *vertices;
+    uint32_t vertex_count;
+    uint32_t *indices;
+    uint32_t index_count;
+} CookMesh;
+
+/* Post transform cache size the reordering and statistics assume */
+#define COOK_CACHE_SIZE 16
+/* Each level aims for this fraction of the previous level's triangles */
+#define COOK_LOD_RATIO 0.5f
+/* A level that cannot get below this fraction of the previous one ends the chain */
+#define COOK_LOD_MIN_REDUCTION 0.85f
+/* A collapse may turn no triangle further than this cosine away from
+ * the full detail triangle it came from                              */
+#define COOK_FLIP_COS 0.5
+/* The chain ends at a level whose error exceeds this fraction of the
+ * mesh's bounding radius, past it the shape is no longer the same    */
+#define COOK_LOD_MAX_ERROR 0.25f
+
+/* Loaded data is always followed by a zero byte so text can be parsed in place */
+bool cook_load_file(const char *filename, void **data, size_t *size);
+uint32_t cook_hash(const void *data, size_t size);
+void cook_mesh_free(CookMesh *mesh);
+
+/* Triangulated, with missing normals generated */
+bool cook_import_obj(const char *text, size_t size, CookMesh *mesh);
+bool cook_import_gltf(const char *filename, const void *data, size_t size, CookMesh *mesh);
+
+void cook_weld(CookMesh *mesh);
+void cook_optimize_cache(uint32_t *indices, uint32_t index_count, uint32_t vertex_count);
+void cook_optimize_overdraw(const CookMesh *mesh, uint32_t *indices, uint32_t index_count);
+void cook_optimize_fetch(CookMesh *mesh);
+float cook_cache_acmr(const uint32_t *indices, uint32_t index_count, uint32_t vertex_count);
+
+/* Writes a simplified copy of the indices with at most target_count
+ * indices into dst and returns its count, error receives the largest
+ * distance any collapse moved the surface                           */
+uint32_t cook_simplify(const CookMesh *mesh, const uint32_t *indices, uint32_t index_count,
+    uint32_t target_count, uint32_t *dst, float *error);
+
+void cook_quantize(const CookMesh *mesh, MeshHeader *header, MeshVertex *vertices);
+
+#endif
@@ -0,0 +1,840 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "cooker.h"
+
+#define JSON_MAX_DEPTH 64
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+#define GLB_MAGIC 0x46546C67
+#define GLB_HEADER_SIZE 12
+#define GLB_CHUNK_JSON 0x4E4F534A
+#define GLB_CHUNK_BIN 0x004E4942
+
+#define GLTF_BYTE 5121
+#define GLTF_SHORT 5123
+#define GLTF_UINT 5125
+#define GLTF_FLOAT 5126
+#define GLTF_TRIANGLES 4
+
+typedef enum
+{
+    JSON_OBJECT,
+    JSON_ARRAY,
+    JSON_STRING,
+    JSON_PRIMITIVE
+} JsonType;
+
+/* Tokens are stored in document order, next is the first token after
+ * this one's children so siblings can be walked without recursion.
+ * Strings point at their contents without the quotes and escapes are
+ * left as is, glTF only needs them for keys and uris.                */
+typedef struct
+{
+    JsonType type;
+    uint32_t start;
+    uint32_t end;
+    uint32_t size;
+    uint32_t next;
+} JsonToken;
+
+typedef struct
+{
+    const char *text;
+    size_t length;
+    size_t position;
+    JsonToken *tokens;
+    uint32_t count;
+    uint32_t capacity;
+} JsonParser;
+
+typedef struct
+{
+    const char *json;
+    JsonToken *tokens;
+    uint8_t **buffers;
+    size_t *buffer_sizes;
+    uint32_t buffer_count;
+} Gltf;
+
+/* Grows an array of element_size items to hold at least count */
+static bool prv_reserve(void **array, uint32_t *capacity, uint32_t count, size_t element_size)
+{
+    bool result = count <= *capacity;
+    uint32_t grown_capacity = *capacity ? *capacity : 256;
+    void *grown;
+    
+    if(!result)
+    {
+        while(grown_capacity < count)
+        {
+            grown_capacity *= 2;
+        }
+        
+        grown = realloc(*array, grown_capacity * element_size);
+        result = grown != NULL;
+        
+        if(result)
+        {
+            *array = grown;
+            *capacity = grown_capacity;
+        }
+    }
+    
+    return result;
+}
+
+/* Area weighted face normals summed over every vertex at a position */
+static void prv_generate_normals(CookMesh *mesh)
+{
+    uint32_t table_size = 1;
+    uint32_t *table = NULL;
+    uint32_t *owner = malloc(mesh->vertex_count * sizeof(uint32_t));
+    float *sums = calloc(mesh->vertex_count, 3 * sizeof(float));
+    const float *a, *b, *c;
+    float ab[3], ac[3], normal[3], length;
+    uint32_t slot;
+    float *sum;
+    
+    while(table_size < mesh->vertex_count * 2)
+    {
+        table_size *= 2;
+    }
+    
+    table = malloc(table_size * sizeof(uint32_t));
+    
+    if(table && owner && sums)
+    {
+        memset(table, 0xff, table_size * sizeof(uint32_t));
+        
+        /* First vertex at each position owns the sum */
+        for(uint32_t i = 0; i < mesh->vertex_count; i++)
+        {
+            slot = cook_hash(mesh->vertices[i].position, sizeof(float) * 3) & (table_size - 1);
+            
+            while(table[slot] != UINT32_MAX && memcmp(mesh->vertices[table[slot]].position, mesh->vertices[i].position, sizeof(float) * 3) != 0)
+            {
+                slot = (slot + 1) & (table_size - 1);
+            }
+            
+            table[slot] = table[slot] == UINT32_MAX ? i : table[slot];
+            owner[i] = table[slot];
+        }
+        
+        for(uint32_t i = 0; i + 2 < mesh->index_count; i += 3)
+        {
+            a = mesh->vertices[mesh->indices[i + 0]].position;
+            b = mesh->vertices[mesh->indices[i + 1]].position;
+            c = mesh->vertices[mesh->indices[i + 2]].position;
+            
+            for(uint32_t j = 0; j < 3; j++)
+            {
+                ab[j] = b[j] - a[j];
+                ac[j] = c[j] - a[j];
+            }
+            
+            normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+            normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+            normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+            
+            for(uint32_t j = 0; j < 3; j++)
+            {
+                sum = &sums[owner[mesh->indices[i + j]] * 3];
+                sum[0] += normal[0];
+                sum[1] += normal[1];
+                sum[2] += normal[2];
+            }
+        }
+        
+        for(uint32_t i = 0; i < mesh->vertex_count; i++)
+        {
+            sum = &sums[owner[i] * 3];
+            length = sqrtf(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+            length = length > 0.0f ? 1.0f / length : 0.0f;
+            
+            mesh->vertices[i].normal[0] = sum[0] * length;
+            mesh->vertices[i].normal[1] = sum[1] * length;
+            mesh->vertices[i].normal[2] = sum[2] * length;
+        }
+    }
+    
+    free(table);
+    free(owner);
+    free(sums);
+}
+
+/* Resolves a one based, or negative relative, OBJ index */
+static bool prv_obj_index(long index, uint32_t count, uint32_t *resolved)
+{
+    bool result = index != 0 && (index > 0 ? (unsigned long)index <= count : (unsigned long)-index <= count);
+    
+    if(result)
+    {
+        *resolved = index > 0 ? (uint32_t)(index - 1) : (uint32_t)(count + index);
+    }
+    
+    return result;
+}
+
+/* Only positions, normals, uvs and faces are read, everything else
+ * in the file is skipped. Faces are triangulated as fans.           */
+bool cook_import_obj(const char *text, size_t size, CookMesh *mesh)
+{
+    bool result = true;
+    bool missing_normals = false;
+    float *positions = NULL, *normals = NULL, *uvs = NULL;
+    uint32_t position_count = 0, normal_count = 0, uv_count = 0;
+    uint32_t position_capacity = 0, normal_capacity = 0, uv_capacity = 0;
+    uint32_t vertex_capacity = 0, index_capacity = 0;
+    uint32_t face_first, face_count, resolved;
+    const char *line = text;
+    const char *end = text + size;
+    char *cursor;
+    long value;
+    CookVertex vertex;
+    
+    *mesh = (CookMesh) {0};
+    
+    while(result && line < end)
+    {
+        if(line[0] == 'v' && line[1] == ' ')
+        {
+            result = prv_reserve((void**)&positions, &position_capacity, (position_count + 1) * 3, sizeof(float));
+            
+            if(result)
+            {
+                cursor = (char*)line + 2;
+                
+                for(uint32_t i = 0; i < 3; i++)
+                {
+                    positions[position_count * 3 + i] = strtof(cursor, &cursor);
+                }
+                
+                position_count += 1;
+            }
+        }
+        else if(line[0] == 'v' && line[1] == 'n' && line[2] == ' ')
+        {
+            result = prv_reserve((void**)&normals, &normal_capacity, (normal_count + 1) * 3, sizeof(float));
+            
+            if(result)
+            {
+                cursor = (char*)line + 3;
+                
+                for(uint32_t i = 0; i < 3; i++)
+                {
+                    normals[normal_count * 3 + i] = strtof(cursor, &cursor);
+                }
+                
+                normal_count += 1;
+            }
+        }
+        else if(line[0] == 'v' && line[1] == 't' && line[2] == ' ')
+        {
+            result = prv_reserve((void**)&uvs, &uv_capacity, (uv_count + 1) * 2, sizeof(float));
+            
+            if(result)
+            {
+                cursor = (char*)line + 3;
+                uvs[uv_count * 2 + 0] = strtof(cursor, &cursor);
+                /* OBJ puts the origin at the bottom left */
+                uvs[uv_count * 2 + 1] = 1.0f - strtof(cursor, &cursor);
+                uv_count += 1;
+            }
+        }
+        else if(line[0] == 'f' && line[1] == ' ')
+        {
+            cursor = (char*)line + 2;
+            face_first = mesh->vertex_count;
+            face_count = 0;
+            
+            while(result && *cursor != '\n' && *cursor != '\0')
+            {
+                value = strtol(cursor, &cursor, 10);
+                
+                if(value != 0)
+                {
+                    vertex = (CookVertex) {0};
+                    result = prv_obj_index(value, position_count, &resolved);
+                    
+                    if(result)
+                    {
+                        memcpy(vertex.position, &positions[resolved * 3], sizeof(vertex.position));
+                    }
+                    
+                    if(result && *cursor == '/')
+                    {
+                        cursor += 1;
+                        value = *cursor == '/' ? 0 : strtol(cursor, &cursor, 10);
+                        
+                        if(value != 0 && (result = prv_obj_index(value, uv_count, &resolved)))
+                        {
+                            memcpy(vertex.uv, &uvs[resolved * 2], sizeof(vertex.uv));
+                        }
+                    }
+                    
+                    if(result && *cursor == '/')
+                    {
+                        cursor += 1;
+                        value = strtol(cursor, &cursor, 10);
+                        
+                        if(value != 0 && (result = prv_obj_index(value, normal_count, &resolved)))
+                        {
+                            memcpy(vertex.normal, &normals[resolved * 3], sizeof(vertex.normal));
+                        }
+                        else
+                        {
+                            missing_normals = true;
+                        }
+                    }
+                    else
+                    {
+                        missing_normals = true;
+                    }
+                    
+                    if(result)
+                    {
+                        result = prv_reserve((void**)&mesh->vertices, &vertex_capacity, mesh->vertex_count + 1, sizeof(CookVertex));
+                    }
+                    
+                    if(result)
+                    {
+                        mesh->vertices[mesh->vertex_count++] = vertex;
+                        face_count += 1;
+                    }
+                }
+                else
+                {
+                    /* Whitespace, a carriage return or something unreadable */
+                    cursor += 1;
+                }
+            }
+            
+            for(uint32_t i = 2; result && i < face_count; i++)
+            {
+                result = prv_reserve((void**)&mesh->indices, &index_capacity, mesh->index_count + 3, sizeof(uint32_t));
+                
+                if(result)
+                {
+                    mesh->indices[mesh->index_count++] = face_first;
+                    mesh->indices[mesh->index_count++] = face_first + i - 1;
+                    mesh->indices[mesh->index_count++] = face_first + i;
+                }
+            }
+        }
+        
+        while(line < end && *line != '\n')
+        {
+            line += 1;
+        }
+        
+        line += 1;
+    }
+    
+    if(result && missing_normals)
+    {
+        prv_generate_normals(mesh);
+    }
+    
+    if(!result || mesh->index_count == 0)
+    {
+        printf("Failed to read OBJ, %s\n", result ? "no faces" : "bad face index or out of memory");
+        cook_mesh_free(mesh);
+        result = false;
+    }
+    
+    free(positions);
+    free(normals);
+    free(uvs);
+    
+    return result;
+}
+
+static void prv_json_skip_space(JsonParser *parser)
+{
+    while(parser->position < parser->length && (parser->text[parser->position] == ' ' || parser->text[parser->position] == '\t' ||
+        parser->text[parser->position] == '\r' || parser->text[parser->position] == '\n'))
+    {
+        parser->position += 1;
+    }
+}
+
+static bool prv_json_value(JsonParser *parser, uint32_t depth)
+{
+    bool result = depth < JSON_MAX_DEPTH;
+    uint32_t token = parser->count;
+    char open;
+    char close;
+    
+    prv_json_skip_space(parser);
+    result = result && parser->position < parser->length &&
+        prv_reserve((void**)&parser->tokens, &parser->capacity, parser->count + 1, sizeof(JsonToken));
+    
+    if(result)
+    {
+        open = parser->text[parser->position];
+        parser->count += 1;
+        parser->tokens[token] = (JsonToken) {JSON_PRIMITIVE, (uint32_t)parser->position, 0, 0, 0};
+        
+        if(open == '{' || open == '[')
+        {
+            close = open == '{' ? '}' : ']';
+            parser->tokens[token].type = open == '{' ? JSON_OBJECT : JSON_ARRAY;
+            parser->position += 1;
+            prv_json_skip_space(parser);
+            
+            while(result && parser->position < parser->length && parser->text[parser->position] != close)
+            {
+                /* Keys are parsed as string tokens before their value */
+                result = prv_json_value(parser, depth + 1);
+                
+                if(result && open == '{')
+                {
+                    prv_json_skip_space(parser);
+                    result = parser->position < parser->length && parser->text[parser->position] == ':';
+                    parser->position += 1;
+                    result = result && prv_json_value(parser, depth + 1);
+                }
+                
+                parser->tokens[token].size += 1;
+                prv_json_skip_space(parser);
+                
+                if(result && parser->position < parser->length && parser->text[parser->position] == ',')
+                {
+                    parser->position += 1;
+                    prv_json_skip_space(parser);
+                }
+            }
+            
+            result = result && parser->position < parser->length;
+            parser->position += 1;
+        }
+        else if(open == '"')
+        {
+            parser->tokens[token].type = JSON_STRING;
+            parser->tokens[token].start += 1;
+            parser->position += 1;
+            
+            while(parser->position < parser->length && parser->text[parser->position] != '"')
+            {
+                parser->position += parser->text[parser->position] == '\\' ? 2 : 1;
+            }
+            
+            result = parser->position < parser->length;
+            parser->tokens[token].end = (uint32_t)parser->position;
+            parser->position += 1;
+        }
+        else
+        {
+            while(parser->position < parser->length && !strchr(",]} \t\r\n", parser->text[parser->position]))
+            {
+                parser->position += 1;
+            }
+            
+            result = parser->tokens[token].start != parser->position;
+            parser->tokens[token].end = (uint32_t)parser->position;
+        }
+        
+        if(parser->tokens[token].type == JSON_OBJECT || parser->tokens[token].type == JSON_ARRAY)
+        {
+            parser->tokens[token].end = (uint32_t)parser->position;
+        }
+        
+        parser->tokens[token].next = parser->count;
+    }
+    
+    return result;
+}
+
+/* Value of key in an object token, UINT32_MAX when it is missing */
+static uint32_t prv_json_key(const Gltf *gltf, uint32_t object, const char *key)
+{
+    uint32_t found = UINT32_MAX;
+    uint32_t child = object + 1;
+    size_t length = strlen(key);
+    const JsonToken *token;
+    
+    if(object != UINT32_MAX && gltf->tokens[object].type == JSON_OBJECT)
+    {
+        for(uint32_t i = 0; i < gltf->tokens[object].size && found == UINT32_MAX; i++)
+        {
+            token = &gltf->tokens[child];
+            
+            if(token->end - token->start == length && strncmp(gltf->json + token->start, key, length) == 0)
+            {
+                found = token->next;
+            }
+            
+            child = gltf->tokens[token->next].next;
+        }
+    }
+    
+    return found;
+}
+
+static uint32_t prv_json_element(const Gltf *gltf, uint32_t array, uint32_t index)
+{
+    uint32_t found = UINT32_MAX;
+    uint32_t child = array + 1;
+    
+    if(array != UINT32_MAX && gltf->tokens[array].type == JSON_ARRAY && index < gltf->tokens[array].size)
+    {
+        for(uint32_t i = 0; i < index; i++)
+        {
+            child = gltf->tokens[child].next;
+        }
+        
+        found = child;
+    }
+    
+    return found;
+}
+
+static long prv_json_int(const Gltf *gltf, uint32_t token, long fallback)
+{
+    return token != UINT32_MAX && gltf->tokens[token].type == JSON_PRIMITIVE ? strtol(gltf->json + gltf->tokens[token].start, NULL, 10) : fallback;
+}
+
+static bool prv_decode_base64(const char *text, size_t length, uint8_t **data, size_t *size)
+{
+    uint32_t bits = 0;
+    uint32_t bit_count = 0;
+    const char *digit;
+    static const char *digits = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    
+    *size = 0;
+    *data = malloc(length / 4 * 3 + 3);
+    
+    for(size_t i = 0; *data && i < length && text[i] != '='; i++)
+    {
+        digit = strchr(digits, text[i]);
+        
+        if(digit && *digit)
+        {
+            bits = bits << 6 | (uint32_t)(digit - digits);
+            bit_count += 6;
+            
+            if(bit_count >= 8)
+            {
+                bit_count -= 8;
+                (*data)[(*size)++] = (uint8_t)(bits >> bit_count);
+            }
+        }
+    }
+    
+    return *data != NULL;
+}
+
+static bool prv_load_buffers(Gltf *gltf, const char *filename, const uint8_t *bin, size_t bin_size)
+{
+    bool result = true;
+    uint32_t buffers = prv_json_key(gltf, 0, "buffers");
+    uint32_t buffer, uri;
+    const char *comma;
+    const char *slash = strrchr(filename, '/');
+    size_t directory = slash ? (size_t)(slash - filename + 1) : 0;
+    char path[4096];
+    void *loaded;
+    
+    gltf->buffer_count = buffers != UINT32_MAX ? gltf->tokens[buffers].size : 0;
+    gltf->buffers = calloc(gltf->buffer_count + 1, sizeof(uint8_t*));
+    gltf->buffer_sizes = calloc(gltf->buffer_count + 1, sizeof(size_t));
+    result = gltf->buffers && gltf->buffer_sizes;
+    
+    for(uint32_t i = 0; result && i < gltf->buffer_count; i++)
+    {
+        buffer = prv_json_element(gltf, buffers, i);
+        uri = prv_json_key(gltf, buffer, "uri");
+        
+        if(uri == UINT32_MAX)
+        {
+            /* The binary chunk of a .glb, copied so every buffer is freed alike */
+            gltf->buffers[i] = malloc(bin_size + 1);
+            result = bin != NULL && gltf->buffers[i] != NULL;
+            
+            if(result)
+            {
+                memcpy(gltf->buffers[i], bin, bin_size);
+                gltf->buffer_sizes[i] = bin_size;
+            }
+        }
+        else if(strncmp(gltf->json + gltf->tokens[uri].start, "data:", 5) == 0)
+        {
+            /* Only base64 data uris are valid in glTF */
+            comma = memchr(gltf->json + gltf->tokens[uri].start, ',', gltf->tokens[uri].end - gltf->tokens[uri].start);
+            result = comma != NULL && comma - (gltf->json + gltf->tokens[uri].start) >= 7 && strncmp(comma - 7, ";base64", 7) == 0;
+            result = result && prv_decode_base64(
+                comma + 1, gltf->json + gltf->tokens[uri].end - comma - 1, &gltf->buffers[i], &gltf->buffer_sizes[i]);
+        }
+        else
+        {
+            result = directory + gltf->tokens[uri].end - gltf->tokens[uri].start < sizeof(path);
+            
+            if(result)
+            {
+                memcpy(path, filename, directory);
+                memcpy(path + directory, gltf->json + gltf->tokens[uri].start, gltf->tokens[uri].end - gltf->tokens[uri].start);
+                path[directory + gltf->tokens[uri].end - gltf->tokens[uri].start] = '\0';
+                
+                result = cook_load_file(path, &loaded, &gltf->buffer_sizes[i]);
+                gltf->buffers[i] = loaded;
+            }
+        }
+        
+        if(!result)
+        {
+            printf("Failed to load glTF buffer %u\n", i);
+        }
+    }
+    
+    return result;
+}
+
+/* Returns a pointer to element 0 of an accessor and its stride, after
+ * checking every element lies inside its buffer                       */
+static const uint8_t *prv_accessor(const Gltf *gltf, uint32_t accessor_index, uint32_t *count,
+    long *component_type, uint32_t components, size_t *stride)
+{
+    const uint8_t *data = NULL;
+    uint32_t accessor = prv_json_element(gltf, prv_json_key(gltf, 0, "accessors"), accessor_index);
+    uint32_t view = prv_json_element(gltf, prv_json_key(gltf, 0, "bufferViews"), (uint32_t)prv_json_int(gltf, prv_json_key(gltf, accessor, "bufferView"), -1));
+    long buffer = prv_json_int(gltf, prv_json_key(gltf, view, "buffer"), -1);
+    size_t offset = prv_json_int(gltf, prv_json_key(gltf, accessor, "byteOffset"), 0) + prv_json_int(gltf, prv_json_key(gltf, view, "byteOffset"), 0);
+    size_t component_size;
+    
+    *component_type = prv_json_int(gltf, prv_json_key(gltf, accessor, "componentType"), 0);
+    *count = (uint32_t)prv_json_int(gltf, prv_json_key(gltf, accessor, "count"), 0);
+    component_size = *component_type == GLTF_BYTE ? 1 : *component_type == GLTF_SHORT ? 2 : 4;
+    *stride = prv_json_int(gltf, prv_json_key(gltf, view, "byteStride"), 0);
+    *stride = *stride ? *stride : component_size * components;
+    
+    if(view != UINT32_MAX && buffer >= 0 && (uint32_t)buffer < gltf->buffer_count && *count > 0 &&
+        offset + *stride * (*count - 1) + component_size * components <= gltf->buffer_sizes[buffer])
+    {
+        data = gltf->buffers[buffer] + offset;
+    }
+    
+    return data;
+}
+
+static float prv_component(const uint8_t *data, long component_type, uint32_t index)
+{
+    float value;
+    uint16_t short_value;
+    
+    if(component_type == GLTF_FLOAT)
+    {
+        memcpy(&value, data + index * 4, sizeof(float));
+    }
+    else if(component_type == GLTF_SHORT)
+    {
+        memcpy(&short_value, data + index * 2, sizeof(uint16_t));
+        value = short_value / 65535.0f;
+    }
+    else
+    {
+        value = data[index] / 255.0f;
+    }
+    
+    return value;
+}
+
+/* Reads components of an accessor into one field of every new vertex */
+static bool prv_read_attribute(const Gltf *gltf, uint32_t attributes, const char *name, uint32_t components,
+    CookMesh *mesh, uint32_t first, uint32_t vertex_count, size_t field)
+{
+    uint32_t accessor = prv_json_key(gltf, attributes, name);
+    bool result = accessor != UINT32_MAX;
+    const uint8_t *data = NULL;
+    uint32_t count = 0;
+    long component_type = 0;
+    size_t stride = 0;
+    
+    if(result)
+    {
+        data = prv_accessor(gltf, (uint32_t)prv_json_int(gltf, accessor, -1), &count, &component_type, components, &stride);
+        result = data != NULL && count == vertex_count;
+    }
+    
+    for(uint32_t i = 0; result && i < count; i++)
+    {
+        for(uint32_t j = 0; j < components; j++)
+        {
+            ((float*)((uint8_t*)&mesh->vertices[first + i] + field))[j] = prv_component(data + stride * i, component_type, j);
+        }
+    }
+    
+    return result;
+}
+
+static bool prv_import_primitive(const Gltf *gltf, uint32_t primitive, CookMesh *mesh,
+    uint32_t *vertex_capacity, uint32_t *index_capacity, bool *missing_normals)
+{
+    bool result = true;
+    uint32_t attributes = prv_json_key(gltf, primitive, "attributes");
+    uint32_t indices = prv_json_key(gltf, primitive, "indices");
+    uint32_t first = mesh->vertex_count;
+    uint32_t count = 0, index_count = 0;
+    long component_type = 0;
+    size_t stride = 0;
+    const uint8_t *data = NULL;
+    uint32_t value;
+    uint16_t short_value;
+    
+    if(result)
+    {
+        result = prv_accessor(gltf, (uint32_t)prv_json_int(gltf, prv_json_key(gltf, attributes, "POSITION"), -1), &count, &component_type, 3, &stride) != NULL;
+        result = result && component_type == GLTF_FLOAT &&
+            prv_reserve((void**)&mesh->vertices, vertex_capacity, first + count, sizeof(CookVertex));
+    }
+    
+    if(result)
+    {
+        memset(&mesh->vertices[first], 0, count * sizeof(CookVertex));
+        mesh->vertex_count += count;
+        result = prv_read_attribute(gltf, attributes, "POSITION", 3, mesh, first, count, offsetof(CookVertex, position));
+    }
+    
+    if(result && !prv_read_attribute(gltf, attributes, "NORMAL", 3, mesh, first, count, offsetof(CookVertex, normal)))
+    {
+        *missing_normals = true;
+    }
+    
+    if(result)
+    {
+        prv_read_attribute(gltf, attributes, "TEXCOORD_0", 2, mesh, first, count, offsetof(CookVertex, uv));
+    }
+    
+    if(result && indices != UINT32_MAX)
+    {
+        data = prv_accessor(gltf, (uint32_t)prv_json_int(gltf, indices, -1), &index_count, &component_type, 1, &stride);
+        result = data != NULL;
+    }
+    else
+    {
+        index_count = count;
+    }
+    
+    result = result && prv_reserve((void**)&mesh->indices, index_capacity, mesh->index_count + index_count, sizeof(uint32_t));
+    
+    for(uint32_t i = 0; result && i < index_count - index_count % 3; i++)
+    {
+        value = i;
+        
+        if(data && component_type == GLTF_UINT)
+        {
+            memcpy(&value, data + stride * i, sizeof(uint32_t));
+        }
+        else if(data && component_type == GLTF_SHORT)
+        {
+            memcpy(&short_value, data + stride * i, sizeof(uint16_t));
+            value = short_value;
+        }
+        else if(data)
+        {
+            value = data[stride * i];
+        }
+        
+        result = value < count;
+        mesh->indices[mesh->index_count++] = first + value;
+    }
+    
+    return result;
+}
+
+/* Reads every triangle primitive of the first mesh in a .gltf or .glb.
+ * Node transforms are not applied, the mesh is cooked in its own space. */
+bool cook_import_gltf(const char *filename, const void *data, size_t size, CookMesh *mesh)
+{
+    bool result = true;
+    JsonParser parser = {0};
+    Gltf gltf = {0};
+    const uint8_t *bytes = data;
+    const uint8_t *bin = NULL;
+    size_t bin_size = 0;
+    uint32_t chunk[2];
+    size_t offset;
+    uint32_t vertex_capacity = 0, index_capacity = 0;
+    uint32_t primitives, primitive;
+    bool missing_normals = false;
+    
+    *mesh = (CookMesh) {0};
+    parser.text = data;
+    parser.length = size;
+    
+    if(size >= GLB_HEADER_SIZE && memcmp(bytes, &(uint32_t) {GLB_MAGIC}, sizeof(uint32_t)) == 0)
+    {
+        /* Chunks follow the header, JSON first and binary second */
+        parser.text = NULL;
+        offset = GLB_HEADER_SIZE;
+        
+        while(offset + sizeof(chunk) <= size && offset + sizeof(chunk) + ((const uint32_t*)(bytes + offset))[0] <= size)
+        {
+            memcpy(chunk, bytes + offset, sizeof(chunk));
+            
+            if(chunk[1] == GLB_CHUNK_JSON && !parser.text)
+            {
+                parser.text = (const char*)bytes + offset + sizeof(chunk);
+                parser.length = chunk[0];
+            }
+            else if(chunk[1] == GLB_CHUNK_BIN && !bin)
+            {
+                bin = bytes + offset + sizeof(chunk);
+                bin_size = chunk[0];
+            }
+            
+            offset += sizeof(chunk) + chunk[0];
+        }
+        
+        result = parser.text != NULL;
+    }
+    
+    result = result && prv_json_value(&parser, 0) && parser.tokens[0].type == JSON_OBJECT;
+    gltf.json = parser.text;
+    gltf.tokens = parser.tokens;
+    
+    if(result)
+    {
+        result = prv_load_buffers(&gltf, filename, bin, bin_size);
+    }
+    
+    primitives = prv_json_key(&gltf, prv_json_element(&gltf, prv_json_key(&gltf, 0, "meshes"), 0), "primitives");
+    result = result && primitives != UINT32_MAX;
+    
+    /* Points and lines have nothing to cook and are skipped */
+    for(uint32_t i = 0; result && i < gltf.tokens[primitives].size; i++)
+    {
+        primitive = prv_json_element(&gltf, primitives, i);
+        
+        if(prv_json_int(&gltf, prv_json_key(&gltf, primitive, "mode"), GLTF_TRIANGLES) == GLTF_TRIANGLES)
+        {
+            result = prv_import_primitive(&gltf, primitive, mesh, &vertex_capacity, &index_capacity, &missing_normals);
+        }
+    }
+    
+    if(result && missing_normals)
+    {
+        prv_generate_normals(mesh);
+    }
+    
+    if(!result || mesh->index_count == 0)
+    {
+        printf("Failed to read glTF, %s\n", result ? "no triangles" : "unsupported or malformed file");
+        cook_mesh_free(mesh);
+        result = false;
+    }
+    
+    for(uint32_t i = 0; i < gltf.buffer_count; i++)
+    {
+        free(gltf.buffers[i]);
+    }
+    
+    free(gltf.buffers);
+    free(gltf.buffer_sizes);
+    free(parser.tokens);
+    
+    return result;
+}
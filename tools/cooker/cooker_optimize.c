@@ -0,0 +1,573 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "cooker.h"
+
+/* Scoring constants from Forsyth's linear speed vertex cache optimisation */
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_TRIANGLE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+/* A cluster is cut once its own miss ratio is within this factor of
+ * the whole mesh, so sorting clusters costs little cache efficiency  */
+#define OVERDRAW_THRESHOLD 1.05f
+#define OVERDRAW_MIN_CLUSTER 16
+
+typedef struct
+{
+    float key;
+    uint32_t first;
+    uint32_t count;
+} Cluster;
+
+uint32_t cook_hash(const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    uint32_t hash = 2166136261u;
+    
+    for(size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    
+    return hash;
+}
+
+/* Merges bitwise identical vertices and drops triangles that collapse */
+void cook_weld(CookMesh *mesh)
+{
+    uint32_t table_size = 1;
+    uint32_t *table = NULL;
+    uint32_t *remap = malloc(mesh->vertex_count * sizeof(uint32_t));
+    uint32_t unique = 0, index_count = 0;
+    uint32_t slot, a, b, c;
+    CookVertex *vertex;
+    
+    while(table_size < mesh->vertex_count * 2)
+    {
+        table_size *= 2;
+    }
+    
+    table = malloc(table_size * sizeof(uint32_t));
+    
+    if(table && remap)
+    {
+        memset(table, 0xff, table_size * sizeof(uint32_t));
+        
+        for(uint32_t i = 0; i < mesh->vertex_count; i++)
+        {
+            vertex = &mesh->vertices[i];
+            
+            /* Negative zero would otherwise hash apart from zero */
+            for(uint32_t j = 0; j < sizeof(CookVertex) / sizeof(float); j++)
+            {
+                ((float*)vertex)[j] += 0.0f;
+            }
+            
+            slot = cook_hash(vertex, sizeof(CookVertex)) & (table_size - 1);
+            
+            while(table[slot] != UINT32_MAX && memcmp(&mesh->vertices[table[slot]], vertex, sizeof(CookVertex)) != 0)
+            {
+                slot = (slot + 1) & (table_size - 1);
+            }
+            
+            if(table[slot] == UINT32_MAX)
+            {
+                mesh->vertices[unique] = *vertex;
+                table[slot] = unique;
+                unique += 1;
+            }
+            
+            remap[i] = table[slot];
+        }
+        
+        for(uint32_t i = 0; i + 2 < mesh->index_count; i += 3)
+        {
+            a = remap[mesh->indices[i + 0]];
+            b = remap[mesh->indices[i + 1]];
+            c = remap[mesh->indices[i + 2]];
+            
+            if(a != b && b != c && c != a)
+            {
+                mesh->indices[index_count++] = a;
+                mesh->indices[index_count++] = b;
+                mesh->indices[index_count++] = c;
+            }
+        }
+        
+        mesh->vertex_count = unique;
+        mesh->index_count = index_count;
+    }
+    
+    free(table);
+    free(remap);
+}
+
+/* Misses per triangle in a FIFO cache of COOK_CACHE_SIZE, 3 is the
+ * worst case and 0.5 the best a regular grid can reach             */
+float cook_cache_acmr(const uint32_t *indices, uint32_t index_count, uint32_t vertex_count)
+{
+    uint32_t *stamps = calloc(vertex_count, sizeof(uint32_t));
+    uint32_t time = COOK_CACHE_SIZE + 1;
+    uint32_t misses = 0;
+    
+    for(uint32_t i = 0; stamps && i < index_count; i++)
+    {
+        if(time - stamps[indices[i]] > COOK_CACHE_SIZE)
+        {
+            stamps[indices[i]] = time;
+            time += 1;
+            misses += 1;
+        }
+    }
+    
+    free(stamps);
+    
+    return index_count ? misses * 3.0f / index_count : 0.0f;
+}
+
+static float prv_vertex_score(int32_t cache_position, uint32_t valence)
+{
+    float score = 0.0f;
+    
+    if(valence == 0)
+    {
+        score = -1.0f;
+    }
+    else
+    {
+        if(cache_position >= 0 && cache_position < 3)
+        {
+            /* The triangle just drawn, no reason to prefer it over the rest */
+            score = LAST_TRIANGLE_SCORE;
+        }
+        else if(cache_position >= 0)
+        {
+            score = powf(1.0f - (cache_position - 3) / (float)(COOK_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+        }
+        
+        score += VALENCE_BOOST_SCALE * powf((float)valence, -VALENCE_BOOST_POWER);
+    }
+    
+    return score;
+}
+
+/* Greedily emits the triangle whose vertices score highest in a
+ * simulated LRU cache, favouring vertices with few triangles left
+ * so they can leave the cache for good.                           */
+void cook_optimize_cache(uint32_t *indices, uint32_t index_count, uint32_t vertex_count)
+{
+    uint32_t triangle_count = index_count / 3;
+    uint32_t *offsets = calloc(vertex_count + 1, sizeof(uint32_t));
+    uint32_t *valence = calloc(vertex_count, sizeof(uint32_t));
+    uint32_t *adjacency = malloc(index_count * sizeof(uint32_t));
+    int32_t *cache_position = malloc(vertex_count * sizeof(int32_t));
+    float *vertex_score = malloc(vertex_count * sizeof(float));
+    float *triangle_score = malloc(triangle_count * sizeof(float));
+    uint8_t *emitted = calloc(triangle_count, 1);
+    uint32_t *output = malloc(index_count * sizeof(uint32_t));
+    uint32_t cache[COOK_CACHE_SIZE + 3], next_cache[COOK_CACHE_SIZE + 6];
+    uint32_t cache_count = 0, next_count;
+    uint32_t cursor = 0, best = 0, emitted_count = 0;
+    uint32_t vertex, triangle, slot;
+    float best_score;
+    
+    if(offsets && valence && adjacency && cache_position && vertex_score && triangle_score && emitted && output)
+    {
+        for(uint32_t i = 0; i < index_count; i++)
+        {
+            offsets[indices[i] + 1] += 1;
+        }
+        
+        for(uint32_t i = 0; i < vertex_count; i++)
+        {
+            offsets[i + 1] += offsets[i];
+        }
+        
+        for(uint32_t i = 0; i < index_count; i++)
+        {
+            adjacency[offsets[indices[i]] + valence[indices[i]]++] = i / 3;
+        }
+        
+        for(uint32_t i = 0; i < vertex_count; i++)
+        {
+            cache_position[i] = -1;
+            vertex_score[i] = prv_vertex_score(-1, valence[i]);
+        }
+        
+        for(uint32_t i = 0; i < triangle_count; i++)
+        {
+            triangle_score[i] = vertex_score[indices[i * 3]] + vertex_score[indices[i * 3 + 1]] + vertex_score[indices[i * 3 + 2]];
+        }
+        
+        while(emitted_count < triangle_count)
+        {
+            memcpy(&output[emitted_count * 3], &indices[best * 3], 3 * sizeof(uint32_t));
+            emitted[best] = 1;
+            emitted_count += 1;
+            next_count = 0;
+            
+            /* Remove the triangle from its vertices' live adjacency */
+            for(uint32_t i = 0; i < 3; i++)
+            {
+                vertex = indices[best * 3 + i];
+                slot = offsets[vertex];
+                
+                while(adjacency[slot] != best)
+                {
+                    slot += 1;
+                }
+                
+                adjacency[slot] = adjacency[offsets[vertex] + valence[vertex] - 1];
+                valence[vertex] -= 1;
+                next_cache[next_count++] = vertex;
+            }
+            
+            for(uint32_t i = 0; i < cache_count; i++)
+            {
+                if(cache[i] != next_cache[0] && cache[i] != next_cache[1] && cache[i] != next_cache[2])
+                {
+                    next_cache[next_count++] = cache[i];
+                }
+            }
+            
+            cache_count = next_count < COOK_CACHE_SIZE + 3 ? next_count : COOK_CACHE_SIZE + 3;
+            memcpy(cache, next_cache, cache_count * sizeof(uint32_t));
+            
+            for(uint32_t i = cache_count; i < next_count; i++)
+            {
+                cache_position[next_cache[i]] = -1;
+                vertex_score[next_cache[i]] = prv_vertex_score(-1, valence[next_cache[i]]);
+            }
+            
+            for(uint32_t i = 0; i < cache_count; i++)
+            {
+                cache_position[cache[i]] = i < COOK_CACHE_SIZE ? (int32_t)i : -1;
+                vertex_score[cache[i]] = prv_vertex_score(cache_position[cache[i]], valence[cache[i]]);
+            }
+            
+            /* Only triangles touching the cache changed score */
+            best_score = -1.0f;
+            
+            for(uint32_t i = 0; i < cache_count; i++)
+            {
+                vertex = cache[i];
+                
+                for(uint32_t j = offsets[vertex]; j < offsets[vertex] + valence[vertex]; j++)
+                {
+                    triangle = adjacency[j];
+                    triangle_score[triangle] = vertex_score[indices[triangle * 3]] +
+                        vertex_score[indices[triangle * 3 + 1]] + vertex_score[indices[triangle * 3 + 2]];
+                    
+                    if(triangle_score[triangle] > best_score)
+                    {
+                        best_score = triangle_score[triangle];
+                        best = triangle;
+                    }
+                }
+            }
+            
+            /* Nothing left near the cache, restart from the input order */
+            if(best_score < 0.0f)
+            {
+                while(cursor < triangle_count && emitted[cursor])
+                {
+                    cursor += 1;
+                }
+                
+                best = cursor;
+            }
+        }
+        
+        memcpy(indices, output, index_count * sizeof(uint32_t));
+    }
+    
+    free(offsets);
+    free(valence);
+    free(adjacency);
+    free(cache_position);
+    free(vertex_score);
+    free(triangle_score);
+    free(emitted);
+    free(output);
+}
+
+static int prv_compare_clusters(const void *a, const void *b)
+{
+    const Cluster *left = a;
+    const Cluster *right = b;
+    
+    return left->key < right->key ? 1 : left->key > right->key ? -1 : (int)left->first - (int)right->first;
+}
+
+/* Splits the cache ordered triangles into clusters and draws the ones
+ * facing away from the mesh center first, they are the most likely to
+ * occlude the rest. Clusters are cut where the cache is cold anyway or
+ * where their own miss ratio stays close to the whole mesh's.          */
+void cook_optimize_overdraw(const CookMesh *mesh, uint32_t *indices, uint32_t index_count)
+{
+    uint32_t triangle_count = index_count / 3;
+    uint32_t *stamps = calloc(mesh->vertex_count, sizeof(uint32_t));
+    Cluster *clusters = malloc((triangle_count + 1) * sizeof(Cluster));
+    uint32_t *output = malloc(index_count * sizeof(uint32_t));
+    float limit = cook_cache_acmr(indices, index_count, mesh->vertex_count) * OVERDRAW_THRESHOLD;
+    uint32_t time = COOK_CACHE_SIZE + 1;
+    uint32_t cluster_count = 0, cluster_misses = 0, misses, written = 0;
+    float center[3] = {0}, centroid[3], normal[3], ab[3], ac[3], area, total_area = 0.0f;
+    const float *p[3];
+    Cluster *cluster;
+    
+    if(stamps && clusters && output && triangle_count > 0)
+    {
+        clusters[0] = (Cluster) {0.0f, 0, 0};
+        cluster_count = 1;
+        
+        for(uint32_t i = 0; i < triangle_count; i++)
+        {
+            misses = 0;
+            
+            for(uint32_t j = 0; j < 3; j++)
+            {
+                if(time - stamps[indices[i * 3 + j]] > COOK_CACHE_SIZE)
+                {
+                    stamps[indices[i * 3 + j]] = time;
+                    time += 1;
+                    misses += 1;
+                }
+            }
+            
+            cluster = &clusters[cluster_count - 1];
+            
+            if(cluster->count > 0 && (misses == 3 ||
+                (cluster->count >= OVERDRAW_MIN_CLUSTER && cluster_misses <= limit * cluster->count)))
+            {
+                clusters[cluster_count] = (Cluster) {0.0f, i, 0};
+                cluster = &clusters[cluster_count++];
+                cluster_misses = 0;
+                
+                /* The new cluster starts with a cold cache */
+                time += COOK_CACHE_SIZE;
+                misses = 0;
+                
+                for(uint32_t j = 0; j < 3; j++)
+                {
+                    stamps[indices[i * 3 + j]] = time;
+                    time += 1;
+                    misses += 1;
+                }
+            }
+            
+            cluster->count += 1;
+            cluster_misses += misses;
+        }
+        
+        for(uint32_t i = 0; i < index_count; i++)
+        {
+            for(uint32_t j = 0; j < 3; j++)
+            {
+                center[j] += mesh->vertices[indices[i]].position[j] / index_count;
+            }
+        }
+        
+        for(uint32_t c = 0; c < cluster_count; c++)
+        {
+            memset(centroid, 0, sizeof(centroid));
+            memset(normal, 0, sizeof(normal));
+            total_area = 0.0f;
+            
+            for(uint32_t i = clusters[c].first; i < clusters[c].first + clusters[c].count; i++)
+            {
+                for(uint32_t j = 0; j < 3; j++)
+                {
+                    p[j] = mesh->vertices[indices[i * 3 + j]].position;
+                }
+                
+                for(uint32_t j = 0; j < 3; j++)
+                {
+                    ab[j] = p[1][j] - p[0][j];
+                    ac[j] = p[2][j] - p[0][j];
+                }
+                
+                normal[0] += ab[1] * ac[2] - ab[2] * ac[1];
+                normal[1] += ab[2] * ac[0] - ab[0] * ac[2];
+                normal[2] += ab[0] * ac[1] - ab[1] * ac[0];
+                
+                area = sqrtf((ab[1] * ac[2] - ab[2] * ac[1]) * (ab[1] * ac[2] - ab[2] * ac[1]) +
+                    (ab[2] * ac[0] - ab[0] * ac[2]) * (ab[2] * ac[0] - ab[0] * ac[2]) +
+                    (ab[0] * ac[1] - ab[1] * ac[0]) * (ab[0] * ac[1] - ab[1] * ac[0]));
+                total_area += area;
+                
+                for(uint32_t j = 0; j < 3; j++)
+                {
+                    centroid[j] += (p[0][j] + p[1][j] + p[2][j]) * area;
+                }
+            }
+            
+            area = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            clusters[c].key = 0.0f;
+            
+            if(total_area > 0.0f && area > 0.0f)
+            {
+                for(uint32_t j = 0; j < 3; j++)
+                {
+                    clusters[c].key += (centroid[j] / (3.0f * total_area) - center[j]) * normal[j] / area;
+                }
+            }
+        }
+        
+        qsort(clusters, cluster_count, sizeof(Cluster), prv_compare_clusters);
+        
+        for(uint32_t c = 0; c < cluster_count; c++)
+        {
+            memcpy(&output[written], &indices[clusters[c].first * 3], clusters[c].count * 3 * sizeof(uint32_t));
+            written += clusters[c].count * 3;
+        }
+        
+        memcpy(indices, output, index_count * sizeof(uint32_t));
+    }
+    
+    free(stamps);
+    free(clusters);
+    free(output);
+}
+
+/* Renumbers vertices in the order the indices first use them, so the
+ * vertex fetch walks memory forward. Unreferenced vertices are dropped. */
+void cook_optimize_fetch(CookMesh *mesh)
+{
+    uint32_t *remap = malloc(mesh->vertex_count * sizeof(uint32_t));
+    CookVertex *vertices = malloc(mesh->vertex_count * sizeof(CookVertex));
+    uint32_t count = 0;
+    
+    if(remap && vertices)
+    {
+        memset(remap, 0xff, mesh->vertex_count * sizeof(uint32_t));
+        
+        for(uint32_t i = 0; i < mesh->index_count; i++)
+        {
+            if(remap[mesh->indices[i]] == UINT32_MAX)
+            {
+                vertices[count] = mesh->vertices[mesh->indices[i]];
+                remap[mesh->indices[i]] = count++;
+            }
+            
+            mesh->indices[i] = remap[mesh->indices[i]];
+        }
+        
+        free(mesh->vertices);
+        mesh->vertices = vertices;
+        mesh->vertex_count = count;
+        vertices = NULL;
+    }
+    
+    free(remap);
+    free(vertices);
+}
+
+static uint16_t prv_half(float value)
+{
+    uint32_t bits;
+    uint32_t sign, exponent, mantissa;
+    uint16_t half;
+    
+    memcpy(&bits, &value, sizeof(bits));
+    sign = bits >> 16 & 0x8000;
+    exponent = bits >> 23 & 0xff;
+    mantissa = bits & 0x7fffff;
+    
+    if(exponent == 0xff)
+    {
+        half = (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+    }
+    else if(exponent > 142)
+    {
+        half = (uint16_t)(sign | 0x7c00);
+    }
+    else if(exponent < 113)
+    {
+        /* Subnormal in half precision, or flushed to zero */
+        half = (uint16_t)(sign | (exponent < 103 ? 0 : (((mantissa | 0x800000) >> (125 - exponent)) + 1) >> 1));
+    }
+    else
+    {
+        /* Rounds to nearest, a carry correctly bumps the exponent */
+        half = (uint16_t)(sign | (((exponent - 112) << 10 | mantissa >> 13) + (mantissa >> 12 & 1)));
+    }
+    
+    return half;
+}
+
+static int8_t prv_snorm8(float value)
+{
+    value = value < -1.0f ? -1.0f : value > 1.0f ? 1.0f : value;
+    
+    return (int8_t)lrintf(value * 127.0f);
+}
+
+/* Positions become 16 bit fractions of the bounds, normals octahedral
+ * snorm8 and uvs half floats, 16 bytes a vertex from 32             */
+void cook_quantize(const CookMesh *mesh, MeshHeader *header, MeshVertex *vertices)
+{
+    float min[3] = {INFINITY, INFINITY, INFINITY};
+    float max[3] = {-INFINITY, -INFINITY, -INFINITY};
+    float extent, distance, length, x, y, folded_x;
+    const CookVertex *vertex;
+    
+    for(uint32_t i = 0; i < mesh->vertex_count; i++)
+    {
+        for(uint32_t j = 0; j < 3; j++)
+        {
+            min[j] = fminf(min[j], mesh->vertices[i].position[j]);
+            max[j] = fmaxf(max[j], mesh->vertices[i].position[j]);
+        }
+    }
+    
+    header->radius = 0.0f;
+    
+    for(uint32_t j = 0; j < 3; j++)
+    {
+        extent = max[j] - min[j];
+        header->position_offset[j] = min[j];
+        header->position_scale[j] = extent > 0.0f ? extent / 65535.0f : 1.0f;
+        header->center[j] = (min[j] + max[j]) * 0.5f;
+    }
+    
+    for(uint32_t i = 0; i < mesh->vertex_count; i++)
+    {
+        vertex = &mesh->vertices[i];
+        distance = 0.0f;
+        
+        for(uint32_t j = 0; j < 3; j++)
+        {
+            vertices[i].position[j] = (uint16_t)lrintf((vertex->position[j] - min[j]) / header->position_scale[j]);
+            distance += (vertex->position[j] - header->center[j]) * (vertex->position[j] - header->center[j]);
+        }
+        
+        vertices[i].position[3] = 0;
+        header->radius = fmaxf(header->radius, sqrtf(distance));
+        
+        vertices[i].uv[0] = prv_half(vertex->uv[0]);
+        vertices[i].uv[1] = prv_half(vertex->uv[1]);
+        
+        /* Project onto the octahedron and fold the lower half over */
+        length = fabsf(vertex->normal[0]) + fabsf(vertex->normal[1]) + fabsf(vertex->normal[2]);
+        length = length > 0.0f ? length : 1.0f;
+        x = vertex->normal[0] / length;
+        y = vertex->normal[1] / length;
+        
+        if(vertex->normal[2] < 0.0f)
+        {
+            folded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = folded_x;
+        }
+        
+        vertices[i].normal[0] = prv_snorm8(x);
+        vertices[i].normal[1] = prv_snorm8(y);
+        vertices[i].padding[0] = 0;
+        vertices[i].padding[1] = 0;
+    }
+}
@@ -0,0 +1,379 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "cooker.h"
+
+/* Plane distance squared summed over the triangles a vertex has
+ * absorbed, weighted by area. Evaluating it at a point divided by
+ * weight gives the mean squared distance to those planes.          */
+typedef struct
+{
+    double a2, ab, ac, ad;
+    double b2, bc, bd;
+    double c2, cd;
+    double d2;
+    double weight;
+} Quadric;
+
+typedef struct
+{
+    uint32_t from;
+    uint32_t to;
+    float error;
+} Collapse;
+
+static void prv_quadric_add(Quadric *dst, const Quadric *src)
+{
+    dst->a2 += src->a2;
+    dst->ab += src->ab;
+    dst->ac += src->ac;
+    dst->ad += src->ad;
+    dst->b2 += src->b2;
+    dst->bc += src->bc;
+    dst->bd += src->bd;
+    dst->c2 += src->c2;
+    dst->cd += src->cd;
+    dst->d2 += src->d2;
+    dst->weight += src->weight;
+}
+
+static double prv_quadric_error(const Quadric *q, const float *p)
+{
+    double x = p[0], y = p[1], z = p[2];
+    double error = q->a2 * x * x + q->b2 * y * y + q->c2 * z * z + q->d2 +
+        2.0 * (q->ab * x * y + q->ac * x * z + q->bc * y * z + q->ad * x + q->bd * y + q->cd * z);
+    
+    return q->weight > 0.0 ? fabs(error) / q->weight : 0.0;
+}
+
+static void prv_normal(const float *a, const float *b, const float *c, double *normal)
+{
+    double ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    double ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    
+    normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+    normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+    normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+}
+
+static int prv_compare_edges(const void *a, const void *b)
+{
+    uint64_t left = *(const uint64_t*)a;
+    uint64_t right = *(const uint64_t*)b;
+    
+    return left < right ? -1 : left > right ? 1 : 0;
+}
+
+static int prv_compare_collapses(const void *a, const void *b)
+{
+    const Collapse *left = a;
+    const Collapse *right = b;
+    
+    return left->error < right->error ? -1 : left->error > right->error ? 1 : 0;
+}
+
+/* Vertices on an open border or on an attribute seam, where several
+ * vertices share a position, never move so the outline and uv layout
+ * of every level match the full detail mesh                          */
+static void prv_find_locked(const CookMesh *mesh, const uint32_t *indices, uint32_t index_count, uint8_t *locked)
+{
+    uint32_t table_size = 1;
+    uint32_t *table = NULL;
+    uint32_t *position = malloc(mesh->vertex_count * sizeof(uint32_t));
+    uint64_t *edges = malloc(index_count * sizeof(uint64_t));
+    uint32_t slot, a, b, run;
+    
+    while(table_size < mesh->vertex_count * 2)
+    {
+        table_size *= 2;
+    }
+    
+    table = malloc(table_size * sizeof(uint32_t));
+    
+    if(table && position && edges)
+    {
+        memset(table, 0xff, table_size * sizeof(uint32_t));
+        
+        for(uint32_t i = 0; i < mesh->vertex_count; i++)
+        {
+            slot = cook_hash(mesh->vertices[i].position, sizeof(float) * 3) & (table_size - 1);
+            
+            while(table[slot] != UINT32_MAX && memcmp(mesh->vertices[table[slot]].position, mesh->vertices[i].position, sizeof(float) * 3) != 0)
+            {
+                slot = (slot + 1) & (table_size - 1);
+            }
+            
+            if(table[slot] != UINT32_MAX)
+            {
+                locked[table[slot]] = 1;
+                locked[i] = 1;
+            }
+            
+            table[slot] = table[slot] == UINT32_MAX ? i : table[slot];
+            position[i] = table[slot];
+        }
+        
+        /* Undirected edges between positions, an edge used once is a border */
+        for(uint32_t i = 0; i < index_count; i++)
+        {
+            a = position[indices[i]];
+            b = position[indices[i % 3 == 2 ? i - 2 : i + 1]];
+            edges[i] = a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a;
+        }
+        
+        qsort(edges, index_count, sizeof(uint64_t), prv_compare_edges);
+        
+        for(uint32_t i = 0; i < index_count; i += run)
+        {
+            run = 1;
+            
+            while(i + run < index_count && edges[i + run] == edges[i])
+            {
+                run += 1;
+            }
+            
+            if(run == 1)
+            {
+                /* Seam vertices are already locked, so the position's owner is the vertex */
+                locked[edges[i] >> 32] = 1;
+                locked[edges[i] & UINT32_MAX] = 1;
+            }
+        }
+    }
+    
+    free(table);
+    free(position);
+    free(edges);
+}
+
+/* True if moving from onto to keeps a triangle facing the way it and
+ * the full detail triangle it came from face, and doesn't squash it  */
+static bool prv_keeps_facing(const CookMesh *mesh, const uint32_t *triangle, uint32_t from, uint32_t to, const double *original)
+{
+    const float *p[3];
+    double before[3], after[3], length;
+    
+    for(uint32_t i = 0; i < 3; i++)
+    {
+        p[i] = mesh->vertices[triangle[i] == from ? to : triangle[i]].position;
+    }
+    
+    prv_normal(mesh->vertices[triangle[0]].position, mesh->vertices[triangle[1]].position, mesh->vertices[triangle[2]].position, before);
+    prv_normal(p[0], p[1], p[2], after);
+    length = sqrt(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+    
+    return length > 0.0 && before[0] * after[0] + before[1] * after[1] + before[2] * after[2] > 0.0 &&
+        (original[0] * after[0] + original[1] * after[1] + original[2] * after[2]) / length > COOK_FLIP_COS;
+}
+
+/* Collapses edges in passes, cheapest first, moving one vertex onto
+ * another so no new vertices are needed and every level indexes the
+ * same vertex buffer. A pass only collapses edges whose neighbourhood
+ * nothing else in the pass has touched. Every triangle around the
+ * moving vertex has to keep facing both its current direction and
+ * that of the full detail triangle it descends from, so flips can't
+ * build up over many small turns.                                     */
+uint32_t cook_simplify(const CookMesh *mesh, const uint32_t *indices, uint32_t index_count,
+    uint32_t target_count, uint32_t *dst, float *error)
+{
+    uint32_t vertex_count = mesh->vertex_count;
+    Quadric *quadrics = calloc(vertex_count, sizeof(Quadric));
+    uint8_t *locked = calloc(vertex_count, 1);
+    uint8_t *touched = malloc(vertex_count);
+    uint32_t *remap = malloc(vertex_count * sizeof(uint32_t));
+    uint32_t *offsets = malloc((vertex_count + 1) * sizeof(uint32_t));
+    uint32_t *adjacency = malloc(index_count * sizeof(uint32_t));
+    Collapse *collapses = malloc(index_count * 2 * sizeof(Collapse));
+    /* Unit normal of every full detail triangle, and which one each
+     * triangle left in dst descends from                            */
+    double *normals = calloc(index_count, sizeof(double));
+    uint32_t *origins = malloc(index_count / 3 * sizeof(uint32_t));
+    bool progress = true;
+    uint32_t collapse_count, budget, applied;
+    uint32_t from, to, triangle, a, b, c;
+    const float *p[3];
+    double normal[3], length, d;
+    Quadric q;
+    bool valid;
+    double max_error = 0.0;
+    
+    memcpy(dst, indices, index_count * sizeof(uint32_t));
+    
+    if(quadrics && locked && touched && remap && offsets && adjacency && collapses && normals && origins)
+    {
+        prv_find_locked(mesh, indices, index_count, locked);
+        
+        for(uint32_t i = 0; i < index_count; i += 3)
+        {
+            for(uint32_t j = 0; j < 3; j++)
+            {
+                p[j] = mesh->vertices[indices[i + j]].position;
+            }
+            
+            prv_normal(p[0], p[1], p[2], normal);
+            length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            
+            origins[i / 3] = i / 3;
+            
+            if(length > 0.0)
+            {
+                normal[0] /= length;
+                normal[1] /= length;
+                normal[2] /= length;
+                memcpy(&normals[i], normal, sizeof(normal));
+                d = -(normal[0] * p[0][0] + normal[1] * p[0][1] + normal[2] * p[0][2]);
+                
+                /* Weighted by area so a sliver counts for as little as it covers */
+                length *= 0.5;
+                q = (Quadric) {
+                    normal[0] * normal[0] * length, normal[0] * normal[1] * length, normal[0] * normal[2] * length, normal[0] * d * length,
+                    normal[1] * normal[1] * length, normal[1] * normal[2] * length, normal[1] * d * length,
+                    normal[2] * normal[2] * length, normal[2] * d * length,
+                    d * d * length, length};
+                
+                for(uint32_t j = 0; j < 3; j++)
+                {
+                    prv_quadric_add(&quadrics[indices[i + j]], &q);
+                }
+            }
+        }
+    }
+    else
+    {
+        progress = false;
+    }
+    
+    while(progress && index_count > target_count)
+    {
+        /* Triangles around each vertex, rebuilt as the topology changes */
+        memset(offsets, 0, (vertex_count + 1) * sizeof(uint32_t));
+        
+        for(uint32_t i = 0; i < index_count; i++)
+        {
+            offsets[dst[i] + 1] += 1;
+        }
+        
+        for(uint32_t i = 0; i < vertex_count; i++)
+        {
+            offsets[i + 1] += offsets[i];
+        }
+        
+        for(uint32_t i = 0; i < index_count; i++)
+        {
+            adjacency[offsets[dst[i]]++] = i / 3;
+        }
+        
+        for(uint32_t i = vertex_count; i > 0; i--)
+        {
+            offsets[i] = offsets[i - 1];
+        }
+        
+        offsets[0] = 0;
+        collapse_count = 0;
+        
+        for(uint32_t i = 0; i < index_count; i++)
+        {
+            from = dst[i];
+            to = dst[i % 3 == 2 ? i - 2 : i + 1];
+            
+            if(!locked[from])
+            {
+                collapses[collapse_count++] = (Collapse) {from, to, (float)prv_quadric_error(&quadrics[from], mesh->vertices[to].position)};
+            }
+            
+            if(!locked[to])
+            {
+                collapses[collapse_count++] = (Collapse) {to, from, (float)prv_quadric_error(&quadrics[to], mesh->vertices[from].position)};
+            }
+        }
+        
+        qsort(collapses, collapse_count, sizeof(Collapse), prv_compare_collapses);
+        
+        /* Each collapse removes about two triangles */
+        budget = (index_count - target_count) / 6 + 1;
+        applied = 0;
+        memset(touched, 0, vertex_count);
+        
+        for(uint32_t i = 0; i < vertex_count; i++)
+        {
+            remap[i] = i;
+        }
+        
+        for(uint32_t i = 0; i < collapse_count && applied < budget; i++)
+        {
+            from = collapses[i].from;
+            to = collapses[i].to;
+            valid = !touched[from] && !touched[to];
+            
+            for(uint32_t j = offsets[from]; valid && j < offsets[from + 1]; j++)
+            {
+                triangle = adjacency[j];
+                a = dst[triangle * 3];
+                b = dst[triangle * 3 + 1];
+                c = dst[triangle * 3 + 2];
+                
+                valid = !touched[a] && !touched[b] && !touched[c];
+                
+                /* Triangles on the edge itself collapse away */
+                if(valid && a != to && b != to && c != to)
+                {
+                    valid = prv_keeps_facing(mesh, &dst[triangle * 3], from, to, &normals[origins[triangle] * 3]);
+                }
+            }
+            
+            if(valid)
+            {
+                /* Everything around from is reshaped, nothing else in this pass may rely on it */
+                for(uint32_t j = offsets[from]; j < offsets[from + 1]; j++)
+                {
+                    triangle = adjacency[j];
+                    touched[dst[triangle * 3]] = 1;
+                    touched[dst[triangle * 3 + 1]] = 1;
+                    touched[dst[triangle * 3 + 2]] = 1;
+                }
+                
+                touched[to] = 1;
+                remap[from] = to;
+                prv_quadric_add(&quadrics[to], &quadrics[from]);
+                max_error = fmax(max_error, collapses[i].error);
+                applied += 1;
+            }
+        }
+        
+        collapse_count = 0;
+        
+        for(uint32_t i = 0; i < index_count; i += 3)
+        {
+            a = remap[dst[i]];
+            b = remap[dst[i + 1]];
+            c = remap[dst[i + 2]];
+            
+            if(a != b && b != c && c != a)
+            {
+                origins[collapse_count / 3] = origins[i / 3];
+                dst[collapse_count++] = a;
+                dst[collapse_count++] = b;
+                dst[collapse_count++] = c;
+            }
+        }
+        
+        index_count = collapse_count;
+        progress = applied > 0;
+    }
+    
+    *error = (float)sqrt(max_error);
+    
+    free(quadrics);
+    free(locked);
+    free(touched);
+    free(remap);
+    free(offsets);
+    free(adjacency);
+    free(collapses);
+    free(normals);
+    free(origins);
+    
+    return index_count;
+}